@@ -0,0 +1,71 @@
+#include "annotatedsource.h"
+#include "callgrindprofile.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+QString AnnotatedSource::locate(QByteArrayView name, const QString &profileFileName)
+{
+    if (name.isEmpty())
+        return QString();
+    const QString path = QString::fromUtf8(name);
+    const QFileInfo source = QFileInfo(path).isAbsolute()
+            ? QFileInfo(path)
+            : QFileInfo(QFileInfo(profileFileName).absoluteDir(), path);
+    return source.isFile() ? source.absoluteFilePath() : QString();
+}
+
+int AnnotatedSource::lineColumn(const CallgrindProfile &profile)
+{
+    // Without a positions: line, cost lines start with the source line
+    const QList<QByteArray> &names = profile.positionNames();
+    return names.isEmpty() ? 0 : int(names.indexOf("line"));
+}
+
+bool AnnotatedSource::open(const QString &fileName, const CallgrindProfile &profile, int fileSymbol)
+{
+    m_costs.clear();
+    m_maxSelfCosts.clear();
+    m_missingLineCount = 0;
+    if (!m_file.open(fileName))
+        return false;
+    m_lines.build(m_file.data());
+
+    m_eventCount = profile.eventCount();
+    m_costs.resize(m_lines.lineCount() * 2 * m_eventCount, 0);
+    m_maxSelfCosts.resize(m_eventCount, 0);
+    const int column = lineColumn(profile);
+    if (column < 0)
+        return true;
+
+    const PositionCosts &positionCosts = profile.positionCosts();
+    for (int function = 0; function < profile.functionCount(); ++function) {
+        if (profile.function(function).file != fileSymbol)
+            continue;
+        const PositionCosts::Table table = positionCosts.table(function);
+        for (int row = 0; row < table.rowCount(); ++row) {
+            // Line 0 stands for an unknown line
+            const quint64 line = table.positions(row)[column];
+            if (line == 0)
+                continue;
+            if (line > quint64(m_lines.lineCount())) {
+                ++m_missingLineCount;
+                continue;
+            }
+            quint64 *costs = m_costs.data() + qint64(line - 1) * 2 * m_eventCount;
+            for (int event = 0; event < m_eventCount; ++event) {
+                costs[event] += table.selfCosts(row)[event];
+                costs[m_eventCount + event] += table.callCosts(row)[event];
+                m_maxSelfCosts[event] = qMax(m_maxSelfCosts.at(event), costs[event]);
+            }
+        }
+    }
+    return true;
+}
+
+qint64 AnnotatedSource::memoryUsage() const
+{
+    // The mapping counts in full: shown lines are paged in and stay resident
+    return m_file.size() + qint64(m_lines.checkpoints().capacity()) * qint64(sizeof(qint64))
+            + qint64(m_costs.capacity() + m_maxSelfCosts.capacity()) * qint64(sizeof(quint64));
+}
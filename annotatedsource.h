@@ -0,0 +1,59 @@
+#ifndef ANNOTATEDSOURCE_H
+#define ANNOTATEDSOURCE_H
+
+#include "lineindex.h"
+#include "mappedfile.h"
+
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+
+class CallgrindProfile;
+
+// A source file mapped for annotation, with the costs of each of its lines
+// summed over every function the profile places in the file. The text is
+// read from the mapping through a line index, so opening a file costs one
+// scan for line starts and nothing per line until the line is shown.
+class AnnotatedSource
+{
+public:
+    // Where the profile \a profileFileName found the source file \a name:
+    // absolute names as they are, relative ones against the directory of the
+    // profile. Empty if there is no such file.
+    static QString locate(QByteArrayView name, const QString &profileFileName);
+
+    // The position column holding source lines, or -1 if the profile has none
+    static int lineColumn(const CallgrindProfile &profile);
+
+    // Maps \a fileName and adds up the costs of the functions in the file
+    // symbol \a fileSymbol of \a profile by line
+    bool open(const QString &fileName, const CallgrindProfile &profile, int fileSymbol);
+
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_file.errorString(); }
+
+    qint64 lineCount() const { return m_lines.lineCount(); }
+    // The text of 0-based \a line
+    QByteArrayView line(qint64 line) const { return m_lines.line(line); }
+
+    // Costs of 0-based \a line: eventCount() self costs, then eventCount()
+    // inclusive costs of the calls made on it
+    int eventCount() const { return m_eventCount; }
+    const quint64 *costs(qint64 line) const { return m_costs.constData() + line * 2 * m_eventCount; }
+    // The highest self cost of any line, for shading
+    quint64 maxSelfCost(int event) const { return m_maxSelfCosts.at(event); }
+    // Cost lines past the end of the file, as when it changed after profiling
+    qint64 missingLineCount() const { return m_missingLineCount; }
+
+    qint64 memoryUsage() const;
+
+private:
+    MappedFile m_file;
+    LineIndex m_lines;
+    int m_eventCount = 0;
+    QList<quint64> m_costs;
+    QList<quint64> m_maxSelfCosts;
+    qint64 m_missingLineCount = 0;
+};
+
+#endif // ANNOTATEDSOURCE_H
@@ -0,0 +1,230 @@
+#include "annotatedsourcemodel.h"
+#include "profiledocument.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QFont>
+#include <QFutureWatcher>
+#include <QLocale>
+#include <QtConcurrent>
+
+using namespace Qt::StringLiterals;
+
+// Enough for the sources of a few dozen recently viewed functions
+static const qint64 DefaultMemoryBudget = 64 << 20;
+
+AnnotatedSourceModel::AnnotatedSourceModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , m_cache(DefaultMemoryBudget)
+{
+}
+
+void AnnotatedSourceModel::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    beginResetModel();
+    ++m_generation; // Drops sources still loading for the old document
+    m_cache.clear();
+    m_source.reset();
+    m_fileSymbol = m_function = -1;
+    m_firstRow = m_lastRow = m_hottestRow = -1;
+    m_document = document;
+    m_totalCosts.clear();
+    if (m_document && m_document->hasProfile()) {
+        const CallgrindProfile &profile = m_document->profile();
+        for (int event = 0; event < profile.eventCount(); ++event)
+            m_totalCosts.append(profile.totalCost(event));
+    }
+    endResetModel();
+}
+
+void AnnotatedSourceModel::updateDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    const int function = m_function;
+    setDocument(document);
+    setFunction(function);
+}
+
+void AnnotatedSourceModel::setMemoryBudget(qint64 bytes)
+{
+    m_cache.setMaxCost(bytes);
+}
+
+void AnnotatedSourceModel::setFunction(int function)
+{
+    if (!m_document || !m_document->hasProfile() || function < 0
+        || function >= m_document->profile().functionCount()) {
+        return;
+    }
+    const int generation = ++m_generation;
+    m_function = function;
+    const int fileSymbol = m_document->profile().function(function).file;
+    if (m_source && fileSymbol == m_fileSymbol) {
+        updateFunctionRows();
+        emit sourceShown(true);
+        return;
+    }
+    if (const SourcePointer *cached = m_cache.object(fileSymbol)) {
+        showSource(*cached, fileSymbol);
+        emit sourceShown(true);
+        return;
+    }
+
+    const QString name = QString::fromUtf8(m_document->profile().symbolName(CallgrindProfile::FileSymbol,
+                                                                           fileSymbol));
+    auto *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, fileSymbol, name] {
+        const Result result = watcher->result();
+        watcher->deleteLater();
+        if (generation != m_generation)
+            return;
+        if (!result.source) {
+            emit sourceFailed(name, result.errorString);
+            return;
+        }
+        m_cache.insert(fileSymbol, new SourcePointer(result.source), qMax<qint64>(1, result.source->memoryUsage()));
+        showSource(result.source, fileSymbol);
+        emit sourceShown(false);
+    });
+    watcher->setFuture(QtConcurrent::run([document = m_document, fileSymbol, name] {
+        Result result;
+        const QString fileName = AnnotatedSource::locate(name.toUtf8(), document->fileName());
+        if (fileName.isEmpty()) {
+            result.errorString = tr("Source file not found");
+            return result;
+        }
+        QSharedPointer<AnnotatedSource> source(new AnnotatedSource);
+        if (!source->open(fileName, document->profile(), fileSymbol)) {
+            result.errorString = source->errorString();
+            return result;
+        }
+        result.source = source;
+        return result;
+    }));
+}
+
+void AnnotatedSourceModel::showSource(const SourcePointer &source, int fileSymbol)
+{
+    beginResetModel();
+    m_source = source;
+    m_fileSymbol = fileSymbol;
+    endResetModel();
+    updateFunctionRows();
+}
+
+void AnnotatedSourceModel::updateFunctionRows()
+{
+    const int oldFirst = m_firstRow;
+    const int oldLast = m_lastRow;
+    m_firstRow = m_lastRow = m_hottestRow = -1;
+
+    const CallgrindProfile &profile = m_document->profile();
+    const int column = AnnotatedSource::lineColumn(profile);
+    const PositionCosts::Table table = profile.positionCosts().table(m_function);
+    quint64 hottestCost = 0;
+    for (int row = 0; column >= 0 && row < table.rowCount(); ++row) {
+        const quint64 line = table.positions(row)[column];
+        if (line == 0 || line > quint64(m_source->lineCount()))
+            continue;
+        const int sourceRow = int(line - 1);
+        if (m_firstRow < 0 || sourceRow < m_firstRow)
+            m_firstRow = sourceRow;
+        m_lastRow = qMax(m_lastRow, sourceRow);
+        const quint64 cost = profile.eventCount() > 0 ? table.selfCosts(row)[0] : 0;
+        if (m_hottestRow < 0 || cost > hottestCost) {
+            m_hottestRow = sourceRow;
+            hottestCost = cost;
+        }
+    }
+
+    // Only the bold rows change
+    if (oldFirst >= 0 && oldFirst < rowCount())
+        emit dataChanged(index(oldFirst, 0), index(qMin(oldLast, rowCount() - 1), columnCount() - 1));
+    if (m_firstRow >= 0)
+        emit dataChanged(index(m_firstRow, 0), index(m_lastRow, columnCount() - 1));
+}
+
+int AnnotatedSourceModel::eventCount() const
+{
+    return m_source ? m_source->eventCount() : 0;
+}
+
+int AnnotatedSourceModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() || !m_source ? 0 : int(m_source->lineCount());
+}
+
+int AnnotatedSourceModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() || !m_source ? 0 : sourceColumn() + 1;
+}
+
+QVariant AnnotatedSourceModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int column = index.column();
+    const int row = index.row();
+    if (role == Qt::FontRole) {
+        if (row < m_firstRow || row > m_lastRow)
+            return QVariant();
+        QFont font;
+        font.setBold(true);
+        return font;
+    }
+    if (column == sourceColumn()) {
+        if (role != Qt::DisplayRole)
+            return QVariant();
+        QString text = QString::fromUtf8(m_source->line(row));
+        return text.replace(u'\t', u"    "_s);
+    }
+    if (role == Qt::TextAlignmentRole)
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    if (column == LineColumn)
+        return role == Qt::DisplayRole ? QVariant(row + 1) : QVariant();
+
+    const int event = (column - FirstCostColumn) / 2;
+    const bool calls = (column - FirstCostColumn) % 2;
+    const quint64 cost = m_source->costs(row)[(calls ? eventCount() : 0) + event];
+    if (cost == 0)
+        return QVariant();
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return QLocale().toString(cost);
+    case Qt::ToolTipRole: {
+        const quint64 total = m_totalCosts.value(event);
+        if (total == 0)
+            return QVariant();
+        return tr("%1 % of the total").arg(QLocale().toString(100.0 * double(cost) / double(total), 'f', 2));
+    }
+    case Qt::BackgroundRole: {
+        // Shade self costs by how hot the line is within the file
+        const quint64 max = m_source->maxSelfCost(event);
+        if (calls || max == 0)
+            return QVariant();
+        QColor color(Qt::red);
+        color.setAlphaF(0.05f + 0.45f * float(double(cost) / double(max)));
+        return QBrush(color);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QVariant AnnotatedSourceModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    if (section == LineColumn)
+        return tr("Line");
+    if (section == sourceColumn())
+        return tr("Source");
+
+    const int event = (section - FirstCostColumn) / 2;
+    if (!m_document || event >= m_document->profile().eventCount())
+        return QVariant();
+    const QString name = QString::fromUtf8(m_document->profile().eventNames().at(event));
+    return (section - FirstCostColumn) % 2 ? tr("Calls %1").arg(name) : tr("Self %1").arg(name);
+}
@@ -0,0 +1,85 @@
+#ifndef ANNOTATEDSOURCEMODEL_H
+#define ANNOTATEDSOURCEMODEL_H
+
+#include "annotatedsource.h"
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QList>
+#include <QSharedPointer>
+
+class ProfileDocument;
+
+// The source file of the selected function, one row per line: the line
+// number, a self and a call cost column per event, then the text. Rows of
+// the function itself are shown in bold.
+//
+// Sources are opened on a worker thread and kept, together with their line
+// costs, in a least-recently-used cache bounded by memoryBudget(), so going
+// back to a recently shown file needs neither the disk nor the profile.
+class AnnotatedSourceModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        LineColumn,
+        FirstCostColumn
+    };
+
+    explicit AnnotatedSourceModel(QObject *parent = nullptr);
+
+    // Line costs belong to one document: switching drops the cached sources
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+    // Switches to a continuation of the document, as in watch mode, and
+    // shows the same function again with the updated costs
+    void updateDocument(const QSharedPointer<const ProfileDocument> &document);
+    void setFunction(int function);
+    int function() const { return m_function; }
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return m_cache.maxCost(); }
+    qint64 memoryUsage() const { return m_cache.totalCost(); }
+
+    QString fileName() const { return m_source ? m_source->fileName() : QString(); }
+    int sourceColumn() const { return FirstCostColumn + 2 * eventCount(); }
+    // The function's costliest line by the first event, or its first line
+    int hottestRow() const { return m_hottestRow; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+signals:
+    // The function's source is shown; \a cached if it came from the cache
+    void sourceShown(bool cached);
+    void sourceFailed(const QString &fileName, const QString &errorString);
+
+private:
+    using SourcePointer = QSharedPointer<const AnnotatedSource>;
+
+    struct Result {
+        SourcePointer source;
+        QString errorString;
+    };
+
+    int eventCount() const;
+    void showSource(const SourcePointer &source, int fileSymbol);
+    void updateFunctionRows();
+
+    QSharedPointer<const ProfileDocument> m_document;
+    QList<quint64> m_totalCosts;
+    // By file symbol; costs are bytes
+    QCache<int, SourcePointer> m_cache;
+    SourcePointer m_source;
+    int m_fileSymbol = -1;
+    int m_function = -1;
+    int m_firstRow = -1;
+    int m_lastRow = -1;
+    int m_hottestRow = -1;
+    int m_generation = 0;
+};
+
+#endif // ANNOTATEDSOURCEMODEL_H
@@ -0,0 +1,363 @@
+// Times every stage of opening a profile, for tracking regressions between
+// versions.
+//
+// Usage: benchmarksuite [options] [callgrind.out.file]
+// Without a file a profile is generated in the temp directory, shaped by the
+// same options as profilegenerator. Each stage runs --repeat times and is
+// reported with its median, minimum and maximum time as a table, CSV or JSON.
+// A JSON report saved from an earlier version can be passed as --baseline:
+// stages whose median grew by more than --tolerance percent are marked, and
+// the exit code is 3.
+
+#include "benchmarksupport.h"
+#include "callgraph.h"
+#include "callgrindlexer.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "flatprofile.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "parallelcallgrindparser.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+using namespace Qt::StringLiterals;
+
+namespace {
+
+struct Stage {
+    QString name;
+    QString unit;
+    qint64 units = 0;
+    QList<qint64> nanoseconds;
+    qint64 baselineMedian = -1;
+
+    qint64 median() const
+    {
+        QList<qint64> sorted = nanoseconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted.at(sorted.size() / 2);
+    }
+    qint64 minimum() const { return *std::min_element(nanoseconds.cbegin(), nanoseconds.cend()); }
+    qint64 maximum() const { return *std::max_element(nanoseconds.cbegin(), nanoseconds.cend()); }
+    double perSecond() const { return double(units) * 1e9 / double(qMax<qint64>(1, median())); }
+    // Relative change of the median against the baseline, 0.1 for 10% slower
+    double change() const { return double(median()) / double(baselineMedian) - 1; }
+};
+
+class Suite
+{
+public:
+    explicit Suite(int repeat) : m_repeat(repeat) { }
+
+    // Runs \a prepare untimed and then \a run timed, --repeat times. The
+    // stage is only recorded if every run succeeded.
+    bool measure(const QString &name, const QString &unit, qint64 units,
+                 const std::function<void()> &prepare, const std::function<bool()> &run)
+    {
+        Stage stage{name, unit, units, {}, -1};
+        QElapsedTimer timer;
+        for (int i = 0; i < m_repeat; ++i) {
+            if (prepare)
+                prepare();
+            timer.start();
+            if (!run())
+                return false;
+            stage.nanoseconds.append(timer.nsecsElapsed());
+        }
+        m_stages.append(stage);
+        return true;
+    }
+
+    QList<Stage> &stages() { return m_stages; }
+
+private:
+    int m_repeat;
+    QList<Stage> m_stages;
+};
+
+bool readBaseline(const QString &fileName, QList<Stage> &stages, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (document.isNull()) {
+        *errorString = error.errorString();
+        return false;
+    }
+    QHash<QString, qint64> medians;
+    const QJsonArray baseline = document.object().value("stages"_L1).toArray();
+    for (const QJsonValue &value : baseline) {
+        const QJsonObject stage = value.toObject();
+        medians.insert(stage.value("name"_L1).toString(),
+                       qint64(stage.value("medianNs"_L1).toDouble()));
+    }
+    for (Stage &stage : stages)
+        stage.baselineMedian = medians.value(stage.name, -1);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    const ProfileShape defaults;
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Times loading, parsing, highlighting, call graph "
+                                     "construction and sorting of a Callgrind profile."_s);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"file"_s, u"Profile to measure; generated if omitted."_s,
+                                 u"[file]"_s);
+    const QCommandLineOption repeatOption(u"repeat"_s, u"Runs per stage."_s, u"count"_s, u"5"_s);
+    const QCommandLineOption threadsOption(u"threads"_s, u"Threads for the parallel parser, 0 for all."_s,
+                                           u"count"_s, u"0"_s);
+    const QCommandLineOption formatOption({ u"f"_s, u"format"_s }, u"Report format: text, csv or json."_s,
+                                          u"format"_s, u"text"_s);
+    const QCommandLineOption outputOption({ u"o"_s, u"output"_s },
+                                          u"Write the report to a file instead of stdout."_s, u"file"_s);
+    const QCommandLineOption baselineOption(u"baseline"_s, u"JSON report to compare against."_s,
+                                            u"file"_s);
+    const QCommandLineOption toleranceOption(u"tolerance"_s,
+                                             u"Slowdown in percent tolerated against the baseline."_s,
+                                             u"percent"_s, u"10"_s);
+    const QCommandLineOption sizeOption(u"size"_s, u"Generated file size in MB."_s, u"MB"_s,
+                                        QString::number(defaults.targetBytes >> 20));
+    const QCommandLineOption functionsOption(u"functions"_s, u"Generated function count."_s,
+                                             u"count"_s, QString::number(defaults.functionCount));
+    const QCommandLineOption filesOption(u"files"_s, u"Generated source file count."_s, u"count"_s,
+                                         QString::number(defaults.fileCount));
+    const QCommandLineOption fanOutOption(u"fan-out"_s, u"Generated calls per function entry."_s,
+                                          u"count"_s, QString::number(defaults.fanOut));
+    const QCommandLineOption recursionOption(u"recursion"_s, u"Generated recursive cycle length."_s,
+                                             u"depth"_s, QString::number(defaults.recursionDepth));
+    const QCommandLineOption eventsOption(u"events"_s, u"Generated event count."_s, u"count"_s,
+                                          QString::number(defaults.eventCount));
+    const QCommandLineOption uncompressedOption(u"uncompressed"_s, u"Generate without name compression."_s);
+    parser.addOptions({ repeatOption, threadsOption, formatOption, outputOption, baselineOption,
+                        toleranceOption, sizeOption, functionsOption, filesOption, fanOutOption,
+                        recursionOption, eventsOption, uncompressedOption });
+    parser.process(app);
+
+    const QString format = parser.value(formatOption);
+    if (format != "text"_L1 && format != "csv"_L1 && format != "json"_L1) {
+        err << "Unknown format: " << format << '\n';
+        return 2;
+    }
+
+    ProfileShape shape;
+    shape.targetBytes = qint64(parser.value(sizeOption).toDouble() * (1 << 20));
+    shape.functionCount = parser.value(functionsOption).toInt();
+    shape.fileCount = parser.value(filesOption).toInt();
+    shape.fanOut = parser.value(fanOutOption).toInt();
+    shape.recursionDepth = parser.value(recursionOption).toInt();
+    shape.eventCount = parser.value(eventsOption).toInt();
+    shape.compressNames = !parser.isSet(uncompressedOption);
+
+    QTemporaryFile temporary;
+    const bool generated = parser.positionalArguments().isEmpty();
+    const QString fileName = openOrGenerateProfile(parser.positionalArguments().value(0), shape, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    Suite suite(qMax(1, parser.value(repeatOption).toInt()));
+    const int threadCount = parser.value(threadsOption).toInt();
+    MappedFile file;
+    LineIndex lineIndex;
+    CallgrindProfile profile;
+    CallGraph graph;
+    FlatProfile flat;
+    QList<int> rows;
+    QString errorString;
+
+    const bool ok =
+        suite.measure(u"load"_s, u"bytes"_s, QFileInfo(fileName).size(), [&] { file.close(); }, [&] {
+            if (!file.open(fileName)) {
+                errorString = file.errorString();
+                return false;
+            }
+            file.adviseSequential();
+            return lineIndex.build(file.data());
+        })
+        && suite.measure(u"parse"_s, u"bytes"_s, file.size(), [&] { profile.clear(); }, [&] {
+            CallgrindParser callgrindParser;
+            if (!callgrindParser.parse(file.data(), &profile)) {
+                errorString = callgrindParser.errorString();
+                return false;
+            }
+            return true;
+        })
+        && suite.measure(u"parse-parallel"_s, u"bytes"_s, file.size(), [&] { profile.clear(); }, [&] {
+            ParallelCallgrindParser parallelParser;
+            parallelParser.setThreadCount(threadCount);
+            if (!parallelParser.parse(file.data(), &profile)) {
+                errorString = parallelParser.errorString();
+                return false;
+            }
+            return true;
+        })
+        && suite.measure(u"highlight"_s, u"lines"_s, lineIndex.lineCount(), {}, [&] {
+            CallgrindLexer::Tokens tokens;
+            for (qint64 line = 0; line < lineIndex.lineCount(); ++line) {
+                tokens.clear();
+                CallgrindLexer::tokenize(QString::fromUtf8(lineIndex.line(line)), tokens);
+            }
+            return true;
+        })
+        && suite.measure(u"callgraph"_s, u"calls"_s, profile.callCount(), [&] { graph.clear(); }, [&] {
+            graph.build(profile);
+            return true;
+        })
+        && suite.measure(u"flatprofile"_s, u"functions"_s, profile.functionCount(), [&] { flat.clear(); }, [&] {
+            flat.build(graph);
+            return true;
+        })
+        && suite.measure(u"sort"_s, u"functions"_s, profile.functionCount(), [&] {
+            rows.resize(profile.functionCount());
+            std::iota(rows.begin(), rows.end(), 0);
+        }, [&] {
+            flat.sortRows(rows.data(), rows.data() + rows.size(), rows.data() + rows.size(),
+                          FlatProfile::SortBySelfCost, 0, Qt::DescendingOrder);
+            return true;
+        })
+        && suite.measure(u"sort-top100"_s, u"functions"_s, profile.functionCount(), [&] {
+            rows.resize(profile.functionCount());
+            std::iota(rows.begin(), rows.end(), 0);
+        }, [&] {
+            flat.sortRows(rows.data(), rows.data() + qMin<qsizetype>(100, rows.size()),
+                          rows.data() + rows.size(), FlatProfile::SortByInclusiveCost, 0,
+                          Qt::DescendingOrder);
+            return true;
+        });
+    if (!ok) {
+        err << fileName << ": " << errorString << '\n';
+        return 1;
+    }
+
+    QList<Stage> &stages = suite.stages();
+    if (parser.isSet(baselineOption) && !readBaseline(parser.value(baselineOption), stages, &errorString)) {
+        err << parser.value(baselineOption) << ": " << errorString << '\n';
+        return 1;
+    }
+    const double tolerance = parser.value(toleranceOption).toDouble() / 100;
+    bool regressed = false;
+    for (const Stage &stage : std::as_const(stages))
+        regressed |= stage.baselineMedian > 0 && stage.change() > tolerance;
+
+    QFile output;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << output.fileName() << ": " << output.errorString() << '\n';
+            return 1;
+        }
+    } else if (!output.open(stdout, QIODevice::WriteOnly)) {
+        return 1;
+    }
+    QTextStream report(&output);
+
+    if (format == "json"_L1) {
+        QJsonObject shapeObject;
+        if (generated) {
+            shapeObject = QJsonObject{
+                { "bytes"_L1, shape.targetBytes },
+                { "functions"_L1, shape.functionCount },
+                { "files"_L1, shape.fileCount },
+                { "fanOut"_L1, shape.fanOut },
+                { "recursionDepth"_L1, shape.recursionDepth },
+                { "events"_L1, shape.eventCount },
+                { "compressNames"_L1, shape.compressNames },
+            };
+        }
+        QJsonArray stageArray;
+        for (const Stage &stage : std::as_const(stages)) {
+            QJsonObject object{
+                { "name"_L1, stage.name },
+                { "medianNs"_L1, stage.median() },
+                { "minNs"_L1, stage.minimum() },
+                { "maxNs"_L1, stage.maximum() },
+                { "units"_L1, stage.units },
+                { "unit"_L1, stage.unit },
+                { "perSecond"_L1, stage.perSecond() },
+            };
+            if (stage.baselineMedian > 0) {
+                object.insert("baselineMedianNs"_L1, stage.baselineMedian);
+                object.insert("change"_L1, stage.change());
+            }
+            stageArray.append(object);
+        }
+        const QJsonObject root{
+            { "timestamp"_L1, QDateTime::currentDateTimeUtc().toString(Qt::ISODate) },
+            { "host"_L1, QSysInfo::machineHostName() },
+            { "qtVersion"_L1, QString::fromLatin1(qVersion()) },
+            { "idealThreadCount"_L1, QThread::idealThreadCount() },
+            { "repeat"_L1, int(stages.constFirst().nanoseconds.size()) },
+            { "profile"_L1, QJsonObject{
+                  { "file"_L1, generated ? QString() : fileName },
+                  { "bytes"_L1, file.size() },
+                  { "lines"_L1, lineIndex.lineCount() },
+                  { "functions"_L1, profile.functionCount() },
+                  { "calls"_L1, profile.callCount() },
+                  { "events"_L1, profile.eventCount() },
+                  { "shape"_L1, generated ? QJsonValue(shapeObject) : QJsonValue() },
+              } },
+            { "peakRssKb"_L1, procStatusKb("VmHWM") },
+            { "stages"_L1, stageArray },
+        };
+        report << QJsonDocument(root).toJson(QJsonDocument::Indented);
+    } else if (format == "csv"_L1) {
+        report << "stage,median_ns,min_ns,max_ns,units,unit,per_second,baseline_median_ns\n";
+        for (const Stage &stage : std::as_const(stages)) {
+            report << stage.name << ',' << stage.median() << ',' << stage.minimum() << ','
+                   << stage.maximum() << ',' << stage.units << ',' << stage.unit << ','
+                   << QString::number(stage.perSecond(), 'f', 0) << ','
+                   << (stage.baselineMedian > 0 ? QString::number(stage.baselineMedian) : QString())
+                   << '\n';
+        }
+    } else {
+        report << "profile:         " << (generated ? u"generated"_s : fileName) << ", "
+               << QString::number(double(file.size()) / (1 << 20), 'f', 1) << " MB, "
+               << lineIndex.lineCount() << " lines, " << profile.functionCount() << " functions, "
+               << profile.callCount() << " calls\n\n"
+               << "stage               median       min       max   throughput\n";
+        for (const Stage &stage : std::as_const(stages)) {
+            report << stage.name.leftJustified(16) << formatDuration(stage.median()).rightJustified(10)
+                   << formatDuration(stage.minimum()).rightJustified(10)
+                   << formatDuration(stage.maximum()).rightJustified(10) << "   "
+                   << (stage.unit == "bytes"_L1
+                               ? QString::number(stage.perSecond() / (1 << 20), 'f', 1) + u" MB/s"_s
+                               : QString::number(stage.perSecond(), 'f', 0) + u' ' + stage.unit + u"/s"_s);
+            if (stage.baselineMedian > 0) {
+                report << "   " << (stage.change() >= 0 ? "+" : "")
+                       << QString::number(stage.change() * 100, 'f', 1) << "%"
+                       << (stage.change() > tolerance ? " REGRESSION" : "");
+            }
+            report << '\n';
+        }
+        report << "\npeak rss:        " << procStatusKb("VmHWM") << " kB\n";
+    }
+    return regressed ? 3 : 0;
+}
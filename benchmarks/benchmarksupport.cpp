@@ -0,0 +1,219 @@
+#include "benchmarksupport.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include <iterator>
+
+qint64 procStatusKb(const char *key)
+{
+#ifdef Q_OS_LINUX
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    const QByteArray prefix = QByteArray(key) + ':';
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith(prefix))
+            return line.mid(prefix.size()).trimmed().split(' ').first().toLongLong();
+    }
+#else
+    Q_UNUSED(key);
+#endif
+    return -1;
+}
+
+namespace {
+
+const char *const eventNames[] = {
+    "Ir", "Dr", "Dw", "I1mr", "D1mr", "D1mw", "ILmr", "DLmr", "DLmw", "Bc", "Bcm", "Bi", "Bim"
+};
+
+// Appends "key(id) name", "key(id)" or "key name" and marks \a id as defined
+void appendName(QByteArray &buffer, const char *key, int id, const QByteArray &name,
+                QList<bool> &defined, bool compress)
+{
+    buffer += key;
+    if (compress) {
+        buffer += '(' + QByteArray::number(id) + ')';
+        if (!defined.at(id))
+            buffer += ' ' + name;
+        defined[id] = true;
+    } else {
+        buffer += name;
+    }
+    buffer += '\n';
+}
+
+QByteArray fileName(int file)
+{
+    return "src/module" + QByteArray::number(file) + ".cpp";
+}
+
+QByteArray functionName(int function, bool mangled)
+{
+    if (!mangled)
+        return "namespace::Class::method" + QByteArray::number(function) + "(int, char const*)";
+    const QByteArray method = "method" + QByteArray::number(function);
+    return "_ZN9namespace5Class" + QByteArray::number(method.size()) + method + "EiPKc";
+}
+
+// A subposition relative to the previous cost line: "+n", "-n" or "*"
+QByteArray relativePosition(qint64 delta)
+{
+    if (delta == 0)
+        return "*";
+    return delta > 0 ? '+' + QByteArray::number(delta) : '-' + QByteArray::number(-delta);
+}
+
+quint64 functionAddress(int function)
+{
+    return 0x400000 + quint64(function) * 0x100;
+}
+
+} // namespace
+
+bool generateProfile(QIODevice *device, const ProfileShape &shape)
+{
+    const int functionCount = qMax(1, shape.functionCount);
+    const int fileCount = qBound(1, shape.fileCount, functionCount);
+    const int eventCount = qMax(1, shape.eventCount);
+    const bool compress = shape.compressNames;
+
+    QByteArray buffer;
+    buffer.reserve(1 << 20);
+    buffer += "# callgrind format\nversion: 1\ncreator: benchmarksupport\n";
+    buffer += shape.instructions ? "positions: instr line\nevents:" : "positions: line\nevents:";
+    for (int event = 0; event < eventCount; ++event) {
+        buffer += ' ';
+        buffer += event < int(std::size(eventNames)) ? QByteArray(eventNames[event])
+                                                     : "Ev" + QByteArray::number(event + 1);
+    }
+    buffer += "\n\n";
+
+    const int firstCallCosts[] = { 4000, 1200, 300 };
+    QByteArray callCosts;
+    for (int event = 0; event < eventCount; ++event)
+        callCosts += ' ' + QByteArray::number(event < 3 ? firstCallCosts[event] : 50);
+    callCosts += '\n';
+
+    QList<bool> definedFiles(fileCount, false);
+    QList<bool> definedFunctions(functionCount, false);
+    // Instruction addresses and source lines of the last cost line; the
+    // first line of most function entries is relative to them too
+    quint64 address = 0;
+    int sourceLine = 0;
+    const auto position = [&](quint64 nextAddress, int nextLine, bool absolute) {
+        QByteArray text;
+        if (absolute)
+            text = "0x" + QByteArray::number(nextAddress, 16) + ' ' + QByteArray::number(nextLine);
+        else
+            text = relativePosition(qint64(nextAddress - address)) + ' ' + relativePosition(nextLine - sourceLine);
+        address = nextAddress;
+        sourceLine = nextLine;
+        return text;
+    };
+
+    const auto appendCall = [&](int callee, qint64 count, int line) {
+        appendName(buffer, "cfi=", callee % fileCount, fileName(callee % fileCount), definedFiles, compress);
+        appendName(buffer, "cfn=", callee, functionName(callee, shape.mangledNames), definedFunctions, compress);
+        if (shape.instructions) {
+            buffer += "calls=" + QByteArray::number(count) + " 0x" + QByteArray::number(functionAddress(callee), 16)
+                      + ' ' + QByteArray::number(line) + '\n' + position(address + 2, sourceLine, false) + callCosts;
+        } else {
+            buffer += "calls=" + QByteArray::number(count) + ' ' + QByteArray::number(line) + '\n'
+                      + QByteArray::number(line + 8) + callCosts;
+        }
+    };
+
+    qint64 written = 0;
+    int line = 1;
+    for (qint64 i = 0; written + buffer.size() < shape.targetBytes; ++i) {
+        const int function = int(i % functionCount);
+        const int sourceFile = function % fileCount;
+
+        appendName(buffer, "fl=", sourceFile, fileName(sourceFile), definedFiles, compress);
+        appendName(buffer, "fn=", function, functionName(function, shape.mangledNames), definedFunctions, compress);
+
+        quint64 instruction = functionAddress(function);
+        for (int j = 0; j < 8; ++j) {
+            if (shape.instructions) {
+                buffer += position(instruction, line + j / 2, i % 16 == 0 && j == 0);
+                instruction += 1 + (j * 3) % 7;
+            } else {
+                buffer += QByteArray::number(line + j);
+            }
+            for (int event = 0; event < eventCount; ++event) {
+                const int cost = event == 0 ? 3 + j : event == 1 ? j : event == 2 ? j & 1 : (j + event) % 4;
+                buffer += ' ' + QByteArray::number(cost);
+            }
+            buffer += '\n';
+        }
+        // Only call functions that were entered before, so that their
+        // compressed names are defined in order
+        const qint64 entered = qMin<qint64>(i, functionCount);
+        for (int k = 0; entered > 0 && k < shape.fanOut; ++k)
+            appendCall(int((i * 7919 + 1 + k * 104729) % entered), 2, line);
+        if (shape.recursionDepth > 0) {
+            const int first = function - function % shape.recursionDepth;
+            const int length = qMin(shape.recursionDepth, functionCount - first);
+            appendCall(first + (function - first + 1) % length, 1, line);
+        }
+        buffer += '\n';
+        line = (line + 13) % 5000 + 1;
+
+        if (buffer.size() > (1 << 20) - 4096) {
+            if (device->write(buffer) != buffer.size())
+                return false;
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+    return device->write(buffer) == buffer.size();
+}
+
+QString openOrGenerateProfile(int argc, char *argv[], const ProfileShape &defaults,
+                              QTemporaryFile *temporary)
+{
+    const QString argument = argc > 1 ? QString::fromLocal8Bit(argv[1]) : QString();
+    if (!argument.isEmpty() && QFileInfo::exists(argument))
+        return argument;
+
+    ProfileShape shape = defaults;
+    if (!argument.isEmpty())
+        shape.targetBytes = argument.toLongLong() << 20;
+    if (argc > 2) {
+        shape.functionCount = QByteArray(argv[2]).toInt();
+        shape.fileCount = qMax(1, shape.functionCount / 50);
+    }
+    return openOrGenerateProfile(QString(), shape, temporary);
+}
+
+QString openOrGenerateProfile(const QString &fileName, const ProfileShape &shape,
+                              QTemporaryFile *temporary)
+{
+    if (!fileName.isEmpty())
+        return fileName;
+    if (!temporary->open() || !generateProfile(temporary, shape)) {
+        QTextStream(stderr) << "Failed to generate the synthetic profile\n";
+        return QString();
+    }
+    temporary->close();
+    return temporary->fileName();
+}
+
+QString formatDuration(qint64 nanoseconds)
+{
+    if (nanoseconds < 0)
+        return QStringLiteral("-");
+    if (nanoseconds < 1000)
+        return QString::number(nanoseconds) + QStringLiteral(" ns");
+    if (nanoseconds < 1000000)
+        return QString::number(double(nanoseconds) / 1e3, 'f', 1) + QStringLiteral(" µs");
+    if (nanoseconds < 1000000000)
+        return QString::number(double(nanoseconds) / 1e6, 'f', 1) + QStringLiteral(" ms");
+    return QString::number(double(nanoseconds) / 1e9, 'f', 3) + QStringLiteral(" s");
+}
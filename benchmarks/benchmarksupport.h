@@ -0,0 +1,61 @@
+#ifndef BENCHMARKSUPPORT_H
+#define BENCHMARKSUPPORT_H
+
+#include <QtGlobal>
+
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QTemporaryFile;
+QT_END_NAMESPACE
+
+// A field of /proc/self/status in kB, such as "VmRSS" or "VmHWM"; -1 if
+// unavailable.
+qint64 procStatusKb(const char *key);
+
+// The shape of a synthetic profile. Function entries are written round-robin
+// until the file reaches targetBytes, so a size larger than one pass over the
+// functions repeats them with further costs, as callgrind does for functions
+// entered from several contexts.
+struct ProfileShape
+{
+    qint64 targetBytes = qint64(64) << 20;
+    int functionCount = 100000;
+    int fileCount = 2000;
+    // Calls written per function entry, to already defined functions
+    int fanOut = 1;
+    // Functions are grouped into cycles of this many that call each other in
+    // turn; 1 makes every function call itself and 0 writes no recursion.
+    int recursionDepth = 0;
+    // Ir Dr Dw first, then the other cache and branch events
+    int eventCount = 3;
+    // Write "(id) name" once and "(id)" afterwards instead of full names
+    bool compressNames = true;
+    // "positions: instr line" with relative subpositions, as callgrind
+    // --dump-instr=yes writes them, instead of source lines only
+    bool instructions = false;
+    // Function names as g++ mangles them, as callgrind --demangle=no writes
+    // them: "_ZN9namespace5Class7method1EiPKc"
+    bool mangledNames = false;
+};
+
+// Writes a synthetic Callgrind profile of the given shape.
+bool generateProfile(QIODevice *device, const ProfileShape &shape);
+
+// The profile a benchmark runs on: the file named by its first argument if
+// that exists, else a profile of \a defaults generated into \a temporary. A
+// first argument sets the generated size in MB and a second one the function
+// count, with a source file per 50 functions. Returns the file name, or an
+// empty string after a message on stderr if generating fails.
+QString openOrGenerateProfile(int argc, char *argv[], const ProfileShape &defaults,
+                              QTemporaryFile *temporary);
+// The same for a file name taken from elsewhere; an empty one generates
+QString openOrGenerateProfile(const QString &fileName, const ProfileShape &shape,
+                              QTemporaryFile *temporary);
+
+// A duration in the unit that suits it, such as "812 ns", "3.4 ms" or
+// "2.051 s"; "-" for a negative one, which stands for never measured.
+QString formatDuration(qint64 nanoseconds);
+
+#endif // BENCHMARKSUPPORT_H
@@ -0,0 +1,132 @@
+// Builds the call graph of a large synthetic profile and checks its
+// inclusive costs against values known by construction.
+//
+// Usage: callgraphbenchmark [function-count]
+// The default of 1000000 functions yields about 4 million call arcs. Functions
+// are grouped into components: most are single functions, some recursive
+// cycles of two to five functions, some directly self-recursive. Components
+// only call later components, so their inclusive cost can be computed back to
+// front without any graph algorithm. Arcs inside a cycle get large, unrelated
+// costs; counting any of them would show up as a mismatch.
+
+#include "benchmarksupport.h"
+#include "callgraph.h"
+#include "callgrindprofile.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#include <algorithm>
+#include <numeric>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    const int functionCount = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+    const int eventCount = 2;
+    QRandomGenerator random(1);
+
+    // Components as ranges of consecutive ids in construction order
+    QList<int> componentStart;
+    for (int f = 0; f < functionCount;) {
+        componentStart.append(f);
+        f += random.bounded(100) < 5 ? 2 + int(random.bounded(4)) : 1;
+    }
+    const int componentCount = int(componentStart.size());
+    componentStart.append(functionCount);
+
+    // Added in shuffled order, so that profile order says nothing about the
+    // structure
+    QList<int> order(functionCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), random);
+
+    CallgrindProfile profile;
+    profile.setEventNames({"Ir", "Dr"});
+    const int object = profile.addSymbol(CallgrindProfile::ObjectSymbol, "synthetic");
+    const int file = profile.addSymbol(CallgrindProfile::FileSymbol, "synthetic.c");
+    QList<int> functionOf(functionCount, -1);
+    for (int f : std::as_const(order)) {
+        const int name = profile.addSymbol(CallgrindProfile::FunctionSymbol, "f" + QByteArray::number(f));
+        functionOf[f] = profile.addFunction(object, file, name);
+        const quint64 self[eventCount] = {quint64(10 + f % 97), quint64(f % 13)};
+        profile.addSelfCost(functionOf[f], self);
+    }
+
+    // Expected inclusive cost per component, filled from the last one back
+    QList<quint64> expected(qsizetype(componentCount) * eventCount, 0);
+    QList<int> componentOf(functionCount);
+    for (int c = 0; c < componentCount; ++c) {
+        for (int f = componentStart[c]; f < componentStart[c + 1]; ++f)
+            componentOf[f] = c;
+    }
+
+    const quint64 recursive[eventCount] = {1000000007, 1000000009};
+    const auto addRecursion = [&](int caller, int callee) {
+        const int call = profile.addCall(functionOf[caller], functionOf[callee]);
+        profile.addCallCost(call, 1, recursive);
+    };
+
+    for (int c = componentCount - 1; c >= 0; --c) {
+        const int begin = componentStart[c];
+        const int end = componentStart[c + 1];
+        quint64 *inclusive = expected.data() + qsizetype(c) * eventCount;
+        for (int f = begin; f < end; ++f) {
+            for (int e = 0; e < eventCount; ++e)
+                inclusive[e] += profile.selfCost(functionOf[f], e);
+        }
+
+        // Recursion, whose arcs must not be counted
+        if (end - begin > 1) {
+            for (int f = begin; f < end; ++f)
+                addRecursion(f, f + 1 < end ? f + 1 : begin);
+        } else if (random.bounded(100) < 3) {
+            addRecursion(begin, begin);
+        }
+
+        // Calls into later components, costed as a share of their inclusive cost
+        const int calls = c + 1 < componentCount ? 3 + int(random.bounded(3)) : 0;
+        for (int i = 0; i < calls; ++i) {
+            const int caller = begin + int(random.bounded(end - begin));
+            const int target = c + 1 + int(random.bounded(qMin(componentCount - c - 1, 1000)));
+            const int callee = componentStart[target] + int(random.bounded(componentStart[target + 1] - componentStart[target]));
+            const int call = profile.addCall(functionOf[caller], functionOf[callee]);
+            quint64 cost[eventCount];
+            for (int e = 0; e < eventCount; ++e) {
+                cost[e] = expected[qsizetype(target) * eventCount + e] / (8 + random.bounded(8));
+                inclusive[e] += cost[e];
+            }
+            profile.addCallCost(call, 1, cost);
+        }
+    }
+
+    CallGraph graph;
+    QElapsedTimer timer;
+    timer.start();
+    graph.build(profile);
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    qsizetype mismatches = 0;
+    for (int f = 0; f < functionCount; ++f) {
+        for (int e = 0; e < eventCount; ++e) {
+            if (graph.inclusiveCost(functionOf[f], e) != expected[qsizetype(componentOf[f]) * eventCount + e])
+                ++mismatches;
+        }
+    }
+
+    int expectedCycles = 0;
+    for (int c = 0; c < componentCount; ++c)
+        expectedCycles += componentStart[c + 1] - componentStart[c] > 1;
+
+    const double seconds = double(elapsedNs) / 1e9;
+    out << "functions:       " << profile.functionCount() << '\n'
+        << "arcs:            " << profile.callCount() << '\n'
+        << "cycles:          " << graph.cycleCount() << " (expected " << expectedCycles << ")\n"
+        << "build time:      " << formatDuration(elapsedNs) << '\n'
+        << "arcs per second: " << QString::number(double(profile.callCount()) / seconds / 1e6, 'f', 1) << " M\n"
+        << "result:          " << (mismatches == 0 && graph.cycleCount() == expectedCycles
+                                   ? "verified" : "MISMATCH") << '\n';
+    return mismatches == 0 && graph.cycleCount() == expectedCycles ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+// Compares opening a compressed profile with parsing the uncompressed file.
+//
+// Usage: decompressionbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 256 MB profile is generated in the temp directory.
+// The profile is compressed with gzip and Zstandard (where this build supports
+// them) and each variant is opened through ProfileDocument, which decompresses
+// on one thread while parsing on another. Decompression alone is timed too:
+// with full overlap, opening takes about as long as the slower of decompressing
+// and parsing rather than their sum.
+
+#include "benchmarksupport.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "profiledocument.h"
+#include "streamdecompressor.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#ifdef CALLGRIND_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CALLGRIND_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static bool compress(QByteArrayView data, StreamDecompressor::Format format, QFile *file)
+{
+    QByteArray compressed;
+    switch (format) {
+    case StreamDecompressor::Gzip: {
+#ifdef CALLGRIND_HAVE_ZLIB
+        z_stream zlib = {};
+        if (deflateInit2(&zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        compressed.resize(qsizetype(deflateBound(&zlib, uLong(data.size()))));
+        zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        zlib.avail_in = uInt(data.size());
+        zlib.next_out = reinterpret_cast<Bytef *>(compressed.data());
+        zlib.avail_out = uInt(compressed.size());
+        const bool ok = deflate(&zlib, Z_FINISH) == Z_STREAM_END;
+        compressed.resize(qsizetype(zlib.total_out));
+        deflateEnd(&zlib);
+        if (!ok)
+            return false;
+        break;
+#else
+        return false;
+#endif
+    }
+    case StreamDecompressor::Zstd: {
+#ifdef CALLGRIND_HAVE_ZSTD
+        compressed.resize(qsizetype(ZSTD_compressBound(size_t(data.size()))));
+        const size_t size = ZSTD_compress(compressed.data(), size_t(compressed.size()),
+                                          data.data(), size_t(data.size()), 3);
+        if (ZSTD_isError(size))
+            return false;
+        compressed.resize(qsizetype(size));
+        break;
+#else
+        return false;
+#endif
+    }
+    case StreamDecompressor::Uncompressed:
+        return false;
+    }
+    return file->write(compressed) == compressed.size();
+}
+
+static QString throughput(qint64 bytes, qint64 nanoseconds)
+{
+    const double seconds = double(nanoseconds) / 1e9;
+    return formatDuration(nanoseconds) + QStringLiteral(", ")
+           + QString::number(double(bytes) / (1 << 20) / seconds, 'f', 1) + QStringLiteral(" MB/s");
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(256) << 20;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    MappedFile file;
+    if (!file.open(fileName)) {
+        out << "Cannot open " << fileName << ": " << file.errorString() << '\n';
+        return 1;
+    }
+    const qint64 size = file.size();
+    out << "file:            " << fileName << '\n'
+        << "size:            " << QString::number(double(size) / (1 << 20), 'f', 1) << " MB\n";
+
+    QElapsedTimer timer;
+    timer.start();
+    CallgrindProfile reference;
+    LineIndex referenceLines;
+    CallgrindParser parser;
+    if (!parser.parse(file.data(), &reference, &referenceLines)) {
+        out << "Parse failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+    const qint64 parseNs = timer.nsecsElapsed();
+    out << "uncompressed:    " << throughput(size, parseNs) << " (sequential parse)\n";
+
+    bool same = true;
+    for (const auto format : {StreamDecompressor::Gzip, StreamDecompressor::Zstd}) {
+        const char *name = format == StreamDecompressor::Gzip ? "gzip" : "zstd";
+        if (!StreamDecompressor::isSupported(format)) {
+            out << name << ":            not supported by this build\n";
+            continue;
+        }
+
+        QTemporaryFile compressed;
+        if (!compressed.open() || !compress(file.data(), format, &compressed)) {
+            out << "Failed to write the " << name << " file\n";
+            return 1;
+        }
+        compressed.close();
+
+        MappedFile input;
+        input.open(compressed.fileName());
+        StreamDecompressor decompressor;
+        decompressor.open(input.data());
+        QByteArray buffer(4 << 20, Qt::Uninitialized);
+        timer.restart();
+        qint64 decompressed = 0;
+        for (qint64 n; (n = decompressor.read(buffer.data(), buffer.size())) > 0;)
+            decompressed += n;
+        const qint64 decompressNs = timer.nsecsElapsed();
+
+        ProfileDocument document;
+        timer.restart();
+        if (!document.open(compressed.fileName(), true) || !document.hasProfile()) {
+            out << "Opening the " << name << " file failed: " << document.errorString()
+                << document.profileErrorString() << '\n';
+            return 1;
+        }
+        const qint64 openNs = timer.nsecsElapsed();
+
+        // As the other side of a comparison opens it, without the text
+        ProfileDocument parsed;
+        parsed.setKeepsText(false);
+        timer.restart();
+        if (!parsed.open(compressed.fileName(), true) || !parsed.hasProfile()) {
+            out << "Parsing the " << name << " file failed: " << parsed.errorString()
+                << parsed.profileErrorString() << '\n';
+            return 1;
+        }
+        const qint64 parseOnlyNs = timer.nsecsElapsed();
+
+        const bool identical = decompressed == size && document.data() == file.data()
+                && document.profile().functionCount() == reference.functionCount()
+                && document.profile().callCount() == reference.callCount()
+                && document.lineCount() == referenceLines.lineCount()
+                && document.profile().totalCost(0) == reference.totalCost(0)
+                && parsed.data().isEmpty() && parsed.lineCount() == 0
+                && parsed.profile().functionCount() == reference.functionCount()
+                && parsed.profile().totalCost(0) == reference.totalCost(0);
+        same = same && identical;
+
+        out << name << " ratio:      "
+            << QString::number(double(size) / double(input.size()), 'f', 1) << ":1\n"
+            << name << " decompress: " << throughput(size, decompressNs) << '\n'
+            << name << " open:       " << throughput(size, openNs)
+            << ", overlap " << QString::number(double(decompressNs + parseNs) / double(openNs), 'f', 2)
+            << "x, " << QString::number(double(openNs) / double(parseNs), 'f', 2)
+            << "x uncompressed time" << (identical ? "" : ", MISMATCH") << '\n'
+            << name << " parse only: " << throughput(size, parseOnlyNs) << ", text dropped\n";
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+// Measures demangling the function names of a profile written with
+// --demangle=no: opening it through ProfileDocument, which starts the
+// demangler, the time until the first and the last batch of names is
+// ready, and the same work done serially for comparison.
+//
+// Usage: demanglebenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 256 MB profile of 500000 functions with mangled
+// names is generated in the temp directory.
+
+#include "benchmarksupport.h"
+#include "callgrindprofile.h"
+#include "profiledocument.h"
+#include "symboldemangler.h"
+#include "symboltable.h"
+
+#include <QElapsedTimer>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QThread>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(256) << 20;
+    defaults.functionCount = 500000;
+    defaults.fileCount = defaults.functionCount / 50;
+    defaults.mangledNames = true;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    // The load returns while names are still being demangled
+    QElapsedTimer timer;
+    timer.start();
+    ProfileDocument document;
+    if (!document.open(fileName, true) || !document.hasProfile()) {
+        out << "Cannot open " << fileName << ": " << document.errorString() << document.profileErrorString() << '\n';
+        return 1;
+    }
+    const qint64 openNanoseconds = timer.nsecsElapsed();
+    const SymbolDemangler &names = document.functionNames();
+    qint64 firstNanoseconds = names.doneCount() > 0 ? openNanoseconds : -1;
+    while (!names.isDone()) {
+        if (firstNanoseconds < 0 && names.doneCount() > 0)
+            firstNanoseconds = timer.nsecsElapsed();
+        QThread::usleep(100);
+    }
+    const qint64 doneNanoseconds = timer.nsecsElapsed();
+
+    const SymbolTable &symbols = document.profile().symbols(CallgrindProfile::FunctionSymbol);
+    int mangled = 0;
+    int demangled = 0;
+    qint64 demangledBytes = 0;
+    for (int symbol = 0; symbol < symbols.count(); ++symbol) {
+        mangled += SymbolDemangler::isMangled(symbols.name(symbol));
+        if (names.name(symbol).data() != symbols.name(symbol).data()) {
+            ++demangled;
+            demangledBytes += names.name(symbol).size();
+        }
+    }
+
+    // One thread, one allocation per name
+    timer.restart();
+    qint64 serialBytes = 0;
+    for (int symbol = 0; symbol < symbols.count(); ++symbol)
+        serialBytes += SymbolDemangler::demangle(symbols.name(symbol)).size();
+    const qint64 serialNanoseconds = timer.nsecsElapsed();
+
+    // A live tail update takes over every batch of the same symbols
+    timer.restart();
+    SymbolDemangler continued;
+    continued.start(symbols, &names);
+    continued.waitForDone();
+    const qint64 continuedNanoseconds = timer.nsecsElapsed();
+
+    // What a view pays per name once they are ready
+    timer.restart();
+    qint64 lookupBytes = 0;
+    for (int symbol = 0; symbol < symbols.count(); ++symbol)
+        lookupBytes += names.name(symbol).size();
+    const qint64 lookupNanoseconds = timer.nsecsElapsed();
+
+    out << "file:        " << fileName << '\n'
+        << "functions:   " << document.profile().functionCount() << ", " << symbols.count() << " names, "
+        << mangled << " mangled, " << demangled << " demangled ("
+        << QString::number(double(demangledBytes) / (1 << 20), 'f', 1) << " MB)\n"
+        << "threads:     " << QThread::idealThreadCount() << "\n\n"
+        << "open:                 " << formatDuration(openNanoseconds) << '\n'
+        << "first names ready:    " << formatDuration(firstNanoseconds) << '\n'
+        << "all names ready:      " << formatDuration(doneNanoseconds) << ", "
+        << formatDuration(qMax<qint64>(0, doneNanoseconds - openNanoseconds)) << " after the open\n"
+        << "serial demangling:    " << formatDuration(serialNanoseconds) << ", "
+        << QString::number(double(serialNanoseconds) / qMax(1, mangled), 'f', 0) << " ns per name\n"
+        << "continued table:      " << formatDuration(continuedNanoseconds) << '\n'
+        << "lookup of every name: " << formatDuration(lookupNanoseconds) << ", "
+        << QString::number(double(lookupNanoseconds) / qMax(1, symbols.count()), 'f', 1) << " ns per name\n";
+    return serialBytes == demangledBytes && lookupBytes > 0 ? 0 : 1;
+}
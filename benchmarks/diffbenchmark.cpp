@@ -0,0 +1,155 @@
+// Times ProfileDiff on two large synthetic profiles and checks the result
+// against deltas known by construction.
+//
+// Usage: diffbenchmark [function-count]
+//        diffbenchmark before.callgrind.out after.callgrind.out
+// The default of 300000 functions spread over 5000 files and 50 objects
+// matches the largest profiles we compare. The second profile drops 5% of
+// the functions, adds as many new ones, lists its events in a different
+// order with an extra one, and adds its names in a different order, so
+// neither symbol nor function ids line up between the two.
+
+#include "benchmarksupport.h"
+#include "callgraph.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "flatprofile.h"
+#include "profilediff.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#include <algorithm>
+#include <numeric>
+
+static const int Runs = 5;
+
+static void addFunctions(CallgrindProfile *profile, const QList<int> &ids, bool after)
+{
+    for (int id : ids) {
+        const int object = profile->addSymbol(CallgrindProfile::ObjectSymbol,
+                                              "lib" + QByteArray::number(id % 50) + ".so");
+        const int file = profile->addSymbol(CallgrindProfile::FileSymbol,
+                                            "src/file" + QByteArray::number(id % 5000) + ".cpp");
+        const int name = profile->addSymbol(CallgrindProfile::FunctionSymbol,
+                                            "function" + QByteArray::number(id));
+        const int function = profile->addFunction(object, file, name);
+        const quint64 ir = 10 + id % 97;
+        const quint64 dr = id % 13;
+        if (after) {
+            // Dr, Ir, Cycles; Ir moves by -3..+3
+            const quint64 costs[3] = {dr, ir + id % 7 - 3, 2 * ir};
+            profile->addSelfCost(function, costs);
+        } else {
+            const quint64 costs[2] = {ir, dr};
+            profile->addSelfCost(function, costs);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    CallgrindProfile before;
+    CallgrindProfile after;
+    int removed = -1;
+    int added = -1;
+
+    if (argc > 2) {
+        CallgrindParser parser;
+        if (!parser.parseFile(QString::fromLocal8Bit(argv[1]), &before)
+            || !parser.parseFile(QString::fromLocal8Bit(argv[2]), &after)) {
+            out << "Parse failed: " << parser.errorString() << '\n';
+            return 1;
+        }
+    } else {
+        const int functionCount = argc > 1 ? QByteArray(argv[1]).toInt() : 300000;
+        QRandomGenerator random(1);
+        QList<int> ids(functionCount);
+        std::iota(ids.begin(), ids.end(), 0);
+
+        // Ids divisible by 20 only exist before, ids past the end only after
+        QList<int> beforeIds = ids;
+        std::shuffle(beforeIds.begin(), beforeIds.end(), random);
+        QList<int> afterIds;
+        for (int id : std::as_const(ids)) {
+            if (id % 20 != 0)
+                afterIds.append(id);
+        }
+        removed = int(ids.size() - afterIds.size());
+        for (int id = functionCount; id < functionCount + removed; ++id)
+            afterIds.append(id);
+        added = removed;
+        std::shuffle(afterIds.begin(), afterIds.end(), random);
+
+        before.setEventNames({"Ir", "Dr"});
+        after.setEventNames({"Dr", "Ir", "Cycles"});
+        addFunctions(&before, beforeIds, false);
+        addFunctions(&after, afterIds, true);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    CallGraph beforeGraph;
+    CallGraph afterGraph;
+    beforeGraph.build(before);
+    afterGraph.build(after);
+    FlatProfile beforeFlat;
+    FlatProfile afterFlat;
+    beforeFlat.build(beforeGraph);
+    afterFlat.build(afterGraph);
+    out << "functions:       " << before.functionCount() << " before, " << after.functionCount() << " after\n"
+        << "flat profiles:   " << formatDuration(timer.nsecsElapsed()) << " (not part of the diff)\n";
+
+    ProfileDiff diff;
+    qint64 best = -1;
+    for (int run = 0; run < Runs; ++run) {
+        timer.restart();
+        if (!diff.build(beforeFlat, afterFlat)) {
+            out << "Diff failed: " << diff.errorString() << '\n';
+            return 1;
+        }
+        const qint64 ns = timer.nsecsElapsed();
+        best = best < 0 ? ns : qMin(best, ns);
+    }
+    out << "diff:            " << formatDuration(best) << ", best of " << Runs
+        << ", " << diff.rowCount() << " rows, " << diff.eventCount() << " common events\n"
+        << "only before:     " << diff.onlyBeforeCount() << '\n'
+        << "only after:      " << diff.onlyAfterCount() << '\n';
+
+    QList<int> rows(diff.rowCount());
+    std::iota(rows.begin(), rows.end(), 0);
+    timer.restart();
+    diff.sortRows(rows.data(), rows.data() + qMin<qsizetype>(1000, rows.size()), rows.data() + rows.size(),
+                  ProfileDiff::SortByInclusiveDelta, 0, Qt::DescendingOrder);
+    const qint64 topNs = timer.nsecsElapsed();
+    timer.restart();
+    diff.sortRows(rows.data(), rows.data() + rows.size(), rows.data() + rows.size(),
+                  ProfileDiff::SortByRelativeInclusiveDelta, 0, Qt::DescendingOrder);
+    out << "sort top 1000:   " << formatDuration(topNs) << '\n'
+        << "sort relative:   " << formatDuration(timer.nsecsElapsed()) << " (all rows)\n";
+
+    if (removed < 0)
+        return 0;
+
+    // Every matched function moved by (id % 7) - 3 instructions
+    bool ok = diff.onlyBeforeCount() == removed && diff.onlyAfterCount() == added
+            && diff.eventNames() == QList<QByteArray>{"Ir", "Dr"};
+    for (int row = 0; ok && row < diff.rowCount(); ++row) {
+        const int beforeFunction = diff.beforeFunction(row);
+        const int afterFunction = diff.afterFunction(row);
+        const int id = diff.symbolName(row, CallgrindProfile::FunctionSymbol).sliced(8).toByteArray().toInt();
+        const qint64 ir = 10 + id % 97;
+        qint64 expected = id % 7 - 3;
+        if (beforeFunction < 0)
+            expected = ir + id % 7 - 3;
+        else if (afterFunction < 0)
+            expected = -ir;
+        ok = diff.selfDelta(row, 0) == expected && diff.inclusiveDelta(row, 0) == expected
+                && diff.selfDelta(row, 1) == (beforeFunction < 0 ? id % 13 : afterFunction < 0 ? -(id % 13) : 0);
+    }
+    out << "result:          " << (ok ? "matches construction" : "MISMATCH") << '\n';
+    return ok ? 0 : 1;
+}
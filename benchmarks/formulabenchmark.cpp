@@ -0,0 +1,108 @@
+// Times derived events over a large synthetic profile: the column kernels of
+// FlatProfile against interpreting the formula per function and call arc,
+// and checks that both agree.
+//
+// Usage: formulabenchmark [function-count]
+// The default of 1000000 functions with the 13 cache and branch events of
+// --cache-sim=yes --branch-sim=yes yields about a million call arcs.
+
+#include "benchmarksupport.h"
+#include "callgraph.h"
+#include "callgrindprofile.h"
+#include "eventformula.h"
+#include "flatprofile.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    const int functionCount = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+    const QList<QByteArray> events = {"Ir", "Dr", "Dw", "I1mr", "D1mr", "D1mw", "ILmr",
+                                      "DLmr", "DLmw", "Bc", "Bcm", "Bi", "Bim"};
+    const int eventCount = int(events.size());
+    QRandomGenerator random(1);
+
+    CallgrindProfile profile;
+    profile.setEventNames(events);
+    const int object = profile.addSymbol(CallgrindProfile::ObjectSymbol, "synthetic");
+    const int file = profile.addSymbol(CallgrindProfile::FileSymbol, "synthetic.c");
+    QList<quint64> costs(eventCount);
+    for (int f = 0; f < functionCount; ++f) {
+        const int name = profile.addSymbol(CallgrindProfile::FunctionSymbol, "f" + QByteArray::number(f));
+        const int function = profile.addFunction(object, file, name);
+        for (quint64 &cost : costs)
+            cost = random.bounded(1000);
+        profile.addSelfCost(function, costs.constData());
+    }
+    // Calls only go to later functions, so the graph has no cycles
+    for (int f = 0; f + 1 < functionCount; ++f) {
+        const int call = profile.addCall(f, f + 1 + int(random.bounded(functionCount - f - 1)));
+        for (quint64 &cost : costs)
+            cost = random.bounded(100000);
+        profile.addCallCost(call, 1, costs.constData());
+    }
+    profile.addEventDefinition("CEst = Ir + 10 Bcm + 10 I1mr + 10 D1mr + 10 D1mw + 100 ILmr + 100 DLmr"
+                               " + 100 DLmw : Cycle estimation");
+
+    CallGraph graph;
+    graph.build(profile);
+    QElapsedTimer timer;
+    timer.start();
+    FlatProfile flat;
+    flat.build(graph);
+    out << functionCount << " functions, " << profile.callCount() << " call arcs, " << eventCount
+        << " events\n";
+    out << "build with CEst:  " << formatDuration(timer.nsecsElapsed()) << '\n';
+
+    EventFormula formula;
+    formula.parseDefinition("L1m = I1mr + D1mr + D1mw");
+    timer.restart();
+    flat.setDerivedEvent(formula);
+    out << "add L1m:          " << formatDuration(timer.nsecsElapsed()) << '\n';
+
+    formula.parseDefinition("CEst = Ir + 10 Bcm + 10 L1m + 100 ILmr + 100 DLmr + 100 DLmw");
+    if (flat.setDerivedEvent(formula))
+        out << "CEst refers to the later L1m: accepted, which is wrong\n";
+    formula.parseDefinition("CEst = Ir + 10 Bcm + 10 I1mr + 10 D1mr + 10 D1mw + 100 ILmr + 100 DLmr"
+                            " + 100 DLmw + 5 Bim");
+    timer.restart();
+    flat.setDerivedEvent(formula);
+    out << "change CEst:      " << formatDuration(timer.nsecsElapsed()) << " (CEst and L1m)\n";
+
+    // The same formula interpreted term by term for every record
+    const int event = int(flat.eventNames().indexOf("CEst"));
+    QList<int> columns;
+    for (const EventFormula::Term &term : formula.terms())
+        columns.append(int(events.indexOf(term.event)));
+    const auto interpret = [&](const quint64 *row) {
+        quint64 sum = 0;
+        for (qsizetype t = 0; t < columns.size(); ++t)
+            sum += formula.terms().at(t).factor * row[columns.at(t)];
+        return sum;
+    };
+    timer.restart();
+    QList<quint64> self(functionCount);
+    QList<quint64> inclusive(functionCount);
+    QList<quint64> calls(profile.callCount());
+    for (int f = 0; f < functionCount; ++f) {
+        self[f] = interpret(profile.selfCosts(f));
+        inclusive[f] = interpret(graph.inclusiveCosts(f));
+    }
+    for (int call = 0; call < profile.callCount(); ++call)
+        calls[call] = interpret(profile.callCosts(call));
+    out << "interpreted CEst: " << formatDuration(timer.nsecsElapsed()) << '\n';
+
+    qint64 mismatches = 0;
+    for (int f = 0; f < functionCount; ++f) {
+        mismatches += flat.selfCosts(event).at(f) != self.at(f);
+        mismatches += flat.inclusiveCosts(event).at(f) != inclusive.at(f);
+    }
+    for (int call = 0; call < profile.callCount(); ++call)
+        mismatches += flat.callCost(call, event) != calls.at(call);
+    out << "mismatches:       " << mismatches << '\n';
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Compares the single-pass CallgrindLexer against the previous five-regex
+// highlighter, in highlighted blocks (lines) per second.
+//
+// Usage: highlighterbenchmark [callgrind.out.file]
+
+#include "callgrindlexer.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextStream>
+
+namespace {
+
+struct RegexMatch {
+    qsizetype start;
+    qsizetype length;
+    int rule;
+};
+
+// The rules of the original CallgrindSyntaxHighlighter::highlightBlock()
+QList<QRegularExpression> regexRules()
+{
+    return {
+        QRegularExpression(R"(^#.*$)"),
+        QRegularExpression(R"(^(cmd|events|creator|pid|desc|positions|summary|version):)"),
+        QRegularExpression(R"(\b(fl|fn|ob|cfi|cfn|cob|jump)=)"),
+        QRegularExpression(R"(\b\d+\b)"),
+        QRegularExpression(R"(0x[0-9A-Fa-f]+)"),
+    };
+}
+
+QStringList syntheticLines(int count)
+{
+    const QStringList pattern = {
+        QStringLiteral("fl=(12) /usr/src/project/module/file.cpp"),
+        QStringLiteral("fn=(3456) Namespace::Class::method(int, char const*)"),
+        QStringLiteral("0x4005f0 16 400 12 3"),
+        QStringLiteral("+3 * 20 4 1"),
+        QStringLiteral("-2 +1 7 2 0"),
+        QStringLiteral("cfi=(13)"),
+        QStringLiteral("cfn=(3457)"),
+        QStringLiteral("calls=2 +4"),
+        QStringLiteral("+1 * 4000 1200 300"),
+        QStringLiteral("# comment line"),
+    };
+    QStringList lines;
+    lines.reserve(count);
+    for (int i = 0; i < count; ++i)
+        lines.append(pattern.at(i % pattern.size()));
+    return lines;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    QStringList lines;
+    if (argc > 1) {
+        MappedFile file;
+        if (!file.open(QString::fromLocal8Bit(argv[1]))) {
+            out << "Cannot open " << argv[1] << ": " << file.errorString() << '\n';
+            return 1;
+        }
+        LineIndex index;
+        index.build(file.data());
+        for (qint64 i = 0; i < index.lineCount(); ++i)
+            lines.append(QString::fromUtf8(index.line(i)));
+    } else {
+        lines = syntheticLines(200000);
+    }
+
+    const QList<QRegularExpression> rules = regexRules();
+    QList<RegexMatch> matches;
+    QElapsedTimer timer;
+    timer.start();
+    for (const QString &line : std::as_const(lines)) {
+        matches.clear();
+        for (int rule = 0; rule < rules.size(); ++rule) {
+            QRegularExpressionMatchIterator it = rules.at(rule).globalMatch(line);
+            while (it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
+                matches.append({match.capturedStart(), match.capturedLength(), rule});
+            }
+        }
+    }
+    const double regexSeconds = timer.nsecsElapsed() / 1e9;
+
+    qsizetype tokenCount = 0;
+    CallgrindLexer::Tokens tokens;
+    timer.restart();
+    for (const QString &line : std::as_const(lines)) {
+        tokens.clear();
+        CallgrindLexer::tokenize(line, tokens);
+        tokenCount += tokens.size();
+    }
+    const double lexerSeconds = timer.nsecsElapsed() / 1e9;
+
+    const double blocks = double(lines.size());
+    out << "blocks:          " << lines.size() << '\n'
+        << "tokens:          " << tokenCount << '\n'
+        << "regex:           " << QString::number(blocks / regexSeconds, 'f', 0) << " blocks/s\n"
+        << "lexer:           " << QString::number(blocks / lexerSeconds, 'f', 0) << " blocks/s\n"
+        << "speedup:         " << QString::number(regexSeconds / lexerSeconds, 'f', 1) << "x\n";
+    return 0;
+}
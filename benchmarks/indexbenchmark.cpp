@@ -0,0 +1,94 @@
+// Measures how much a profile index saves when re-opening a profile.
+//
+// Usage: indexbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 1 GB profile is generated in the temp directory. The
+// profile is parsed, its index written to a temporary file and loaded back;
+// the loaded profile must match the parsed one.
+
+#include "benchmarksupport.h"
+#include "callgrindprofile.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "parallelcallgrindparser.h"
+#include "profileindex.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(1024) << 20;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    MappedFile file;
+    if (!file.open(fileName)) {
+        out << "Cannot open " << fileName << ": " << file.errorString() << '\n';
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    CallgrindProfile parsed;
+    LineIndex parsedLines;
+    ParallelCallgrindParser parser;
+    if (!parser.parse(file.data(), &parsed, &parsedLines)) {
+        out << "Parse failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+    const qint64 parseNs = timer.nsecsElapsed();
+
+    timer.restart();
+    const ProfileIndex::Stamp stamp = ProfileIndex::stamp(fileName, file.data());
+    const qint64 stampNs = timer.nsecsElapsed();
+
+    QTemporaryFile indexFile;
+    if (!indexFile.open()) {
+        out << "Cannot create a temporary index file\n";
+        return 1;
+    }
+    indexFile.close();
+
+    ProfileIndex index;
+    timer.restart();
+    if (!index.save(indexFile.fileName(), stamp, parsed, parsedLines)) {
+        out << "Saving the index failed: " << index.errorString() << '\n';
+        return 1;
+    }
+    const qint64 saveNs = timer.nsecsElapsed();
+
+    CallgrindProfile loaded;
+    LineIndex loadedLines;
+    timer.restart();
+    if (!index.load(indexFile.fileName(), stamp, file.data(), &loaded, &loadedLines)) {
+        out << "Loading the index failed: " << index.errorString() << '\n';
+        return 1;
+    }
+    const qint64 loadNs = timer.nsecsElapsed();
+
+    bool same = loaded.functionCount() == parsed.functionCount()
+            && loaded.callCount() == parsed.callCount()
+            && loadedLines.checkpoints() == parsedLines.checkpoints();
+    for (int event = 0; same && event < parsed.eventCount(); ++event)
+        same = loaded.totalCost(event) == parsed.totalCost(event);
+
+    const qint64 reopenNs = stampNs + loadNs;
+    out << "file:            " << fileName << '\n'
+        << "size:            " << QString::number(double(file.size()) / (1 << 20), 'f', 1) << " MB\n"
+        << "index size:      " << QString::number(double(QFileInfo(indexFile.fileName()).size()) / (1 << 20), 'f', 1) << " MB\n"
+        << "parse:           " << formatDuration(parseNs) << '\n'
+        << "stamp:           " << formatDuration(stampNs) << '\n'
+        << "save index:      " << formatDuration(saveNs) << '\n'
+        << "load index:      " << formatDuration(loadNs) << '\n'
+        << "re-open speedup: " << QString::number(double(parseNs) / double(reopenNs), 'f', 1) << "x\n"
+        << "result:          " << (same ? "identical" : "MISMATCH") << '\n';
+    return same ? 0 : 1;
+}
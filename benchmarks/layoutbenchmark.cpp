@@ -0,0 +1,91 @@
+// Measures laying out the call graph around the costliest function of a
+// large profile at the thresholds the call graph view offers: how long the
+// first layer takes to arrive, which is what the view shows first, and the
+// whole layout. Checks that no two nodes of a layer overlap and that every
+// edge connects nodes produced before it.
+//
+// Usage: layoutbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 128 MB profile of 200000 functions, three calls
+// each, is generated in the temp directory.
+
+#include "benchmarksupport.h"
+#include "callgraphlayout.h"
+#include "callgrindprofile.h"
+#include "flatprofile.h"
+#include "profiledocument.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(128) << 20;
+    defaults.functionCount = 200000;
+    defaults.fileCount = defaults.functionCount / 50;
+    defaults.fanOut = 3;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    ProfileDocument document;
+    if (!document.open(fileName, true) || !document.hasProfile()) {
+        out << "Cannot open " << fileName << ": " << document.errorString() << document.profileErrorString() << '\n';
+        return 1;
+    }
+    const FlatProfile &flat = document.flatProfile();
+    const QList<quint64> &inclusive = flat.inclusiveCosts(0);
+    const int root = int(std::max_element(inclusive.cbegin(), inclusive.cend()) - inclusive.cbegin());
+
+    out << "file:      " << fileName << '\n'
+        << "functions: " << document.profile().functionCount() << ", "
+        << document.profile().callCount() << " calls\n\n";
+
+    int failures = 0;
+    for (const double threshold : {0.0, 0.001, 0.01, 0.05, 0.1}) {
+        CallGraphLayout layout;
+        layout.setThreshold(threshold);
+        int nodes = 0;
+        int edges = 0;
+        int layers = 0;
+        int invalid = 0;
+        qint64 firstNanoseconds = -1;
+        QMap<int, QList<double>> positions;
+        QElapsedTimer timer;
+        timer.start();
+        layout.run(document.callGraph(), flat, root,
+                   [&](const QList<CallGraphLayout::Node> &layerNodes, const QList<CallGraphLayout::Edge> &layerEdges) {
+            if (firstNanoseconds < 0)
+                firstNanoseconds = timer.nsecsElapsed();
+            nodes += int(layerNodes.size());
+            for (const CallGraphLayout::Edge &edge : layerEdges)
+                invalid += edge.caller >= nodes || edge.callee >= nodes;
+            edges += int(layerEdges.size());
+            ++layers;
+            for (const CallGraphLayout::Node &node : layerNodes)
+                positions[node.layer].append(node.x);
+            return true;
+        });
+        const qint64 totalNanoseconds = timer.nsecsElapsed();
+
+        for (QList<double> &x : positions) {
+            std::sort(x.begin(), x.end());
+            for (qsizetype i = 1; i < x.size(); ++i)
+                invalid += x.at(i) - x.at(i - 1) < 0.999;
+        }
+        failures += invalid;
+
+        out << "threshold " << QString::number(100 * threshold) << " %: "
+            << nodes << " nodes, " << edges << " edges in " << positions.size() << " layers; first layer "
+            << formatDuration(firstNanoseconds) << ", all " << formatDuration(totalNanoseconds)
+            << (invalid > 0 ? ", INVALID" : "") << '\n';
+    }
+    return failures == 0 ? 0 : 1;
+}
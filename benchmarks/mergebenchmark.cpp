@@ -0,0 +1,132 @@
+// Measures how merging many profiles scales with the number of threads.
+//
+// Usage: mergebenchmark [file-count [size-in-MB]]
+// A profile of the given size (default 16 MB) is generated in the temp
+// directory, together with a copy that lists an extra Cycles event in front
+// of the others, written back out with CallgrindWriter. The files alternate
+// in the merge list (default 64 entries), so every merge has to align event
+// columns. Each run must sum to the expected totals; the merged profile is
+// then saved, parsed again and compared.
+
+#include "benchmarksupport.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "callgrindwriter.h"
+#include "profilemerger.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QThread>
+
+static bool sameTotals(const CallgrindProfile &a, const CallgrindProfile &b)
+{
+    if (a.functionCount() != b.functionCount() || a.callCount() != b.callCount()
+        || a.eventNames() != b.eventNames())
+        return false;
+    for (int event = 0; event < a.eventCount(); ++event) {
+        if (a.totalCost(event) != b.totalCost(event))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    const int fileCount = argc > 1 ? QByteArray(argv[1]).toInt() : 64;
+    const qint64 megabytes = argc > 2 ? QByteArray(argv[2]).toLongLong() : 16;
+
+    ProfileShape shape;
+    shape.targetBytes = megabytes << 20;
+    QTemporaryFile base;
+    if (openOrGenerateProfile(QString(), shape, &base).isEmpty())
+        return 1;
+
+    CallgrindProfile baseProfile;
+    CallgrindParser parser;
+    if (!parser.parseFile(base.fileName(), &baseProfile)) {
+        out << "Parse failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+
+    QTemporaryFile variant;
+    CallgrindProfile variantProfile = baseProfile;
+    variantProfile.alignEvents(QList<QByteArray>{"Cycles"} + baseProfile.eventNames());
+    QElapsedTimer timer;
+    timer.start();
+    CallgrindWriter writer;
+    if (!variant.open() || !writer.write(variantProfile, &variant)) {
+        out << "Write failed: " << writer.errorString() << '\n';
+        return 1;
+    }
+    const qint64 writeNs = timer.nsecsElapsed();
+    variant.close();
+    out << "input:           " << fileCount << " files of "
+        << QString::number(double(QFileInfo(base.fileName()).size()) / (1 << 20), 'f', 1) << " and "
+        << QString::number(double(QFileInfo(variant.fileName()).size()) / (1 << 20), 'f', 1) << " MB, "
+        << baseProfile.functionCount() << " functions\n"
+        << "write:           " << formatDuration(writeNs) << " for the variant\n";
+
+    QStringList fileNames;
+    qint64 totalBytes = 0;
+    for (int i = 0; i < fileCount; ++i) {
+        fileNames.append(i % 2 == 0 ? base.fileName() : variant.fileName());
+        totalBytes += QFileInfo(fileNames.constLast()).size();
+    }
+
+    // Base events first, as the first file lists them, then Cycles at zero
+    CallgrindProfile expected;
+    expected.setEventNames(baseProfile.eventNames() + QList<QByteArray>{"Cycles"});
+    for (int i = 0; i < fileCount; ++i)
+        expected.merge(baseProfile);
+
+    QList<int> threadCounts;
+    for (int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+        threadCounts.append(threads);
+    threadCounts.append(QThread::idealThreadCount());
+
+    CallgrindProfile merged;
+    double singleSeconds = 0;
+    for (int threads : std::as_const(threadCounts)) {
+        ProfileMerger merger;
+        merger.setThreadCount(threads);
+        timer.restart();
+        if (!merger.merge(fileNames, &merged)) {
+            out << "Merge failed: " << merger.errorString() << '\n';
+            return 1;
+        }
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        const double seconds = double(elapsedNs) / 1e9;
+        if (threads == 1)
+            singleSeconds = seconds;
+        const bool same = sameTotals(expected, merged);
+        out << QString::number(threads).rightJustified(3) << " threads:     "
+            << formatDuration(elapsedNs) << ", "
+            << QString::number(double(totalBytes) / (1 << 20) / seconds, 'f', 1) << " MB/s, speedup "
+            << QString::number(singleSeconds / seconds, 'f', 2) << "x" << (same ? "" : ", MISMATCH") << '\n';
+        if (!same)
+            return 1;
+    }
+
+    QTemporaryFile saved;
+    CallgrindProfile reloaded;
+    if (!saved.open() || !writer.write(merged, &saved)) {
+        out << "Write failed: " << writer.errorString() << '\n';
+        return 1;
+    }
+    saved.close();
+    if (!parser.parseFile(saved.fileName(), &reloaded)) {
+        out << "Parse of the merged file failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+    const bool roundTrip = sameTotals(merged, reloaded);
+    out << "saved:           " << QString::number(double(QFileInfo(saved.fileName()).size()) / (1 << 20), 'f', 1)
+        << " MB" << (roundTrip ? ", parses back to the same totals" : ", MISMATCH after parsing back") << '\n'
+        << "peak rss:        " << procStatusKb("VmHWM") << " kB\n";
+    return roundTrip ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Measures how parsing scales with the number of threads.
+//
+// Usage: parallelparserbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 1 GB profile is generated in the temp directory. The
+// file is parsed once sequentially and then with 1, 2, 4, ... threads up to
+// QThread::idealThreadCount(); every run must produce the same profile.
+
+#include "benchmarksupport.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "parallelcallgrindparser.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QThread>
+
+static bool sameProfile(const CallgrindProfile &a, const CallgrindProfile &b)
+{
+    if (a.functionCount() != b.functionCount() || a.callCount() != b.callCount()
+        || a.eventCount() != b.eventCount())
+        return false;
+    for (int event = 0; event < a.eventCount(); ++event) {
+        if (a.totalCost(event) != b.totalCost(event))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(1024) << 20;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    MappedFile file;
+    if (!file.open(fileName)) {
+        out << "Cannot open " << fileName << ": " << file.errorString() << '\n';
+        return 1;
+    }
+    const double megabytes = double(file.size()) / (1 << 20);
+    out << "file:            " << fileName << '\n'
+        << "size:            " << QString::number(megabytes, 'f', 1) << " MB\n";
+
+    // Fault the mapping in so the first run is not charged for the disk
+    volatile char sink = 0;
+    for (qint64 offset = 0; offset < file.size(); offset += 4096)
+        sink = sink + file.data().at(offset);
+
+    CallgrindProfile reference;
+    LineIndex referenceIndex;
+    CallgrindParser sequential;
+    QElapsedTimer timer;
+    timer.start();
+    if (!sequential.parse(file.data(), &reference, &referenceIndex)) {
+        out << "Parse failed: " << sequential.errorString() << '\n';
+        return 1;
+    }
+    const qint64 sequentialNs = timer.nsecsElapsed();
+    const double sequentialSeconds = double(sequentialNs) / 1e9;
+    out << "sequential:      " << formatDuration(sequentialNs) << ", "
+        << QString::number(megabytes / sequentialSeconds, 'f', 1) << " MB/s\n";
+
+    QList<int> threadCounts;
+    for (int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+        threadCounts.append(threads);
+    threadCounts.append(QThread::idealThreadCount());
+
+    for (int threads : std::as_const(threadCounts)) {
+        CallgrindProfile profile;
+        LineIndex index;
+        ParallelCallgrindParser parser;
+        parser.setThreadCount(threads);
+        timer.restart();
+        if (!parser.parse(file.data(), &profile, &index)) {
+            out << "Parse failed: " << parser.errorString() << '\n';
+            return 1;
+        }
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        const double seconds = double(elapsedNs) / 1e9;
+        const bool same = sameProfile(reference, profile)
+                && index.lineCount() == referenceIndex.lineCount()
+                && index.lineStart(index.lineCount() - 1)
+                        == referenceIndex.lineStart(referenceIndex.lineCount() - 1);
+        out << QString::number(threads).rightJustified(3) << " threads:     "
+            << formatDuration(elapsedNs) << ", "
+            << QString::number(megabytes / seconds, 'f', 1) << " MB/s, speedup "
+            << QString::number(sequentialSeconds / seconds, 'f', 2) << "x, "
+            << parser.chunkCount() << " chunks" << (same ? "" : ", MISMATCH") << '\n';
+        if (!same)
+            return 1;
+    }
+    out << "peak rss:        " << procStatusKb("VmHWM") << " kB\n";
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Measures parser throughput and memory on a synthetic Callgrind profile.
+//
+// Usage: parserbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 1 GB profile is generated in the temp directory.
+
+#include "benchmarksupport.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(1024) << 20;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    const qint64 fileSize = QFileInfo(fileName).size();
+    const qint64 rssBefore = procStatusKb("VmRSS");
+
+    CallgrindProfile profile;
+    CallgrindParser parser;
+    QElapsedTimer timer;
+    timer.start();
+    if (!parser.parseFile(fileName, &profile)) {
+        out << "Parse failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    const double megabytes = double(fileSize) / (1 << 20);
+    const double seconds = double(elapsedNs) / 1e9;
+    out << "file:            " << fileName << '\n'
+        << "size:            " << QString::number(megabytes, 'f', 1) << " MB\n"
+        << "lines:           " << parser.lineCount() << '\n'
+        << "functions:       " << profile.functionCount() << '\n'
+        << "calls:           " << profile.callCount() << '\n'
+        << "time:            " << formatDuration(elapsedNs) << '\n'
+        << "throughput:      " << QString::number(megabytes / seconds, 'f', 1) << " MB/s\n"
+        << "rss before:      " << rssBefore << " kB\n"
+        << "peak rss:        " << procStatusKb("VmHWM") << " kB\n"
+        << "anonymous rss:   " << procStatusKb("RssAnon") << " kB\n";
+    // File-backed pages of the mapping count towards VmHWM but can be
+    // reclaimed by the kernel at any time; RssAnon is the model itself.
+    return 0;
+}
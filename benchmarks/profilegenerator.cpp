@@ -0,0 +1,69 @@
+// Writes a synthetic Callgrind profile, for benchmarks and for trying the
+// viewer on profiles of a given size and shape.
+//
+// Usage: profilegenerator [options] <output>
+// See --help for the shape options; the defaults match generateProfile().
+
+#include "benchmarksupport.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QTextStream>
+
+using namespace Qt::StringLiterals;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    const ProfileShape defaults;
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Writes a synthetic Callgrind profile."_s);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"output"_s, u"File to write."_s);
+    const QCommandLineOption sizeOption(u"size"_s, u"Approximate file size in MB."_s, u"MB"_s,
+                                        QString::number(defaults.targetBytes >> 20));
+    const QCommandLineOption functionsOption(u"functions"_s, u"Number of distinct functions."_s,
+                                             u"count"_s, QString::number(defaults.functionCount));
+    const QCommandLineOption filesOption(u"files"_s, u"Number of source files."_s, u"count"_s,
+                                         QString::number(defaults.fileCount));
+    const QCommandLineOption fanOutOption(u"fan-out"_s, u"Calls per function entry."_s, u"count"_s,
+                                          QString::number(defaults.fanOut));
+    const QCommandLineOption recursionOption(
+            u"recursion"_s, u"Length of recursive call cycles, 1 for self recursion, 0 for none."_s,
+            u"depth"_s, QString::number(defaults.recursionDepth));
+    const QCommandLineOption eventsOption(u"events"_s, u"Number of events."_s, u"count"_s,
+                                          QString::number(defaults.eventCount));
+    const QCommandLineOption uncompressedOption(u"uncompressed"_s,
+                                                u"Write full names instead of compressed (id) names."_s);
+    const QCommandLineOption instructionsOption(
+            u"instr"_s, u"Write instruction addresses and lines, as callgrind --dump-instr=yes does."_s);
+    parser.addOptions({ sizeOption, functionsOption, filesOption, fanOutOption, recursionOption,
+                        eventsOption, uncompressedOption, instructionsOption });
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        err << parser.helpText();
+        return 2;
+    }
+
+    ProfileShape shape;
+    shape.targetBytes = qint64(parser.value(sizeOption).toDouble() * (1 << 20));
+    shape.functionCount = parser.value(functionsOption).toInt();
+    shape.fileCount = parser.value(filesOption).toInt();
+    shape.fanOut = parser.value(fanOutOption).toInt();
+    shape.recursionDepth = parser.value(recursionOption).toInt();
+    shape.eventCount = parser.value(eventsOption).toInt();
+    shape.compressNames = !parser.isSet(uncompressedOption);
+    shape.instructions = parser.isSet(instructionsOption);
+
+    QSaveFile file(positional.constFirst());
+    if (!file.open(QIODevice::WriteOnly) || !generateProfile(&file, shape) || !file.commit()) {
+        err << positional.constFirst() << ": " << file.errorString() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Measures full-text search over a mapped profile: TextSearch on the raw
+// bytes against decoding every line and searching the QString, which is
+// what a find in a QTextDocument amounts to before any layout.
+//
+// Usage: searchbenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 1 GB profile is generated in the temp directory.
+// For each pattern the time to the first match, the time for the whole
+// file and the throughput are listed.
+
+#include "benchmarksupport.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "textsearch.h"
+
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+namespace {
+
+struct Pattern {
+    const char *text;
+    bool regularExpression;
+    bool caseSensitive;
+};
+
+struct Result {
+    qint64 matches = 0;
+    qint64 firstNanoseconds = -1;
+    qint64 nanoseconds = 0;
+};
+
+Result searchBytes(QByteArrayView data, const LineIndex &lines, const Pattern &pattern)
+{
+    Result result;
+    TextSearch search;
+    search.setPattern(QString::fromUtf8(pattern.text), pattern.regularExpression, pattern.caseSensitive);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 lineSum = 0;
+    for (qint64 from = 0; from < data.size();) {
+        from = search.search(data, from, 4 << 20, [&](const TextSearch::Match &match) {
+            if (result.matches++ == 0)
+                result.firstNanoseconds = timer.nsecsElapsed();
+            // Mapping matches to lines is part of the cost, as in the viewer
+            lineSum += lines.lineAt(match.offset);
+            return true;
+        });
+    }
+    result.nanoseconds = timer.nsecsElapsed();
+    Q_UNUSED(lineSum);
+    return result;
+}
+
+Result searchDecodedLines(const LineIndex &lines, const Pattern &pattern)
+{
+    Result result;
+    const QString text = QString::fromUtf8(pattern.text);
+    const Qt::CaseSensitivity caseSensitivity = pattern.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    QRegularExpression regularExpression(text, pattern.caseSensitive ? QRegularExpression::NoPatternOption
+                                                                     : QRegularExpression::CaseInsensitiveOption);
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 line = 0; line < lines.lineCount(); ++line) {
+        const QString decoded = QString::fromUtf8(lines.line(line));
+        qint64 found = 0;
+        if (pattern.regularExpression) {
+            for (QRegularExpressionMatchIterator it = regularExpression.globalMatch(decoded); it.hasNext(); it.next())
+                ++found;
+        } else {
+            for (qsizetype i = decoded.indexOf(text, 0, caseSensitivity); i >= 0;
+                 i = decoded.indexOf(text, i + text.size(), caseSensitivity)) {
+                ++found;
+            }
+        }
+        if (found > 0 && result.matches == 0)
+            result.firstNanoseconds = timer.nsecsElapsed();
+        result.matches += found;
+    }
+    result.nanoseconds = timer.nsecsElapsed();
+    return result;
+}
+
+void print(QTextStream &out, const char *method, const Result &result, qint64 bytes)
+{
+    const double megabytesPerSecond = double(bytes) / (1 << 20) / (double(result.nanoseconds) / 1e9);
+    out << "  " << QString::fromLatin1(method).leftJustified(14) << formatDuration(result.firstNanoseconds).rightJustified(10)
+        << formatDuration(result.nanoseconds).rightJustified(12)
+        << QString::number(megabytesPerSecond, 'f', 0).rightJustified(10)
+        << QString::number(result.matches).rightJustified(12) << '\n';
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(1024) << 20;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    MappedFile file;
+    if (!file.open(fileName)) {
+        out << "Cannot open " << fileName << ": " << file.errorString() << '\n';
+        return 1;
+    }
+    LineIndex lines;
+    lines.build(file.data());
+    out << "file:  " << fileName << '\n'
+        << "size:  " << QString::number(double(file.size()) / (1 << 20), 'f', 1) << " MB, "
+        << lines.lineCount() << " lines\n\n";
+
+    const Pattern patterns[] = {
+        {"method99999(", false, true},
+        {"CLASS::METHOD4242(", false, false},
+        {"fn=(123)", false, true},
+        {"method12[0-9]{3}\\(int", true, true},
+        {"^[0-9]+ [0-9]+7$", true, true},
+    };
+    for (const Pattern &pattern : patterns) {
+        out << pattern.text << (pattern.regularExpression ? " (regular expression" : " (text")
+            << (pattern.caseSensitive ? ")\n" : ", ignoring case)\n");
+        out << "  method           first        total      MB/s     matches\n";
+        print(out, "bytes", searchBytes(file.data(), lines, pattern), file.size());
+        print(out, "decoded lines", searchDecodedLines(lines, pattern), file.size());
+        out << '\n';
+    }
+    return 0;
+}
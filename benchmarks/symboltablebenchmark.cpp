@@ -0,0 +1,192 @@
+// Measures what the interned symbol tables cost against a naive model that
+// keeps names as QStrings in every function and call record.
+//
+// Usage: symboltablebenchmark [size-in-MB [function-count] | callgrind.out.file]
+// Without an argument a 256 MB profile of 500000 functions is generated in
+// the temp directory. Model sizes are computed from container capacities;
+// the anonymous RSS growth of building each model is listed next to them.
+
+#include "benchmarksupport.h"
+#include "callgrindparser.h"
+#include "callgrindprofile.h"
+#include "symboltable.h"
+
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+namespace {
+
+struct NaiveFunction {
+    QString object;
+    QString file;
+    QString name;
+};
+
+struct NaiveCall {
+    QString caller;
+    QString callee;
+    quint64 count;
+};
+
+// QString data lives in its own allocation: a 16-byte header and UTF-16
+// text with a terminator, rounded up to malloc's 16-byte granularity
+qint64 stringBytes(const QString &string)
+{
+    return qint64(sizeof(QString)) + ((16 + (string.capacity() + 1) * 2 + 8 + 15) & ~qint64(15));
+}
+
+QString megabytes(qint64 bytes)
+{
+    return QString::number(double(bytes) / (1 << 20), 'f', 1) + QStringLiteral(" MB");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    ProfileShape defaults;
+    defaults.targetBytes = qint64(256) << 20;
+    defaults.functionCount = 500000;
+    defaults.fileCount = defaults.functionCount / 50;
+    QTemporaryFile temporary;
+    const QString fileName = openOrGenerateProfile(argc, argv, defaults, &temporary);
+    if (fileName.isEmpty())
+        return 1;
+
+    const qint64 anonBefore = procStatusKb("RssAnon");
+    CallgrindProfile profile;
+    CallgrindParser parser;
+    if (!parser.parseFile(fileName, &profile)) {
+        out << "Parse failed: " << parser.errorString() << '\n';
+        return 1;
+    }
+    const qint64 anonParsed = procStatusKb("RssAnon");
+
+    const int functions = profile.functionCount();
+    out << "input:           " << megabytes(QFileInfo(fileName).size()) << ", " << functions
+        << " functions, " << profile.callCount() << " calls\n";
+
+    static const char *const kindNames[] = { "objects", "files", "functions" };
+    for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind) {
+        const SymbolTable &symbols = profile.symbols(CallgrindProfile::SymbolKind(kind));
+        const SymbolTable::MemoryUsage usage = symbols.memoryUsage();
+        out << QString::fromLatin1(kindNames[kind]).leftJustified(17) << symbols.count() << " names, "
+            << megabytes(usage.nameBytes) << " of text, " << megabytes(usage.total()) << " interned ("
+            << megabytes(usage.arenaBytes) << " arena, " << megabytes(usage.entryBytes) << " entries, "
+            << megabytes(usage.indexBytes) << " index)\n";
+    }
+
+    const CallgrindProfile::MemoryUsage model = profile.memoryUsage();
+    const double perFunction = functions > 0 ? 1.0 / functions : 0;
+    out << "interned model:  " << megabytes(model.total()) << ", names "
+        << QString::number(double(model.symbols) * perFunction, 'f', 1) << " B/function, total "
+        << QString::number(double(model.total()) * perFunction, 'f', 1) << " B/function";
+    if (anonBefore >= 0)
+        out << ", anon rss +" << megabytes((anonParsed - anonBefore) * 1024);
+    out << '\n';
+
+    // The same records with the names copied into each of them, as a model
+    // built straight from the text would hold them
+    const auto name = [&profile](CallgrindProfile::SymbolKind kind, int symbol) {
+        return QString::fromUtf8(profile.symbolName(kind, symbol));
+    };
+    QElapsedTimer timer;
+    timer.start();
+    QList<NaiveFunction> naiveFunctions;
+    naiveFunctions.reserve(functions);
+    QHash<QString, int> naiveIndex;
+    naiveIndex.reserve(functions);
+    for (int i = 0; i < functions; ++i) {
+        const CallgrindProfile::Function &f = profile.function(i);
+        naiveFunctions.append({name(CallgrindProfile::ObjectSymbol, f.object),
+                               name(CallgrindProfile::FileSymbol, f.file),
+                               name(CallgrindProfile::FunctionSymbol, f.name)});
+        naiveIndex.insert(naiveFunctions.constLast().name, i);
+    }
+    QList<NaiveCall> naiveCalls;
+    naiveCalls.reserve(profile.callCount());
+    for (int i = 0; i < profile.callCount(); ++i) {
+        const CallgrindProfile::Call &call = profile.call(i);
+        naiveCalls.append({name(CallgrindProfile::FunctionSymbol, profile.function(call.caller).name),
+                           name(CallgrindProfile::FunctionSymbol, profile.function(call.callee).name),
+                           call.count});
+    }
+    const qint64 naiveNs = timer.nsecsElapsed();
+    const qint64 anonNaive = procStatusKb("RssAnon");
+
+    qint64 naiveNames = 0;
+    for (const NaiveFunction &f : std::as_const(naiveFunctions))
+        naiveNames += stringBytes(f.object) + stringBytes(f.file) + stringBytes(f.name);
+    for (const NaiveCall &call : std::as_const(naiveCalls))
+        naiveNames += stringBytes(call.caller) + stringBytes(call.callee);
+    // The index holds shared copies of the function names
+    naiveNames += qint64(naiveIndex.capacity()) * qint64(sizeof(QString) + sizeof(int) + 1);
+    const qint64 naiveTotal = naiveNames + model.total() - model.symbols;
+    out << "naive model:     " << megabytes(naiveTotal) << ", names "
+        << QString::number(double(naiveNames) * perFunction, 'f', 1) << " B/function, total "
+        << QString::number(double(naiveTotal) * perFunction, 'f', 1) << " B/function";
+    if (anonBefore >= 0)
+        out << ", anon rss +" << megabytes((anonNaive - anonParsed) * 1024) << " for the names";
+    out << ", built in " << formatDuration(naiveNs) << '\n';
+    out << "saving:          " << megabytes(naiveTotal - model.total()) << ", "
+        << QString::number(double(naiveTotal) / double(qMax<qint64>(1, model.total())), 'f', 2)
+        << "x smaller\n";
+
+    // Interning speed: every function record's names looked up again, as the
+    // parser does for each fn= line, in a fresh table and in the QHash of
+    // QByteArray copies the profile used before
+    QList<QByteArrayView> lookups;
+    lookups.reserve(qsizetype(functions) * 3);
+    for (int i = 0; i < functions; ++i) {
+        const CallgrindProfile::Function &f = profile.function(i);
+        lookups.append(profile.symbolName(CallgrindProfile::ObjectSymbol, f.object));
+        lookups.append(profile.symbolName(CallgrindProfile::FileSymbol, f.file));
+        lookups.append(profile.symbolName(CallgrindProfile::FunctionSymbol, f.name));
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        SymbolTable table;
+        timer.restart();
+        qint64 checksum = 0;
+        for (int round = 0; round < 2; ++round) {
+            for (const QByteArrayView view : std::as_const(lookups))
+                checksum += table.insert(view);
+        }
+        const qint64 tableNs = timer.nsecsElapsed();
+
+        QList<QByteArray> names;
+        QHash<QByteArray, int> index;
+        timer.restart();
+        qint64 hashChecksum = 0;
+        for (int round = 0; round < 2; ++round) {
+            for (const QByteArrayView view : std::as_const(lookups)) {
+                const auto it = index.constFind(QByteArray::fromRawData(view.data(), view.size()));
+                if (it != index.cend()) {
+                    hashChecksum += it.value();
+                } else {
+                    const int symbol = int(names.size());
+                    names.append(view.toByteArray());
+                    index.insert(names.constLast(), symbol);
+                    hashChecksum += symbol;
+                }
+            }
+        }
+        const qint64 hashNs = timer.nsecsElapsed();
+        if (pass == 0)
+            continue; // Warm-up
+        out << "intern:          " << lookups.size() * 2 << " lookups, SymbolTable "
+            << formatDuration(tableNs) << ", QHash<QByteArray, int> "
+            << formatDuration(hashNs)
+            << (checksum == hashChecksum ? "" : ", MISMATCH") << '\n';
+        if (checksum != hashChecksum)
+            return 1;
+    }
+    out << "peak rss:        " << procStatusKb("VmHWM") << " kB\n";
+    return 0;
+}
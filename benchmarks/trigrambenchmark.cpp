@@ -0,0 +1,149 @@
+// Measures filtering function names through a TrigramIndex against a linear
+// scan of every name, as a filter box does when typing.
+//
+// Usage: trigrambenchmark [symbol-count]
+// Without an argument 1000000 synthetic demangled C++ names are interned.
+// Every query is also timed prefix by prefix, the way it is typed, from the
+// third character on; shorter text has no trigram and is scanned either way.
+// The index results are checked against the scan.
+
+#include "benchmarksupport.h"
+#include "symboltable.h"
+#include "trigramindex.h"
+
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+namespace {
+
+const char *const Namespaces[] = {
+    "std", "boost", "llvm", "clang", "Qt", "app", "core", "detail", "impl", "net", "io", "gfx",
+};
+
+const char *const Words[] = {
+    "Parser", "Lexer", "Token", "Stream", "Buffer", "Node", "Graph", "Cost", "Event", "Profile",
+    "Cache", "Symbol", "Table", "Index", "Reader", "Writer", "Model", "View", "Layout", "Socket",
+};
+
+const char *const Parameters[] = {
+    "", "int", "char const*", "std::string const&", "unsigned long, bool", "void*, unsigned long",
+};
+
+template <typename T, size_t N>
+const T &pick(QRandomGenerator &random, const T (&values)[N])
+{
+    return values[random.bounded(int(N))];
+}
+
+// Names shaped like demangled C++: nested namespaces, a class, a method
+// with a number to make it unique, and a parameter list
+QByteArray syntheticName(QRandomGenerator &random)
+{
+    QByteArray name;
+    const int depth = 1 + random.bounded(3);
+    for (int i = 0; i < depth; ++i)
+        name += QByteArray(pick(random, Namespaces)) + "::";
+    name += pick(random, Words);
+    name += pick(random, Words);
+    name += "::";
+    name += random.bounded(2) ? "get" : "update";
+    name += pick(random, Words);
+    name += QByteArray::number(random.bounded(100000));
+    name += '(';
+    name += pick(random, Parameters);
+    name += ')';
+    return name;
+}
+
+char toLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+// The scan the index replaces: every name, compared ignoring ASCII case
+QList<int> scan(const SymbolTable &symbols, const QByteArray &text)
+{
+    QByteArray lower = text;
+    for (char &c : lower)
+        c = toLowerAscii(c);
+    QList<int> result;
+    for (int symbol = 0; symbol < symbols.count(); ++symbol) {
+        const QByteArrayView name = symbols.name(symbol);
+        for (qsizetype i = 0; i + lower.size() <= name.size(); ++i) {
+            qsizetype j = 0;
+            while (j < lower.size() && toLowerAscii(name.at(i + j)) == lower.at(j))
+                ++j;
+            if (j == lower.size()) {
+                result.append(symbol);
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    const int symbolCount = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+
+    SymbolTable symbols;
+    QRandomGenerator random(42);
+    while (symbols.count() < symbolCount)
+        symbols.insert(syntheticName(random));
+
+    QElapsedTimer timer;
+    timer.start();
+    TrigramIndex index;
+    index.build(symbols);
+    out << "symbols: " << symbols.count() << '\n'
+        << "build:   " << formatDuration(timer.nsecsElapsed()) << '\n'
+        << "memory:  " << QString::number(double(index.memoryUsage()) / (1 << 20), 'f', 1) << " MB, symbol table "
+        << QString::number(double(symbols.memoryUsage().total()) / (1 << 20), 'f', 1) << " MB\n\n";
+
+    const char *const queries[] = {
+        "parsertoken", "getCache4242", "updateSocketIndex7", "LLVM::", "cacheview", "(void*, unsigned long)",
+        "xyzzy",
+    };
+    out << "query                    matches  candidates      index       scan     typed index     typed scan\n";
+    bool mismatch = false;
+    for (const char *query : queries) {
+        const QByteArray text(query);
+        qsizetype candidates = 0;
+        timer.restart();
+        const QList<int> found = index.find(symbols, text, &candidates);
+        const qint64 indexNanoseconds = timer.nsecsElapsed();
+        timer.restart();
+        const QList<int> expected = scan(symbols, text);
+        const qint64 scanNanoseconds = timer.nsecsElapsed();
+        mismatch = mismatch || found != expected;
+
+        // Every keystroke filters again
+        qint64 typedIndexNanoseconds = 0;
+        qint64 typedScanNanoseconds = 0;
+        for (qsizetype length = 3; length <= text.size(); ++length) {
+            const QByteArray prefix = text.left(length);
+            timer.restart();
+            const QList<int> prefixFound = index.find(symbols, prefix);
+            typedIndexNanoseconds += timer.nsecsElapsed();
+            timer.restart();
+            const QList<int> prefixExpected = scan(symbols, prefix);
+            typedScanNanoseconds += timer.nsecsElapsed();
+            mismatch = mismatch || prefixFound != prefixExpected;
+        }
+
+        out << QString::fromLatin1(query).leftJustified(24) << QString::number(found.size()).rightJustified(8)
+            << QString::number(candidates).rightJustified(12) << formatDuration(indexNanoseconds).rightJustified(11)
+            << formatDuration(scanNanoseconds).rightJustified(11)
+            << formatDuration(typedIndexNanoseconds).rightJustified(16)
+            << formatDuration(typedScanNanoseconds).rightJustified(15) << '\n';
+    }
+    if (mismatch) {
+        out << "\nThe index and the scan disagree\n";
+        return 1;
+    }
+    return 0;
+}
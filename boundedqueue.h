@@ -0,0 +1,62 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+// Blocking single-producer/single-consumer queue with a fixed capacity, so a
+// fast producer cannot run arbitrarily far ahead of its consumer.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(qsizetype capacity) : m_capacity(capacity) {}
+
+    // Waits while the queue is full. Returns false once the queue is closed.
+    bool push(T value)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.size() >= m_capacity && !m_closed)
+            m_notFull.wait(&m_mutex);
+        if (m_closed)
+            return false;
+        m_items.enqueue(std::move(value));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    // Waits while the queue is empty. Returns false once it is closed and
+    // everything pushed before has been taken.
+    bool pop(T *value)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.isEmpty() && !m_closed)
+            m_notEmpty.wait(&m_mutex);
+        if (m_items.isEmpty())
+            return false;
+        *value = m_items.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    // Ends the stream: the producer when it has no more items, the consumer
+    // to make the producer give up.
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<T> m_items;
+    const qsizetype m_capacity;
+    bool m_closed = false;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,328 @@
+#include "callgraph.h"
+
+#include <QSet>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+// Arcs added by update() are merged into the compressed rows once they come
+// to this share of them
+static const int AdjacencyFoldShare = 8;
+
+// Compressed sparse rows: offsets[f]..offsets[f + 1] index into arcs
+static void buildRows(const CallgrindProfile &profile, bool outgoing, QList<int> *offsets, QList<int> *arcs)
+{
+    const int functionCount = profile.functionCount();
+    offsets->fill(0, functionCount + 1);
+    for (int i = 0; i < profile.callCount(); ++i) {
+        const CallgrindProfile::Call &call = profile.call(i);
+        ++(*offsets)[(outgoing ? call.caller : call.callee) + 1];
+    }
+    for (int f = 0; f < functionCount; ++f)
+        (*offsets)[f + 1] += offsets->at(f);
+
+    QList<int> next(offsets->cbegin(), offsets->cend() - 1);
+    arcs->resize(profile.callCount());
+    for (int i = 0; i < profile.callCount(); ++i) {
+        const CallgrindProfile::Call &call = profile.call(i);
+        (*arcs)[next[outgoing ? call.caller : call.callee]++] = i;
+    }
+}
+
+void CallGraph::clear()
+{
+    *this = CallGraph();
+}
+
+void CallGraph::buildAdjacency()
+{
+    buildRows(*m_profile, true, &m_callees.offsets, &m_callees.arcs);
+    buildRows(*m_profile, false, &m_callers.offsets, &m_callers.arcs);
+    for (Adjacency *adjacency : {&m_callees, &m_callers}) {
+        adjacency->added.clear();
+        adjacency->addedCount = 0;
+    }
+}
+
+void CallGraph::build(const CallgrindProfile &profile)
+{
+    clear();
+    m_profile = &profile;
+    m_eventCount = profile.eventCount();
+    buildAdjacency();
+
+    QList<int> components;
+    int componentCount = 0;
+    findComponents(&components, &componentCount);
+
+    // Members by component; Tarjan's numbering is a topological order
+    const int functionCount = profile.functionCount();
+    QList<int> componentSize(componentCount, 0);
+    for (int f = 0; f < functionCount; ++f) {
+        ++componentSize[components.at(f)];
+        m_components.append(components.at(f));
+    }
+    QList<int> next(componentCount);
+    m_memberOffsets.append(0);
+    for (int c = 0; c < componentCount; ++c) {
+        next[c] = m_memberOffsets.constLast();
+        m_memberOffsets.append(next.at(c) + componentSize.at(c));
+        m_order.append(c);
+    }
+    m_members.resize(functionCount);
+    for (int f = 0; f < functionCount; ++f)
+        m_members[next[components.at(f)]++] = f;
+
+    // Component cost: self cost of the members plus every arc leaving it
+    QList<quint64> componentCosts(qsizetype(componentCount) * m_eventCount, 0);
+    for (int f = 0; f < functionCount; ++f) {
+        quint64 *costs = componentCosts.data() + qsizetype(components.at(f)) * m_eventCount;
+        const quint64 *self = profile.selfCosts(f);
+        for (int e = 0; e < m_eventCount; ++e)
+            costs[e] += self[e];
+    }
+    for (int i = 0; i < profile.callCount(); ++i) {
+        const CallgrindProfile::Call &call = profile.call(i);
+        const int component = components.at(call.caller);
+        if (component == components.at(call.callee))
+            continue;
+        quint64 *costs = componentCosts.data() + qsizetype(component) * m_eventCount;
+        const quint64 *arc = profile.callCosts(i);
+        for (int e = 0; e < m_eventCount; ++e)
+            costs[e] += arc[e];
+    }
+
+    m_inclusiveCosts.setWidth(m_eventCount);
+    m_inclusiveCosts.resize(functionCount);
+    m_cycles.fill(-1, functionCount);
+    QList<int> componentCycle(componentCount, -1);
+    for (int f = 0; f < functionCount; ++f) {
+        const int component = components.at(f);
+        std::copy_n(componentCosts.constData() + qsizetype(component) * m_eventCount, m_eventCount,
+                    m_inclusiveCosts.rowData(f));
+        if (componentSize.at(component) > 1) {
+            if (componentCycle.at(component) < 0)
+                componentCycle[component] = m_cycleCount++;
+            m_cycles[f] = componentCycle.at(component);
+        }
+    }
+}
+
+// Iterative Tarjan, so deep call chains cannot overflow the stack
+void CallGraph::findComponents(QList<int> *components, int *componentCount) const
+{
+    struct Frame {
+        int function;
+        int nextArc;
+    };
+
+    const QList<int> &offsets = m_callees.offsets;
+    const QList<int> &arcs = m_callees.arcs;
+    const int functionCount = m_profile->functionCount();
+    QList<int> order(functionCount, -1);
+    QList<int> lowLink(functionCount, 0);
+    QList<bool> onStack(functionCount, false);
+    QList<int> stack;
+    QList<Frame> frames;
+    components->fill(-1, functionCount);
+    *componentCount = 0;
+    int visited = 0;
+
+    const auto visit = [&](int function) {
+        order[function] = lowLink[function] = visited++;
+        stack.append(function);
+        onStack[function] = true;
+        frames.append({function, offsets.at(function)});
+    };
+
+    for (int root = 0; root < functionCount; ++root) {
+        if (order.at(root) >= 0)
+            continue;
+        visit(root);
+        while (!frames.isEmpty()) {
+            const int function = frames.last().function;
+            if (frames.last().nextArc < offsets.at(function + 1)) {
+                const int callee = m_profile->call(arcs.at(frames.last().nextArc++)).callee;
+                if (order.at(callee) < 0)
+                    visit(callee);
+                else if (onStack.at(callee))
+                    lowLink[function] = qMin(lowLink.at(function), order.at(callee));
+                continue;
+            }
+
+            frames.removeLast();
+            if (!frames.isEmpty()) {
+                const int caller = frames.last().function;
+                lowLink[caller] = qMin(lowLink.at(caller), lowLink.at(function));
+            }
+            if (lowLink.at(function) == order.at(function)) {
+                int member;
+                do {
+                    member = stack.takeLast();
+                    onStack[member] = false;
+                    (*components)[member] = *componentCount;
+                } while (member != function);
+                ++*componentCount;
+            }
+        }
+    }
+}
+
+bool CallGraph::update(const CallgrindProfile &profile, const CallGraph &previous,
+                       const QList<int> &changedCalls, QList<int> *changedFunctions)
+{
+    const CallgrindProfile *before = previous.m_profile;
+    if (!before || profile.eventNames() != before->eventNames()
+        || profile.functionCount() < before->functionCount() || profile.callCount() < before->callCount()) {
+        build(profile);
+        return false;
+    }
+
+    *this = previous;
+    m_profile = &profile;
+    for (int function = before->functionCount(); function < profile.functionCount(); ++function)
+        addComponent(function);
+    for (int call = before->callCount(); call < profile.callCount(); ++call) {
+        if (!addArc(call)) {
+            build(profile);
+            return false;
+        }
+    }
+    if (qsizetype(m_callees.addedCount) * AdjacencyFoldShare > m_callees.arcs.size())
+        buildAdjacency();
+
+    // A component's cost changes with the self cost of a member or the cost
+    // of an arc leaving it
+    QSet<int> components;
+    for (const int function : std::as_const(*changedFunctions))
+        components.insert(m_components.at(function));
+    for (const int call : changedCalls)
+        components.insert(m_components.at(profile.call(call).caller));
+
+    changedFunctions->clear();
+    for (const int component : std::as_const(components)) {
+        computeCosts(component);
+        for (int i = m_memberOffsets.at(component); i < m_memberOffsets.at(component + 1); ++i)
+            changedFunctions->append(m_members.at(i));
+    }
+    std::sort(changedFunctions->begin(), changedFunctions->end());
+    return true;
+}
+
+// A new function starts out as a component of its own, placed below all
+// others: it has no arcs yet
+void CallGraph::addComponent(int function)
+{
+    const int component = int(m_memberOffsets.size() - 1);
+    m_components.append(component);
+    m_members.append(function);
+    m_memberOffsets.append(int(m_members.size()));
+    m_order.append(--m_lowestOrder);
+    m_cycles.append(-1);
+    m_inclusiveCosts.resize(function + 1, 0);
+}
+
+bool CallGraph::addArc(int call)
+{
+    const CallgrindProfile::Call &arc = m_profile->call(call);
+    m_callees.added[arc.caller].append(call);
+    ++m_callees.addedCount;
+    m_callers.added[arc.callee].append(call);
+    ++m_callers.addedCount;
+
+    const int caller = m_components.at(arc.caller);
+    const int callee = m_components.at(arc.callee);
+    if (caller == callee || m_order.at(caller) > m_order.at(callee))
+        return true;
+    return reorder(caller, callee);
+}
+
+// Pearce and Kelly: the new arc from the component \a caller to \a callee
+// goes up the order. The components the callee reaches that are placed
+// above the caller, and those reaching the caller that are placed below
+// the callee, are the only ones out of place; they swap places, callee side
+// first, keeping their order within each side. Fails if the callee reaches
+// the caller, that is if the arc closed a cycle.
+bool CallGraph::reorder(int caller, int callee)
+{
+    const int lower = m_order.at(caller);
+    const int upper = m_order.at(callee);
+
+    // Everything found lies between the two, the arc aside
+    const auto search = [this, lower, upper](int start, const Adjacency &adjacency, bool forward, int target,
+                                             QList<int> *found) {
+        QSet<int> seen;
+        seen.insert(start);
+        QList<int> stack{start};
+        while (!stack.isEmpty()) {
+            const int component = stack.takeLast();
+            found->append(component);
+            for (int i = m_memberOffsets.at(component); i < m_memberOffsets.at(component + 1); ++i) {
+                const int function = m_members.at(i);
+                for (int a = 0; a < adjacency.count(function); ++a) {
+                    const CallgrindProfile::Call &call = m_profile->call(adjacency.arc(function, a));
+                    const int next = m_components.at(forward ? call.callee : call.caller);
+                    if (next == target)
+                        return false;
+                    const int order = m_order.at(next);
+                    if (order > lower && order < upper && !seen.contains(next)) {
+                        seen.insert(next);
+                        stack.append(next);
+                    }
+                }
+            }
+        }
+        return true;
+    };
+
+    QList<int> below;
+    QList<int> above;
+    if (!search(callee, m_callees, true, caller, &below))
+        return false;
+    search(caller, m_callers, false, -1, &above);
+
+    const auto byOrder = [this](int a, int b) { return m_order.at(a) < m_order.at(b); };
+    std::sort(below.begin(), below.end(), byOrder);
+    std::sort(above.begin(), above.end(), byOrder);
+    QList<int> places;
+    for (const QList<int> *side : {&below, &above}) {
+        for (const int component : *side)
+            places.append(m_order.at(component));
+    }
+    std::sort(places.begin(), places.end());
+    qsizetype place = 0;
+    for (const QList<int> *side : {&below, &above}) {
+        for (const int component : *side)
+            m_order[component] = places.at(place++);
+    }
+    return true;
+}
+
+void CallGraph::computeCosts(int component)
+{
+    QVarLengthArray<quint64, 16> costs(m_eventCount);
+    std::fill(costs.begin(), costs.end(), 0);
+    const int first = m_memberOffsets.at(component);
+    const int end = m_memberOffsets.at(component + 1);
+    for (int i = first; i < end; ++i) {
+        const int function = m_members.at(i);
+        const quint64 *self = m_profile->selfCosts(function);
+        for (int e = 0; e < m_eventCount; ++e)
+            costs[e] += self[e];
+        for (int a = 0; a < m_callees.count(function); ++a) {
+            const int call = m_callees.arc(function, a);
+            if (m_components.at(m_profile->call(call).callee) == component)
+                continue;
+            const quint64 *arc = m_profile->callCosts(call);
+            for (int e = 0; e < m_eventCount; ++e)
+                costs[e] += arc[e];
+        }
+    }
+
+    // Rows that come out the same are left shared
+    for (int i = first; i < end; ++i) {
+        const int function = m_members.at(i);
+        if (!std::equal(costs.cbegin(), costs.cend(), m_inclusiveCosts.constRowData(function)))
+            std::copy(costs.cbegin(), costs.cend(), m_inclusiveCosts.rowData(function));
+    }
+}
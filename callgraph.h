@@ -0,0 +1,121 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include "callgrindprofile.h"
+#include "chunkedarray.h"
+
+#include <QHash>
+#include <QList>
+
+// Caller/callee adjacency and inclusive costs over a CallgrindProfile.
+//
+// Callgrind records the inclusive cost of every call arc, so a function's
+// inclusive cost is its self cost plus the cost of the arcs it makes. That
+// double counts under recursion: an arc inside a cycle already contains the
+// nested calls of the cycle. Strongly connected components are therefore
+// collapsed first, and each function reports the inclusive cost of its
+// component: the self cost of all members plus the arcs leaving it. Members
+// of a recursive cycle share that cost, as in KCachegrind's cycle detection.
+//
+// Building is O(V + E). The graph refers to the profile, which must outlive
+// it and stay unchanged.
+//
+// A live tail continues the graph of the previous profile with update(),
+// which shares its arrays and only works on the functions and calls that
+// changed: new arcs are kept apart from the compressed rows until they make
+// up a good share of them, and the components stay in a topological order
+// that is repaired around each new arc (Pearce and Kelly's algorithm), so
+// that only an arc closing a new cycle has them found again.
+class CallGraph
+{
+public:
+    void build(const CallgrindProfile &profile);
+    // Builds the graph of \a profile, a copy of the profile of \a previous
+    // that went on with the same events, from \a previous: arcs are added
+    // for the new calls, and the inclusive costs computed again for the
+    // components that hold a function in \a changedFunctions or make a call
+    // in \a changedCalls, as CallgrindProfile::changedFunctions() and
+    // changedCalls() list them. The functions of those components are added
+    // to \a changedFunctions. Returns false if the graph had to be built in
+    // full instead, as when a new arc closes a cycle.
+    bool update(const CallgrindProfile &profile, const CallGraph &previous,
+                const QList<int> &changedCalls, QList<int> *changedFunctions);
+    void clear();
+
+    const CallgrindProfile *profile() const { return m_profile; }
+    int functionCount() const { return m_profile ? m_profile->functionCount() : 0; }
+    int eventCount() const { return m_eventCount; }
+
+    // Outgoing and incoming arcs, as call indices into the profile, in the
+    // order of the calls
+    int calleeCount(int function) const { return m_callees.count(function); }
+    int calleeCall(int function, int i) const { return m_callees.arc(function, i); }
+    int callerCount(int function) const { return m_callers.count(function); }
+    int callerCall(int function, int i) const { return m_callers.arc(function, i); }
+
+    quint64 selfCost(int function, int event) const { return m_profile->selfCost(function, event); }
+    quint64 inclusiveCost(int function, int event) const { return inclusiveCosts(function)[event]; }
+    const quint64 *inclusiveCosts(int function) const { return m_inclusiveCosts.constRowData(function); }
+
+    // Recursive cycles are components of more than one function; -1 for a
+    // function outside any cycle. Direct self-recursion is not a cycle, the
+    // self arc is simply not counted.
+    int cycleCount() const { return m_cycleCount; }
+    int cycle(int function) const { return m_cycles.at(function); }
+
+private:
+    // Arcs by function: compressed sparse rows for the calls known when
+    // they were built, offsets[f]..offsets[f + 1] indexing into arcs, then
+    // those added since, per function
+    struct Adjacency {
+        QList<int> offsets;
+        QList<int> arcs;
+        QHash<int, QList<int>> added;
+        int addedCount = 0;
+
+        int builtCount(int function) const
+        { return function + 1 < offsets.size() ? offsets.at(function + 1) - offsets.at(function) : 0; }
+        int count(int function) const
+        {
+            if (added.isEmpty())
+                return builtCount(function);
+            const auto it = added.constFind(function);
+            return builtCount(function) + (it != added.cend() ? int(it.value().size()) : 0);
+        }
+        int arc(int function, int i) const
+        {
+            const int built = builtCount(function);
+            if (i < built)
+                return arcs.at(offsets.at(function) + i);
+            return added.constFind(function).value().at(i - built);
+        }
+    };
+
+    void buildAdjacency();
+    void findComponents(QList<int> *components, int *componentCount) const;
+    void addComponent(int function);
+    bool addArc(int call);
+    bool reorder(int caller, int callee);
+    void computeCosts(int component);
+
+    const CallgrindProfile *m_profile = nullptr;
+    int m_eventCount = 0;
+
+    Adjacency m_callees;
+    Adjacency m_callers;
+
+    // Strongly connected components, numbered by Tarjan's algorithm, with
+    // their members as compressed sparse rows, and their place in an order
+    // where every arc between two of them goes to a lower place
+    ChunkedArray<int> m_components;
+    ChunkedArray<int> m_memberOffsets;
+    ChunkedArray<int> m_members;
+    ChunkedArray<int> m_order;
+    int m_lowestOrder = 0;
+
+    ChunkedArray<quint64> m_inclusiveCosts;
+    ChunkedArray<int> m_cycles;
+    int m_cycleCount = 0;
+};
+
+#endif // CALLGRAPH_H
@@ -0,0 +1,132 @@
+#include "callgraphlayout.h"
+#include "callgraph.h"
+#include "flatprofile.h"
+
+#include <QBitArray>
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Orders the nodes of a layer by their barycenters and spreads them to one
+// slot apart, keeping the layer centered under the nodes that reach it
+void place(QList<CallGraphLayout::Node> &nodes, const QList<double> &barycenters)
+{
+    QList<int> order(nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        if (barycenters.at(a) != barycenters.at(b))
+            return barycenters.at(a) < barycenters.at(b);
+        return nodes.at(a).function < nodes.at(b).function;
+    });
+
+    double shift = 0;
+    double previous = 0;
+    for (qsizetype i = 0; i < order.size(); ++i) {
+        const int node = order.at(i);
+        const double x = i == 0 ? barycenters.at(node) : qMax(barycenters.at(node), previous + 1);
+        nodes[node].x = x;
+        shift += x - barycenters.at(node);
+        previous = x;
+    }
+    shift /= qMax<qsizetype>(1, nodes.size());
+    for (CallGraphLayout::Node &node : nodes)
+        node.x -= shift;
+}
+
+} // namespace
+
+bool CallGraphLayout::run(const CallGraph &graph, const FlatProfile &flat, int function,
+                          const LayerCallback &callback) const
+{
+    const CallgrindProfile &profile = *graph.profile();
+    quint64 minCost = quint64(m_threshold * double(flat.inclusiveCosts(m_event).at(function)));
+    if (m_threshold > 0 && minCost == 0)
+        minCost = 1;
+
+    // The arcs onwards from a function, towards its callees or its callers
+    const auto arcCount = [&graph](int f, bool callees) {
+        return callees ? graph.calleeCount(f) : graph.callerCount(f);
+    };
+    const auto arc = [&graph](int f, bool callees, int i) {
+        return callees ? graph.calleeCall(f, i) : graph.callerCall(f, i);
+    };
+    const auto prunedCalls = [&](int f, bool callees) {
+        int pruned = 0;
+        for (int i = 0; i < arcCount(f, callees); ++i) {
+            const int call = arc(f, callees, i);
+            const CallgrindProfile::Call &c = profile.call(call);
+            pruned += c.caller != c.callee && flat.callCost(call, m_event) < minCost;
+        }
+        return pruned;
+    };
+
+    // Node of every placed function, or -1; functions and positions of the
+    // nodes; arcs already reported, which both directions can reach
+    QList<int> nodeOf(graph.functionCount(), -1);
+    QList<int> functions;
+    QList<double> positions;
+    QBitArray reported(profile.callCount());
+
+    const Node root{function, 0, 0, prunedCalls(function, true) + prunedCalls(function, false)};
+    nodeOf[function] = 0;
+    functions.append(function);
+    positions.append(0);
+    if (!callback({root}, {}))
+        return false;
+
+    // Places the next layer beyond \a frontier, which then holds its nodes
+    const auto expand = [&](QList<int> *frontier, int layer, bool callees) {
+        const int first = int(functions.size());
+        QList<Node> nodes;
+        QList<Edge> edges;
+        QList<double> barycenters;
+        QList<int> parents;
+        for (const int source : std::as_const(*frontier)) {
+            const int f = functions.at(source);
+            for (int i = 0; i < arcCount(f, callees); ++i) {
+                const int call = arc(f, callees, i);
+                const CallgrindProfile::Call &c = profile.call(call);
+                const quint64 cost = flat.callCost(call, m_event);
+                if (c.caller == c.callee || cost < minCost || reported.testBit(call))
+                    continue;
+                reported.setBit(call);
+                const int other = callees ? c.callee : c.caller;
+                int &node = nodeOf[other];
+                if (node < 0) {
+                    node = first + int(nodes.size());
+                    nodes.append({other, layer, 0, prunedCalls(other, callees)});
+                    barycenters.append(0);
+                    parents.append(0);
+                }
+                if (node >= first) {
+                    barycenters[node - first] += positions.at(source);
+                    ++parents[node - first];
+                }
+                edges.append(callees ? Edge{source, node, call, cost} : Edge{node, source, call, cost});
+            }
+        }
+
+        for (qsizetype i = 0; i < nodes.size(); ++i)
+            barycenters[i] /= parents.at(i);
+        place(nodes, barycenters);
+        frontier->clear();
+        for (const Node &node : std::as_const(nodes)) {
+            frontier->append(int(functions.size()));
+            functions.append(node.function);
+            positions.append(node.x);
+        }
+        return nodes.isEmpty() && edges.isEmpty() ? true : callback(nodes, edges);
+    };
+
+    QList<int> calleeFrontier{0};
+    QList<int> callerFrontier{0};
+    for (int depth = 1; !calleeFrontier.isEmpty() || !callerFrontier.isEmpty(); ++depth) {
+        if (!calleeFrontier.isEmpty() && !expand(&calleeFrontier, depth, true))
+            return false;
+        if (!callerFrontier.isEmpty() && !expand(&callerFrontier, -depth, false))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef CALLGRAPHLAYOUT_H
+#define CALLGRAPHLAYOUT_H
+
+#include <QList>
+
+#include <functional>
+
+class CallGraph;
+class FlatProfile;
+
+// The call graph around one function, laid out in layers: the function in
+// layer 0, its callees in layers 1, 2, ... and its callers in layers -1,
+// -2, ... Every function is placed once, in the first layer that reaches
+// it. Arcs whose inclusive cost is below a share of the function's own
+// inclusive cost are pruned, along with whatever only they lead to, so the
+// part of a large graph that is laid out is the part that matters.
+//
+// run() produces the layers one at a time, alternating between callees and
+// callers, and hands each to a callback as soon as it is placed. A layer is
+// ordered by the mean position of the nodes that reach it from the layer
+// before, then spread to one slot per node. x is in slots, centered on the
+// function.
+class CallGraphLayout
+{
+public:
+    struct Node {
+        int function;
+        int layer;
+        double x;
+        // Arcs onwards from this node that were pruned
+        int prunedCalls;
+    };
+
+    struct Edge {
+        int caller; // Node indexes, in the order nodes are produced
+        int callee;
+        int call; // Call index in the profile
+        quint64 cost;
+    };
+
+    // Receives the nodes of one more layer and the edges found with them,
+    // which may also connect nodes of earlier layers. Returns false to stop.
+    using LayerCallback = std::function<bool(const QList<Node> &nodes, const QList<Edge> &edges)>;
+
+    void setEvent(int event) { m_event = event; }
+    int event() const { return m_event; }
+    // Share of the function's inclusive cost an arc needs to be kept; 0
+    // keeps every arc
+    void setThreshold(double threshold) { m_threshold = threshold; }
+    double threshold() const { return m_threshold; }
+
+    // Lays out the graph around \a function. Returns false if the callback
+    // stopped it.
+    bool run(const CallGraph &graph, const FlatProfile &flat, int function, const LayerCallback &callback) const;
+
+private:
+    int m_event = 0;
+    double m_threshold = 0.01;
+};
+
+#endif // CALLGRAPHLAYOUT_H
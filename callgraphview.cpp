@@ -0,0 +1,620 @@
+#include "callgraphview.h"
+#include "profiledocument.h"
+#include "tracer.h"
+
+#include <QHelpEvent>
+#include <QKeyEvent>
+#include <QLocale>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QSet>
+#include <QToolTip>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+// Scene geometry, in pixels at zoom 1: nodes sit in slots of a layer
+static const double SlotWidth = 200;
+static const double NodeWidth = 180;
+static const double NodeHeight = 40;
+static const double LayerHeight = 120;
+static const double Margin = 200;
+
+static const double MinZoom = 0.002;
+static const double MaxZoom = 4;
+static const double ZoomStep = 1.25;
+// Below these zoom levels node labels, arcs and arc labels are left out
+static const double LabelZoom = 0.45;
+static const double ArcZoom = 0.05;
+static const double ArcLabelZoom = 0.8;
+
+// Layers are handed over in batches at most this old, the function itself
+// on its own
+static const qint64 BatchInterval = 100; // ms
+
+// Green for cheap, red for the function's own inclusive cost and above
+static QColor costColor(double share)
+{
+    return QColor::fromHsvF(0.33 * (1 - std::sqrt(qBound(0.0, share, 1.0))), 0.45, 1.0);
+}
+
+CallGraphView::CallGraphView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+{
+    m_pool.setMaxThreadCount(1);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setAutoFillBackground(true);
+}
+
+CallGraphView::~CallGraphView()
+{
+    cancel();
+}
+
+void CallGraphView::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    m_document = document;
+    m_function = -1;
+    relayout();
+}
+
+void CallGraphView::updateDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    const QSharedPointer<const ProfileDocument> previous = m_document;
+    m_document = document;
+    if (!m_document || !m_document->hasProfile() || m_function >= m_document->profile().functionCount()) {
+        m_function = -1;
+        relayout();
+        return;
+    }
+    // Node costs are read from the document when painting
+    if (previous && previous->hasProfile() && hasSameArcs(*previous)) {
+        viewport()->update();
+        return;
+    }
+    relayout(true);
+}
+
+void CallGraphView::setFunction(int function)
+{
+    if (function == m_function)
+        return;
+    m_function = function;
+    relayout();
+}
+
+void CallGraphView::setEvent(int event)
+{
+    if (event == m_event)
+        return;
+    m_event = event;
+    relayout();
+}
+
+void CallGraphView::setThreshold(double threshold)
+{
+    if (threshold == m_threshold)
+        return;
+    m_threshold = threshold;
+    relayout();
+}
+
+void CallGraphView::cancel()
+{
+    // The worker stops after its current layer; whatever it sent is ignored
+    if (m_cancelFlag)
+        m_cancelFlag->storeRelaxed(1);
+    m_cancelFlag.reset();
+    ++m_generation;
+    m_layingOut = false;
+}
+
+void CallGraphView::clearScene()
+{
+    m_nodes.clear();
+    m_edges.clear();
+    m_nodeEdges.clear();
+    m_layers.clear();
+    m_minX = m_maxX = 0;
+    m_replacing = false;
+    m_pendingNodes.clear();
+    m_pendingEdges.clear();
+    m_heldScene = QRectF();
+}
+
+// Whether laying out the function again would give the graph shown, which
+// was laid out in \a previous: every arc of a node shown, pruned or not, is
+// there with the same cost, and so is the function's inclusive cost, which
+// the threshold is relative to
+bool CallGraphView::hasSameArcs(const ProfileDocument &previous) const
+{
+    if (m_layingOut || m_nodes.isEmpty())
+        return false;
+    const FlatProfile &before = previous.flatProfile();
+    const FlatProfile &after = m_document->flatProfile();
+    if (after.eventNames() != before.eventNames()
+        || after.inclusiveCosts(m_event).at(m_function) != before.inclusiveCosts(m_event).at(m_function)) {
+        return false;
+    }
+    const CallGraph &oldGraph = previous.callGraph();
+    const CallGraph &graph = m_document->callGraph();
+    for (const CallGraphLayout::Node &node : m_nodes) {
+        const int function = node.function;
+        if (graph.calleeCount(function) != oldGraph.calleeCount(function)
+            || graph.callerCount(function) != oldGraph.callerCount(function)) {
+            return false;
+        }
+        for (int i = 0; i < graph.calleeCount(function); ++i) {
+            const int call = graph.calleeCall(function, i);
+            if (call != oldGraph.calleeCall(function, i)
+                || after.callCost(call, m_event) != before.callCost(call, m_event)) {
+                return false;
+            }
+        }
+        for (int i = 0; i < graph.callerCount(function); ++i) {
+            const int call = graph.callerCall(function, i);
+            if (call != oldGraph.callerCall(function, i)
+                || after.callCost(call, m_event) != before.callCost(call, m_event)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void CallGraphView::relayout(bool keepScene)
+{
+    cancel();
+    if (keepScene && !m_nodes.isEmpty()) {
+        m_replacing = true;
+        m_pendingNodes.clear();
+        m_pendingEdges.clear();
+        m_heldScene = sceneRect();
+    } else {
+        clearScene();
+        m_rootCost = 0;
+        updateScrollBars();
+    }
+    m_layoutMilliseconds = -1;
+    viewport()->update();
+    if (!m_document || !m_document->hasProfile() || m_function < 0
+        || m_function >= m_document->profile().functionCount()) {
+        return;
+    }
+
+    const FlatProfile &flat = m_document->flatProfile();
+    if (m_event < 0 || m_event >= flat.eventCount())
+        m_event = 0;
+    m_rootCost = flat.inclusiveCosts(m_event).at(m_function);
+    CallGraphLayout layout;
+    layout.setEvent(m_event);
+    layout.setThreshold(m_threshold);
+
+    const QSharedPointer<QAtomicInt> cancelFlag(new QAtomicInt(0));
+    const int generation = m_generation;
+    m_cancelFlag = cancelFlag;
+    m_layingOut = true;
+    m_layoutTimer.start();
+
+    m_pool.start([this, document = m_document, layout, function = m_function, generation, cancelFlag] {
+        const TraceScope scope("lay out call graph", nullptr, "call graph");
+        QList<CallGraphLayout::Node> nodes;
+        QList<CallGraphLayout::Edge> edges;
+        QElapsedTimer age;
+        age.start();
+
+        const auto flush = [&](bool done) {
+            QMetaObject::invokeMethod(this, [this, generation, nodes, edges, done] {
+                deliver(generation, nodes, edges, done);
+            }, Qt::QueuedConnection);
+            nodes.clear();
+            edges.clear();
+            age.restart();
+        };
+
+        bool first = true;
+        const bool finished = layout.run(document->callGraph(), document->flatProfile(), function,
+                                         [&](const QList<CallGraphLayout::Node> &layerNodes,
+                                             const QList<CallGraphLayout::Edge> &layerEdges) {
+            if (cancelFlag->loadRelaxed() != 0)
+                return false;
+            nodes.append(layerNodes);
+            edges.append(layerEdges);
+            if (first || age.elapsed() >= BatchInterval)
+                flush(false);
+            first = false;
+            return true;
+        });
+        if (finished)
+            flush(true);
+    });
+}
+
+void CallGraphView::deliver(int generation, const QList<CallGraphLayout::Node> &nodes,
+                            const QList<CallGraphLayout::Edge> &edges, bool done)
+{
+    if (generation != m_generation)
+        return; // Canceled or superseded
+
+    // A graph being replaced stays until the new one has more than the
+    // function itself to show
+    if (m_replacing) {
+        m_pendingNodes.append(nodes);
+        m_pendingEdges.append(edges);
+        if (!done && m_pendingNodes.size() <= 1)
+            return;
+    }
+
+    // The view stays on the same part of the scene while it grows or is
+    // replaced, and starts out centered on the function
+    const QPointF center = m_nodes.isEmpty() ? QPointF(0, 0)
+                                             : mapToScene(QPointF(viewport()->rect().center()));
+
+    if (m_replacing) {
+        const QRectF heldScene = m_heldScene;
+        const QList<CallGraphLayout::Node> pendingNodes = m_pendingNodes;
+        const QList<CallGraphLayout::Edge> pendingEdges = m_pendingEdges;
+        clearScene();
+        m_heldScene = heldScene;
+        addNodes(pendingNodes, pendingEdges);
+    } else {
+        addNodes(nodes, edges);
+    }
+    if (done)
+        m_heldScene = QRectF();
+
+    updateScrollBars();
+    scrollTo(center, QPointF(viewport()->rect().center()));
+    viewport()->update();
+
+    if (done) {
+        m_layingOut = false;
+        m_cancelFlag.reset();
+        m_layoutMilliseconds = m_layoutTimer.elapsed();
+        emit layoutFinished();
+    }
+}
+
+void CallGraphView::addNodes(const QList<CallGraphLayout::Node> &nodes,
+                             const QList<CallGraphLayout::Edge> &edges)
+{
+    QList<int> layers;
+    for (const CallGraphLayout::Node &node : nodes) {
+        const int index = int(m_nodes.size());
+        m_nodes.append(node);
+        QList<int> &layer = m_layers[node.layer];
+        if (layer.isEmpty())
+            layers.append(node.layer);
+        layer.append(index);
+        m_minX = qMin(m_minX, node.x);
+        m_maxX = qMax(m_maxX, node.x);
+    }
+    // A layer arrives whole, so it is sorted once
+    for (const int layer : std::as_const(layers)) {
+        QList<int> &indexes = m_layers[layer];
+        std::sort(indexes.begin(), indexes.end(), [this](int a, int b) { return m_nodes.at(a).x < m_nodes.at(b).x; });
+    }
+    m_nodeEdges.resize(m_nodes.size());
+    for (const CallGraphLayout::Edge &edge : edges) {
+        const int index = int(m_edges.size());
+        m_edges.append(edge);
+        m_nodeEdges[edge.caller].append(index);
+        m_nodeEdges[edge.callee].append(index);
+    }
+}
+
+QRectF CallGraphView::sceneRect() const
+{
+    if (m_layers.isEmpty())
+        return m_heldScene;
+    const QRectF scene(QPointF(m_minX * SlotWidth - Margin, m_layers.firstKey() * LayerHeight - Margin),
+                       QPointF(m_maxX * SlotWidth + Margin, m_layers.lastKey() * LayerHeight + Margin));
+    return m_heldScene.isNull() ? scene : scene.united(m_heldScene);
+}
+
+// A scene smaller than the viewport is centered in it
+QPointF CallGraphView::mapFromScene(const QPointF &point) const
+{
+    const QRectF scene = sceneRect();
+    const double width = scene.width() * m_zoom;
+    const double height = scene.height() * m_zoom;
+    const double left = width < viewport()->width() ? (viewport()->width() - width) / 2
+                                                    : -horizontalScrollBar()->value();
+    const double top = height < viewport()->height() ? (viewport()->height() - height) / 2
+                                                     : -verticalScrollBar()->value();
+    return QPointF(left + (point.x() - scene.left()) * m_zoom, top + (point.y() - scene.top()) * m_zoom);
+}
+
+QPointF CallGraphView::mapToScene(const QPointF &point) const
+{
+    const QPointF origin = mapFromScene(sceneRect().topLeft());
+    return sceneRect().topLeft() + (point - origin) / m_zoom;
+}
+
+void CallGraphView::scrollTo(const QPointF &scenePoint, const QPointF &viewportPoint)
+{
+    const QRectF scene = sceneRect();
+    horizontalScrollBar()->setValue(qRound((scenePoint.x() - scene.left()) * m_zoom - viewportPoint.x()));
+    verticalScrollBar()->setValue(qRound((scenePoint.y() - scene.top()) * m_zoom - viewportPoint.y()));
+}
+
+void CallGraphView::updateScrollBars()
+{
+    const QRectF scene = sceneRect();
+    const QSize size = viewport()->size();
+    horizontalScrollBar()->setRange(0, qMax(0, int(std::ceil(scene.width() * m_zoom)) - size.width()));
+    horizontalScrollBar()->setPageStep(size.width());
+    horizontalScrollBar()->setSingleStep(qMax(1, size.width() / 20));
+    verticalScrollBar()->setRange(0, qMax(0, int(std::ceil(scene.height() * m_zoom)) - size.height()));
+    verticalScrollBar()->setPageStep(size.height());
+    verticalScrollBar()->setSingleStep(qMax(1, size.height() / 20));
+}
+
+void CallGraphView::setZoom(double zoom, const QPointF &anchor)
+{
+    zoom = qBound(MinZoom, zoom, MaxZoom);
+    const QPointF scenePoint = mapToScene(anchor);
+    m_zoom = zoom;
+    updateScrollBars();
+    scrollTo(scenePoint, anchor);
+    viewport()->update();
+}
+
+void CallGraphView::zoomIn()
+{
+    setZoom(m_zoom * ZoomStep, QPointF(viewport()->rect().center()));
+}
+
+void CallGraphView::zoomOut()
+{
+    setZoom(m_zoom / ZoomStep, QPointF(viewport()->rect().center()));
+}
+
+QRectF CallGraphView::nodeRect(int node) const
+{
+    const CallGraphLayout::Node &n = m_nodes.at(node);
+    return QRectF(n.x * SlotWidth - NodeWidth / 2, n.layer * LayerHeight - NodeHeight / 2, NodeWidth, NodeHeight);
+}
+
+// The spatial index lookup: layers by key, then nodes by x within a layer
+QList<int> CallGraphView::nodesIn(const QRectF &sceneRect) const
+{
+    QList<int> nodes;
+    const int firstLayer = int(std::ceil((sceneRect.top() - NodeHeight / 2) / LayerHeight));
+    const int lastLayer = int(std::floor((sceneRect.bottom() + NodeHeight / 2) / LayerHeight));
+    const double left = (sceneRect.left() - NodeWidth / 2) / SlotWidth;
+    const double right = (sceneRect.right() + NodeWidth / 2) / SlotWidth;
+    for (auto it = m_layers.lowerBound(firstLayer); it != m_layers.cend() && it.key() <= lastLayer; ++it) {
+        const QList<int> &layer = it.value();
+        auto node = std::lower_bound(layer.cbegin(), layer.cend(), left,
+                                     [this](int index, double x) { return m_nodes.at(index).x < x; });
+        for (; node != layer.cend() && m_nodes.at(*node).x <= right; ++node)
+            nodes.append(*node);
+    }
+    return nodes;
+}
+
+int CallGraphView::nodeAt(const QPoint &point) const
+{
+    const QPointF scenePoint = mapToScene(QPointF(point));
+    for (const int node : nodesIn(QRectF(scenePoint, QSizeF(1, 1)))) {
+        if (nodeRect(node).contains(scenePoint))
+            return node;
+    }
+    return -1;
+}
+
+QString CallGraphView::nodeName(int node) const
+{
+    const int name = m_document->profile().function(m_nodes.at(node).function).name;
+    return QString::fromUtf8(m_document->functionNames().name(name));
+}
+
+double CallGraphView::share(quint64 cost) const
+{
+    return m_rootCost > 0 ? double(cost) / double(m_rootCost) : 0;
+}
+
+void CallGraphView::paintEvent(QPaintEvent *)
+{
+    QPainter painter(viewport());
+    if (m_nodes.isEmpty()) {
+        if (m_function < 0) {
+            painter.setPen(palette().color(QPalette::PlaceholderText));
+            painter.drawText(viewport()->rect(), Qt::AlignCenter,
+                             tr("Select a function to see its callers and callees"));
+        }
+        return;
+    }
+
+    const QRectF visible(mapToScene(QPointF(0, 0)), mapToScene(QPointF(viewport()->width(), viewport()->height())));
+    // Nodes a layer beyond the viewport still anchor arcs that cross it
+    const QList<int> nodes = nodesIn(visible.adjusted(-SlotWidth, -LayerHeight, SlotWidth, LayerHeight));
+    const bool labels = m_zoom >= LabelZoom;
+    const FlatProfile &flat = m_document->flatProfile();
+    const QList<quint64> &inclusiveCosts = flat.inclusiveCosts(m_event);
+    painter.setRenderHint(QPainter::Antialiasing, labels);
+
+    if (m_zoom >= ArcZoom) {
+        const QSet<int> shown(nodes.cbegin(), nodes.cend());
+        const QRectF bounds = QRectF(viewport()->rect()).adjusted(-1, -1, 1, 1);
+        QPen pen(palette().color(QPalette::Text));
+        for (const int node : nodes) {
+            for (const int index : m_nodeEdges.at(node)) {
+                const CallGraphLayout::Edge &edge = m_edges.at(index);
+                const int other = edge.caller == node ? edge.callee : edge.caller;
+                if (other < node && shown.contains(other))
+                    continue; // Drawn from the other end
+
+                // Arcs run from the caller's bottom to the callee's top, or
+                // from top to bottom when they lead back up
+                const QRectF caller = nodeRect(edge.caller);
+                const QRectF callee = nodeRect(edge.callee);
+                const bool down = callee.top() >= caller.bottom();
+                const QPointF from = mapFromScene(QPointF(caller.center().x(), down ? caller.bottom() : caller.top()));
+                const QPointF to = mapFromScene(QPointF(callee.center().x(), down ? callee.top() : callee.bottom()));
+                if (!QRectF(from, to).normalized().adjusted(-1, -1, 1, 1).intersects(bounds))
+                    continue;
+
+                const double arcShare = share(edge.cost);
+                pen.setWidthF(qMax(1.0, (1 + 5 * qMin(1.0, arcShare)) * qMin(1.0, m_zoom)));
+                painter.setPen(pen);
+                painter.drawLine(from, to);
+                if (m_zoom >= ArcLabelZoom) {
+                    const quint64 count = m_document->profile().call(edge.call).count;
+                    painter.drawText((from + to) / 2 + QPointF(4, 0),
+                                     tr("%1 % (%2×)").arg(100 * arcShare, 0, 'f', 2).arg(count));
+                }
+            }
+        }
+    }
+
+    if (!labels) {
+        // Nodes sharing a pixel are drawn once
+        int lastLayer = INT_MIN;
+        int lastPixel = INT_MIN;
+        for (const int node : nodes) {
+            const QRectF rect(mapFromScene(nodeRect(node).topLeft()), mapFromScene(nodeRect(node).bottomRight()));
+            const int pixel = int(rect.left());
+            if (m_nodes.at(node).layer == lastLayer && pixel == lastPixel)
+                continue;
+            lastLayer = m_nodes.at(node).layer;
+            lastPixel = pixel;
+            const QColor color = costColor(share(inclusiveCosts.at(m_nodes.at(node).function)));
+            painter.fillRect(QRectF(rect.topLeft(), rect.size().expandedTo(QSizeF(1, 1))), node == 0 ? palette().color(QPalette::Highlight) : color);
+        }
+        return;
+    }
+
+    // Labeled nodes are drawn in scene coordinates, so text scales with them
+    const QPointF origin = mapFromScene(QPointF(0, 0));
+    painter.setTransform(QTransform(m_zoom, 0, 0, m_zoom, origin.x(), origin.y()));
+    const QFontMetrics metrics = fontMetrics();
+    const QPen border(palette().color(QPalette::Mid), 1);
+    const QPen rootBorder(palette().color(QPalette::Highlight), 3);
+    for (const int node : nodes) {
+        const CallGraphLayout::Node &n = m_nodes.at(node);
+        const QRectF rect = nodeRect(node);
+        const double nodeShare = share(inclusiveCosts.at(n.function));
+        painter.setPen(node == 0 ? rootBorder : border);
+        painter.setBrush(costColor(nodeShare));
+        painter.drawRoundedRect(rect, 6, 6);
+
+        const QRectF text = rect.adjusted(6, 2, -6, -2);
+        QString cost = tr("%1 %").arg(100 * nodeShare, 0, 'f', 2);
+        if (n.prunedCalls > 0)
+            cost += tr(", %n hidden", nullptr, n.prunedCalls);
+        painter.setPen(Qt::black);
+        painter.drawText(text, Qt::AlignLeft | Qt::AlignTop,
+                         metrics.elidedText(nodeName(node), Qt::ElideMiddle, int(text.width())));
+        painter.drawText(text, Qt::AlignLeft | Qt::AlignBottom, cost);
+    }
+}
+
+void CallGraphView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void CallGraphView::scrollContentsBy(int, int)
+{
+    viewport()->update();
+}
+
+void CallGraphView::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Plus:
+    case Qt::Key_Equal:
+        zoomIn();
+        break;
+    case Qt::Key_Minus:
+        zoomOut();
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        break;
+    }
+}
+
+void CallGraphView::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+    m_dragging = true;
+    m_dragStart = event->position().toPoint();
+    m_dragScroll = QPoint(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    viewport()->setCursor(Qt::ClosedHandCursor);
+}
+
+void CallGraphView::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging) {
+        QAbstractScrollArea::mouseMoveEvent(event);
+        return;
+    }
+    const QPoint delta = event->position().toPoint() - m_dragStart;
+    horizontalScrollBar()->setValue(m_dragScroll.x() - delta.x());
+    verticalScrollBar()->setValue(m_dragScroll.y() - delta.y());
+}
+
+void CallGraphView::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!m_dragging) {
+        QAbstractScrollArea::mouseReleaseEvent(event);
+        return;
+    }
+    m_dragging = false;
+    viewport()->unsetCursor();
+}
+
+void CallGraphView::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    const int node = nodeAt(event->position().toPoint());
+    if (node >= 0)
+        emit functionActivated(m_nodes.at(node).function);
+}
+
+// Ctrl+wheel zooms around the cursor; the wheel alone scrolls
+void CallGraphView::wheelEvent(QWheelEvent *event)
+{
+    if (!(event->modifiers() & Qt::ControlModifier)) {
+        QAbstractScrollArea::wheelEvent(event);
+        return;
+    }
+    setZoom(m_zoom * std::pow(ZoomStep, event->angleDelta().y() / 120.0), event->position());
+    event->accept();
+}
+
+bool CallGraphView::viewportEvent(QEvent *event)
+{
+    if (event->type() != QEvent::ToolTip)
+        return QAbstractScrollArea::viewportEvent(event);
+
+    const auto *help = static_cast<QHelpEvent *>(event);
+    const int node = nodeAt(help->pos());
+    if (node < 0) {
+        QToolTip::hideText();
+        event->ignore();
+        return true;
+    }
+    const CallGraphLayout::Node &n = m_nodes.at(node);
+    const FlatProfile &flat = m_document->flatProfile();
+    const quint64 inclusive = flat.inclusiveCosts(m_event).at(n.function);
+    const QLocale locale;
+    QString text = nodeName(node) + u'\n'
+            + tr("Inclusive %1: %2 (%3 %)").arg(QString::fromUtf8(flat.eventNames().at(m_event)),
+                                                locale.toString(inclusive))
+                  .arg(100 * share(inclusive), 0, 'f', 2)
+            + u'\n' + tr("Self: %1").arg(locale.toString(flat.selfCosts(m_event).at(n.function)));
+    if (n.prunedCalls > 0)
+        text += u'\n' + tr("%n call(s) below the threshold hidden", nullptr, n.prunedCalls);
+    QToolTip::showText(help->globalPos(), text, viewport());
+    return true;
+}
@@ -0,0 +1,132 @@
+#ifndef CALLGRAPHVIEW_H
+#define CALLGRAPHVIEW_H
+
+#include "callgraphlayout.h"
+
+#include <QAbstractScrollArea>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+class ProfileDocument;
+
+// The call graph around the current function: callers above, callees
+// below, each arc labeled with its inclusive cost. A CallGraphLayout runs on
+// a worker thread and its layers are added to the view as they are placed,
+// the function itself first.
+//
+// Nodes are kept per layer in x order, which is the spatial index: painting
+// looks up the layers that cross the viewport and, in each, the nodes that
+// fall inside it by binary search, so the cost of a frame depends on what
+// is visible rather than on the size of the graph. Zoomed out, labels are
+// dropped first, then arcs, and nodes sharing a pixel are drawn once.
+class CallGraphView : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    explicit CallGraphView(QWidget *parent = nullptr);
+    ~CallGraphView() override;
+
+    // Clears the graph; setFunction() picks the function to show
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+    // Lays out the current function again in a document that continues the
+    // current one. The zoom and the part of the scene in view are kept, as
+    // is the graph shown until the new layout has more than the function
+    // itself; if no arc around the graph changed, it is only repainted.
+    void updateDocument(const QSharedPointer<const ProfileDocument> &document);
+
+    void setFunction(int function);
+    int function() const { return m_function; }
+    void setEvent(int event);
+    // Share of the function's inclusive cost below which arcs are pruned
+    void setThreshold(double threshold);
+
+    bool isLayingOut() const { return m_layingOut; }
+    int nodeCount() const { return int(m_nodes.size()); }
+    int edgeCount() const { return int(m_edges.size()); }
+    qint64 layoutMilliseconds() const { return m_layoutMilliseconds; }
+
+public slots:
+    void zoomIn();
+    void zoomOut();
+
+signals:
+    // A node was double-clicked
+    void functionActivated(int function);
+    void layoutFinished();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    bool viewportEvent(QEvent *event) override;
+
+private:
+    void relayout(bool keepScene = false);
+    void cancel();
+    void clearScene();
+    bool hasSameArcs(const ProfileDocument &previous) const;
+    void deliver(int generation, const QList<CallGraphLayout::Node> &nodes,
+                 const QList<CallGraphLayout::Edge> &edges, bool done);
+    void addNodes(const QList<CallGraphLayout::Node> &nodes, const QList<CallGraphLayout::Edge> &edges);
+
+    QRectF sceneRect() const;
+    QPointF mapToScene(const QPointF &point) const;
+    QPointF mapFromScene(const QPointF &point) const;
+    void scrollTo(const QPointF &scenePoint, const QPointF &viewportPoint);
+    void updateScrollBars();
+    void setZoom(double zoom, const QPointF &anchor);
+
+    QRectF nodeRect(int node) const;
+    QList<int> nodesIn(const QRectF &sceneRect) const;
+    int nodeAt(const QPoint &point) const;
+    QString nodeName(int node) const;
+    double share(quint64 cost) const;
+
+    QSharedPointer<const ProfileDocument> m_document;
+    int m_function = -1;
+    int m_event = 0;
+    double m_threshold = 0.01;
+
+    QList<CallGraphLayout::Node> m_nodes;
+    QList<CallGraphLayout::Edge> m_edges;
+    // Edges by node, either end
+    QList<QList<int>> m_nodeEdges;
+    // Node indexes by layer, in x order
+    QMap<int, QList<int>> m_layers;
+    double m_minX = 0;
+    double m_maxX = 0;
+    quint64 m_rootCost = 0;
+
+    // While a live update lays out the graph again, the old one is shown
+    // and the new layers wait here; the old scene bounds are kept until the
+    // layout is done, so that the view does not jump while the graph grows
+    bool m_replacing = false;
+    QList<CallGraphLayout::Node> m_pendingNodes;
+    QList<CallGraphLayout::Edge> m_pendingEdges;
+    QRectF m_heldScene;
+
+    double m_zoom = 1;
+    QPoint m_dragStart;
+    QPoint m_dragScroll;
+    bool m_dragging = false;
+
+    QSharedPointer<QAtomicInt> m_cancelFlag;
+    QElapsedTimer m_layoutTimer;
+    qint64 m_layoutMilliseconds = -1;
+    int m_generation = 0;
+    bool m_layingOut = false;
+
+    QThreadPool m_pool;
+};
+
+#endif // CALLGRAPHVIEW_H
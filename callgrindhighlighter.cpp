@@ -1,62 +1,46 @@
 #include "callgrindhighlighter.h"
-#include <QDebug>
 
-CallgrindSyntaxHighlighter::CallgrindSyntaxHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent)
+CallgrindSyntaxHighlighter::CallgrindSyntaxHighlighter()
 {
-    initRules();
+    initFormats();
 }
 
-void CallgrindSyntaxHighlighter::initRules()
+void CallgrindSyntaxHighlighter::initFormats()
 {
     // Comments (green)
-    QTextCharFormat commentFormat;
-    commentFormat.setForeground(Qt::darkGreen);
-    HighlightRule commentRule;
-    commentRule.pattern = QRegularExpression(R"(^#.*$)");
-    commentRule.format = commentFormat;
-    rules.append(commentRule);
+    formats[CallgrindLexer::Comment].setForeground(Qt::darkGreen);
 
     // Commands (blue)
-    QTextCharFormat commandFormat;
-    commandFormat.setForeground(Qt::blue);
-    HighlightRule commandRule;
-    commandRule.pattern = QRegularExpression(R"(^(cmd|events|creator|pid|desc|positions|summary|version):)");
-    commandRule.format = commandFormat;
-    rules.append(commandRule);
+    formats[CallgrindLexer::HeaderKey].setForeground(Qt::blue);
 
     // Positions (magenta)
-    QTextCharFormat positionFormat;
-    positionFormat.setForeground(Qt::darkMagenta);
-    HighlightRule positionRule;
-    positionRule.pattern = QRegularExpression(R"(\b(fl|fn|ob|cfi|cfn|cob|jump)=)");
-    positionRule.format = positionFormat;
-    rules.append(positionRule);
+    formats[CallgrindLexer::PositionSpec].setForeground(Qt::darkMagenta);
+
+    // Compressed names (dark yellow)
+    formats[CallgrindLexer::CompressedId].setForeground(Qt::darkYellow);
 
     // Numbers (red)
-    QTextCharFormat numberFormat;
-    numberFormat.setForeground(Qt::red);
-    HighlightRule numberRule;
-    numberRule.pattern = QRegularExpression(R"(\b\d+\b)");
-    numberRule.format = numberFormat;
-    rules.append(numberRule);
+    formats[CallgrindLexer::Number].setForeground(Qt::red);
 
     // Hex addresses (cyan)
-    QTextCharFormat hexFormat;
-    hexFormat.setForeground(Qt::cyan);
-    HighlightRule hexRule;
-    hexRule.pattern = QRegularExpression(R"(0x[0-9A-Fa-f]+)");
-    hexRule.format = hexFormat;
-    rules.append(hexRule);
+    formats[CallgrindLexer::HexNumber].setForeground(Qt::cyan);
+
+    // Relative subpositions (dark red)
+    formats[CallgrindLexer::SubPosition].setForeground(Qt::darkRed);
+}
+
+QList<QTextLayout::FormatRange> CallgrindSyntaxHighlighter::highlightLine(const QString &text) const
+{
+    CallgrindLexer::Tokens tokens;
+    CallgrindLexer::tokenize(text, tokens);
+    return formatRanges(tokens);
 }
 
-void CallgrindSyntaxHighlighter::highlightBlock(const QString &text)
+QList<QTextLayout::FormatRange> CallgrindSyntaxHighlighter::formatRanges(const CallgrindLexer::Tokens &tokens) const
 {
-    for (const HighlightRule &rule : rules) {
-        QRegularExpressionMatchIterator it = rule.pattern.globalMatch(text);
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
-        }
-    }
+    QList<QTextLayout::FormatRange> ranges;
+    ranges.reserve(tokens.size());
+    for (const CallgrindLexer::Token &token : tokens)
+        ranges.append({token.start, token.length, formats[token.kind]});
+    return ranges;
 }
@@ -1,26 +1,27 @@
 #ifndef CALLGRINDHIGHLIGHTER_H
 #define CALLGRINDHIGHLIGHTER_H
 
-#include <QSyntaxHighlighter>
-#include <QRegularExpression>
+#include "callgrindlexer.h"
 
-class CallgrindSyntaxHighlighter : public QSyntaxHighlighter
+#include <QList>
+#include <QTextCharFormat>
+#include <QTextLayout>
+
+// Maps CallgrindLexer tokens to character formats, one line at a time, so the
+// view only has to highlight the lines it actually paints. Tokenizing is
+// independent of the formats and may run on a worker thread.
+class CallgrindSyntaxHighlighter
 {
-    Q_OBJECT
 public:
-    explicit CallgrindSyntaxHighlighter(QTextDocument *parent = nullptr);
+    CallgrindSyntaxHighlighter();
 
-protected:
-    void highlightBlock(const QString &text) override;
+    QList<QTextLayout::FormatRange> highlightLine(const QString &text) const;
+    QList<QTextLayout::FormatRange> formatRanges(const CallgrindLexer::Tokens &tokens) const;
 
 private:
-    struct HighlightRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-    QVector<HighlightRule> rules;
+    QTextCharFormat formats[CallgrindLexer::TokenKindCount];
 
-    void initRules();
+    void initFormats();
 };
 
 #endif // CALLGRINDHIGHLIGHTER_H
@@ -0,0 +1,211 @@
+#include "callgrindlexer.h"
+
+#include <array>
+
+namespace {
+
+enum CharClass : quint8 {
+    OtherChar,
+    SpaceChar,
+    DigitChar,
+    LetterChar, // letters and '_'
+    HashChar,
+    ColonChar,
+    EqualsChar,
+    OpenParenChar,
+    CloseParenChar,
+    SignChar,   // '+' and '-'
+    StarChar
+};
+
+constexpr std::array<CharClass, 128> makeClassTable()
+{
+    std::array<CharClass, 128> table{};
+    for (auto &c : table)
+        c = OtherChar;
+    table[' '] = table['\t'] = SpaceChar;
+    for (int c = '0'; c <= '9'; ++c)
+        table[c] = DigitChar;
+    for (int c = 'a'; c <= 'z'; ++c)
+        table[c] = LetterChar;
+    for (int c = 'A'; c <= 'Z'; ++c)
+        table[c] = LetterChar;
+    table['_'] = LetterChar;
+    table['#'] = HashChar;
+    table[':'] = ColonChar;
+    table['='] = EqualsChar;
+    table['('] = OpenParenChar;
+    table[')'] = CloseParenChar;
+    table['+'] = table['-'] = SignChar;
+    table['*'] = StarChar;
+    return table;
+}
+
+constexpr std::array<CharClass, 128> classTable = makeClassTable();
+
+inline CharClass classOf(QChar c)
+{
+    const char16_t u = c.unicode();
+    return u < 128 ? classTable[u] : OtherChar;
+}
+
+inline bool isWordChar(QChar c)
+{
+    const CharClass cls = classOf(c);
+    return cls == DigitChar || cls == LetterChar;
+}
+
+inline bool isHexDigit(QChar c)
+{
+    const char16_t u = c.unicode();
+    return (u >= '0' && u <= '9') || (u >= 'a' && u <= 'f') || (u >= 'A' && u <= 'F');
+}
+
+enum class KeyKind {
+    None,
+    Header,
+    NameSpec,  // followed by an optionally compressed name
+    ValueSpec  // followed by numbers and positions
+};
+
+KeyKind classifyKey(QStringView key, QChar separator)
+{
+    static constexpr const char16_t *headerKeys[] = {
+        u"cmd", u"creator", u"desc", u"event", u"events", u"part", u"pid",
+        u"positions", u"summary", u"thread", u"totals", u"version"
+    };
+    static constexpr const char16_t *nameSpecs[] = {
+        u"ob", u"fl", u"fi", u"fe", u"fn", u"cob", u"cfi", u"cfl", u"cfn"
+    };
+    static constexpr const char16_t *valueSpecs[] = {
+        u"calls", u"jump", u"jcnd"
+    };
+
+    if (separator == u':') {
+        for (const char16_t *header : headerKeys) {
+            if (key == QStringView(header))
+                return KeyKind::Header;
+        }
+    } else if (separator == u'=') {
+        for (const char16_t *spec : nameSpecs) {
+            if (key == QStringView(spec))
+                return KeyKind::NameSpec;
+        }
+        for (const char16_t *spec : valueSpecs) {
+            if (key == QStringView(spec))
+                return KeyKind::ValueSpec;
+        }
+    }
+    return KeyKind::None;
+}
+
+// Numbers, hex addresses and subposition prefixes in cost lines and values
+void tokenizeValues(QStringView line, int from, CallgrindLexer::Tokens &tokens)
+{
+    const int n = int(line.size());
+    int i = from;
+    while (i < n) {
+        const bool wordStart = i == 0 || !isWordChar(line[i - 1]);
+        switch (classOf(line[i])) {
+        case SignChar: {
+            int j = i + 1;
+            while (j < n && classOf(line[j]) == DigitChar)
+                ++j;
+            if (wordStart && j > i + 1 && (j == n || !isWordChar(line[j]))) {
+                tokens.append({i, j - i, CallgrindLexer::SubPosition});
+                i = j;
+            } else {
+                ++i;
+            }
+            break;
+        }
+        case StarChar:
+            if (wordStart && (i + 1 == n || classOf(line[i + 1]) == SpaceChar))
+                tokens.append({i, 1, CallgrindLexer::SubPosition});
+            ++i;
+            break;
+        case DigitChar: {
+            int j = i + 1;
+            CallgrindLexer::TokenKind kind = CallgrindLexer::Number;
+            if (line[i] == u'0' && j + 1 < n && (line[j] == u'x' || line[j] == u'X')
+                && isHexDigit(line[j + 1])) {
+                j += 2;
+                while (j < n && isHexDigit(line[j]))
+                    ++j;
+                kind = CallgrindLexer::HexNumber;
+            } else {
+                while (j < n && classOf(line[j]) == DigitChar)
+                    ++j;
+            }
+            if (wordStart && (j == n || !isWordChar(line[j])))
+                tokens.append({i, j - i, kind});
+            // Skip the rest of an identifier such as "1st"
+            while (j < n && isWordChar(line[j]))
+                ++j;
+            i = j;
+            break;
+        }
+        case LetterChar:
+            while (i < n && isWordChar(line[i]))
+                ++i;
+            break;
+        default:
+            ++i;
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void CallgrindLexer::tokenize(QStringView line, Tokens &tokens)
+{
+    const int n = int(line.size());
+    if (n == 0)
+        return;
+
+    switch (classOf(line[0])) {
+    case HashChar:
+        tokens.append({0, n, Comment});
+        return;
+    case LetterChar:
+        break;
+    default:
+        tokenizeValues(line, 0, tokens);
+        return;
+    }
+
+    int keyEnd = 1;
+    while (keyEnd < n && classOf(line[keyEnd]) == LetterChar)
+        ++keyEnd;
+    if (keyEnd == n)
+        return;
+
+    switch (classifyKey(line.first(keyEnd), line[keyEnd])) {
+    case KeyKind::Header:
+        tokens.append({0, keyEnd + 1, HeaderKey});
+        tokenizeValues(line, keyEnd + 1, tokens);
+        break;
+    case KeyKind::ValueSpec:
+        tokens.append({0, keyEnd + 1, PositionSpec});
+        tokenizeValues(line, keyEnd + 1, tokens);
+        break;
+    case KeyKind::NameSpec: {
+        tokens.append({0, keyEnd + 1, PositionSpec});
+        int i = keyEnd + 1;
+        while (i < n && classOf(line[i]) == SpaceChar)
+            ++i;
+        if (i < n && classOf(line[i]) == OpenParenChar) {
+            int j = i + 1;
+            while (j < n && classOf(line[j]) == DigitChar)
+                ++j;
+            if (j > i + 1 && j < n && classOf(line[j]) == CloseParenChar)
+                tokens.append({i, j + 1 - i, CompressedId});
+        }
+        // The rest is a symbol name and stays plain
+        break;
+    }
+    case KeyKind::None:
+        break;
+    }
+}
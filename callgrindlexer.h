@@ -0,0 +1,36 @@
+#ifndef CALLGRINDLEXER_H
+#define CALLGRINDLEXER_H
+
+#include <QStringView>
+#include <QVarLengthArray>
+
+// Single-pass, table-driven lexer for one line of a Callgrind profile. Every
+// character is classified exactly once and tokens never overlap, so callers
+// can map them to formats without later rules overwriting earlier ones.
+class CallgrindLexer
+{
+public:
+    enum TokenKind : quint8 {
+        Comment,      // # ...
+        HeaderKey,    // events:, positions:, summary: ...
+        PositionSpec, // fl=, fn=, cfn=, calls= ...
+        CompressedId, // (12)
+        Number,       // 1234
+        HexNumber,    // 0x4005f0
+        SubPosition,  // +3, -2, *
+        TokenKindCount
+    };
+
+    struct Token {
+        int start;
+        int length;
+        TokenKind kind;
+    };
+
+    using Tokens = QVarLengthArray<Token, 16>;
+
+    // Appends the tokens of \a line to \a tokens; plain text is not reported.
+    static void tokenize(QStringView line, Tokens &tokens);
+};
+
+#endif // CALLGRINDLEXER_H
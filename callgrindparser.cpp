@@ -0,0 +1,476 @@
+#include "callgrindparser.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace Qt::StringLiterals;
+
+static const qint64 ProgressInterval = 4 << 20;
+
+// Placeholder name for the object and file inherited by a parse chunk. The
+// leading NUL keeps it apart from anything that can appear in a profile.
+static const QByteArrayView InheritedSymbolName("\0inherited", 10);
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit(char c)
+{
+    return unsigned(c - '0') < 10;
+}
+
+static inline const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+static inline const char *trimEnd(const char *begin, const char *end)
+{
+    while (end > begin && isSpace(end[-1]))
+        --end;
+    return end;
+}
+
+static inline quint64 parseDecimal(const char *&p, const char *end)
+{
+    quint64 value = 0;
+    while (p < end && isDigit(*p))
+        value = value * 10 + quint64(*p++ - '0');
+    return value;
+}
+
+static inline quint64 parseHex(const char *&p, const char *end)
+{
+    quint64 value = 0;
+    for (; p < end; ++p) {
+        const char c = *p;
+        if (isDigit(c))
+            value = (value << 4) | quint64(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            value = (value << 4) | quint64(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            value = (value << 4) | quint64(c - 'A' + 10);
+        else
+            break;
+    }
+    return value;
+}
+
+// A decimal or 0x-prefixed hexadecimal number ending the line or followed
+// by a space; false, with p left anywhere, for anything else
+static inline bool parseNumber(const char *&p, const char *end, quint64 *value)
+{
+    const char *digits = p;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        digits = p += 2;
+        *value = parseHex(p, end);
+    } else {
+        *value = parseDecimal(p, end);
+    }
+    return p != digits && (p == end || isSpace(*p));
+}
+
+// One position of a cost or calls= line: "*" for the one before, +n or -n
+// relative to it, or an absolute number, which sets \a absolute
+static inline bool parsePosition(const char *&p, const char *end, quint64 *position, bool *absolute)
+{
+    quint64 value = 0;
+    *absolute = false;
+    switch (*p) {
+    case '*':
+        ++p;
+        return p == end || isSpace(*p);
+    case '+':
+    case '-': {
+        const bool forward = *p++ == '+';
+        if (!parseNumber(p, end, &value))
+            return false;
+        *position = forward ? *position + value : *position - value;
+        return true;
+    }
+    default:
+        if (!parseNumber(p, end, &value))
+            return false;
+        *position = value;
+        *absolute = true;
+        return true;
+    }
+}
+
+static QList<QByteArray> splitWords(QByteArrayView value)
+{
+    QList<QByteArray> words;
+    const char *p = value.data();
+    const char *end = p + value.size();
+    while ((p = skipSpaces(p, end)) < end) {
+        const char *word = p;
+        while (p < end && !isSpace(*p))
+            ++p;
+        words.append(QByteArray(word, p - word));
+    }
+    return words;
+}
+
+bool CallgrindParser::parseFile(const QString &fileName, CallgrindProfile *profile)
+{
+    MappedFile file;
+    if (!file.open(fileName)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    file.adviseSequential();
+    return parse(file.data(), profile);
+}
+
+bool CallgrindParser::parse(QByteArrayView data, CallgrindProfile *profile, LineIndex *lineIndex)
+{
+    if (lineIndex)
+        lineIndex->beginBuild(data);
+    begin(profile, lineIndex);
+    const bool ok = feed(data);
+    profile->positionCosts().squeeze();
+    return ok;
+}
+
+void CallgrindParser::begin(CallgrindProfile *profile, LineIndex *lineIndex)
+{
+    reset(profile);
+    m_lineIndex = lineIndex;
+    m_offset = 0;
+    m_nextProgress = ProgressInterval;
+}
+
+bool CallgrindParser::feed(QByteArrayView data)
+{
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    const char *p = begin;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!eol)
+            eol = end;
+        const char *lineEnd = eol;
+        if (lineEnd > p && lineEnd[-1] == '\r')
+            --lineEnd;
+
+        if (m_lineIndex)
+            m_lineIndex->addLine(m_offset + (p - begin));
+        ++m_lineNumber;
+        if (!parseLine(p, lineEnd))
+            return false;
+        p = eol < end ? eol + 1 : end;
+
+        const qint64 offset = m_offset + (p - begin);
+        if (offset >= m_nextProgress && m_progress) {
+            if (!m_progress(offset, m_lineNumber)) {
+                m_canceled = true;
+                return fail(u"canceled"_s);
+            }
+            m_nextProgress += ProgressInterval;
+        }
+    }
+    m_offset += data.size();
+    return true;
+}
+
+void CallgrindParser::resume(CallgrindProfile *profile, LineIndex *lineIndex, qint64 offset)
+{
+    m_profile = profile;
+    m_lineIndex = lineIndex;
+    m_offset = offset;
+    m_nextProgress = offset + ProgressInterval;
+    m_errorString.clear();
+    m_canceled = false;
+}
+
+void CallgrindParser::reset(CallgrindProfile *profile)
+{
+    m_profile = profile;
+    m_errorString.clear();
+    m_lineNumber = 0;
+    m_canceled = false;
+    for (ChunkedArray<int> &table : m_compressed)
+        table.clear();
+    m_object = m_file = m_functionName = m_function = -1;
+    m_calledObject = m_calledFile = m_calledName = -1;
+    m_nextLine = SelfCostLine;
+    m_callCount = 0;
+    m_positions.clear();
+    m_callTarget.clear();
+    m_rawCallTargets = 0;
+    m_profile->positionCosts().breakRange();
+
+    m_needsSequential = false;
+    m_relativeRanges.clear();
+    m_definitions.clear();
+    m_unresolved.clear();
+    if (m_chunkMode) {
+        m_object = m_inheritedObject =
+                m_profile->addSymbol(CallgrindProfile::ObjectSymbol, InheritedSymbolName);
+        m_file = m_inheritedFile =
+                m_profile->addSymbol(CallgrindProfile::FileSymbol, InheritedSymbolName);
+    }
+}
+
+bool CallgrindParser::fail(const QString &message)
+{
+    m_errorString = u"Line %1: %2"_s.arg(m_lineNumber).arg(message);
+    return false;
+}
+
+bool CallgrindParser::parseLine(const char *begin, const char *end)
+{
+    if (begin == end || *begin == '#')
+        return true;
+
+    const char first = *begin;
+    if (isDigit(first) || first == '+' || first == '-' || first == '*')
+        return parseCostLine(begin, end);
+
+    const char *p = begin;
+    while (p < end && (std::isalnum(static_cast<unsigned char>(*p)) || *p == '_'))
+        ++p;
+    if (p == end) {
+        if (skipSpaces(begin, end) == end)
+            return true;
+        return fail(u"unrecognized line"_s);
+    }
+
+    const QByteArrayView key(begin, p - begin);
+    const char *value = p + 1;
+    if (*p == ':')
+        return parseHeader(key, QByteArrayView(skipSpaces(value, end), trimEnd(value, end)));
+    if (*p != '=')
+        return fail(u"unrecognized line"_s);
+
+    using Kind = CallgrindProfile;
+    if (key == "fn") {
+        m_functionName = parseName(Kind::FunctionSymbol, value, end);
+        m_function = -1;
+        m_calledObject = m_calledFile = -1;
+    } else if (key == "fl") {
+        m_file = parseName(Kind::FileSymbol, value, end);
+    } else if (key == "fi" || key == "fe") {
+        // Inlined code changes the source file of the following cost lines
+        // but not the identity of the current function.
+        parseName(Kind::FileSymbol, value, end);
+    } else if (key == "ob") {
+        m_object = parseName(Kind::ObjectSymbol, value, end);
+    } else if (key == "cfn") {
+        m_calledName = parseName(Kind::FunctionSymbol, value, end);
+    } else if (key == "cfi" || key == "cfl") {
+        m_calledFile = parseName(Kind::FileSymbol, value, end);
+    } else if (key == "cob") {
+        m_calledObject = parseName(Kind::ObjectSymbol, value, end);
+    } else if (key == "calls") {
+        return parseCallsLine(value, end);
+    }
+    // jump=, jcnd= and unknown specifications carry no function-level cost
+
+    return m_errorString.isEmpty();
+}
+
+bool CallgrindParser::parseHeader(QByteArrayView key, QByteArrayView value)
+{
+    if (m_chunkMode && (key == "events" || key == "positions")) {
+        // A new part with its own layout; only a sequential parse can follow
+        m_needsSequential = true;
+        return fail(u"header inside a parse chunk"_s);
+    }
+
+    if (key == "events") {
+        const QList<QByteArray> events = splitWords(value);
+        if (m_profile->eventCount() != 0 && m_profile->eventNames() != events)
+            return fail(u"events: header differs from an earlier part"_s);
+        if (m_profile->eventCount() == 0)
+            m_profile->setEventNames(events);
+        m_costs.resize(events.size());
+    } else if (key == "positions") {
+        m_profile->setPositionNames(splitWords(value));
+        m_positions.clear();
+    } else if (key == "event") {
+        m_profile->addEventDefinition(value.toByteArray());
+    } else {
+        m_profile->setHeader(key.toByteArray(), value.toByteArray());
+    }
+    return true;
+}
+
+int CallgrindParser::parseName(CallgrindProfile::SymbolKind kind, const char *begin, const char *end)
+{
+    const char *p = skipSpaces(begin, end);
+    end = trimEnd(p, end);
+
+    if (p == end || *p != '(')
+        return m_profile->addSymbol(kind, QByteArrayView(p, end - p));
+
+    ++p;
+    const qsizetype id = qsizetype(parseDecimal(p, end));
+    if (p == end || *p != ')') {
+        fail(u"malformed compressed name"_s);
+        return -1;
+    }
+    p = skipSpaces(p + 1, end);
+
+    ChunkedArray<int> &table = m_compressed[kind];
+    if (p < end) {
+        const int symbol = m_profile->addSymbol(kind, QByteArrayView(p, end - p));
+        if (table.size() <= id)
+            table.resize(id + 1, -1);
+        table[id] = symbol;
+        if (m_chunkMode)
+            m_definitions.append({kind, id, symbol});
+        return symbol;
+    }
+
+    if (id < table.size() && table.at(id) >= 0)
+        return table.at(id);
+
+    int symbol;
+    if (m_chunkMode) {
+        // Most likely defined in an earlier chunk
+        symbol = m_profile->addSymbol(kind, QByteArray('\0' + QByteArray::number(id)));
+        m_unresolved.append({kind, id, symbol});
+    } else {
+        // Reference to an undefined id: keep going with a placeholder name
+        symbol = m_profile->addSymbol(kind, QByteArray('(' + QByteArray::number(id) + ')'));
+    }
+    if (table.size() <= id)
+        table.resize(id + 1, -1);
+    table[id] = symbol;
+    return symbol;
+}
+
+int CallgrindParser::unknownSymbol(CallgrindProfile::SymbolKind kind)
+{
+    return m_profile->addSymbol(kind, "???");
+}
+
+int CallgrindParser::currentFunction()
+{
+    if (m_function < 0) {
+        const int object = m_object >= 0 ? m_object : unknownSymbol(CallgrindProfile::ObjectSymbol);
+        const int file = m_file >= 0 ? m_file : unknownSymbol(CallgrindProfile::FileSymbol);
+        const int name = m_functionName >= 0 ? m_functionName
+                                              : unknownSymbol(CallgrindProfile::FunctionSymbol);
+        m_function = m_profile->addFunction(object, file, name);
+    }
+    return m_function;
+}
+
+int CallgrindParser::calledFunction()
+{
+    // cob= and cfi= default to the caller's object and file
+    int object = m_calledObject >= 0 ? m_calledObject : m_object;
+    int file = m_calledFile >= 0 ? m_calledFile : m_file;
+    if (object < 0)
+        object = unknownSymbol(CallgrindProfile::ObjectSymbol);
+    if (file < 0)
+        file = unknownSymbol(CallgrindProfile::FileSymbol);
+    const int name = m_calledName >= 0 ? m_calledName
+                                        : unknownSymbol(CallgrindProfile::FunctionSymbol);
+    return m_profile->addFunction(object, file, name);
+}
+
+bool CallgrindParser::parseCallsLine(const char *begin, const char *end)
+{
+    const char *p = skipSpaces(begin, end);
+    if (p == end || !isDigit(*p) || !parseNumber(p, end, &m_callCount))
+        return fail(u"malformed calls= line"_s);
+
+    // The target is written like the positions of a cost line, relative to
+    // the current ones, but leaves them as they are; positions left out are
+    // those of the call
+    const qsizetype positionCount = preparePositions();
+    m_callTarget = m_positions;
+    m_rawCallTargets = 0;
+    for (qsizetype i = 0; i < positionCount; ++i) {
+        p = skipSpaces(p, end);
+        if (p == end)
+            break;
+        bool absolute;
+        if (!parsePosition(p, end, &m_callTarget[i], &absolute))
+            return fail(u"malformed calls= line"_s);
+        if (absolute && m_chunkMode && m_relativeRanges[i] < 0)
+            m_rawCallTargets |= 1u << i;
+    }
+    m_nextLine = CallCostLine;
+    return true;
+}
+
+qsizetype CallgrindParser::preparePositions()
+{
+    const qsizetype positionCount = qMax<qsizetype>(1, m_profile->positionNames().size());
+    if (m_positions.size() != positionCount) {
+        m_positions.resize(positionCount, 0);
+        if (m_chunkMode)
+            m_relativeRanges.resize(positionCount, -1);
+    }
+    return positionCount;
+}
+
+bool CallgrindParser::parseCostLine(const char *begin, const char *end)
+{
+    const int eventCount = m_profile->eventCount();
+    if (eventCount == 0)
+        return fail(u"cost line before events: header"_s);
+
+    const qsizetype positionCount = preparePositions();
+    PositionCosts &positionCosts = m_profile->positionCosts();
+
+    const char *p = begin;
+    for (qsizetype i = 0; i < positionCount; ++i) {
+        p = skipSpaces(p, end);
+        if (p == end)
+            return fail(u"missing position in cost line"_s);
+        bool absolute;
+        if (!parsePosition(p, end, &m_positions[i], &absolute))
+            return fail(u"malformed position in cost line"_s);
+        if (absolute && m_chunkMode && m_relativeRanges[i] < 0) {
+            // Positions so far were relative to where the previous chunk
+            // ended; ranges from here on are absolute, which puts a pending
+            // call target in the other frame now
+            m_relativeRanges[i] = positionCosts.rangeCount();
+            positionCosts.breakRange();
+            if (m_nextLine == CallCostLine && m_callTarget.size() == positionCount)
+                m_rawCallTargets ^= 1u << i;
+        }
+    }
+
+    // Events left out at the end of the line cost nothing
+    m_costs.resize(eventCount);
+    for (int i = 0; i < eventCount; ++i) {
+        p = skipSpaces(p, end);
+        if (p == end) {
+            std::fill(m_costs.begin() + i, m_costs.end(), 0);
+            break;
+        }
+        if (!parseNumber(p, end, &m_costs[i]))
+            return fail(u"malformed cost in cost line"_s);
+    }
+
+    const int function = currentFunction();
+    if (m_nextLine == CallCostLine) {
+        const int index = m_profile->addCall(function, calledFunction());
+        m_profile->addCallCost(index, m_callCount, m_costs.constData());
+        m_nextLine = SelfCostLine;
+        m_calledObject = m_calledFile = -1;
+        // A positions: line between calls= and its cost line leaves no target
+        if (m_callTarget.size() != positionCount) {
+            m_callTarget = m_positions;
+            m_rawCallTargets = 0;
+        }
+        const PositionCosts::CallSite site{index, m_callCount, m_callTarget.constData(), m_rawCallTargets};
+        positionCosts.addLine(function, m_positions.constData(), &site, m_costs.constData());
+    } else {
+        m_profile->addSelfCost(function, m_costs.constData());
+        positionCosts.addLine(function, m_positions.constData(), nullptr, m_costs.constData());
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef CALLGRINDPARSER_H
+#define CALLGRINDPARSER_H
+
+#include "callgrindprofile.h"
+#include "chunkedarray.h"
+#include "lineindex.h"
+
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <QVarLengthArray>
+
+// Streaming parser for the Callgrind profile format. Lines are tokenized
+// directly from the input bytes (normally a read-only file mapping); the only
+// allocations are for names the first time they are seen and for the
+// position costs, which grow by a few bytes per cost line.
+class CallgrindParser
+{
+public:
+    // Costs are added to whatever \a profile already holds, so several parts
+    // of one run can be parsed into the same profile.
+    //
+    // If \a lineIndex is given it is filled in the same pass over the data.
+    bool parseFile(const QString &fileName, CallgrindProfile *profile);
+    bool parse(QByteArrayView data, CallgrindProfile *profile, LineIndex *lineIndex = nullptr);
+
+    // Incremental parsing of input that arrives in pieces, such as the output
+    // of a decompressor: begin(), then feed() the pieces in order. Every piece
+    // but the last must end at a line boundary. Line index offsets count from
+    // the start of the first piece; \a lineIndex must have been prepared with
+    // LineIndex::beginBuild().
+    void begin(CallgrindProfile *profile, LineIndex *lineIndex = nullptr);
+    bool feed(QByteArrayView data);
+
+    // Continues feeding from a copy of an earlier parser, into copies of the
+    // profile and line index it was filling. \a offset is where the next
+    // piece starts; all input so far must have ended at a line boundary.
+    void resume(CallgrindProfile *profile, LineIndex *lineIndex, qint64 offset);
+
+    // Reported every few megabytes; returning false cancels parsing.
+    void setProgressCallback(const LoadProgressCallback &callback) { m_progress = callback; }
+
+    QString errorString() const { return m_errorString; }
+    bool wasCanceled() const { return m_canceled; }
+    qint64 lineCount() const { return m_lineNumber; }
+
+private:
+    friend class ParallelCallgrindParser;
+
+    enum LineType {
+        SelfCostLine,
+        CallCostLine
+    };
+
+    bool parseLine(const char *begin, const char *end);
+    bool parseHeader(QByteArrayView key, QByteArrayView value);
+    bool parseCostLine(const char *begin, const char *end);
+    bool parseCallsLine(const char *begin, const char *end);
+    qsizetype preparePositions();
+    int parseName(CallgrindProfile::SymbolKind kind, const char *begin, const char *end);
+    int currentFunction();
+    int calledFunction();
+    int unknownSymbol(CallgrindProfile::SymbolKind kind);
+    void reset(CallgrindProfile *profile);
+    bool fail(const QString &message);
+
+    CallgrindProfile *m_profile = nullptr;
+    LineIndex *m_lineIndex = nullptr;
+    LoadProgressCallback m_progress;
+    qint64 m_offset = 0;
+    qint64 m_nextProgress = 0;
+    QString m_errorString;
+    qint64 m_lineNumber = 0;
+    bool m_canceled = false;
+
+    // Compressed "(id)" to symbol index, one table per symbol kind; chunked,
+    // so that a copy resumed on a live tail shares them
+    ChunkedArray<int> m_compressed[CallgrindProfile::SymbolKindCount];
+
+    int m_object = -1;
+    int m_file = -1;
+    int m_functionName = -1;
+    int m_function = -1;
+    int m_calledObject = -1;
+    int m_calledFile = -1;
+    int m_calledName = -1;
+
+    LineType m_nextLine = SelfCostLine;
+    quint64 m_callCount = 0;
+    // Where the pending call goes, and which of its positions are in
+    // another frame than those of the chunk (see PositionCosts::CallSite)
+    QVarLengthArray<quint64, 8> m_callTarget;
+    quint32 m_rawCallTargets = 0;
+
+    QVarLengthArray<quint64, 8> m_positions;
+    QVarLengthArray<quint64, 16> m_costs;
+
+    // Chunk mode, used by ParallelCallgrindParser for a slice of a file that
+    // starts at an fn= line. Compressed ids defined in earlier slices, and the
+    // object and file in effect where the slice starts, are not known yet;
+    // they become placeholder symbols that are resolved when merging.
+    struct SymbolReference {
+        CallgrindProfile::SymbolKind kind;
+        qsizetype id;
+        int symbol;
+    };
+
+    bool m_chunkMode = false;
+    bool m_needsSequential = false;
+    int m_inheritedObject = -1;
+    int m_inheritedFile = -1;
+    QList<SymbolReference> m_definitions;
+    QList<SymbolReference> m_unresolved;
+    // Per position: how many position cost ranges hold it relative to the
+    // end of the previous chunk, or -1 while it has only been relative
+    QVarLengthArray<int, 4> m_relativeRanges;
+};
+
+#endif // CALLGRINDPARSER_H
@@ -0,0 +1,323 @@
+#include "callgrindprofile.h"
+
+#include <algorithm>
+
+// Lookups added to a shared index are folded into a copy of it once they
+// come to this share of it, so a run of live updates copies it only as
+// often as it grows by that much
+static const qsizetype IndexFoldShare = 8;
+
+void CallgrindProfile::clear()
+{
+    *this = CallgrindProfile();
+}
+
+void CallgrindProfile::setEventNames(const QList<QByteArray> &names)
+{
+    Q_ASSERT(m_functions.isEmpty() && m_calls.isEmpty());
+    m_eventNames = names;
+    m_selfCosts.setWidth(eventCount());
+    m_callCosts.setWidth(eventCount());
+    m_positionCosts.setLayout(qMax(1, int(m_positionNames.size())), eventCount());
+}
+
+void CallgrindProfile::setPositionNames(const QList<QByteArray> &names)
+{
+    m_positionNames = names;
+    m_positionCosts.setLayout(qMax(1, int(names.size())), eventCount());
+}
+
+void CallgrindProfile::addEventDefinition(const QByteArray &definition)
+{
+    if (!m_eventDefinitions.contains(definition))
+        m_eventDefinitions.append(definition);
+}
+
+void CallgrindProfile::alignEvents(const QList<QByteArray> &names)
+{
+    if (names == m_eventNames)
+        return;
+
+    const int oldCount = eventCount();
+    const int newCount = int(names.size());
+    QList<int> column(oldCount);
+    for (int e = 0; e < oldCount; ++e) {
+        column[e] = int(names.indexOf(m_eventNames.at(e)));
+        Q_ASSERT(column.at(e) >= 0);
+    }
+    const auto align = [&](ChunkedArray<quint64> &costs) {
+        ChunkedArray<quint64> aligned(newCount);
+        aligned.resize(costs.size(), 0);
+        for (qsizetype record = 0; record < costs.size(); ++record) {
+            const quint64 *from = costs.constRowData(record);
+            quint64 *to = aligned.rowData(record);
+            for (int e = 0; e < oldCount; ++e)
+                to[column.at(e)] = from[e];
+        }
+        costs = std::move(aligned);
+    };
+    align(m_selfCosts);
+    align(m_callCosts);
+    m_positionCosts.alignEvents(column, newCount);
+    m_eventNames = names;
+}
+
+int CallgrindProfile::findFunction(int object, int file, int name) const
+{
+    return indexedFunction(FunctionKey{object, file, name});
+}
+
+int CallgrindProfile::indexedFunction(const FunctionKey &key) const
+{
+    if (m_index) {
+        const auto it = m_index->functions.constFind(key);
+        if (it != m_index->functions.cend())
+            return it.value();
+    }
+    return m_addedFunctions.value(key, -1);
+}
+
+int CallgrindProfile::indexedCall(quint64 key) const
+{
+    if (m_index) {
+        const auto it = m_index->calls.constFind(key);
+        if (it != m_index->calls.cend())
+            return it.value();
+    }
+    return m_addedCalls.value(key, -1);
+}
+
+// Whether the index can be added to in place: copies hold on to it
+bool CallgrindProfile::ownsIndex()
+{
+    if (!m_index)
+        m_index = QExplicitlySharedDataPointer<Index>(new Index);
+    return m_index->ref.loadRelaxed() == 1;
+}
+
+void CallgrindProfile::foldIndex()
+{
+    const qsizetype added = m_addedFunctions.size() + m_addedCalls.size();
+    if (added * IndexFoldShare < m_index->functions.size() + m_index->calls.size())
+        return;
+    m_index.detach();
+    for (auto it = m_addedFunctions.cbegin(); it != m_addedFunctions.cend(); ++it)
+        m_index->functions.insert(it.key(), it.value());
+    for (auto it = m_addedCalls.cbegin(); it != m_addedCalls.cend(); ++it)
+        m_index->calls.insert(it.key(), it.value());
+    m_addedFunctions.clear();
+    m_addedCalls.clear();
+}
+
+int CallgrindProfile::addFunction(int object, int file, int name)
+{
+    // Most names belong to exactly one function, so try the direct
+    // name-indexed slot before paying for a hash lookup.
+    if (name < m_functionByName.size()) {
+        const int candidate = m_functionByName.at(name);
+        if (candidate >= 0) {
+            const Function &function = m_functions.at(candidate);
+            if (function.object == object && function.file == file)
+                return candidate;
+        }
+    }
+
+    const FunctionKey key{object, file, name};
+    int index = indexedFunction(key);
+    if (index < 0) {
+        index = int(m_functions.size());
+        m_functions.append(Function{object, file, name});
+        if (ownsIndex()) {
+            m_index->functions.insert(key, index);
+        } else {
+            m_addedFunctions.insert(key, index);
+            foldIndex();
+        }
+        m_selfCosts.resize(m_selfCosts.size() + 1, 0);
+    }
+
+    if (m_functionByName.size() <= name)
+        m_functionByName.resize(name + 1, -1);
+    if (m_functionByName.at(name) != index)
+        m_functionByName[name] = index;
+    return index;
+}
+
+void CallgrindProfile::addSelfCost(int function, const quint64 *costs)
+{
+    quint64 *dst = m_selfCosts.rowData(function);
+    for (int i = 0; i < eventCount(); ++i)
+        dst[i] += costs[i];
+}
+
+int CallgrindProfile::addCall(int caller, int callee)
+{
+    const quint64 key = (quint64(quint32(caller)) << 32) | quint32(callee);
+    const int existing = indexedCall(key);
+    if (existing >= 0)
+        return existing;
+
+    const int index = int(m_calls.size());
+    m_calls.append(Call{caller, callee, 0});
+    if (ownsIndex()) {
+        m_index->calls.insert(key, index);
+    } else {
+        m_addedCalls.insert(key, index);
+        foldIndex();
+    }
+    m_callCosts.resize(m_callCosts.size() + 1, 0);
+    return index;
+}
+
+void CallgrindProfile::addCallCost(int call, quint64 count, const quint64 *costs)
+{
+    m_calls[call].count += count;
+    quint64 *dst = m_callCosts.rowData(call);
+    for (int i = 0; i < eventCount(); ++i)
+        dst[i] += costs[i];
+}
+
+quint64 CallgrindProfile::totalCost(int event) const
+{
+    quint64 total = 0;
+    for (int function = 0; function < functionCount(); ++function)
+        total += selfCost(function, event);
+    return total;
+}
+
+// Rows of \a costs, a copy of \a previous, that are new or differ from
+// theirs there; the rows of chunks the two still share are not compared
+static QList<int> changedRows(const ChunkedArray<quint64> &costs, const ChunkedArray<quint64> &previous)
+{
+    Q_ASSERT(costs.width() == previous.width());
+    QList<int> changed;
+    for (int chunk = 0; chunk < costs.chunkCount(); ++chunk) {
+        if (costs.sharesChunk(previous, chunk))
+            continue;
+        const qsizetype first = qsizetype(chunk) * ChunkedArray<quint64>::ChunkRows;
+        const qsizetype end = first + costs.chunkRowCount(chunk);
+        for (qsizetype row = first; row < end; ++row) {
+            if (row >= previous.size()
+                || !std::equal(costs.constRowData(row), costs.constRowData(row) + costs.width(),
+                               previous.constRowData(row))) {
+                changed.append(int(row));
+            }
+        }
+    }
+    return changed;
+}
+
+QList<int> CallgrindProfile::changedFunctions(const CallgrindProfile &previous) const
+{
+    return changedRows(m_selfCosts, previous.m_selfCosts);
+}
+
+QList<int> CallgrindProfile::changedCalls(const CallgrindProfile &previous) const
+{
+    return changedRows(m_callCosts, previous.m_callCosts);
+}
+
+void CallgrindProfile::merge(const CallgrindProfile &other)
+{
+    QList<QByteArray> names = m_eventNames;
+    for (const QByteArray &name : other.m_eventNames) {
+        if (!names.contains(name))
+            names.append(name);
+    }
+
+    bool empty = m_functions.isEmpty() && m_calls.isEmpty();
+    for (const SymbolTable &symbols : m_symbols)
+        empty = empty && symbols.isEmpty();
+    if (empty) {
+        // Nothing to match against: take over the tables wholesale
+        const QHash<QByteArray, QByteArray> headers = m_headers;
+        *this = other;
+        m_headers = headers;
+        alignEvents(names);
+        return;
+    }
+
+    alignEvents(names);
+    if (m_positionNames.isEmpty())
+        setPositionNames(other.m_positionNames);
+    for (const QByteArray &definition : other.m_eventDefinitions)
+        addEventDefinition(definition);
+
+    // Cost rows of other in this profile's column order; used as they are
+    // when both list the same events
+    const int otherCount = other.eventCount();
+    QList<int> column(otherCount);
+    bool sameColumns = otherCount == eventCount();
+    for (int e = 0; e < otherCount; ++e) {
+        column[e] = int(m_eventNames.indexOf(other.m_eventNames.at(e)));
+        sameColumns = sameColumns && column.at(e) == e;
+    }
+    QList<quint64> aligned(eventCount(), 0);
+    const auto align = [&](const quint64 *costs) {
+        if (sameColumns)
+            return costs;
+        for (int e = 0; e < otherCount; ++e)
+            aligned[column.at(e)] = costs[e];
+        return aligned.constData();
+    };
+
+    QList<int> symbolMap[SymbolKindCount];
+    for (int kind = 0; kind < SymbolKindCount; ++kind) {
+        const SymbolTable &symbols = other.m_symbols[kind];
+        symbolMap[kind].resize(symbols.count());
+        for (int symbol = 0; symbol < symbols.count(); ++symbol)
+            symbolMap[kind][symbol] = m_symbols[kind].insert(symbols.name(symbol));
+    }
+
+    QList<int> functionMap(other.functionCount());
+    for (int i = 0; i < other.functionCount(); ++i) {
+        const Function &function = other.function(i);
+        functionMap[i] = addFunction(symbolMap[ObjectSymbol].at(function.object),
+                                     symbolMap[FileSymbol].at(function.file),
+                                     symbolMap[FunctionSymbol].at(function.name));
+        addSelfCost(functionMap.at(i), align(other.selfCosts(i)));
+    }
+    QList<int> callMap(other.callCount());
+    for (int i = 0; i < other.callCount(); ++i) {
+        const Call &call = other.call(i);
+        callMap[i] = addCall(functionMap.at(call.caller), functionMap.at(call.callee));
+        addCallCost(callMap.at(i), call.count, align(other.callCosts(i)));
+    }
+
+    // Position costs only add up under the same positions: layout
+    const PositionCosts &positions = other.m_positionCosts;
+    if (positions.positionCount() == m_positionCosts.positionCount()) {
+        if (sameColumns) {
+            m_positionCosts.append(positions, functionMap, callMap);
+        } else {
+            PositionCosts aligned = positions;
+            aligned.alignEvents(column, eventCount());
+            m_positionCosts.append(aligned, functionMap, callMap);
+        }
+    }
+}
+
+CallgrindProfile::MemoryUsage CallgrindProfile::memoryUsage() const
+{
+    // QHash keeps its nodes in spans with one offset byte per bucket
+    const auto hashBytes = [](const auto &hash, qsizetype nodeSize) {
+        return qint64(hash.capacity()) * (nodeSize + 1);
+    };
+
+    const qsizetype functionNode = sizeof(FunctionKey) + sizeof(int);
+    const qsizetype callNode = sizeof(quint64) + sizeof(int);
+
+    MemoryUsage usage;
+    for (const SymbolTable &symbols : m_symbols)
+        usage.symbols += symbols.memoryUsage().total();
+    usage.functions = m_functions.memoryUsage() + m_functionByName.memoryUsage()
+            + hashBytes(m_addedFunctions, functionNode);
+    usage.calls = m_calls.memoryUsage() + hashBytes(m_addedCalls, callNode);
+    if (m_index) {
+        usage.functions += hashBytes(m_index->functions, functionNode);
+        usage.calls += hashBytes(m_index->calls, callNode);
+    }
+    usage.costs = m_selfCosts.memoryUsage() + m_callCosts.memoryUsage();
+    usage.positions = m_positionCosts.memoryUsage();
+    return usage;
+}
@@ -0,0 +1,172 @@
+#ifndef CALLGRINDPROFILE_H
+#define CALLGRINDPROFILE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QExplicitlySharedDataPointer>
+#include <QHash>
+#include <QList>
+#include <QSharedData>
+
+#include "chunkedarray.h"
+#include "positioncosts.h"
+#include "symboltable.h"
+
+// Structured, text-free representation of a Callgrind profile: interned
+// object/file/function names, one record per function with its self cost and
+// one record per caller/callee arc with its call count and inclusive cost.
+// Costs are stored in arrays with eventCount() entries per record. The cost
+// lines themselves, by position, are kept in positionCosts().
+//
+// Copies share everything but what they change: the arrays and symbol
+// tables chunk by chunk, the lookup indexes while the copy adds to a small
+// one of its own. A live tail thus copies the previous profile for little
+// more than the chunks its new lines touch, which changedFunctions() and
+// changedCalls() then find without comparing the rest.
+class CallgrindProfile
+{
+public:
+    enum SymbolKind {
+        ObjectSymbol,
+        FileSymbol,
+        FunctionSymbol,
+        SymbolKindCount
+    };
+
+    struct Function {
+        int object;
+        int file;
+        int name;
+    };
+
+    struct Call {
+        int caller;
+        int callee;
+        quint64 count;
+    };
+
+    void clear();
+
+    void setEventNames(const QList<QByteArray> &names);
+    const QList<QByteArray> &eventNames() const { return m_eventNames; }
+    int eventCount() const { return int(m_eventNames.size()); }
+
+    // Rearranges the cost columns to \a names, which must include every
+    // current event; events new to the profile start at zero.
+    void alignEvents(const QList<QByteArray> &names);
+
+    void setPositionNames(const QList<QByteArray> &names);
+    const QList<QByteArray> &positionNames() const { return m_positionNames; }
+
+    // Values of the "event:" lines in order, such as "CEst = Ir + 10 Bm":
+    // descriptions of events and formulas of derived ones
+    void addEventDefinition(const QByteArray &definition);
+    const QList<QByteArray> &eventDefinitions() const { return m_eventDefinitions; }
+
+    void setHeader(const QByteArray &key, const QByteArray &value) { m_headers.insert(key, value); }
+    QByteArray header(const QByteArray &key) const { return m_headers.value(key); }
+    const QHash<QByteArray, QByteArray> &headers() const { return m_headers; }
+
+    int symbolCount(SymbolKind kind) const { return m_symbols[kind].count(); }
+    QByteArrayView symbolName(SymbolKind kind, int symbol) const { return m_symbols[kind].name(symbol); }
+    int findSymbol(SymbolKind kind, QByteArrayView name) const { return m_symbols[kind].find(name); }
+    int addSymbol(SymbolKind kind, QByteArrayView name) { return m_symbols[kind].insert(name); }
+    void reserveSymbols(SymbolKind kind, int count) { m_symbols[kind].reserve(count); }
+    const SymbolTable &symbols(SymbolKind kind) const { return m_symbols[kind]; }
+
+    int functionCount() const { return int(m_functions.size()); }
+    const Function &function(int index) const { return m_functions.at(index); }
+    int findFunction(int object, int file, int name) const;
+    int addFunction(int object, int file, int name);
+    QByteArrayView functionName(int index) const { return symbolName(FunctionSymbol, m_functions.at(index).name); }
+
+    quint64 selfCost(int function, int event) const { return selfCosts(function)[event]; }
+    const quint64 *selfCosts(int function) const { return m_selfCosts.constRowData(function); }
+    void addSelfCost(int function, const quint64 *costs);
+
+    int callCount() const { return int(m_calls.size()); }
+    const Call &call(int index) const { return m_calls.at(index); }
+    int addCall(int caller, int callee);
+
+    quint64 callCost(int call, int event) const { return callCosts(call)[event]; }
+    const quint64 *callCosts(int call) const { return m_callCosts.constRowData(call); }
+    void addCallCost(int call, quint64 count, const quint64 *costs);
+
+    const PositionCosts &positionCosts() const { return m_positionCosts; }
+    PositionCosts &positionCosts() { return m_positionCosts; }
+
+    // Sum of all self costs for an event.
+    quint64 totalCost(int event) const;
+
+    // Functions, and calls, of this profile, a copy of \a previous that
+    // went on with the same events, that are new or whose costs differ, in
+    // ascending order
+    QList<int> changedFunctions(const CallgrindProfile &previous) const;
+    QList<int> changedCalls(const CallgrindProfile &previous) const;
+
+    // Adds the functions, calls and costs of \a other, matching names and
+    // events by name. Events only \a other records are appended to
+    // eventNames(), its event definitions to eventDefinitions(). Headers
+    // are left alone.
+    void merge(const CallgrindProfile &other);
+
+    // Bytes held by the model, by part. Hash tables are estimated from their
+    // capacity.
+    struct MemoryUsage {
+        qint64 symbols = 0;
+        qint64 functions = 0;
+        qint64 calls = 0;
+        qint64 costs = 0;
+        qint64 positions = 0;
+
+        qint64 total() const { return symbols + functions + calls + costs + positions; }
+    };
+    MemoryUsage memoryUsage() const;
+
+private:
+    struct FunctionKey {
+        int object;
+        int file;
+        int name;
+
+        friend bool operator==(const FunctionKey &a, const FunctionKey &b) noexcept
+        { return a.object == b.object && a.file == b.file && a.name == b.name; }
+        friend size_t qHash(const FunctionKey &key, size_t seed = 0) noexcept
+        { return qHashMulti(seed, key.object, key.file, key.name); }
+    };
+
+    QList<QByteArray> m_eventNames;
+    QList<QByteArray> m_positionNames;
+    QList<QByteArray> m_eventDefinitions;
+    QHash<QByteArray, QByteArray> m_headers;
+
+    SymbolTable m_symbols[SymbolKindCount];
+
+    // Functions and calls are looked up in an index that copies share, then
+    // in those added since the copy, which are folded in once they make up
+    // a good share of the index
+    struct Index : QSharedData {
+        QHash<FunctionKey, int> functions;
+        QHash<quint64, int> calls;
+    };
+
+    int indexedFunction(const FunctionKey &key) const;
+    int indexedCall(quint64 key) const;
+    bool ownsIndex();
+    void foldIndex();
+
+    ChunkedArray<Function> m_functions;
+    ChunkedArray<int> m_functionByName;
+    ChunkedArray<quint64> m_selfCosts;
+
+    ChunkedArray<Call> m_calls;
+    ChunkedArray<quint64> m_callCosts;
+
+    QExplicitlySharedDataPointer<Index> m_index;
+    QHash<FunctionKey, int> m_addedFunctions;
+    QHash<quint64, int> m_addedCalls;
+
+    PositionCosts m_positionCosts;
+};
+
+#endif // CALLGRINDPROFILE_H
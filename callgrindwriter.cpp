@@ -0,0 +1,308 @@
+#include "callgrindwriter.h"
+
+#include <QIODevice>
+#include <QSaveFile>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <charconv>
+
+// Text is built in memory and handed to the device in blocks of this size
+static const qsizetype FlushSize = 1 << 20;
+
+// Written by the writer itself rather than copied from the profile
+static const char *const ReservedHeaders[] = {
+    "creator", "event", "events", "positions", "summary", "totals", "version"
+};
+
+namespace {
+
+int digitCount(quint64 value, quint64 base)
+{
+    int count = 1;
+    for (; value >= base; value /= base)
+        ++count;
+    return count;
+}
+
+class TextBuffer
+{
+public:
+    explicit TextBuffer(QIODevice *device)
+        : m_device(device)
+    {
+        m_data.reserve(FlushSize + 4096);
+    }
+
+    void append(QByteArrayView text) { m_data.append(text.data(), text.size()); }
+    void append(char c) { m_data.append(c); }
+
+    void appendNumber(quint64 value)
+    {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        m_data.append(digits, result.ptr - digits);
+    }
+
+    void appendHexNumber(quint64 value)
+    {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value, 16);
+        m_data.append("0x", 2);
+        m_data.append(digits, result.ptr - digits);
+    }
+
+    // The costs after the position columns, without trailing zeros, which
+    // the format lets readers fill in
+    void appendCosts(const quint64 *costs, int eventCount)
+    {
+        while (eventCount > 0 && costs[eventCount - 1] == 0)
+            --eventCount;
+        for (int e = 0; e < eventCount; ++e) {
+            append(' ');
+            appendNumber(costs[e]);
+        }
+        append('\n');
+    }
+
+    bool flush(bool force = false)
+    {
+        if (!m_ok || (!force && m_data.size() < FlushSize))
+            return m_ok;
+        m_ok = m_device->write(m_data) == m_data.size();
+        m_data.clear();
+        return m_ok;
+    }
+
+private:
+    QIODevice *m_device;
+    QByteArray m_data;
+    bool m_ok = true;
+};
+
+} // namespace
+
+bool CallgrindWriter::write(const CallgrindProfile &profile, QIODevice *device)
+{
+    m_errorString.clear();
+    TextBuffer out(device);
+    const int eventCount = profile.eventCount();
+
+    out.append("# callgrind format\nversion: 1\ncreator: simpletextviewer\n");
+    QList<QByteArray> keys = profile.headers().keys();
+    std::sort(keys.begin(), keys.end());
+    for (const QByteArray &key : std::as_const(keys)) {
+        if (std::find(std::begin(ReservedHeaders), std::end(ReservedHeaders), key) != std::end(ReservedHeaders))
+            continue;
+        out.append(key);
+        out.append(": ");
+        out.append(profile.header(key));
+        out.append('\n');
+    }
+    // Positions are written relative to the previous cost line where that
+    // is shorter, as callgrind does, and instruction addresses in hex. The
+    // target of a calls= line is written the same way but is not a position
+    // the next line builds on.
+    const PositionCosts &positionCosts = profile.positionCosts();
+    const int positionCount = positionCosts.positionCount();
+    QList<QByteArray> positionNames = profile.positionNames();
+    if (positionNames.size() != positionCount)
+        positionNames = {"line"};
+    QVarLengthArray<quint64, 4> position(positionCount, 0);
+    const auto appendPositions = [&](const quint64 *positions, bool relative, bool update = true) {
+        for (int p = 0; p < positionCount; ++p) {
+            if (p > 0)
+                out.append(' ');
+            const qint64 delta = qint64(positions[p] - position[p]);
+            const bool address = positionNames.at(p) == "instr";
+            const quint64 magnitude = delta < 0 ? 0 - quint64(delta) : quint64(delta);
+            // "*", "+n" or "-n" if shorter than the absolute value
+            const int absoluteLength = address ? 2 + digitCount(positions[p], 16) : digitCount(positions[p], 10);
+            const int relativeLength = delta == 0 ? 1 : 1 + digitCount(magnitude, 10);
+            if (relative && relativeLength < absoluteLength) {
+                if (delta == 0) {
+                    out.append('*');
+                } else {
+                    out.append(delta > 0 ? '+' : '-');
+                    out.appendNumber(magnitude);
+                }
+            } else if (address) {
+                out.appendHexNumber(positions[p]);
+            } else {
+                out.appendNumber(positions[p]);
+            }
+            if (update)
+                position[p] = positions[p];
+        }
+    };
+
+    out.append("positions:");
+    for (const QByteArray &name : std::as_const(positionNames)) {
+        out.append(' ');
+        out.append(name);
+    }
+    out.append('\n');
+    for (const QByteArray &definition : profile.eventDefinitions()) {
+        out.append("event: ");
+        out.append(definition);
+        out.append('\n');
+    }
+    out.append("events:");
+    for (const QByteArray &name : profile.eventNames()) {
+        out.append(' ');
+        out.append(name);
+    }
+    out.append("\nsummary:");
+    for (int e = 0; e < eventCount; ++e) {
+        out.append(' ');
+        out.appendNumber(profile.totalCost(e));
+    }
+    out.append("\n\n");
+
+    // Names are written in full the first time and as "(id)" afterwards
+    QList<bool> defined[CallgrindProfile::SymbolKindCount];
+    for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind)
+        defined[kind].resize(profile.symbolCount(CallgrindProfile::SymbolKind(kind)), false);
+    const auto appendName = [&](QByteArrayView key, CallgrindProfile::SymbolKind kind, int symbol) {
+        out.append(key);
+        out.append('(');
+        out.appendNumber(quint64(symbol) + 1);
+        out.append(')');
+        if (!defined[kind].at(symbol)) {
+            defined[kind][symbol] = true;
+            out.append(' ');
+            out.append(profile.symbolName(kind, symbol));
+        }
+        out.append('\n');
+    };
+
+    // Calls grouped by caller
+    const int functionCount = profile.functionCount();
+    QList<int> callOffsets(functionCount + 1, 0);
+    for (int call = 0; call < profile.callCount(); ++call)
+        ++callOffsets[profile.call(call).caller + 1];
+    for (int f = 0; f < functionCount; ++f)
+        callOffsets[f + 1] += callOffsets.at(f);
+    QList<int> calls(profile.callCount());
+    QList<int> callIndex(profile.callCount());
+    QList<int> next = callOffsets;
+    for (int call = 0; call < profile.callCount(); ++call) {
+        callIndex[call] = next[profile.call(call).caller]++;
+        calls[callIndex.at(call)] = call;
+    }
+
+    QVarLengthArray<quint64, 16> remainder(eventCount);
+    // Per call of the function being written: its count and costs not yet
+    // written at a call site, and whether it had any
+    QList<quint64> callRemainders;
+    QList<bool> callWritten;
+    int object = -1;
+    int file = -1;
+    for (int f = 0; f < functionCount; ++f) {
+        const CallgrindProfile::Function &function = profile.function(f);
+        if (function.object != object) {
+            object = function.object;
+            appendName("ob=", CallgrindProfile::ObjectSymbol, object);
+        }
+        if (function.file != file) {
+            file = function.file;
+            appendName("fl=", CallgrindProfile::FileSymbol, file);
+        }
+        appendName("fn=", CallgrindProfile::FunctionSymbol, function.name);
+
+        // Self cost by position, then whatever the positions do not account
+        // for, such as costs merged in from a profile with another layout
+        const PositionCosts::Table costs = positionCosts.table(f);
+        std::copy(profile.selfCosts(f), profile.selfCosts(f) + eventCount, remainder.begin());
+        for (int row = 0; row < costs.rowCount(); ++row) {
+            const quint64 *self = costs.selfCosts(row);
+            if (std::all_of(self, self + eventCount, [](quint64 cost) { return cost == 0; }))
+                continue;
+            appendPositions(costs.positions(row), true);
+            out.appendCosts(self, eventCount);
+            for (int e = 0; e < eventCount; ++e)
+                remainder[e] -= qMin(remainder.at(e), self[e]);
+        }
+        if (costs.rowCount() == 0
+            || std::any_of(remainder.cbegin(), remainder.cend(), [](quint64 cost) { return cost != 0; })) {
+            appendPositions(position.constData(), false);
+            out.appendCosts(remainder.constData(), eventCount);
+        }
+
+        const int firstCall = callOffsets.at(f);
+        const int callCount = callOffsets.at(f + 1) - firstCall;
+        const qsizetype stride = 1 + qsizetype(eventCount);
+        callRemainders.resize(callCount * stride);
+        callWritten.fill(false, callCount);
+        for (int i = 0; i < callCount; ++i) {
+            const int call = calls.at(firstCall + i);
+            callRemainders[i * stride] = profile.call(call).count;
+            std::copy(profile.callCosts(call), profile.callCosts(call) + eventCount,
+                      callRemainders.begin() + i * stride + 1);
+        }
+        // cob= and cfi= only hold for the next call and default to the
+        // caller's object and file
+        const auto appendCall = [&](int call, quint64 count, const quint64 *target) {
+            const CallgrindProfile::Function &callee = profile.function(profile.call(call).callee);
+            if (callee.object != object)
+                appendName("cob=", CallgrindProfile::ObjectSymbol, callee.object);
+            if (callee.file != file)
+                appendName("cfi=", CallgrindProfile::FileSymbol, callee.file);
+            appendName("cfn=", CallgrindProfile::FunctionSymbol, callee.name);
+            out.append("calls=");
+            out.appendNumber(count);
+            out.append(' ');
+            appendPositions(target, true, false);
+            out.append('\n');
+        };
+
+        // Calls where they were made, then whatever of each call the call
+        // sites do not account for
+        const PositionCosts::CallLines callLines = positionCosts.callLines(f);
+        for (int row = 0; row < callLines.rowCount(); ++row) {
+            const int call = callLines.call(row);
+            const qsizetype i = callIndex.at(call) - firstCall;
+            quint64 *left = callRemainders.data() + i * stride;
+            appendCall(call, callLines.count(row), callLines.target(row));
+            appendPositions(callLines.positions(row), true);
+            out.appendCosts(callLines.costs(row), eventCount);
+            left[0] -= qMin(left[0], callLines.count(row));
+            for (int e = 0; e < eventCount; ++e)
+                left[1 + e] -= qMin(left[1 + e], callLines.costs(row)[e]);
+            callWritten[i] = true;
+        }
+        for (int i = 0; i < callCount; ++i) {
+            const quint64 *left = callRemainders.constData() + i * stride;
+            if (callWritten.at(i) && std::all_of(left, left + stride, [](quint64 value) { return value == 0; }))
+                continue;
+            appendCall(calls.at(firstCall + i), left[0], position.constData());
+            appendPositions(position.constData(), false);
+            out.appendCosts(left + 1, eventCount);
+        }
+        out.append('\n');
+        if (!out.flush())
+            break;
+    }
+
+    if (!out.flush(true)) {
+        m_errorString = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool CallgrindWriter::save(const CallgrindProfile &profile, const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    if (!write(profile, &file))
+        return false;
+    if (!file.commit()) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef CALLGRINDWRITER_H
+#define CALLGRINDWRITER_H
+
+#include "callgrindprofile.h"
+
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// Writes a CallgrindProfile back out in the Callgrind format, with
+// compressed names and positions: each function's self cost by position,
+// followed by its calls at the positions they were made from, with the
+// positions they went to. The summary: line is recomputed from the costs.
+class CallgrindWriter
+{
+public:
+    bool write(const CallgrindProfile &profile, QIODevice *device);
+
+    // Writes through QSaveFile, so an existing file is only replaced once
+    // the new one is complete.
+    bool save(const CallgrindProfile &profile, const QString &fileName);
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    QString m_errorString;
+};
+
+#endif // CALLGRINDWRITER_H
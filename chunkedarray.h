@@ -0,0 +1,145 @@
+#ifndef CHUNKEDARRAY_H
+#define CHUNKEDARRAY_H
+
+#include <QList>
+#include <QSharedData>
+#include <QSharedDataPointer>
+
+#include <algorithm>
+
+// Growable array of rows of width() values each, kept in chunks of
+// 2^ChunkBits rows. Copies share the chunks, and writing to a copy detaches
+// only the chunk written to, so a copy that grows at the end or changes in
+// a few rows costs those chunks rather than the whole array, as a live tail
+// continuing a large profile does. A row never straddles two chunks and is
+// contiguous; the array as a whole is not.
+//
+// sharesChunk() tells the chunks a copy still shares with the array it was
+// taken from, whose rows need no comparing to know they are unchanged.
+template <typename T, int ChunkBits = 10>
+class ChunkedArray
+{
+public:
+    static constexpr qsizetype ChunkRows = qsizetype(1) << ChunkBits;
+
+    explicit ChunkedArray(int width = 1) : m_width(width) {}
+
+    // Drops the rows
+    void setWidth(int width)
+    {
+        clear();
+        m_width = width;
+    }
+    int width() const { return m_width; }
+
+    qsizetype size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    void clear()
+    {
+        m_chunks.clear();
+        m_size = 0;
+    }
+    void reserve(qsizetype rows) { m_chunks.reserve((rows + ChunkRows - 1) >> ChunkBits); }
+
+    // The first value of \a row, which is all of it for a width of one
+    const T &at(qsizetype row) const { return *constRowData(row); }
+    T &operator[](qsizetype row) { return *rowData(row); }
+    const T &constLast() const { return at(m_size - 1); }
+    T &last() { return (*this)[m_size - 1]; }
+
+    const T *constRowData(qsizetype row) const
+    {
+        return m_chunks.at(row >> ChunkBits)->values.constData() + (row & (ChunkRows - 1)) * m_width;
+    }
+    // Detaches the chunk of \a row
+    T *rowData(qsizetype row)
+    {
+        return m_chunks[row >> ChunkBits]->values.data() + (row & (ChunkRows - 1)) * m_width;
+    }
+
+    void append(const T &value) { appendRows(&value, 1); }
+    void appendRow(const T *values) { appendRows(values, 1); }
+    // \a count rows of width() values
+    void appendRows(const T *values, qsizetype count)
+    {
+        while (count > 0) {
+            const qsizetype rows = qMin(count, grow(count));
+            std::copy_n(values, rows * m_width, rowData(m_size - rows));
+            values += rows * m_width;
+            count -= rows;
+        }
+    }
+    void resize(qsizetype rows, const T &value = T())
+    {
+        if (rows < m_size) {
+            m_chunks.resize((rows + ChunkRows - 1) >> ChunkBits);
+            if (!m_chunks.isEmpty())
+                m_chunks.last()->values.resize((rows - ((m_chunks.size() - 1) << ChunkBits)) * m_width);
+            m_size = rows;
+            return;
+        }
+        while (m_size < rows) {
+            const qsizetype added = grow(rows - m_size);
+            std::fill_n(rowData(m_size - added), added * m_width, value);
+        }
+    }
+    void fill(const T &value, qsizetype rows)
+    {
+        clear();
+        resize(rows, value);
+    }
+
+    // Chunks in order, for passes over all rows
+    int chunkCount() const { return int(m_chunks.size()); }
+    qsizetype chunkRowCount(int chunk) const { return m_chunks.at(chunk)->values.size() / m_width; }
+    const T *chunkData(int chunk) const { return m_chunks.at(chunk)->values.constData(); }
+    // Whether \a chunk is the same one in \a other, a copy of this array or
+    // the array this is a copy of, and so holds the same rows there
+    bool sharesChunk(const ChunkedArray &other, int chunk) const
+    {
+        return chunk < other.m_chunks.size()
+                && m_chunks.at(chunk).constData() == other.m_chunks.at(chunk).constData();
+    }
+
+    void squeeze()
+    {
+        m_chunks.squeeze();
+        if (m_chunks.isEmpty())
+            return;
+        const QList<T> &values = m_chunks.constLast()->values;
+        if (values.capacity() > values.size())
+            m_chunks.last()->values.squeeze();
+    }
+    qint64 memoryUsage() const
+    {
+        qint64 bytes = m_chunks.capacity() * qint64(sizeof(QSharedDataPointer<Chunk>));
+        for (const QSharedDataPointer<Chunk> &chunk : m_chunks)
+            bytes += sizeof(Chunk) + chunk->values.capacity() * qint64(sizeof(T));
+        return bytes;
+    }
+
+private:
+    struct Chunk : QSharedData {
+        QList<T> values;
+    };
+
+    // Adds up to \a rows default rows at the end of the last chunk, or of a
+    // new one if it is full, and returns how many
+    qsizetype grow(qsizetype rows)
+    {
+        if (m_size == qsizetype(m_chunks.size()) << ChunkBits)
+            m_chunks.append(QSharedDataPointer<Chunk>(new Chunk));
+        const qsizetype used = m_size & (ChunkRows - 1);
+        const qsizetype added = qMin(rows, ChunkRows - used);
+        QList<T> &values = m_chunks.last()->values;
+        values.resize((used + added) * m_width);
+        m_size += added;
+        return added;
+    }
+
+    QList<QSharedDataPointer<Chunk>> m_chunks;
+    qsizetype m_size = 0;
+    int m_width = 1;
+};
+
+#endif // CHUNKEDARRAY_H
@@ -0,0 +1,16 @@
+#include "commandline.h"
+
+#include <QCoreApplication>
+
+// The headless commands on their own, for machines without the GUI libraries
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+    if (arguments.size() > 1 && !CommandLine::isCommand(arguments.at(1).toLocal8Bit().constData())
+        && !arguments.at(1).startsWith(u'-')) {
+        // "callgrindcli file" is short for "callgrindcli summary file"
+        arguments.insert(1, QStringLiteral("summary"));
+    }
+    return CommandLine::run(arguments);
+}
@@ -0,0 +1,690 @@
+#include "commandline.h"
+#include "callgraph.h"
+#include "callgrindprofile.h"
+#include "callgrindwriter.h"
+#include "eventformula.h"
+#include "flatprofile.h"
+#include "mappedfile.h"
+#include "parallelcallgrindparser.h"
+#include "profilediff.h"
+#include "profilemerger.h"
+#include "streamdecompressor.h"
+#include "tracer.h"
+
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+using namespace Qt::StringLiterals;
+
+namespace {
+
+enum class Format {
+    Text,
+    Csv,
+    Json
+};
+
+struct Options {
+    int top = 20;
+    int event = 0;
+    bool inclusive = false;
+    bool ascending = false;
+    Format format = Format::Text;
+};
+
+QTextStream &standardError()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// A parsed profile with the models built on it
+struct Analysis {
+    QString name;
+    CallgrindProfile profile;
+    CallGraph callGraph;
+    FlatProfile flatProfile;
+
+    void build()
+    {
+        const TraceScope scope("build models", nullptr, "cli");
+        callGraph.build(profile);
+        flatProfile.build(callGraph);
+        if (!flatProfile.errorString().isEmpty()) {
+            standardError() << name << ": derived events left out: " << flatProfile.errorString() << '\n';
+            standardError().flush();
+        }
+    }
+
+    // Derived events given with --formula, after those of the profile
+    bool addFormulas(const QStringList &definitions, QString *errorString)
+    {
+        const TraceScope scope("derived events", nullptr, "cli");
+        for (const QString &definition : definitions) {
+            EventFormula formula;
+            QString error;
+            if (!formula.parseDefinition(definition.toUtf8()))
+                error = formula.errorString();
+            else if (!flatProfile.setDerivedEvent(formula))
+                error = flatProfile.errorString();
+            if (!error.isEmpty()) {
+                *errorString = u"--formula %1: %2"_s.arg(definition, error);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+int fail(const QString &message)
+{
+    standardError() << message << '\n';
+    standardError().flush();
+    return 1;
+}
+
+// Uncompressed files are parsed straight from the mapping on all cores;
+// compressed ones are streamed through the merger, so that the decompressed
+// text is never held in memory as a whole
+bool loadProfile(const QString &fileName, int threads, CallgrindProfile *profile, QString *errorString)
+{
+    const TraceScope scope("load", nullptr, "cli");
+    MappedFile file;
+    if (!file.open(fileName)) {
+        *errorString = u"%1: %2"_s.arg(fileName, file.errorString());
+        return false;
+    }
+    if (StreamDecompressor::detectFormat(file.data()) != StreamDecompressor::Uncompressed) {
+        file.close();
+        ProfileMerger merger;
+        if (!merger.merge({fileName}, profile)) {
+            *errorString = merger.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    file.adviseSequential();
+    ParallelCallgrindParser parser;
+    parser.setThreadCount(threads);
+    if (!parser.parse(file.data(), profile)) {
+        *errorString = u"%1: %2"_s.arg(fileName, parser.errorString());
+        return false;
+    }
+    return true;
+}
+
+QString number(qint64 value)
+{
+    // Grouped like callgrind_annotate, whatever the system locale
+    static const QLocale locale(QLocale::English);
+    return locale.toString(value);
+}
+
+QString percentage(quint64 value, quint64 total)
+{
+    return total == 0 ? u"-"_s : QString::number(100.0 * double(value) / double(total), 'f', 1) + u'%';
+}
+
+QString csvField(const QString &text)
+{
+    if (!text.contains(u',') && !text.contains(u'"') && !text.contains(u'\n'))
+        return text;
+    QString quoted = text;
+    quoted.replace(u"\""_s, u"\"\""_s);
+    return u'"' + quoted + u'"';
+}
+
+QString jsonString(const QString &text)
+{
+    QString escaped;
+    escaped.reserve(text.size() + 2);
+    escaped += u'"';
+    for (const QChar c : text) {
+        switch (c.unicode()) {
+        case '"':
+            escaped += u"\\\""_s;
+            break;
+        case '\\':
+            escaped += u"\\\\"_s;
+            break;
+        case '\n':
+            escaped += u"\\n"_s;
+            break;
+        case '\t':
+            escaped += u"\\t"_s;
+            break;
+        default:
+            if (c.unicode() < 0x20)
+                escaped += u"\\u%1"_s.arg(int(c.unicode()), 4, 16, u'0');
+            else
+                escaped += c;
+        }
+    }
+    escaped += u'"';
+    return escaped;
+}
+
+QString symbol(const CallgrindProfile &profile, int function, CallgrindProfile::SymbolKind kind)
+{
+    const CallgrindProfile::Function &f = profile.function(function);
+    const int id = kind == CallgrindProfile::ObjectSymbol ? f.object
+            : kind == CallgrindProfile::FileSymbol ? f.file
+                                                   : f.name;
+    return QString::fromUtf8(profile.symbolName(kind, id));
+}
+
+// Right-aligned columns followed by a left-aligned name, as in
+// callgrind_annotate
+void printTable(QTextStream &out, const QStringList &header, const QList<QStringList> &rows)
+{
+    QList<qsizetype> widths(header.size());
+    for (qsizetype column = 0; column < header.size(); ++column)
+        widths[column] = header.at(column).size();
+    for (const QStringList &row : rows) {
+        for (qsizetype column = 0; column + 1 < row.size(); ++column)
+            widths[column] = qMax(widths.at(column), row.at(column).size());
+    }
+    const auto printRow = [&](const QStringList &row) {
+        for (qsizetype column = 0; column + 1 < row.size(); ++column)
+            out << row.at(column).rightJustified(widths.at(column)) << "  ";
+        out << row.constLast() << '\n';
+    };
+    printRow(header);
+    for (const QStringList &row : rows)
+        printRow(row);
+}
+
+QList<int> topRows(int rowCount, int top, const std::function<void(int *, int *, int *)> &sort)
+{
+    QList<int> rows(rowCount);
+    std::iota(rows.begin(), rows.end(), 0);
+    const int shown = top > 0 ? qMin(top, rowCount) : rowCount;
+    sort(rows.data(), rows.data() + shown, rows.data() + rows.size());
+    rows.resize(shown);
+    return rows;
+}
+
+void printSummary(QTextStream &out, const Analysis &analysis, const Options &options)
+{
+    const CallgrindProfile &profile = analysis.profile;
+    const FlatProfile &flat = analysis.flatProfile;
+    const QList<int> rows = topRows(flat.functionCount(), options.top, [&](int *begin, int *middle, int *end) {
+        flat.sortRows(begin, middle, end,
+                      options.inclusive ? FlatProfile::SortByInclusiveCost : FlatProfile::SortBySelfCost,
+                      options.event, Qt::DescendingOrder);
+    });
+    // Derived events included
+    const int eventCount = flat.eventCount();
+    const QList<QByteArray> &eventNames = flat.eventNames();
+    QList<quint64> totals(eventCount);
+    for (int e = 0; e < eventCount; ++e)
+        totals[e] = std::accumulate(flat.selfCosts(e).cbegin(), flat.selfCosts(e).cend(), quint64(0));
+
+    if (options.format == Format::Csv) {
+        QStringList header{u"function"_s, u"file"_s, u"object"_s};
+        for (const QByteArray &event : eventNames)
+            header << csvField(QString::fromUtf8(event) + u" self"_s) << csvField(QString::fromUtf8(event) + u" inclusive"_s);
+        out << header.join(u',') << '\n';
+        for (int function : rows) {
+            out << csvField(symbol(profile, function, CallgrindProfile::FunctionSymbol)) << ','
+                << csvField(symbol(profile, function, CallgrindProfile::FileSymbol)) << ','
+                << csvField(symbol(profile, function, CallgrindProfile::ObjectSymbol));
+            for (int e = 0; e < eventCount; ++e)
+                out << ',' << flat.selfCosts(e).at(function) << ',' << flat.inclusiveCosts(e).at(function);
+            out << '\n';
+        }
+        return;
+    }
+
+    if (options.format == Format::Json) {
+        const auto costs = [&](const auto &value) {
+            QStringList fields;
+            for (int e = 0; e < eventCount; ++e)
+                fields << jsonString(QString::fromUtf8(eventNames.at(e))) + u": "_s + QString::number(value(e));
+            return u'{' + fields.join(u", "_s) + u'}';
+        };
+        out << "{\n  \"file\": " << jsonString(analysis.name)
+            << ",\n  \"command\": " << jsonString(QString::fromUtf8(profile.header("cmd")))
+            << ",\n  \"functionCount\": " << profile.functionCount()
+            << ",\n  \"totals\": " << costs([&](int e) { return totals.at(e); })
+            << ",\n  \"functions\": [";
+        for (qsizetype i = 0; i < rows.size(); ++i) {
+            const int function = rows.at(i);
+            out << (i == 0 ? "\n" : ",\n")
+                << "    {\"function\": " << jsonString(symbol(profile, function, CallgrindProfile::FunctionSymbol))
+                << ", \"file\": " << jsonString(symbol(profile, function, CallgrindProfile::FileSymbol))
+                << ", \"object\": " << jsonString(symbol(profile, function, CallgrindProfile::ObjectSymbol))
+                << ", \"self\": " << costs([&](int e) { return flat.selfCosts(e).at(function); })
+                << ", \"inclusive\": " << costs([&](int e) { return flat.inclusiveCosts(e).at(function); })
+                << '}';
+        }
+        out << "\n  ]\n}\n";
+        return;
+    }
+
+    out << "Profile:    " << analysis.name << '\n';
+    if (!profile.header("cmd").isEmpty())
+        out << "Command:    " << QString::fromUtf8(profile.header("cmd")) << '\n';
+    out << "Events:     " << QString::fromUtf8(eventNames.join(' ')) << '\n'
+        << "Sorted by:  " << (options.inclusive ? "inclusive " : "self ")
+        << QString::fromUtf8(eventNames.value(options.event)) << ", top " << rows.size()
+        << " of " << profile.functionCount() << " functions\n\n";
+
+    QStringList header;
+    QStringList totalRow;
+    for (int e = 0; e < eventCount; ++e) {
+        header << QString::fromUtf8(eventNames.at(e));
+        totalRow << number(qint64(totals.at(e))) + u" (100.0%)"_s;
+    }
+    header << (options.inclusive ? u"file:function (inclusive)"_s : u"file:function"_s);
+    totalRow << u"PROGRAM TOTALS"_s;
+
+    QList<QStringList> table{totalRow};
+    for (int function : rows) {
+        QStringList row;
+        for (int e = 0; e < eventCount; ++e) {
+            const quint64 cost = options.inclusive ? flat.inclusiveCosts(e).at(function)
+                                                   : flat.selfCosts(e).at(function);
+            row << number(qint64(cost)) + u" ("_s + percentage(cost, totals.at(e)) + u')';
+        }
+        row << symbol(profile, function, CallgrindProfile::FileSymbol) + u':'
+                + symbol(profile, function, CallgrindProfile::FunctionSymbol) + u" ["_s
+                + symbol(profile, function, CallgrindProfile::ObjectSymbol) + u']';
+        table << row;
+    }
+    printTable(out, header, table);
+}
+
+void printDiff(QTextStream &out, const Analysis &before, const Analysis &after, const ProfileDiff &diff,
+               const Options &options)
+{
+    const QList<int> rows = topRows(diff.rowCount(), options.top, [&](int *begin, int *middle, int *end) {
+        diff.sortRows(begin, middle, end,
+                      options.inclusive ? ProfileDiff::SortByInclusiveDelta : ProfileDiff::SortBySelfDelta,
+                      options.event, options.ascending ? Qt::AscendingOrder : Qt::DescendingOrder);
+    });
+    const int eventCount = diff.eventCount();
+    const auto name = [&](int row, CallgrindProfile::SymbolKind kind) {
+        return QString::fromUtf8(diff.symbolName(row, kind));
+    };
+
+    if (options.format == Format::Csv) {
+        QStringList header{u"function"_s, u"file"_s, u"object"_s};
+        for (const QByteArray &event : diff.eventNames()) {
+            for (const QString &column : {u" self before"_s, u" self after"_s, u" self delta"_s,
+                                          u" inclusive before"_s, u" inclusive after"_s, u" inclusive delta"_s})
+                header << csvField(QString::fromUtf8(event) + column);
+        }
+        out << header.join(u',') << '\n';
+        for (int row : rows) {
+            out << csvField(name(row, CallgrindProfile::FunctionSymbol)) << ','
+                << csvField(name(row, CallgrindProfile::FileSymbol)) << ','
+                << csvField(name(row, CallgrindProfile::ObjectSymbol));
+            for (int e = 0; e < eventCount; ++e) {
+                out << ',' << diff.selfCostBefore(row, e) << ',' << diff.selfCostAfter(row, e) << ','
+                    << diff.selfDelta(row, e) << ',' << diff.inclusiveCostBefore(row, e) << ','
+                    << diff.inclusiveCostAfter(row, e) << ',' << diff.inclusiveDelta(row, e);
+            }
+            out << '\n';
+        }
+        return;
+    }
+
+    if (options.format == Format::Json) {
+        const auto costs = [&](const auto &value) {
+            QStringList fields;
+            for (int e = 0; e < eventCount; ++e)
+                fields << jsonString(QString::fromUtf8(diff.eventNames().at(e))) + u": "_s + QString::number(value(e));
+            return u'{' + fields.join(u", "_s) + u'}';
+        };
+        out << "{\n  \"before\": " << jsonString(before.name)
+            << ",\n  \"after\": " << jsonString(after.name)
+            << ",\n  \"rowCount\": " << diff.rowCount()
+            << ",\n  \"onlyBefore\": " << diff.onlyBeforeCount()
+            << ",\n  \"onlyAfter\": " << diff.onlyAfterCount()
+            << ",\n  \"functions\": [";
+        for (qsizetype i = 0; i < rows.size(); ++i) {
+            const int row = rows.at(i);
+            out << (i == 0 ? "\n" : ",\n")
+                << "    {\"function\": " << jsonString(name(row, CallgrindProfile::FunctionSymbol))
+                << ", \"file\": " << jsonString(name(row, CallgrindProfile::FileSymbol))
+                << ", \"object\": " << jsonString(name(row, CallgrindProfile::ObjectSymbol))
+                << ", \"status\": " << (diff.beforeFunction(row) < 0 ? "\"added\""
+                                        : diff.afterFunction(row) < 0 ? "\"removed\"" : "\"common\"")
+                << ",\n     \"selfBefore\": " << costs([&](int e) { return diff.selfCostBefore(row, e); })
+                << ", \"selfAfter\": " << costs([&](int e) { return diff.selfCostAfter(row, e); })
+                << ",\n     \"inclusiveBefore\": " << costs([&](int e) { return diff.inclusiveCostBefore(row, e); })
+                << ", \"inclusiveAfter\": " << costs([&](int e) { return diff.inclusiveCostAfter(row, e); })
+                << '}';
+        }
+        out << "\n  ]\n}\n";
+        return;
+    }
+
+    const int e = options.event;
+    out << "Before:     " << before.name << '\n'
+        << "After:      " << after.name << '\n'
+        << "Functions:  " << diff.rowCount() << ", " << diff.onlyBeforeCount() << " only before, "
+        << diff.onlyAfterCount() << " only after\n"
+        << "Sorted by:  " << (options.inclusive ? "inclusive " : "self ")
+        << QString::fromUtf8(diff.eventNames().at(e)) << " delta, "
+        << (options.ascending ? "improvements" : "regressions") << " first, top " << rows.size() << "\n\n";
+
+    const QString event = QString::fromUtf8(diff.eventNames().at(e));
+    QList<QStringList> table;
+    for (int row : rows) {
+        const quint64 oldCost = options.inclusive ? diff.inclusiveCostBefore(row, e) : diff.selfCostBefore(row, e);
+        const quint64 newCost = options.inclusive ? diff.inclusiveCostAfter(row, e) : diff.selfCostAfter(row, e);
+        const qint64 delta = options.inclusive ? diff.inclusiveDelta(row, e) : diff.selfDelta(row, e);
+        const double relative = ProfileDiff::relative(delta, oldCost);
+        table << QStringList{
+            number(qint64(oldCost)),
+            number(qint64(newCost)),
+            (delta > 0 ? u"+"_s : QString()) + number(delta),
+            std::isinf(relative) ? u"new"_s
+                                 : (relative > 0 ? u"+"_s : QString()) + QString::number(relative * 100, 'f', 1) + u'%',
+            name(row, CallgrindProfile::FileSymbol) + u':' + name(row, CallgrindProfile::FunctionSymbol)
+                    + u" ["_s + name(row, CallgrindProfile::ObjectSymbol) + u']'
+        };
+    }
+    printTable(out, {event + u" before"_s, event + u" after"_s, u"delta"_s, u"change"_s, u"file:function"_s},
+               table);
+}
+
+QString positionText(const QList<QByteArray> &positionNames, const quint64 *positions, int positionCount,
+                     const QString &separator)
+{
+    QStringList fields;
+    for (int p = 0; p < positionCount; ++p) {
+        fields << (positionNames.value(p) == "instr" ? u"0x"_s + QString::number(positions[p], 16)
+                                                      : QString::number(positions[p]));
+    }
+    return fields.join(separator);
+}
+
+// The hottest positions of one function, by self cost
+void printAnnotation(QTextStream &out, const Analysis &analysis, int function, const Options &options)
+{
+    const CallgrindProfile &profile = analysis.profile;
+    const PositionCosts &positionCosts = profile.positionCosts();
+    const PositionCosts::Table costs = positionCosts.table(function);
+    const int eventCount = profile.eventCount();
+    const int positionCount = positionCosts.positionCount();
+    QList<QByteArray> positionNames = profile.positionNames();
+    if (positionNames.size() != positionCount)
+        positionNames = {"line"};
+    const int e = options.event;
+    const QList<int> rows = topRows(costs.rowCount(), options.top, [&](int *begin, int *middle, int *end) {
+        std::partial_sort(begin, middle, end, [&](int a, int b) {
+            const quint64 costA = costs.selfCosts(a)[e];
+            const quint64 costB = costs.selfCosts(b)[e];
+            return costA != costB ? costA > costB : a < b;
+        });
+    });
+
+    if (options.format == Format::Csv) {
+        QStringList header;
+        for (const QByteArray &name : std::as_const(positionNames))
+            header << csvField(QString::fromUtf8(name));
+        for (const QByteArray &event : profile.eventNames())
+            header << csvField(QString::fromUtf8(event) + u" self"_s) << csvField(QString::fromUtf8(event) + u" calls"_s);
+        out << header.join(u',') << '\n';
+        for (int row : rows) {
+            out << positionText(positionNames, costs.positions(row), positionCount, u","_s);
+            for (int event = 0; event < eventCount; ++event)
+                out << ',' << costs.selfCosts(row)[event] << ',' << costs.callCosts(row)[event];
+            out << '\n';
+        }
+        return;
+    }
+
+    if (options.format == Format::Json) {
+        const auto eventCosts = [&](const quint64 *values) {
+            QStringList fields;
+            for (int event = 0; event < eventCount; ++event)
+                fields << jsonString(QString::fromUtf8(profile.eventNames().at(event))) + u": "_s + QString::number(values[event]);
+            return u'{' + fields.join(u", "_s) + u'}';
+        };
+        out << "{\n  \"file\": " << jsonString(analysis.name)
+            << ",\n  \"function\": " << jsonString(symbol(profile, function, CallgrindProfile::FunctionSymbol))
+            << ",\n  \"sourceFile\": " << jsonString(symbol(profile, function, CallgrindProfile::FileSymbol))
+            << ",\n  \"object\": " << jsonString(symbol(profile, function, CallgrindProfile::ObjectSymbol))
+            << ",\n  \"positionCount\": " << costs.rowCount()
+            << ",\n  \"positions\": [";
+        for (qsizetype i = 0; i < rows.size(); ++i) {
+            const int row = rows.at(i);
+            out << (i == 0 ? "\n    {" : ",\n    {");
+            for (int p = 0; p < positionCount; ++p) {
+                const quint64 position = costs.positions(row)[p];
+                out << jsonString(QString::fromUtf8(positionNames.at(p))) << ": "
+                    << (positionNames.at(p) == "instr" ? jsonString(u"0x"_s + QString::number(position, 16))
+                                                       : QString::number(position))
+                    << ", ";
+            }
+            out << "\"self\": " << eventCosts(costs.selfCosts(row))
+                << ", \"calls\": " << eventCosts(costs.callCosts(row)) << '}';
+        }
+        out << "\n  ]\n}\n";
+        return;
+    }
+
+    const quint64 functionCost = profile.selfCost(function, e);
+    const QString event = QString::fromUtf8(profile.eventNames().at(e));
+    out << "Profile:    " << analysis.name << '\n'
+        << "Function:   " << symbol(profile, function, CallgrindProfile::FileSymbol) << ':'
+        << symbol(profile, function, CallgrindProfile::FunctionSymbol) << " ["
+        << symbol(profile, function, CallgrindProfile::ObjectSymbol) << "]\n"
+        << "Positions:  " << number(costs.rowCount()) << " in the function; "
+        << number(positionCosts.lineCount()) << " cost lines in the profile take "
+        << QString::number(double(positionCosts.memoryUsage()) / (1 << 20), 'f', 1) << " MB\n"
+        << "Sorted by:  self " << event << ", top " << rows.size() << "\n\n";
+
+    QList<QStringList> table;
+    for (int row : rows) {
+        const quint64 cost = costs.selfCosts(row)[e];
+        table << QStringList{
+            number(qint64(cost)) + u" ("_s + percentage(cost, functionCost) + u')',
+            number(qint64(costs.callCosts(row)[e])),
+            positionText(positionNames, costs.positions(row), positionCount, u" "_s)
+        };
+    }
+    printTable(out, {event + u" self"_s, event + u" calls"_s, QString::fromUtf8(positionNames.join(' '))}, table);
+}
+
+// Resolves --event against \a eventNames; empty selects the first event
+bool findEvent(const QString &name, const QList<QByteArray> &eventNames, int *event)
+{
+    if (name.isEmpty()) {
+        *event = 0;
+        return !eventNames.isEmpty();
+    }
+    *event = int(eventNames.indexOf(name.toUtf8()));
+    return *event >= 0;
+}
+
+} // namespace
+
+bool CommandLine::isCommand(const char *argument)
+{
+    return std::strcmp(argument, "summary") == 0 || std::strcmp(argument, "diff") == 0
+            || std::strcmp(argument, "merge") == 0 || std::strcmp(argument, "annotate") == 0;
+}
+
+int CommandLine::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Summarizes, compares and merges Callgrind profiles without a display."_s);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"command"_s, u"summary <file>, diff <before> <after>, merge <file>... "
+                                                "or annotate <file> [function]"_s);
+    parser.addPositionalArgument(u"files"_s, u"Profiles to read; gzip and Zstandard files are accepted."_s,
+                                 u"<file>..."_s);
+    const QCommandLineOption topOption({u"n"_s, u"top"_s},
+                                       u"Number of functions or positions to list, 0 for all (default 20)."_s,
+                                       u"count"_s, u"20"_s);
+    const QCommandLineOption eventOption({u"e"_s, u"event"_s},
+                                         u"Event to sort by (default: the first one)."_s, u"name"_s);
+    const QCommandLineOption inclusiveOption(u"inclusive"_s, u"Sort by inclusive rather than self cost."_s);
+    const QCommandLineOption ascendingOption(u"ascending"_s, u"diff: list the largest improvements first."_s);
+    const QCommandLineOption formatOption({u"f"_s, u"format"_s}, u"text, csv or json (default text)."_s,
+                                          u"format"_s, u"text"_s);
+    const QCommandLineOption outputOption({u"o"_s, u"output"_s},
+                                          u"merge: also save the merged profile as a Callgrind file."_s,
+                                          u"file"_s);
+    const QCommandLineOption threadsOption({u"j"_s, u"threads"_s},
+                                           u"Threads for parsing, 0 for all cores (default)."_s,
+                                           u"count"_s, u"0"_s);
+    const QCommandLineOption formulaOption(u"formula"_s,
+                                           u"Add a derived event, such as \"CEst = Ir + 10 Bm + 100 LLm\"; "
+                                            "may be repeated."_s,
+                                           u"definition"_s);
+    const QCommandLineOption traceOption(u"trace"_s,
+                                         u"Write a Chrome trace of where the time went to this file."_s,
+                                         u"file"_s);
+    parser.addOptions({topOption, eventOption, inclusiveOption, ascendingOption, formatOption,
+                       outputOption, threadsOption, formulaOption, traceOption});
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    const QString command = positional.value(0);
+    const QStringList fileNames = positional.mid(1);
+    if ((command == "summary"_L1 && fileNames.size() != 1) || (command == "diff"_L1 && fileNames.size() != 2)
+        || (command == "merge"_L1 && fileNames.isEmpty())
+        || (command == "annotate"_L1 && fileNames.size() != 1 && fileNames.size() != 2)
+        || (command != "summary"_L1 && command != "diff"_L1 && command != "merge"_L1
+            && command != "annotate"_L1)) {
+        standardError() << parser.helpText();
+        standardError().flush();
+        return 2;
+    }
+
+    Options options;
+    bool ok = false;
+    options.top = parser.value(topOption).toInt(&ok);
+    if (!ok || options.top < 0)
+        return fail(u"--top needs a count"_s);
+    const int threads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threads < 0)
+        return fail(u"--threads needs a count"_s);
+    const QString format = parser.value(formatOption);
+    if (format == "text"_L1)
+        options.format = Format::Text;
+    else if (format == "csv"_L1)
+        options.format = Format::Csv;
+    else if (format == "json"_L1)
+        options.format = Format::Json;
+    else
+        return fail(u"unknown format %1; use text, csv or json"_s.arg(format));
+    options.inclusive = parser.isSet(inclusiveOption);
+    options.ascending = parser.isSet(ascendingOption);
+    const QString eventName = parser.value(eventOption);
+    const QStringList formulas = parser.values(formulaOption);
+
+    // Saved however the command ends, so that failures can be traced too
+    struct TraceWriter {
+        QString fileName;
+        ~TraceWriter()
+        {
+            QString errorString;
+            if (!fileName.isEmpty() && !Tracer::saveChromeTrace(fileName, &errorString))
+                fail(u"%1: %2"_s.arg(fileName, errorString));
+        }
+    } traceWriter{parser.value(traceOption)};
+    Tracer::setRecording(!traceWriter.fileName.isEmpty());
+
+    QTextStream out(stdout);
+    QString errorString;
+
+    if (command == "diff"_L1) {
+        Analysis before;
+        Analysis after;
+        before.name = fileNames.at(0);
+        after.name = fileNames.at(1);
+        if (!loadProfile(before.name, threads, &before.profile, &errorString)
+            || !loadProfile(after.name, threads, &after.profile, &errorString)) {
+            return fail(errorString);
+        }
+        before.build();
+        after.build();
+        if (!before.addFormulas(formulas, &errorString) || !after.addFormulas(formulas, &errorString))
+            return fail(errorString);
+        ProfileDiff diff;
+        TraceScope diffScope("diff", nullptr, "cli");
+        if (!diff.build(before.flatProfile, after.flatProfile))
+            return fail(diff.errorString());
+        diffScope.finish();
+        if (!findEvent(eventName, diff.eventNames(), &options.event))
+            return fail(u"no common event %1"_s.arg(eventName));
+        const TraceScope printScope("print", nullptr, "cli");
+        printDiff(out, before, after, diff, options);
+        return 0;
+    }
+
+    Analysis analysis;
+    if (command == "merge"_L1) {
+        // Refused up front rather than after a long merge
+        const QString outputFileName = parser.value(outputOption);
+        const QString canonicalOutput = QFileInfo(outputFileName).canonicalFilePath();
+        for (const QString &fileName : fileNames) {
+            if (!canonicalOutput.isEmpty() && QFileInfo(fileName).canonicalFilePath() == canonicalOutput)
+                return fail(u"%1: the merged profile cannot replace one of its inputs"_s.arg(outputFileName));
+        }
+
+        ProfileMerger merger;
+        merger.setThreadCount(threads);
+        TraceScope mergeScope("merge", nullptr, "cli");
+        if (!merger.merge(fileNames, &analysis.profile))
+            return fail(merger.errorString());
+        mergeScope.finish();
+        analysis.name = u"%1 profiles merged"_s.arg(fileNames.size());
+        if (!outputFileName.isEmpty()) {
+            const TraceScope saveScope("save", nullptr, "cli");
+            CallgrindWriter writer;
+            if (!writer.save(analysis.profile, outputFileName))
+                return fail(u"%1: %2"_s.arg(outputFileName, writer.errorString()));
+            analysis.name = outputFileName;
+        }
+    } else {
+        analysis.name = fileNames.at(0);
+        if (!loadProfile(analysis.name, threads, &analysis.profile, &errorString))
+            return fail(errorString);
+    }
+    if (command == "annotate"_L1) {
+        // Position costs are kept for recorded events only
+        if (!findEvent(eventName, analysis.profile.eventNames(), &options.event))
+            return fail(u"no event %1"_s.arg(eventName));
+        // The hottest function whose name contains the pattern
+        const CallgrindProfile &profile = analysis.profile;
+        const QByteArray pattern = fileNames.value(1).toUtf8();
+        int function = -1;
+        for (int i = 0; i < profile.functionCount(); ++i) {
+            if (!profile.functionName(i).contains(pattern))
+                continue;
+            if (function < 0 || profile.selfCost(i, options.event) > profile.selfCost(function, options.event))
+                function = i;
+        }
+        if (function < 0)
+            return fail(u"no function matches %1"_s.arg(fileNames.value(1)));
+        const TraceScope printScope("print", nullptr, "cli");
+        printAnnotation(out, analysis, function, options);
+        return 0;
+    }
+    analysis.build();
+    if (!analysis.addFormulas(formulas, &errorString))
+        return fail(errorString);
+    if (!findEvent(eventName, analysis.flatProfile.eventNames(), &options.event))
+        return fail(u"no event %1"_s.arg(eventName));
+    const TraceScope printScope("print", nullptr, "cli");
+    printSummary(out, analysis, options);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QStringList>
+
+// Headless analysis for scripts, CI and machines without a display. Uses the
+// same parser and models as the viewer, but only QtCore: no widgets, no
+// Assistant, and no text kept in memory beyond the file mapping, so it
+// handles profiles too large to browse comfortably.
+//
+//   summary <file>               top functions, like callgrind_annotate
+//   diff <before> <after>        functions whose cost changed most
+//   merge <file>... [-o <out>]   sum of several profiles, optionally saved
+//   annotate <file> [function]   hottest instructions or lines of a function
+//
+// Output is text, CSV or JSON (--format); --trace also writes a Chrome
+// trace of the run. --formula adds derived events to summary and diff.
+class CommandLine
+{
+public:
+    // Whether \a argument names a command, so that the viewer can hand its
+    // arguments over before creating any widget.
+    static bool isCommand(const char *argument);
+
+    // Parses \a arguments, program name first, runs the command and returns
+    // the process exit code.
+    static int run(const QStringList &arguments);
+};
+
+#endif // COMMANDLINE_H
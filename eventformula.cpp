@@ -0,0 +1,169 @@
+#include "eventformula.h"
+
+#include <algorithm>
+#include <cctype>
+
+using namespace Qt::StringLiterals;
+
+// Rows per block: the block of the result stays in L1 while every term is
+// added to it
+static const qsizetype BlockSize = 2048;
+
+static bool isNameStart(char c)
+{
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool isNameChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static QByteArrayView trimmed(QByteArrayView text)
+{
+    while (!text.isEmpty() && std::isspace(static_cast<unsigned char>(text.front())))
+        text = text.sliced(1);
+    while (!text.isEmpty() && std::isspace(static_cast<unsigned char>(text.back())))
+        text.chop(1);
+    return text;
+}
+
+// The kernels are kept apart, each a single loop over contiguous arrays, so
+// that each compiles to one vectorized loop
+static void copyColumn(const quint64 *in, qsizetype count, quint64 *out)
+{
+    for (qsizetype i = 0; i < count; ++i)
+        out[i] = in[i];
+}
+
+static void scaleColumn(const quint64 *in, quint64 factor, qsizetype count, quint64 *out)
+{
+    for (qsizetype i = 0; i < count; ++i)
+        out[i] = factor * in[i];
+}
+
+static void addColumn(const quint64 *in, qsizetype count, quint64 *out)
+{
+    for (qsizetype i = 0; i < count; ++i)
+        out[i] += in[i];
+}
+
+static void addScaledColumn(const quint64 *in, quint64 factor, qsizetype count, quint64 *out)
+{
+    for (qsizetype i = 0; i < count; ++i)
+        out[i] += factor * in[i];
+}
+
+bool EventFormula::parseDefinition(QByteArrayView definition)
+{
+    const qsizetype equals = definition.indexOf('=');
+    const qsizetype colon = definition.indexOf(':');
+    if (equals < 0 || (colon >= 0 && colon < equals))
+        return fail(u"no formula"_s);
+
+    const QByteArrayView name = trimmed(definition.first(equals));
+    if (name.isEmpty() || !isNameStart(name.front()))
+        return fail(u"missing event name"_s);
+    for (const char c : name) {
+        if (!isNameChar(c))
+            return fail(u"invalid event name"_s);
+    }
+
+    const qsizetype end = colon >= 0 ? colon : definition.size();
+    if (!parseExpression(definition.sliced(equals + 1, end - equals - 1)))
+        return false;
+    m_name = name.toByteArray();
+    m_description = colon >= 0 ? trimmed(definition.sliced(colon + 1)).toByteArray() : QByteArray();
+    return true;
+}
+
+bool EventFormula::parseExpression(QByteArrayView expression)
+{
+    m_terms.clear();
+    const char *p = expression.data();
+    const char *end = p + expression.size();
+    const auto skipSpaces = [&] {
+        while (p < end && std::isspace(static_cast<unsigned char>(*p)))
+            ++p;
+    };
+
+    for (;;) {
+        skipSpaces();
+        Term term = {1, QByteArray()};
+        if (p < end && std::isdigit(static_cast<unsigned char>(*p))) {
+            term.factor = 0;
+            for (; p < end && std::isdigit(static_cast<unsigned char>(*p)); ++p) {
+                if (term.factor > (~quint64(0) - 9) / 10)
+                    return fail(u"factor out of range"_s);
+                term.factor = term.factor * 10 + quint64(*p - '0');
+            }
+            skipSpaces();
+            if (p < end && *p == '*') {
+                ++p;
+                skipSpaces();
+            }
+        }
+        const char *name = p;
+        if (p < end && isNameStart(*p)) {
+            while (p < end && isNameChar(*p))
+                ++p;
+        }
+        if (p == name)
+            return fail(u"expected an event name at column %1"_s.arg(name - expression.data() + 1));
+        term.event = QByteArray(name, p - name);
+        m_terms.append(term);
+
+        skipSpaces();
+        if (p == end)
+            break;
+        if (*p != '+')
+            return fail(u"expected + at column %1"_s.arg(p - expression.data() + 1));
+        ++p;
+    }
+    m_errorString.clear();
+    return true;
+}
+
+QByteArray EventFormula::expression() const
+{
+    QByteArray text;
+    for (const Term &term : m_terms) {
+        if (!text.isEmpty())
+            text += " + ";
+        if (term.factor != 1)
+            text += QByteArray::number(term.factor) + ' ';
+        text += term.event;
+    }
+    return text;
+}
+
+void EventFormula::evaluate(const quint64 *const *columns, qsizetype count, quint64 *out) const
+{
+    if (m_terms.isEmpty()) {
+        std::fill(out, out + count, quint64(0));
+        return;
+    }
+    for (qsizetype begin = 0; begin < count; begin += BlockSize) {
+        const qsizetype size = qMin(BlockSize, count - begin);
+        quint64 *block = out + begin;
+        for (qsizetype t = 0; t < m_terms.size(); ++t) {
+            const quint64 *in = columns[t] + begin;
+            const quint64 factor = m_terms.at(t).factor;
+            if (t == 0 && factor == 1)
+                copyColumn(in, size, block);
+            else if (t == 0)
+                scaleColumn(in, factor, size, block);
+            else if (factor == 1)
+                addColumn(in, size, block);
+            else
+                addScaledColumn(in, factor, size, block);
+        }
+    }
+}
+
+bool EventFormula::fail(const QString &errorString)
+{
+    m_terms.clear();
+    m_errorString = errorString;
+    return false;
+}
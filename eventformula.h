@@ -0,0 +1,53 @@
+#ifndef EVENTFORMULA_H
+#define EVENTFORMULA_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+
+// A derived event: a sum of other events with integer factors. Formulas come
+// from "event:" header lines, as in
+//
+//   event: CEst = Ir + 10 Bm + 10 L1m + 20 Ge + 100 L2m + 100 LLm : Cycle estimation
+//
+// or from the user, in the same syntax. Evaluation runs over whole cost
+// columns, one term at a time per block of rows, so every term is a single
+// loop over contiguous arrays that the compiler vectorizes.
+class EventFormula
+{
+public:
+    struct Term {
+        quint64 factor;
+        QByteArray event;
+    };
+
+    // "Name = expression [: description]", the value of an event: line.
+    // Returns false, with errorString() set, if there is no formula.
+    bool parseDefinition(QByteArrayView definition);
+    // Terms "[factor [*]] event" joined by "+"
+    bool parseExpression(QByteArrayView expression);
+    QString errorString() const { return m_errorString; }
+
+    QByteArray name() const { return m_name; }
+    void setName(const QByteArray &name) { m_name = name; }
+    QByteArray description() const { return m_description; }
+
+    const QList<Term> &terms() const { return m_terms; }
+    // The terms in canonical form, such as "Ir + 10 Bm"
+    QByteArray expression() const;
+
+    // out[i] = sum over terms t of factor(t) * columns[t][i], for i < count.
+    // Costs wrap around on overflow, as unsigned arithmetic does.
+    void evaluate(const quint64 *const *columns, qsizetype count, quint64 *out) const;
+
+private:
+    bool fail(const QString &errorString);
+
+    QByteArray m_name;
+    QByteArray m_description;
+    QList<Term> m_terms;
+    QString m_errorString;
+};
+
+#endif // EVENTFORMULA_H
@@ -1,5 +1,6 @@
 #include "assistant.h"
 #include "findfiledialog.h"
+#include "profilefinder.h"
 #include "textedit.h"
 
 #include <QComboBox>
@@ -9,28 +10,41 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QPushButton>
-#include <QRegularExpression>
 #include <QToolButton>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 
+// Item data: the full path, and whether the file is a Callgrind profile
+static const int PathRole = Qt::UserRole;
+static const int ProfileRole = Qt::UserRole + 1;
+
+// The file name pattern is applied once typing pauses for this long
+static const int TypingDelay = 250; // ms
+
 //! [0]
 FindFileDialog::FindFileDialog(TextEdit *editor, Assistant *assistant)
     : QDialog(editor)
     , currentEditor(editor)
     , currentAssistant(assistant)
+    , finder(new ProfileFinder(this))
 {
     //! [0]
 
+    filterTimer.setSingleShot(true);
+    filterTimer.setInterval(TypingDelay);
+    connect(&filterTimer, &QTimer::timeout, this, &FindFileDialog::filterFiles);
+    connect(finder, &ProfileFinder::entriesFound, this, &FindFileDialog::addFiles);
+    connect(finder, &ProfileFinder::finished, this, &FindFileDialog::updateStatus);
+
     createButtons();
     createComboBoxes();
     createFilesTree();
     createLabels();
     createLayout();
 
-    directoryComboBox->addItem(QDir::toNativeSeparators(QDir::currentPath()));
     fileNameComboBox->addItem("*");
-    findFiles();
+    // Starts the search through currentTextChanged()
+    directoryComboBox->addItem(QDir::toNativeSeparators(QDir::currentPath()));
 
     setWindowTitle(tr("Find File"));
     //! [1]
@@ -45,7 +59,6 @@ void FindFileDialog::browse()
     if (!newDirectory.isEmpty()) {
         directoryComboBox->addItem(QDir::toNativeSeparators(newDirectory));
         directoryComboBox->setCurrentIndex(directoryComboBox->count() - 1);
-        update();
     }
 }
 
@@ -62,65 +75,103 @@ void FindFileDialog::openFile()
     if (!item)
         return;
 
-    const QString fileName = item->text(0);
-    const QString path = QDir(directoryComboBox->currentText()).filePath(fileName);
+    const QString path = item->data(0, PathRole).toString();
 
-    bool enableHighlighting = highlightCheckBox->isChecked();
-    currentEditor->setContents(path, enableHighlighting);
-    if (!highlightCheckBox->isChecked()) {
-        currentEditor->clearHighlighter();
-    }
+    // Loads in the background; the editor reports progress and completion
+    currentEditor->setContents(path, highlightCheckBox->isChecked());
 
     close();
 }
 
-void FindFileDialog::update()
+void FindFileDialog::findFiles()
 {
-    findFiles();
-    buttonBox->button(QDialogButtonBox::Open)->setEnabled(foundFilesTree->topLevelItemCount() > 0);
+    find(false);
 }
 
-void FindFileDialog::findFiles()
+void FindFileDialog::rescan()
 {
-    QString wildCard = fileNameComboBox->currentText();
-    if (!wildCard.endsWith('*'))
-        wildCard += '*';
-    const QRegularExpression filePattern(QRegularExpression::wildcardToRegularExpression(wildCard));
-
-    const QDir directory(directoryComboBox->currentText());
+    find(true);
+}
 
-    const QStringList allFiles = directory.entryList(QDir::Files | QDir::NoSymLinks);
-    QStringList matchingFiles;
+void FindFileDialog::filterFiles()
+{
+    clearFiles();
+    addFiles(0, finder->entries().size());
+    updateStatus();
+}
 
-    for (const QString &file : allFiles) {
-        if (filePattern.match(file).hasMatch())
-            matchingFiles << file;
+// Called for everything listed so far after a filter change, and for each
+// batch the finder delivers while it scans
+void FindFileDialog::addFiles(qsizetype first, qsizetype count)
+{
+    const QList<ProfileFinder::Entry> &entries = finder->entries();
+    const QDir directory(finder->directory());
+
+    QList<QTreeWidgetItem *> items;
+    for (qsizetype i = first; i < first + count; ++i) {
+        const ProfileFinder::Entry &entry = entries.at(i);
+        if (!filePattern.match(entry.path.sliced(entry.path.lastIndexOf(u'/') + 1)).hasMatch())
+            continue;
+
+        QTreeWidgetItem *item = new QTreeWidgetItem(QStringList(QDir::toNativeSeparators(entry.path)));
+        item->setData(0, PathRole, directory.filePath(entry.path));
+        item->setData(0, ProfileRole, entry.isProfile);
+        highlight(item);
+        items.append(item);
+        if (entry.isProfile)
+            ++profileCount;
     }
-    showFiles(matchingFiles);
+    if (items.isEmpty())
+        return;
+
+    foundFilesTree->addTopLevelItems(items);
+    if (!foundFilesTree->currentItem())
+        foundFilesTree->setCurrentItem(foundFilesTree->topLevelItem(0));
+    updateStatus();
 }
 
-void FindFileDialog::showFiles(const QStringList &files)
+void FindFileDialog::find(bool rescan)
 {
-    foundFilesTree->clear();
+    // A cached listing arrives before find() returns
+    clearFiles();
+    finder->find(directoryComboBox->currentText(), rescan);
+    updateStatus();
+}
 
-    for (const QString &file : files) {
-        QTreeWidgetItem *item = new QTreeWidgetItem(foundFilesTree, {file});
+void FindFileDialog::clearFiles()
+{
+    filterTimer.stop();
 
-        // Highlight Callgrind files
-        if (file.contains("callgrind.out")) {
-            item->setBackground(0, QBrush(Qt::green));// Set green highlight
+    QString wildCard = fileNameComboBox->currentText();
+    if (!wildCard.endsWith('*'))
+        wildCard += '*';
+    filePattern.setPattern(QRegularExpression::wildcardToRegularExpression(wildCard));
 
-            if (highlightCheckBox->isChecked() && file.contains("callgrind.out")) {
-                item->setBackground(0, QBrush(Qt::green));
-            } else {
-                item->setBackground(0, QBrush(Qt::transparent)); // Remove highlighting
-            }
-        }
-    }
+    foundFilesTree->clear();
+    profileCount = 0;
+}
 
-    if (!files.isEmpty()) {
-        foundFilesTree->setCurrentItem(foundFilesTree->topLevelItem(0));
-    }
+void FindFileDialog::updateStatus()
+{
+    const int matching = foundFilesTree->topLevelItemCount();
+    const QString found = tr("%n matching file(s), %1 Callgrind profile(s)", nullptr, matching)
+                              .arg(profileCount);
+    if (finder->isFinding())
+        statusLabel->setText(tr("Searching... %1").arg(found));
+    else if (finder->scanMilliseconds() >= 0)
+        statusLabel->setText(tr("%1, found in %2 s").arg(found).arg(finder->scanMilliseconds() / 1000.0, 0, 'f', 2));
+    else
+        statusLabel->setText(found);
+    buttonBox->button(QDialogButtonBox::Open)->setEnabled(matching > 0);
+}
+
+void FindFileDialog::highlight(QTreeWidgetItem *item)
+{
+    // Highlight Callgrind files
+    if (highlightCheckBox->isChecked() && item->data(0, ProfileRole).toBool())
+        item->setBackground(0, QBrush(Qt::green));
+    else
+        item->setBackground(0, QBrush(Qt::transparent)); // Remove highlighting
 }
 
 void FindFileDialog::createButtons()
@@ -129,6 +180,11 @@ void FindFileDialog::createButtons()
     browseButton->setText(tr("..."));
     connect(browseButton, &QAbstractButton::clicked, this, &FindFileDialog::browse);
 
+    rescanButton = new QToolButton;
+    rescanButton->setText(tr("Rescan"));
+    rescanButton->setToolTip(tr("List the directory again instead of reusing the last listing"));
+    connect(rescanButton, &QAbstractButton::clicked, this, &FindFileDialog::rescan);
+
     buttonBox = new QDialogButtonBox(QDialogButtonBox::Open
                                      | QDialogButtonBox::Cancel
                                      | QDialogButtonBox::Help);
@@ -153,8 +209,9 @@ void FindFileDialog::createComboBoxes()
     directoryComboBox->setSizeAdjustPolicy(QComboBox::AdjustToContents);
     directoryComboBox->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
 
-    connect(fileNameComboBox, &QComboBox::editTextChanged, this, &FindFileDialog::update);
-    connect(directoryComboBox, &QComboBox::currentTextChanged, this, &FindFileDialog::update);
+    // Filtering waits for a pause in typing; the listing itself is reused
+    connect(fileNameComboBox, &QComboBox::editTextChanged, this, [this] { filterTimer.start(); });
+    connect(directoryComboBox, &QComboBox::currentTextChanged, this, &FindFileDialog::findFiles);
 }
 
 void FindFileDialog::createFilesTree()
@@ -163,6 +220,7 @@ void FindFileDialog::createFilesTree()
     foundFilesTree->setColumnCount(1);
     foundFilesTree->setHeaderLabels(QStringList(tr("Matching Files")));
     foundFilesTree->setRootIsDecorated(false);
+    foundFilesTree->setUniformRowHeights(true);
     foundFilesTree->setSelectionMode(QAbstractItemView::SingleSelection);
 
     connect(foundFilesTree, &QTreeWidget::itemActivated, this, &FindFileDialog::openFile);
@@ -172,6 +230,7 @@ void FindFileDialog::createLabels()
 {
     directoryLabel = new QLabel(tr("Search in:"));
     fileNameLabel = new QLabel(tr("File name (including wildcards):"));
+    statusLabel = new QLabel;
 }
 
 void FindFileDialog::createLayout()
@@ -184,11 +243,13 @@ void FindFileDialog::createLayout()
     directoryLayout->addWidget(directoryLabel);
     directoryLayout->addWidget(directoryComboBox);
     directoryLayout->addWidget(browseButton);
+    directoryLayout->addWidget(rescanButton);
 
     QVBoxLayout *mainLayout = new QVBoxLayout;
     mainLayout->addLayout(fileLayout);
     mainLayout->addLayout(directoryLayout);
     mainLayout->addWidget(foundFilesTree);
+    mainLayout->addWidget(statusLabel);
     mainLayout->addWidget(highlightCheckBox);
     mainLayout->addStretch();
     mainLayout->addWidget(buttonBox);
@@ -196,5 +257,6 @@ void FindFileDialog::createLayout()
 }
 void FindFileDialog::toggleHighlighting()
 {
-    update(); // Refresh the file list when the checkbox is toggled
+    for (int i = 0; i < foundFilesTree->topLevelItemCount(); ++i)
+        highlight(foundFilesTree->topLevelItem(i));
 }
\ No newline at end of file
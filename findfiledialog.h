@@ -6,6 +6,8 @@
 
 #include <QDialog>
 #include <QCheckBox>
+#include <QRegularExpression>
+#include <QTimer>
 
 QT_BEGIN_NAMESPACE
 class QComboBox;
@@ -13,10 +15,12 @@ class QDialogButtonBox;
 class QLabel;
 class QToolButton;
 class QTreeWidget;
+class QTreeWidgetItem;
 
 QT_END_NAMESPACE
 
 class Assistant;
+class ProfileFinder;
 class TextEdit;
 
 //! [0]
@@ -31,12 +35,17 @@ private slots:
     void browse();
     void help();
     void openFile();
-    void update();
+    void findFiles();
+    void rescan();
+    void filterFiles();
+    void addFiles(qsizetype first, qsizetype count);
+    void updateStatus();
     void toggleHighlighting(); // Add this slot
 
 private:
-    void findFiles();
-    void showFiles(const QStringList &files);
+    void find(bool rescan);
+    void clearFiles();
+    void highlight(QTreeWidgetItem *item);
 
     void createButtons();
     void createComboBoxes();
@@ -47,16 +56,22 @@ private:
     TextEdit *currentEditor;
     Assistant *currentAssistant;
     QTreeWidget *foundFilesTree;
+    ProfileFinder *finder;
+    QRegularExpression filePattern;
+    QTimer filterTimer;
+    int profileCount = 0;
 
     QComboBox *directoryComboBox;
     QComboBox *fileNameComboBox;
 
     QLabel *directoryLabel;
     QLabel *fileNameLabel;
+    QLabel *statusLabel;
 
     QDialogButtonBox *buttonBox;
 
     QToolButton *browseButton;
+    QToolButton *rescanButton;
     QCheckBox *highlightCheckBox;
 };
 //! [0]
@@ -0,0 +1,310 @@
+#include "flatprofile.h"
+#include "symboldemangler.h"
+
+#include <QStringList>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+using namespace Qt::StringLiterals;
+
+// Call arcs per block when a formula reads the profile's row-major call
+// costs: the referenced columns are gathered into contiguous blocks first
+static const qsizetype CallBlockSize = 1024;
+
+void FlatProfile::clear()
+{
+    *this = FlatProfile();
+}
+
+void FlatProfile::build(const CallGraph &graph)
+{
+    clear();
+    m_profile = graph.profile();
+    const int functionCount = graph.functionCount();
+    const int eventCount = graph.eventCount();
+    m_selfCosts.resize(eventCount);
+    m_inclusiveCosts.resize(eventCount);
+    for (int e = 0; e < eventCount; ++e) {
+        m_selfCosts[e].resize(functionCount);
+        m_inclusiveCosts[e].resize(functionCount);
+    }
+
+    // One pass over the row-major sources, writing every column at once
+    for (int f = 0; f < functionCount; ++f) {
+        const quint64 *self = m_profile->selfCosts(f);
+        const quint64 *inclusive = graph.inclusiveCosts(f);
+        for (int e = 0; e < eventCount; ++e) {
+            m_selfCosts[e][f] = self[e];
+            m_inclusiveCosts[e][f] = inclusive[e];
+        }
+    }
+
+    m_eventNames = m_profile->eventNames();
+    QStringList leftOut;
+    for (const QByteArray &definition : m_profile->eventDefinitions()) {
+        // Lines without a formula only describe an event
+        EventFormula formula;
+        if (formula.parseDefinition(definition) && !m_eventNames.contains(formula.name())
+            && !setDerivedEvent(formula)) {
+            leftOut.append(u"%1: %2"_s.arg(QString::fromUtf8(formula.name()), m_errorString));
+        }
+    }
+    m_errorString = leftOut.join(u"; "_s);
+}
+
+// Sets the rows of \a column, grown to \a rowCount, to \a value(row) for
+// \a rows; the column is not written to, and stays shared, where that
+// changes nothing
+template <typename Value>
+static void updateColumn(QList<quint64> &column, qsizetype rowCount, const QList<int> &rows, Value value)
+{
+    if (column.size() < rowCount)
+        column.resize(rowCount, 0);
+    for (const int row : rows) {
+        const quint64 cost = value(row);
+        if (std::as_const(column).at(row) != cost)
+            column[row] = cost;
+    }
+}
+
+void FlatProfile::update(const CallGraph &graph, const FlatProfile &previous,
+                         const QList<int> &changedFunctions, const QList<int> &changedCalls)
+{
+    const CallgrindProfile *profile = graph.profile();
+    const CallgrindProfile *before = previous.m_profile;
+    if (!before || profile->eventNames() != before->eventNames()
+        || profile->eventDefinitions() != before->eventDefinitions()) {
+        build(graph);
+        return;
+    }
+
+    *this = previous;
+    m_profile = profile;
+    const int functionCount = graph.functionCount();
+    for (int e = 0; e < recordedEventCount(); ++e) {
+        updateColumn(m_selfCosts[e], functionCount, changedFunctions,
+                     [&](int f) { return profile->selfCost(f, e); });
+        updateColumn(m_inclusiveCosts[e], functionCount, changedFunctions,
+                     [&](int f) { return graph.inclusiveCost(f, e); });
+    }
+    for (int d = 0; d < m_formulas.size(); ++d)
+        updateDerivedEvent(d, changedFunctions, changedCalls);
+}
+
+quint64 FlatProfile::callCost(int call, int event) const
+{
+    const int recorded = recordedEventCount();
+    return event < recorded ? m_profile->callCost(call, event)
+                            : m_derivedCallCosts.at(event - recorded).at(call);
+}
+
+bool FlatProfile::setDerivedEvent(const EventFormula &formula)
+{
+    if (!m_profile)
+        return fail(u"no profile"_s);
+    const QByteArray name = formula.name();
+    if (name.isEmpty())
+        return fail(u"the derived event has no name"_s);
+    if (formula.terms().isEmpty())
+        return fail(u"the formula of %1 is empty"_s.arg(QString::fromUtf8(name)));
+
+    const int recorded = recordedEventCount();
+    const int existing = int(m_eventNames.indexOf(name));
+    if (existing >= 0 && existing < recorded)
+        return fail(u"%1 is recorded in the profile"_s.arg(QString::fromUtf8(name)));
+
+    const int event = existing >= 0 ? existing : eventCount();
+    QList<int> events;
+    if (!resolve(formula, event, &events))
+        return false;
+
+    const int derived = event - recorded;
+    if (existing < 0) {
+        m_eventNames.append(name);
+        m_selfCosts.append(QList<quint64>());
+        m_inclusiveCosts.append(QList<quint64>());
+        m_formulas.append(formula);
+        m_termEvents.append(events);
+        m_derivedCallCosts.append(QList<quint64>());
+        computeDerivedEvent(derived);
+    } else {
+        m_formulas[derived] = formula;
+        m_termEvents[derived] = events;
+        // Later derived events may refer to this one
+        for (int d = derived; d < m_formulas.size(); ++d)
+            computeDerivedEvent(d);
+    }
+    m_errorString.clear();
+    return true;
+}
+
+bool FlatProfile::removeDerivedEvent(const QByteArray &name)
+{
+    const int recorded = recordedEventCount();
+    const int event = int(m_eventNames.indexOf(name));
+    if (event < recorded)
+        return fail(u"%1 is not a derived event"_s.arg(QString::fromUtf8(name)));
+    const int derived = event - recorded;
+    for (int d = derived + 1; d < m_formulas.size(); ++d) {
+        if (m_termEvents.at(d).contains(event)) {
+            return fail(u"%1 refers to %2"_s.arg(QString::fromUtf8(m_formulas.at(d).name()),
+                                                QString::fromUtf8(name)));
+        }
+    }
+
+    m_eventNames.removeAt(event);
+    m_selfCosts.removeAt(event);
+    m_inclusiveCosts.removeAt(event);
+    m_formulas.removeAt(derived);
+    m_termEvents.removeAt(derived);
+    m_derivedCallCosts.removeAt(derived);
+    for (int d = derived; d < m_termEvents.size(); ++d) {
+        for (int &termEvent : m_termEvents[d]) {
+            if (termEvent > event)
+                --termEvent;
+        }
+    }
+    m_errorString.clear();
+    return true;
+}
+
+bool FlatProfile::resolve(const EventFormula &formula, int end, QList<int> *events)
+{
+    for (const EventFormula::Term &term : formula.terms()) {
+        const int event = int(m_eventNames.indexOf(term.event));
+        if (event < 0 || event >= end) {
+            return fail(event == end ? u"%1 refers to itself"_s.arg(QString::fromUtf8(formula.name()))
+                                     : u"unknown event %1"_s.arg(QString::fromUtf8(term.event)));
+        }
+        events->append(event);
+    }
+    return true;
+}
+
+void FlatProfile::computeDerivedEvent(int derived)
+{
+    const int recorded = recordedEventCount();
+    const int event = recorded + derived;
+    const EventFormula &formula = m_formulas.at(derived);
+    const QList<int> &events = m_termEvents.at(derived);
+    const qsizetype termCount = events.size();
+    QVarLengthArray<const quint64 *, 8> columns(termCount);
+
+    // Function costs are columns already
+    const auto evaluateColumns = [&](QList<QList<quint64>> &costs) {
+        for (qsizetype t = 0; t < termCount; ++t)
+            columns[t] = costs.at(events.at(t)).constData();
+        QList<quint64> result(functionCount());
+        formula.evaluate(columns.constData(), result.size(), result.data());
+        costs[event] = std::move(result);
+    };
+    evaluateColumns(m_selfCosts);
+    evaluateColumns(m_inclusiveCosts);
+
+    // Call costs of recorded events are rows in the profile
+    const qsizetype callCount = m_profile->callCount();
+    QList<quint64> result(callCount);
+    QList<quint64> gathered(termCount * CallBlockSize);
+    for (qsizetype begin = 0; begin < callCount; begin += CallBlockSize) {
+        const qsizetype size = qMin(CallBlockSize, callCount - begin);
+        for (qsizetype t = 0; t < termCount; ++t) {
+            const int termEvent = events.at(t);
+            if (termEvent >= recorded) {
+                columns[t] = m_derivedCallCosts.at(termEvent - recorded).constData() + begin;
+                continue;
+            }
+            quint64 *column = gathered.data() + t * CallBlockSize;
+            for (qsizetype i = 0; i < size; ++i)
+                column[i] = m_profile->callCost(int(begin + i), termEvent);
+            columns[t] = column;
+        }
+        formula.evaluate(columns.constData(), size, result.data() + begin);
+    }
+    m_derivedCallCosts[derived] = std::move(result);
+}
+
+// As computeDerivedEvent(), one row at a time
+void FlatProfile::updateDerivedEvent(int derived, const QList<int> &changedFunctions,
+                                     const QList<int> &changedCalls)
+{
+    const int recorded = recordedEventCount();
+    const int event = recorded + derived;
+    const EventFormula &formula = m_formulas.at(derived);
+    const QList<int> &events = m_termEvents.at(derived);
+    const qsizetype termCount = events.size();
+    QVarLengthArray<quint64, 8> values(termCount);
+    QVarLengthArray<const quint64 *, 8> columns(termCount);
+    for (qsizetype t = 0; t < termCount; ++t)
+        columns[t] = &values[t];
+    const auto evaluate = [&](auto term) {
+        for (qsizetype t = 0; t < termCount; ++t)
+            values[t] = term(events.at(t));
+        quint64 cost;
+        formula.evaluate(columns.constData(), 1, &cost);
+        return cost;
+    };
+
+    for (QList<QList<quint64>> *costs : {&m_selfCosts, &m_inclusiveCosts}) {
+        updateColumn((*costs)[event], functionCount(), changedFunctions, [&](int f) {
+            return evaluate([&](int termEvent) { return costs->at(termEvent).at(f); });
+        });
+    }
+    updateColumn(m_derivedCallCosts[derived], m_profile->callCount(), changedCalls, [&](int call) {
+        return evaluate([&](int termEvent) {
+            return termEvent < recorded ? m_profile->callCost(call, termEvent)
+                                        : m_derivedCallCosts.at(termEvent - recorded).at(call);
+        });
+    });
+}
+
+bool FlatProfile::fail(const QString &errorString)
+{
+    m_errorString = errorString;
+    return false;
+}
+
+template <typename Less>
+static void sortRange(int *begin, int *middle, int *end, Less less)
+{
+    if (middle == end)
+        std::sort(begin, end, less);
+    else
+        std::partial_sort(begin, middle, end, less);
+}
+
+void FlatProfile::sortRows(int *begin, int *middle, int *end, SortKey key, int event,
+                           Qt::SortOrder order, const SymbolDemangler *functionNames) const
+{
+    const bool ascending = order == Qt::AscendingOrder;
+
+    if (key == SortBySelfCost || key == SortByInclusiveCost) {
+        const quint64 *costs = (key == SortBySelfCost ? m_selfCosts : m_inclusiveCosts).at(event).constData();
+        sortRange(begin, middle, end, [costs, ascending](int a, int b) {
+            if (costs[a] != costs[b])
+                return ascending ? costs[a] < costs[b] : costs[a] > costs[b];
+            return a < b;
+        });
+        return;
+    }
+
+    const CallgrindProfile *profile = m_profile;
+    const auto symbol = [profile, key, functionNames](int function) -> QByteArrayView {
+        const CallgrindProfile::Function &f = profile->function(function);
+        switch (key) {
+        case SortByFile:
+            return profile->symbolName(CallgrindProfile::FileSymbol, f.file);
+        case SortByObject:
+            return profile->symbolName(CallgrindProfile::ObjectSymbol, f.object);
+        default:
+            return functionNames ? functionNames->name(f.name)
+                                 : profile->symbolName(CallgrindProfile::FunctionSymbol, f.name);
+        }
+    };
+    sortRange(begin, middle, end, [&symbol, ascending](int a, int b) {
+        const int compared = symbol(a).compare(symbol(b));
+        if (compared != 0)
+            return ascending ? compared < 0 : compared > 0;
+        return a < b;
+    });
+}
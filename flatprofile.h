@@ -0,0 +1,98 @@
+#ifndef FLATPROFILE_H
+#define FLATPROFILE_H
+
+#include "callgraph.h"
+#include "callgrindprofile.h"
+#include "eventformula.h"
+
+#include <QList>
+#include <QString>
+
+class SymbolDemangler;
+
+// Self and inclusive costs of every function, stored one contiguous column
+// per event so that sorting or scanning by one event touches only that
+// event's data. Rows are function indices into the profile.
+//
+// Derived events follow the profile's own: the formulas of its "event:"
+// lines, then any added with setDerivedEvent(). Their columns, and their
+// cost per call arc, are computed from the columns they refer to.
+// Copies share the columns, so a copy can gain derived events of its own
+// at the cost of the new columns only.
+class FlatProfile
+{
+public:
+    enum SortKey {
+        SortByFunction,
+        SortByFile,
+        SortByObject,
+        SortBySelfCost,
+        SortByInclusiveCost
+    };
+
+    // Leaves errorString() naming the formulas of the profile's "event:"
+    // lines that had to be left out, such as one naming a missing event
+    void build(const CallGraph &graph);
+    // Builds the flat profile of \a graph from \a previous, that of the
+    // graph CallGraph::update() continued, sharing its columns: only the
+    // rows of \a changedFunctions, and the call costs of derived events at
+    // \a changedCalls, are computed again, and a column is only copied if
+    // one of them comes out different. Builds it in full if the events or
+    // their definitions changed.
+    void update(const CallGraph &graph, const FlatProfile &previous,
+                const QList<int> &changedFunctions, const QList<int> &changedCalls);
+    void clear();
+
+    const CallgrindProfile *profile() const { return m_profile; }
+    int functionCount() const { return m_profile ? m_profile->functionCount() : 0; }
+    int eventCount() const { return int(m_selfCosts.size()); }
+    const QList<QByteArray> &eventNames() const { return m_eventNames; }
+
+    const QList<quint64> &selfCosts(int event) const { return m_selfCosts.at(event); }
+    const QList<quint64> &inclusiveCosts(int event) const { return m_inclusiveCosts.at(event); }
+    // The inclusive cost of call arc \a call of the profile
+    quint64 callCost(int call, int event) const;
+
+    // Derived events are numbered from the profile's event count on
+    bool isDerivedEvent(int event) const { return event >= recordedEventCount(); }
+    const EventFormula &formula(int event) const { return m_formulas.at(event - recordedEventCount()); }
+
+    // Adds the derived event formula.name(), or replaces its formula and
+    // recomputes the derived events after it. A formula may refer to the
+    // profile's events and to derived events before its own. Returns false,
+    // with errorString() set, if it refers to anything else.
+    bool setDerivedEvent(const EventFormula &formula);
+    // Fails if a later derived event refers to it
+    bool removeDerivedEvent(const QByteArray &name);
+    QString errorString() const { return m_errorString; }
+
+    // Orders [begin, end) so that [begin, middle) holds the top rows for \a key
+    // in sorted order; the rest is left in unspecified order. With middle at
+    // end this is a full sort. \a event applies to the cost keys. Ties are
+    // broken by function index, so the order is deterministic. Functions are
+    // ordered by their names in \a functionNames if given, which must be
+    // done, otherwise by their raw names.
+    void sortRows(int *begin, int *middle, int *end, SortKey key, int event,
+                  Qt::SortOrder order, const SymbolDemangler *functionNames = nullptr) const;
+
+private:
+    int recordedEventCount() const { return m_profile ? m_profile->eventCount() : 0; }
+    bool resolve(const EventFormula &formula, int end, QList<int> *events);
+    void computeDerivedEvent(int derived);
+    void updateDerivedEvent(int derived, const QList<int> &changedFunctions, const QList<int> &changedCalls);
+    bool fail(const QString &errorString);
+
+    const CallgrindProfile *m_profile = nullptr;
+    QList<QByteArray> m_eventNames;
+    QList<QList<quint64>> m_selfCosts;
+    QList<QList<quint64>> m_inclusiveCosts;
+
+    // Per derived event: its formula, the events of its terms and its cost
+    // per call arc
+    QList<EventFormula> m_formulas;
+    QList<QList<int>> m_termEvents;
+    QList<QList<quint64>> m_derivedCallCosts;
+    QString m_errorString;
+};
+
+#endif // FLATPROFILE_H
@@ -0,0 +1,420 @@
+#include "flatprofilemodel.h"
+#include "profiledocument.h"
+
+#include <QBitArray>
+#include <QFutureWatcher>
+#include <QLocale>
+#include <QStringList>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <numeric>
+
+// Rows ordered before sort() returns; enough for any view to fill its screen
+static const qsizetype ImmediateRows = 1000;
+
+// How often demangled names are picked up while demangling runs
+static const int DemangleInterval = 250; // ms
+
+FlatProfileModel::FlatProfileModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    m_demangleTimer.setInterval(DemangleInterval);
+    connect(&m_demangleTimer, &QTimer::timeout, this, &FlatProfileModel::updateDemangledNames);
+}
+
+const FlatProfile *FlatProfileModel::flatProfile() const
+{
+    return m_document && m_document->hasProfile() ? &m_flat : nullptr;
+}
+
+FlatProfile FlatProfileModel::withDerivedEvents(const QSharedPointer<const ProfileDocument> &document,
+                                                QString *leftOut) const
+{
+    leftOut->clear();
+    if (!document || !document->hasProfile())
+        return FlatProfile();
+    // Formulas that do not fit this document are left out, not dropped
+    FlatProfile flat = document->flatProfile();
+    QStringList messages;
+    if (!flat.errorString().isEmpty())
+        messages.append(flat.errorString());
+    for (const EventFormula &formula : m_formulas) {
+        if (!flat.setDerivedEvent(formula))
+            messages.append(tr("%1: %2").arg(QString::fromUtf8(formula.name()), flat.errorString()));
+    }
+    if (!messages.isEmpty())
+        *leftOut = tr("Derived events left out: %1").arg(messages.join(tr("; ")));
+    return flat;
+}
+
+void FlatProfileModel::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    beginResetModel();
+    ++m_sortGeneration; // Drops sorts still running for the old document
+    m_document = document;
+    m_flat = withDerivedEvents(document, &m_errorString);
+    m_rows = filteredRows();
+    endResetModel();
+
+    if (m_sortColumn < 0 || m_sortColumn >= columnCount())
+        m_sortColumn = FirstCostColumn + 1; // Inclusive cost of the first event
+    sort(m_sortColumn, m_sortOrder);
+    m_demangledCount = -1;
+    updateDemangledNames();
+}
+
+void FlatProfileModel::updateDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    const FlatProfile *flat = flatProfile();
+    QString leftOut;
+    FlatProfile updated = withDerivedEvents(document, &leftOut);
+    if (!flat || !document->hasProfile() || updated.eventNames() != flat->eventNames()
+        || updated.functionCount() < flat->functionCount()) {
+        setDocument(document);
+        return;
+    }
+
+    // A continued profile keeps the function indexes of the one it grew from
+    ++m_sortGeneration;
+    const int knownFunctions = flat->functionCount();
+    m_document = document;
+    m_flat = std::move(updated);
+    m_errorString = leftOut;
+    // The known rows were filtered on raw names if either pass was
+    const bool filterDemangled = m_filterDemangled;
+    QList<int> added = filteredRows();
+    m_filterDemangled = m_filterDemangled && filterDemangled;
+    added.erase(added.begin(), std::lower_bound(added.begin(), added.end(), knownFunctions));
+    if (!added.isEmpty()) {
+        const int first = int(m_rows.size());
+        beginInsertRows(QModelIndex(), first, first + int(added.size()) - 1);
+        m_rows.append(added);
+        endInsertRows();
+    }
+    if (!m_rows.isEmpty())
+        emit dataChanged(index(0, FirstCostColumn), index(rowCount() - 1, columnCount() - 1));
+    sort(m_sortColumn, m_sortOrder);
+    m_demangledCount = -1;
+    updateDemangledNames();
+}
+
+int FlatProfileModel::function(int row) const
+{
+    return row >= 0 && row < m_rows.size() ? m_rows.at(row) : -1;
+}
+
+int FlatProfileModel::functionCount() const
+{
+    const FlatProfile *flat = flatProfile();
+    return flat ? flat->functionCount() : 0;
+}
+
+void FlatProfileModel::setFilter(const QString &text)
+{
+    const QByteArray filter = text.toUtf8();
+    if (filter == m_filter)
+        return;
+    m_filter = filter;
+    if (!flatProfile())
+        return;
+
+    beginResetModel();
+    ++m_sortGeneration;
+    m_rows = filteredRows();
+    endResetModel();
+    sort(m_sortColumn, m_sortOrder);
+}
+
+void FlatProfileModel::updateDemangledNames()
+{
+    if (!flatProfile()) {
+        m_demangleTimer.stop();
+        return;
+    }
+    const SymbolDemangler &names = m_document->functionNames();
+    const int demangledCount = names.doneCount();
+    if (demangledCount != m_demangledCount && m_demangledCount >= 0) {
+        if (!m_rows.isEmpty())
+            emit dataChanged(index(0, FunctionColumn), index(int(m_rows.size()) - 1, FunctionColumn));
+        emit functionNamesChanged();
+    }
+    m_demangledCount = demangledCount;
+    if (!names.isDone()) {
+        if (!m_demangleTimer.isActive())
+            m_demangleTimer.start();
+        return;
+    }
+    m_demangleTimer.stop();
+
+    // Rows filtered or sorted on raw names are redone on the demangled ones
+    if (!names.nameIndex())
+        return;
+    if (!m_filter.isEmpty() && !m_filterDemangled) {
+        beginResetModel();
+        ++m_sortGeneration;
+        m_rows = filteredRows();
+        endResetModel();
+        sort(m_sortColumn, m_sortOrder);
+    } else if (m_sortColumn == FunctionColumn && !m_sortDemangled) {
+        sort(m_sortColumn, m_sortOrder);
+    }
+}
+
+// The functions passing the filter, in index order
+QList<int> FlatProfileModel::filteredRows()
+{
+    QList<int> rows;
+    m_filterCandidates = 0;
+    const FlatProfile *flat = flatProfile();
+    if (!flat)
+        return rows;
+    if (m_filter.isEmpty()) {
+        rows.resize(flat->functionCount());
+        std::iota(rows.begin(), rows.end(), 0);
+        return rows;
+    }
+
+    // Functions of the same name in several files or objects share a symbol
+    const CallgrindProfile &profile = *flat->profile();
+    const SymbolDemangler &demangled = m_document->functionNames();
+    const QSharedPointer<const TrigramIndex> demangledIndex = demangled.nameIndex();
+    m_filterDemangled = !demangledIndex.isNull();
+    const QList<int> names = demangledIndex
+            ? demangledIndex->find(demangled, m_filter, &m_filterCandidates)
+            : m_document->functionNameIndex().find(profile.symbols(CallgrindProfile::FunctionSymbol),
+                                                   m_filter, &m_filterCandidates);
+    QBitArray matching(profile.symbolCount(CallgrindProfile::FunctionSymbol));
+    for (const int name : names)
+        matching.setBit(name);
+    for (int function = 0; function < flat->functionCount(); ++function) {
+        if (matching.testBit(profile.function(function).name))
+            rows.append(function);
+    }
+    return rows;
+}
+
+bool FlatProfileModel::setDerivedEvent(const EventFormula &formula)
+{
+    const FlatProfile *flat = flatProfile();
+    if (!flat) {
+        m_errorString = tr("No profile is open");
+        return false;
+    }
+    // Computed on a copy, so that a failure leaves the columns alone
+    FlatProfile updated = *flat;
+    if (!updated.setDerivedEvent(formula)) {
+        m_errorString = updated.errorString();
+        return false;
+    }
+
+    ++m_sortGeneration;
+    const int event = int(updated.eventNames().indexOf(formula.name()));
+    if (updated.eventCount() > flat->eventCount()) {
+        const int first = columnCount();
+        beginInsertColumns(QModelIndex(), first, first + 1);
+        m_flat = std::move(updated);
+        endInsertColumns();
+    } else {
+        // Derived events after this one may have changed as well
+        m_flat = std::move(updated);
+        if (!m_rows.isEmpty())
+            emit dataChanged(index(0, FirstCostColumn + 2 * event), index(rowCount() - 1, columnCount() - 1));
+    }
+
+    qsizetype known = 0;
+    while (known < m_formulas.size() && m_formulas.at(known).name() != formula.name())
+        ++known;
+    if (known < m_formulas.size())
+        m_formulas[known] = formula;
+    else
+        m_formulas.append(formula);
+    m_errorString.clear();
+
+    if (m_sortColumn >= FirstCostColumn + 2 * event)
+        sort(m_sortColumn, m_sortOrder);
+    return true;
+}
+
+bool FlatProfileModel::removeDerivedEvent(const QByteArray &name)
+{
+    const FlatProfile *flat = flatProfile();
+    if (!flat) {
+        m_errorString = tr("No profile is open");
+        return false;
+    }
+    const int event = int(flat->eventNames().indexOf(name));
+    FlatProfile updated = *flat;
+    if (!updated.removeDerivedEvent(name)) {
+        m_errorString = updated.errorString();
+        return false;
+    }
+
+    ++m_sortGeneration;
+    const int first = FirstCostColumn + 2 * event;
+    beginRemoveColumns(QModelIndex(), first, first + 1);
+    m_flat = std::move(updated);
+    endRemoveColumns();
+    m_formulas.removeIf([&name](const EventFormula &formula) { return formula.name() == name; });
+    m_errorString.clear();
+
+    if (m_sortColumn >= first + 2)
+        sort(m_sortColumn - 2, m_sortOrder);
+    else if (m_sortColumn >= first)
+        sort(FirstCostColumn + 1, m_sortOrder);
+    return true;
+}
+
+int FlatProfileModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_rows.size());
+}
+
+int FlatProfileModel::columnCount(const QModelIndex &parent) const
+{
+    const FlatProfile *flat = flatProfile();
+    return parent.isValid() || !flat ? 0 : FirstCostColumn + 2 * flat->eventCount();
+}
+
+QVariant FlatProfileModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int column = index.column();
+    if (role == Qt::TextAlignmentRole)
+        return column >= FirstCostColumn ? QVariant(int(Qt::AlignRight | Qt::AlignVCenter)) : QVariant();
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+        return QVariant();
+
+    const FlatProfile *flat = flatProfile();
+    const CallgrindProfile &profile = *flat->profile();
+    const int function = m_rows.at(index.row());
+    const CallgrindProfile::Function &f = profile.function(function);
+    switch (column) {
+    case FunctionColumn: {
+        const QByteArrayView name = m_document->functionNames().name(f.name);
+        const QByteArrayView raw = profile.symbolName(CallgrindProfile::FunctionSymbol, f.name);
+        // The tool tip of a demangled name adds the mangled one
+        if (role == Qt::ToolTipRole && name.data() != raw.data())
+            return QString::fromUtf8(name) + u'\n' + QString::fromUtf8(raw);
+        return QString::fromUtf8(name);
+    }
+    case FileColumn:
+        return QString::fromUtf8(profile.symbolName(CallgrindProfile::FileSymbol, f.file));
+    case ObjectColumn:
+        return QString::fromUtf8(profile.symbolName(CallgrindProfile::ObjectSymbol, f.object));
+    default:
+        break;
+    }
+
+    const int event = (column - FirstCostColumn) / 2;
+    const bool inclusive = (column - FirstCostColumn) % 2;
+    const quint64 cost = (inclusive ? flat->inclusiveCosts(event) : flat->selfCosts(event)).at(function);
+    return QLocale().toString(cost);
+}
+
+QVariant FlatProfileModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case FunctionColumn:
+        return tr("Function");
+    case FileColumn:
+        return tr("File");
+    case ObjectColumn:
+        return tr("Object");
+    default:
+        break;
+    }
+
+    const FlatProfile *flat = flatProfile();
+    const int event = (section - FirstCostColumn) / 2;
+    if (!flat || event >= flat->eventCount())
+        return QVariant();
+    const QString name = QString::fromUtf8(flat->eventNames().at(event));
+    return (section - FirstCostColumn) % 2 ? tr("Incl. %1").arg(name) : tr("Self %1").arg(name);
+}
+
+void FlatProfileModel::sort(int column, Qt::SortOrder order)
+{
+    const FlatProfile *flat = flatProfile();
+    if (!flat || column < 0 || column >= columnCount())
+        return;
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    FlatProfile::SortKey key = FlatProfile::SortByFunction;
+    int event = 0;
+    if (column == FileColumn) {
+        key = FlatProfile::SortByFile;
+    } else if (column == ObjectColumn) {
+        key = FlatProfile::SortByObject;
+    } else if (column >= FirstCostColumn) {
+        event = (column - FirstCostColumn) / 2;
+        key = (column - FirstCostColumn) % 2 ? FlatProfile::SortByInclusiveCost
+                                             : FlatProfile::SortBySelfCost;
+    }
+
+    // Select and order the top rows now, in O(n log k)
+    const int generation = ++m_sortGeneration;
+    QList<int> rows = m_rows;
+    const qsizetype immediate = qMin(ImmediateRows, rows.size());
+    // Names still being demangled would change under the sort
+    const bool demangled = m_document->functionNames().isDone();
+    m_sortDemangled = demangled;
+    flat->sortRows(rows.data(), rows.data() + immediate, rows.data() + rows.size(), key, event, order,
+                   demangled ? &m_document->functionNames() : nullptr);
+    setRows(rows);
+    if (immediate == rows.size())
+        return;
+
+    // The rows below them only need sorting among themselves
+    auto *watcher = new QFutureWatcher<QList<int>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation] {
+        const QList<int> sorted = watcher->result();
+        watcher->deleteLater();
+        if (generation == m_sortGeneration)
+            setRows(sorted);
+    });
+    // The copy shares the columns; the document keeps the profile alive
+    watcher->setFuture(QtConcurrent::run([document = m_document, flat = m_flat, rows, immediate, key, event,
+                                          order, demangled]() mutable {
+        int *begin = rows.data();
+        int *end = begin + rows.size();
+        flat.sortRows(begin + immediate, end, end, key, event, order,
+                      demangled ? &document->functionNames() : nullptr);
+        return rows;
+    }));
+}
+
+void FlatProfileModel::setRows(QList<int> rows)
+{
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    // Keep selections and the current index on the same functions
+    const QModelIndexList persistent = persistentIndexList();
+    QList<int> functions;
+    functions.reserve(persistent.size());
+    for (const QModelIndex &index : persistent)
+        functions.append(m_rows.at(index.row()));
+
+    m_rows = std::move(rows);
+
+    if (!persistent.isEmpty()) {
+        // Filtered rows hold any functions, so this maps all of them; those
+        // filtered out get an invalid index
+        QList<int> rowOf(m_document->profile().functionCount(), -1);
+        for (int row = 0; row < m_rows.size(); ++row)
+            rowOf[m_rows.at(row)] = row;
+        QModelIndexList updated;
+        updated.reserve(persistent.size());
+        for (qsizetype i = 0; i < persistent.size(); ++i)
+            updated.append(index(rowOf.at(functions.at(i)), persistent.at(i).column()));
+        changePersistentIndexList(persistent, updated);
+    }
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
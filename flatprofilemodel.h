@@ -0,0 +1,106 @@
+#ifndef FLATPROFILEMODEL_H
+#define FLATPROFILEMODEL_H
+
+#include "flatprofile.h"
+
+#include <QAbstractTableModel>
+#include <QList>
+#include <QSharedPointer>
+#include <QTimer>
+
+class ProfileDocument;
+
+// Table of every function in a profile: function, file and object, then a
+// self and an inclusive column per event. Cells are read straight from the
+// document's FlatProfile; the model itself only holds the row order.
+//
+// Sorting first selects and orders the rows a view can show right away and
+// finishes the rest on a worker thread, so re-sorting a large profile never
+// stalls the GUI.
+//
+// Derived events added with setDerivedEvent() get columns after the
+// document's events and are kept for the documents that follow, as is the
+// filter, which looks names up in the document's function name index.
+// Once the document's names are demangled, filtering and sorting by
+// function go by the demangled names, and the rows are redone then.
+class FlatProfileModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        FunctionColumn,
+        FileColumn,
+        ObjectColumn,
+        FirstCostColumn
+    };
+
+    explicit FlatProfileModel(QObject *parent = nullptr);
+
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+
+    // Switches to a document that continues the current one, as produced in
+    // watch mode: rows of known functions are kept, new functions are
+    // appended and the order is refreshed without resetting views.
+    void updateDocument(const QSharedPointer<const ProfileDocument> &document);
+
+    // Function index of \a row, or -1.
+    int function(int row) const;
+    // All functions of the profile, shown or not
+    int functionCount() const;
+
+    // Shows only the functions whose name contains \a text, ignoring ASCII
+    // case; an empty text shows all of them
+    void setFilter(const QString &text);
+    QString filter() const { return QString::fromUtf8(m_filter); }
+    // How many names the last filter had to check
+    qsizetype filterCandidateCount() const { return m_filterCandidates; }
+
+    // Adds the derived event formula.name(), or changes its formula. Fails,
+    // with errorString() set, if the formula does not fit the document.
+    bool setDerivedEvent(const EventFormula &formula);
+    bool removeDerivedEvent(const QByteArray &name);
+    // After setDocument() and updateDocument(), names the derived events,
+    // the profile's own or added here, that the document leaves out
+    QString errorString() const { return m_errorString; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+signals:
+    // More function names were demangled; views showing names repaint
+    void functionNamesChanged();
+
+private:
+    const FlatProfile *flatProfile() const;
+    FlatProfile withDerivedEvents(const QSharedPointer<const ProfileDocument> &document,
+                                  QString *leftOut) const;
+    QList<int> filteredRows();
+    void setRows(QList<int> rows);
+    void updateDemangledNames();
+
+    QSharedPointer<const ProfileDocument> m_document;
+    // The document's flat profile, sharing its columns, with the derived
+    // events added here
+    FlatProfile m_flat;
+    QList<EventFormula> m_formulas;
+    QString m_errorString;
+    QList<int> m_rows;
+    QByteArray m_filter;
+    qsizetype m_filterCandidates = 0;
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::DescendingOrder;
+    int m_sortGeneration = 0;
+    // Whether the rows were filtered and sorted on demangled names
+    bool m_filterDemangled = false;
+    bool m_sortDemangled = false;
+    // Repaints the function column while names are being demangled
+    QTimer m_demangleTimer;
+    int m_demangledCount = 0;
+};
+
+#endif // FLATPROFILEMODEL_H
@@ -0,0 +1,94 @@
+#include "lineindex.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const qint64 ProgressInterval = 16 << 20;
+
+bool LineIndex::build(QByteArrayView data, const LoadProgressCallback &progress)
+{
+    beginBuild(data);
+
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    qint64 nextProgress = ProgressInterval;
+    const char *p = begin;
+    while (p < end) {
+        addLine(p - begin);
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!eol)
+            break;
+        p = eol + 1;
+        if (p - begin >= nextProgress && progress) {
+            if (!progress(p - begin, m_lineCount)) {
+                clear();
+                return false;
+            }
+            nextProgress += ProgressInterval;
+        }
+    }
+    return true;
+}
+
+void LineIndex::beginBuild(QByteArrayView data)
+{
+    clear();
+    m_data = data;
+    m_checkpoints.reserve(data.size() / (Stride * 32) + 1);
+}
+
+void LineIndex::assign(QByteArrayView data, QList<qint64> checkpoints, qint64 lineCount)
+{
+    Q_ASSERT(checkpoints.size() == (lineCount + Stride - 1) / Stride);
+    m_data = data;
+    m_checkpoints = std::move(checkpoints);
+    m_lineCount = lineCount;
+}
+
+void LineIndex::clear()
+{
+    m_data = QByteArrayView();
+    m_checkpoints.clear();
+    m_lineCount = 0;
+}
+
+qint64 LineIndex::lineStart(qint64 line) const
+{
+    Q_ASSERT(line >= 0 && line < m_lineCount);
+    const char *begin = m_data.data();
+    const char *end = begin + m_data.size();
+    const char *p = begin + m_checkpoints.at(line / Stride);
+    for (qint64 i = line % Stride; i > 0; --i)
+        p = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p))) + 1;
+    return p - begin;
+}
+
+qint64 LineIndex::lineAt(qint64 offset) const
+{
+    Q_ASSERT(offset >= 0 && offset <= m_data.size() && m_lineCount > 0);
+    const auto checkpoint = std::upper_bound(m_checkpoints.cbegin(), m_checkpoints.cend(), offset) - 1;
+    qint64 line = qint64(checkpoint - m_checkpoints.cbegin()) * Stride;
+    const char *p = m_data.data() + *checkpoint;
+    const char *target = m_data.data() + offset;
+    while (line + 1 < m_lineCount) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(target - p)));
+        if (!eol)
+            break;
+        p = eol + 1;
+        ++line;
+    }
+    return line;
+}
+
+QByteArrayView LineIndex::line(qint64 line) const
+{
+    const qint64 start = lineStart(line);
+    const char *begin = m_data.data() + start;
+    const char *end = m_data.data() + m_data.size();
+    const char *eol = static_cast<const char *>(std::memchr(begin, '\n', size_t(end - begin)));
+    if (!eol)
+        eol = end;
+    if (eol > begin && eol[-1] == '\r')
+        --eol;
+    return QByteArrayView(begin, eol - begin);
+}
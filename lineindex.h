@@ -0,0 +1,54 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QByteArrayView>
+#include <QList>
+
+#include <functional>
+
+// Called periodically while scanning a file with the number of bytes and lines
+// processed so far. Returning false cancels the operation.
+using LoadProgressCallback = std::function<bool(qint64 bytes, qint64 lines)>;
+
+// Sparse index of line start offsets over an immutable byte buffer. Only every
+// Stride-th line start is stored; the lines in between are found with a short
+// forward scan, so lookups stay constant-time at 1/Stride of the memory.
+class LineIndex
+{
+public:
+    enum { Stride = 64 };
+
+    // Returns false if \a progress canceled the scan.
+    bool build(QByteArrayView data, const LoadProgressCallback &progress = {});
+    void clear();
+
+    // Incremental construction for callers that already visit every line,
+    // such as the parser: one addLine() per line start, in order.
+    void beginBuild(QByteArrayView data);
+    void addLine(qint64 offset)
+    {
+        if (m_lineCount % Stride == 0)
+            m_checkpoints.append(offset);
+        ++m_lineCount;
+    }
+
+    // Adopts checkpoints computed elsewhere, e.g. per chunk by a parallel
+    // parser: the start offsets of lines 0, Stride, 2 * Stride, ...
+    void assign(QByteArrayView data, QList<qint64> checkpoints, qint64 lineCount);
+
+    qint64 lineCount() const { return m_lineCount; }
+    const QList<qint64> &checkpoints() const { return m_checkpoints; }
+    qint64 lineStart(qint64 line) const;
+    // The line that contains the byte at \a offset
+    qint64 lineAt(qint64 offset) const;
+
+    // The bytes of \a line without its line terminator.
+    QByteArrayView line(qint64 line) const;
+
+private:
+    QByteArrayView m_data;
+    QList<qint64> m_checkpoints;
+    qint64 m_lineCount = 0;
+};
+
+#endif // LINEINDEX_H
@@ -1,12 +1,19 @@
 // Copyright (C) 2017 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR BSD-3-Clause
 
+#include "commandline.h"
 #include "mainwindow.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    // Commands run headless, before anything touches the display
+    if (argc > 1 && CommandLine::isCommand(argv[1])) {
+        QCoreApplication app(argc, argv);
+        return CommandLine::run(app.arguments());
+    }
+
     QApplication app(argc, argv);
     MainWindow window;
     window.show();
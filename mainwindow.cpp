@@ -1,19 +1,42 @@
 // Copyright (C) 2017 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR BSD-3-Clause
 
+#include "annotatedsourcemodel.h"
 #include "assistant.h"
+#include "callgraphview.h"
+#include "eventformula.h"
 #include "findfiledialog.h"
+#include "flatprofilemodel.h"
 #include "mainwindow.h"
+#include "positioncostmodel.h"
+#include "profilediffmodel.h"
+#include "profiledocument.h"
+#include "profileloader.h"
 #include "textedit.h"
+#include "textsearchmodel.h"
+#include "tracer.h"
 
 #include <QAction>
 #include <QApplication>
-#include <QLibraryInfo>
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDockWidget>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QHeaderView>
+#include <QInputDialog>
+#include <QLabel>
+#include <QLineEdit>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
-
-using namespace Qt::StringLiterals;
+#include <QStackedWidget>
+#include <QStatusBar>
+#include <QTableView>
+#include <QTreeWidget>
 
 // ![0]
 MainWindow::MainWindow()
@@ -21,17 +44,59 @@ MainWindow::MainWindow()
     , assistant(new Assistant)
 {
 // ![0]
-    textViewer->setContents(QLibraryInfo::path(QLibraryInfo::ExamplesPath)
-                            + "/assistant/simpletextviewer/documentation/intro.html"_L1, false);
     setCentralWidget(textViewer);
+    createFlatProfileView();
+    createDiffView();
+    createSourceView();
+    createCallGraphView();
+    createSearchView();
+    createTimingsView();
 
     createActions();
     createMenus();
 
     setWindowTitle(tr("Simple Text Viewer"));
-    resize(750, 400);
+    resize(1100, 500);
 
     connect(textViewer, &TextEdit::fileNameChanged, this, &MainWindow::updateWindowTitle);
+    connect(textViewer, &TextEdit::loadStarted, this, [this](const QString &fileName) {
+        cancelLoadAct->setEnabled(true);
+        statusBar()->showMessage(tr("Loading %1...").arg(fileName));
+    });
+    connect(textViewer, &TextEdit::loadProgress, this, &MainWindow::showLoadProgress);
+    connect(textViewer, &TextEdit::loadFinished, this, &MainWindow::loadFinished);
+    connect(textViewer, &TextEdit::loadFailed, this, &MainWindow::loadFailed);
+    connect(textViewer, &TextEdit::documentChanged, this, [this] {
+        flatProfileModel->setDocument(textViewer->document());
+        sourceModel->setDocument(textViewer->document());
+        positionModel->setDocument(textViewer->document());
+        sourceModeBox->setItemText(1, positionModel->hasAddresses() ? tr("Instructions") : tr("Positions"));
+        callGraphView->setDocument(textViewer->document());
+        updateCallGraphEvents();
+        searchModel->setDocument(textViewer->document());
+        // A comparison is against the document it was started from
+        compareLoader->cancel();
+        diffModel->clear();
+        compareAct->setEnabled(textViewer->document() && textViewer->document()->hasProfile());
+        derivedEventAct->setEnabled(compareAct->isEnabled());
+    });
+    connect(textViewer, &TextEdit::documentUpdated, this, [this] {
+        flatProfileModel->updateDocument(textViewer->document());
+        sourceModel->updateDocument(textViewer->document());
+        positionModel->updateDocument(textViewer->document());
+        callGraphView->updateDocument(textViewer->document());
+        // Lines were added; the search starts over to include them
+        const bool searched = searchModel->rowCount() > 0 || searchModel->isSearching();
+        searchModel->setDocument(textViewer->document());
+        if (searched)
+            findInFile();
+        if (!flatProfileModel->errorString().isEmpty())
+            statusBar()->showMessage(flatProfileModel->errorString(), 5000);
+        else
+            statusBar()->showMessage(tr("Updated: %1 lines").arg(textViewer->lineCount()), 2000);
+        showTimings();
+    });
+    connect(textViewer, &TextEdit::firstPainted, this, &MainWindow::showTimings);
 // ![1]
 }
 //! [1]
@@ -48,6 +113,36 @@ void MainWindow::updateWindowTitle(const QString &fileName)
     setWindowTitle(tr("Simple Text Viewer - %1").arg(fileName));
 }
 
+void MainWindow::showLoadProgress(qint64 bytesRead, qint64 totalBytes, qint64 lines)
+{
+    const double mb = 1024.0 * 1024.0;
+    statusBar()->showMessage(tr("Loading: %1 of %2 MB, %3 lines (Esc to cancel)")
+                             .arg(bytesRead / mb, 0, 'f', 1)
+                             .arg(totalBytes / mb, 0, 'f', 1)
+                             .arg(lines));
+}
+
+void MainWindow::loadFinished(const QString &fileName)
+{
+    cancelLoadAct->setEnabled(false);
+    const auto document = textViewer->document();
+    const QString message = document && document->loadedFromIndex()
+            ? tr("Loaded %1 from its index: %2 lines in %3 s")
+            : tr("Loaded %1: %2 lines in %3 s");
+    const qint64 nanoseconds = document ? document->timings().wallNanoseconds() : 0;
+    QString status = message.arg(fileName).arg(textViewer->lineCount()).arg(nanoseconds / 1e9, 0, 'f', 2);
+    if (!flatProfileModel->errorString().isEmpty())
+        status += tr(". %1").arg(flatProfileModel->errorString());
+    statusBar()->showMessage(status, 5000);
+    showTimings();
+}
+
+void MainWindow::loadFailed(const QString &fileName, const QString &errorString)
+{
+    cancelLoadAct->setEnabled(false);
+    statusBar()->showMessage(tr("Could not load %1: %2").arg(fileName, errorString), 5000);
+}
+
 void MainWindow::about()
 {
     QMessageBox::about(this, tr("About Simple Text Viewer"),
@@ -69,6 +164,177 @@ void MainWindow::open()
     dialog.exec();
 }
 
+void MainWindow::compareWith()
+{
+    const auto document = textViewer->document();
+    if (!document || !document->hasProfile())
+        return;
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Compare With"),
+                                                          QFileInfo(document->fileName()).absolutePath());
+    if (fileName.isEmpty())
+        return;
+    diffModel->clear();
+    compareLoader->load(fileName, true);
+    statusBar()->showMessage(tr("Loading %1 for comparison...").arg(fileName));
+}
+
+void MainWindow::mergeProfiles()
+{
+    const auto document = textViewer->document();
+    const QString directory = document ? QFileInfo(document->fileName()).absolutePath() : QString();
+    const QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("Merge Profiles"), directory,
+                                                                tr("Callgrind profiles (callgrind.out*);;All files (*)"));
+    if (fileNames.isEmpty())
+        return;
+    const QString outputFileName = QFileDialog::getSaveFileName(
+            this, tr("Save Merged Profile"),
+            QFileInfo(fileNames.constFirst()).absolutePath() + "/callgrind.out.merged");
+    if (outputFileName.isEmpty())
+        return;
+    if (fileNames.contains(outputFileName)) {
+        QMessageBox::warning(this, tr("Merge Profiles"),
+                             tr("The merged profile cannot replace one of its inputs."));
+        return;
+    }
+    textViewer->setMergedContents(fileNames, outputFileName, true);
+    statusBar()->showMessage(tr("Merging %n profiles...", nullptr, int(fileNames.size())));
+}
+
+void MainWindow::editDerivedEvent()
+{
+    bool ok = false;
+    const QString definition = QInputDialog::getText(
+            this, tr("Derived Event"),
+            tr("Name = formula, such as CEst = Ir + 10 Bcm + 100 DLmr.\n"
+               "The name of a derived event alone removes it."),
+            QLineEdit::Normal, QString(), &ok).trimmed();
+    if (!ok || definition.isEmpty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray text = definition.toUtf8();
+    bool done;
+    if (!text.contains('=')) {
+        done = flatProfileModel->removeDerivedEvent(text);
+    } else {
+        EventFormula formula;
+        if (!formula.parseDefinition(text)) {
+            QMessageBox::warning(this, tr("Derived Event"), formula.errorString());
+            return;
+        }
+        done = flatProfileModel->setDerivedEvent(formula);
+    }
+    if (!done) {
+        QMessageBox::warning(this, tr("Derived Event"), flatProfileModel->errorString());
+        return;
+    }
+    statusBar()->showMessage(tr("Derived events updated in %1 ms").arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1),
+                             5000);
+}
+
+void MainWindow::filterFunctions(const QString &text)
+{
+    QElapsedTimer timer;
+    timer.start();
+    flatProfileModel->setFilter(text);
+    if (text.isEmpty() || flatProfileModel->functionCount() == 0)
+        return;
+    statusBar()->showMessage(tr("%1 of %2 functions match, %3 names checked in %4 ms")
+                             .arg(flatProfileModel->rowCount())
+                             .arg(flatProfileModel->functionCount())
+                             .arg(flatProfileModel->filterCandidateCount())
+                             .arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1),
+                             5000);
+}
+
+void MainWindow::find()
+{
+    searchDock->show();
+    searchDock->raise();
+    searchEdit->setFocus();
+    searchEdit->selectAll();
+}
+
+void MainWindow::findInFile()
+{
+    const QString pattern = searchEdit->text();
+    if (pattern.isEmpty()) {
+        searchModel->cancel();
+        searchModel->clear();
+        return;
+    }
+    if (!searchModel->search(pattern, regularExpressionCheckBox->isChecked(), caseSensitiveCheckBox->isChecked()))
+        statusBar()->showMessage(tr("Invalid pattern: %1").arg(searchModel->errorString()), 5000);
+}
+
+static void addTimingItems(QTreeWidgetItem *parent, const PhaseTimings &timings)
+{
+    const double wall = double(qMax<qint64>(1, timings.wallNanoseconds()));
+    for (const PhaseTimings::Phase &phase : timings.phases()) {
+        auto *item = new QTreeWidgetItem(parent, {QString::fromLatin1(phase.name),
+                                                  QString::number(phase.nanoseconds / 1e6, 'f', 1),
+                                                  QString::number(100 * phase.nanoseconds / wall, 'f', 1)});
+        item->setTextAlignment(1, Qt::AlignRight);
+        item->setTextAlignment(2, Qt::AlignRight);
+    }
+    parent->setText(1, QString::number(timings.wallNanoseconds() / 1e6, 'f', 1));
+    parent->setTextAlignment(1, Qt::AlignRight);
+}
+
+void MainWindow::showTimings()
+{
+    timingsView->clear();
+    const auto document = textViewer->document();
+    if (!document)
+        return;
+
+    const PhaseTimings &timings = document->timings();
+    auto *opening = new QTreeWidgetItem(timingsView,
+                                        {tr("Open %1").arg(QFileInfo(document->fileName()).fileName())});
+    addTimingItems(opening, timings);
+    // Phases on other threads overlap, so their shares may add up to more
+    opening->setToolTip(0, tr("Shares are of the wall time; decompression runs alongside parsing"));
+
+    const PhaseTimings &paint = textViewer->firstPaintTimings();
+    if (paint.wallNanoseconds() > 0) {
+        auto *firstPaint = new QTreeWidgetItem(timingsView, {tr("First screen")});
+        addTimingItems(firstPaint, paint);
+    }
+
+    if (timings.peakRssKb() >= 0) {
+        auto *memory = new QTreeWidgetItem(timingsView, {tr("Peak memory"),
+                                                         tr("%1 MB").arg(timings.peakRssKb() / 1024.0, 0, 'f', 1)});
+        memory->setTextAlignment(1, Qt::AlignRight);
+        memory->setToolTip(1, tr("Resident high-water mark of the process after opening"));
+    }
+    timingsView->expandAll();
+}
+
+void MainWindow::setTraceRecording(bool recording)
+{
+    if (recording)
+        Tracer::clear();
+    Tracer::setRecording(recording);
+    saveTraceAct->setEnabled(true);
+    statusBar()->showMessage(recording ? tr("Recording trace events") : tr("Trace recording stopped"), 2000);
+}
+
+void MainWindow::saveTrace()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Save Trace"), "trace.json",
+                                                          tr("Chrome trace files (*.json)"));
+    if (fileName.isEmpty())
+        return;
+    QString errorString;
+    if (!Tracer::saveChromeTrace(fileName, &errorString)) {
+        QMessageBox::warning(this, tr("Save Trace"), tr("Could not save %1: %2").arg(fileName, errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Saved %n trace event(s) to %1", nullptr, int(Tracer::eventCount()))
+                             .arg(fileName), 5000);
+}
+
 //! [4]
 void MainWindow::createActions()
 {
@@ -81,9 +347,48 @@ void MainWindow::createActions()
     openAct->setShortcut(QKeySequence::Open);
     connect(openAct, &QAction::triggered, this, &MainWindow::open);
 
+    cancelLoadAct = new QAction(tr("Cancel &Loading"), this);
+    cancelLoadAct->setShortcut(Qt::Key_Escape);
+    cancelLoadAct->setEnabled(false);
+    connect(cancelLoadAct, &QAction::triggered, textViewer, &TextEdit::cancelLoading);
+
+    watchAct = new QAction(tr("&Watch for Changes"), this);
+    watchAct->setCheckable(true);
+    watchAct->setStatusTip(tr("Follow lines and dump parts that callgrind adds to the open file"));
+    connect(watchAct, &QAction::toggled, textViewer, &TextEdit::setWatching);
+
+    compareAct = new QAction(tr("Co&mpare With..."), this);
+    compareAct->setStatusTip(tr("Compare the open profile with another run of the program"));
+    compareAct->setEnabled(false);
+    connect(compareAct, &QAction::triggered, this, &MainWindow::compareWith);
+
+    mergeAct = new QAction(tr("Mer&ge Profiles..."), this);
+    mergeAct->setStatusTip(tr("Sum several profiles, such as one per process, into a new file"));
+    connect(mergeAct, &QAction::triggered, this, &MainWindow::mergeProfiles);
+
+    derivedEventAct = new QAction(tr("Derived &Event..."), this);
+    derivedEventAct->setStatusTip(tr("Add, change or remove an event computed from the recorded ones"));
+    derivedEventAct->setEnabled(false);
+    connect(derivedEventAct, &QAction::triggered, this, &MainWindow::editDerivedEvent);
+
+    findAct = new QAction(tr("&Find..."), this);
+    findAct->setShortcut(QKeySequence::Find);
+    findAct->setStatusTip(tr("Search the open file for text or a regular expression"));
+    connect(findAct, &QAction::triggered, this, &MainWindow::find);
+
+    recordTraceAct = new QAction(tr("&Record Trace"), this);
+    recordTraceAct->setCheckable(true);
+    recordTraceAct->setStatusTip(tr("Record where loading and painting spend their time, "
+                                    "for chrome://tracing or Perfetto"));
+    connect(recordTraceAct, &QAction::toggled, this, &MainWindow::setTraceRecording);
+
+    saveTraceAct = new QAction(tr("&Save Trace..."), this);
+    saveTraceAct->setEnabled(false);
+    connect(saveTraceAct, &QAction::triggered, this, &MainWindow::saveTrace);
+
     clearAct = new QAction(tr("&Clear"), this);
     clearAct->setShortcut(tr("Ctrl+C"));
-    connect(clearAct, &QAction::triggered, textViewer, &QTextEdit::clear);
+    connect(clearAct, &QAction::triggered, textViewer, &TextEdit::clear);
 
     exitAct = new QAction(tr("E&xit"), this);
     exitAct->setShortcuts(QKeySequence::Quit);
@@ -102,10 +407,29 @@ void MainWindow::createMenus()
 {
     fileMenu = new QMenu(tr("&File"), this);
     fileMenu->addAction(openAct);
+    fileMenu->addAction(compareAct);
+    fileMenu->addAction(mergeAct);
+    fileMenu->addAction(cancelLoadAct);
+    fileMenu->addAction(watchAct);
     fileMenu->addAction(clearAct);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAct);
 
+    viewMenu = new QMenu(tr("&View"), this);
+    viewMenu->addAction(flatProfileDock->toggleViewAction());
+    viewMenu->addAction(diffDock->toggleViewAction());
+    viewMenu->addAction(sourceDock->toggleViewAction());
+    viewMenu->addAction(callGraphDock->toggleViewAction());
+    viewMenu->addAction(searchDock->toggleViewAction());
+    viewMenu->addAction(timingsDock->toggleViewAction());
+
+    toolsMenu = new QMenu(tr("&Tools"), this);
+    toolsMenu->addAction(findAct);
+    toolsMenu->addAction(derivedEventAct);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(recordTraceAct);
+    toolsMenu->addAction(saveTraceAct);
+
     helpMenu = new QMenu(tr("&Help"), this);
     helpMenu->addAction(assistantAct);
     helpMenu->addSeparator();
@@ -113,5 +437,331 @@ void MainWindow::createMenus()
     helpMenu->addAction(aboutQtAct);
 
     menuBar()->addMenu(fileMenu);
+    menuBar()->addMenu(viewMenu);
+    menuBar()->addMenu(toolsMenu);
     menuBar()->addMenu(helpMenu);
 }
+
+void MainWindow::createFlatProfileView()
+{
+    flatProfileModel = new FlatProfileModel(this);
+
+    flatProfileView = new QTableView;
+    flatProfileView->setModel(flatProfileModel);
+    flatProfileView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    flatProfileView->setWordWrap(false);
+    flatProfileView->verticalHeader()->hide();
+    // Fixed row heights keep scrolling constant-time with many functions
+    flatProfileView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    flatProfileView->horizontalHeader()->setSortIndicator(FlatProfileModel::FirstCostColumn + 1,
+                                                          Qt::DescendingOrder);
+    flatProfileView->setSortingEnabled(true);
+
+    functionFilterEdit = new QLineEdit;
+    functionFilterEdit->setPlaceholderText(tr("Filter functions"));
+    functionFilterEdit->setClearButtonEnabled(true);
+
+    auto *layout = new QVBoxLayout;
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(functionFilterEdit);
+    layout->addWidget(flatProfileView);
+    auto *flatProfileWidget = new QWidget;
+    flatProfileWidget->setLayout(layout);
+
+    flatProfileDock = new QDockWidget(tr("Flat Profile"), this);
+    flatProfileDock->setObjectName("flatProfileDock");
+    flatProfileDock->setWidget(flatProfileWidget);
+    addDockWidget(Qt::RightDockWidgetArea, flatProfileDock);
+
+    // The name index keeps this fast enough to follow every keystroke
+    connect(functionFilterEdit, &QLineEdit::textChanged, this, &MainWindow::filterFunctions);
+}
+
+void MainWindow::createDiffView()
+{
+    compareLoader = new ProfileLoader(this);
+    compareLoader->setKeepsText(false);
+    diffModel = new ProfileDiffModel(this);
+
+    diffView = new QTableView;
+    diffView->setModel(diffModel);
+    diffView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    diffView->setWordWrap(false);
+    diffView->verticalHeader()->hide();
+    diffView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    diffView->horizontalHeader()->setSortIndicator(ProfileDiffModel::FirstDeltaColumn + 2,
+                                                   Qt::DescendingOrder);
+    diffView->setSortingEnabled(true);
+
+    diffDock = new QDockWidget(tr("Profile Diff"), this);
+    diffDock->setObjectName("diffDock");
+    diffDock->setWidget(diffView);
+    addDockWidget(Qt::BottomDockWidgetArea, diffDock);
+    diffDock->hide();
+
+    connect(compareLoader, &ProfileLoader::progress, this, &MainWindow::showLoadProgress);
+    connect(compareLoader, &ProfileLoader::loaded, this,
+            [this](const QSharedPointer<const ProfileDocument> &document) {
+        if (!document->hasProfile()) {
+            loadFailed(document->fileName(), document->profileErrorString());
+            return;
+        }
+        diffModel->setDocuments(textViewer->document(), document);
+    });
+    connect(compareLoader, &ProfileLoader::failed, this, &MainWindow::loadFailed);
+    connect(compareLoader, &ProfileLoader::canceled, this, [this](const QString &fileName) {
+        loadFailed(fileName, tr("Loading canceled"));
+    });
+    connect(diffModel, &ProfileDiffModel::diffReady, this, [this] {
+        const ProfileDiff *diff = diffModel->diff();
+        diffDock->setWindowTitle(tr("Profile Diff: %1 → %2")
+                                 .arg(QFileInfo(diffModel->before()->fileName()).fileName(),
+                                      QFileInfo(diffModel->after()->fileName()).fileName()));
+        diffDock->show();
+        statusBar()->showMessage(tr("%1 functions compared, %2 only before, %3 only after")
+                                 .arg(diff->rowCount()).arg(diff->onlyBeforeCount())
+                                 .arg(diff->onlyAfterCount()), 5000);
+    });
+    connect(diffModel, &ProfileDiffModel::diffFailed, this, [this](const QString &errorString) {
+        statusBar()->showMessage(tr("Could not compare: %1").arg(errorString), 5000);
+    });
+}
+
+void MainWindow::createSourceView()
+{
+    sourceModel = new AnnotatedSourceModel(this);
+
+    sourceView = new QTableView;
+    sourceView->setModel(sourceModel);
+    sourceView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    sourceView->setWordWrap(false);
+    sourceView->setShowGrid(false);
+    sourceView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    sourceView->verticalHeader()->hide();
+    sourceView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    sourceView->horizontalHeader()->setStretchLastSection(true);
+
+    // The same function by instruction address, or by whatever positions
+    // the profile has, read from the profile alone
+    positionModel = new PositionCostModel(this);
+    positionView = new QTableView;
+    positionView->setModel(positionModel);
+    positionView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    positionView->setWordWrap(false);
+    positionView->setShowGrid(false);
+    positionView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    positionView->verticalHeader()->hide();
+    positionView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    positionView->horizontalHeader()->setStretchLastSection(true);
+    positionView->horizontalHeader()->setSortIndicator(0, Qt::AscendingOrder);
+    positionView->setSortingEnabled(true);
+
+    sourceModeBox = new QComboBox;
+    sourceModeBox->addItem(tr("Source"));
+    sourceModeBox->addItem(tr("Instructions"));
+    sourceStack = new QStackedWidget;
+    sourceStack->addWidget(sourceView);
+    sourceStack->addWidget(positionView);
+    connect(sourceModeBox, &QComboBox::currentIndexChanged, sourceStack, &QStackedWidget::setCurrentIndex);
+
+    auto *controls = new QHBoxLayout;
+    controls->addWidget(new QLabel(tr("Annotate by")));
+    controls->addWidget(sourceModeBox);
+    controls->addStretch();
+    auto *layout = new QVBoxLayout;
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(controls);
+    layout->addWidget(sourceStack);
+    auto *sourceWidget = new QWidget;
+    sourceWidget->setLayout(layout);
+
+    sourceDock = new QDockWidget(tr("Annotated Source"), this);
+    sourceDock->setObjectName("sourceDock");
+    sourceDock->setWidget(sourceWidget);
+    addDockWidget(Qt::BottomDockWidgetArea, sourceDock);
+
+    // The selected function of the flat profile is annotated
+    connect(flatProfileView->selectionModel(), &QItemSelectionModel::currentRowChanged, this,
+            [this](const QModelIndex &current) {
+        if (!current.isValid())
+            return;
+        const int function = flatProfileModel->function(current.row());
+        sourceModel->setFunction(function);
+        positionModel->setFunction(function);
+        positionView->resizeColumnsToContents();
+        if (positionModel->hottestRow() >= 0) {
+            positionView->scrollTo(positionModel->index(positionModel->hottestRow(), 0),
+                                   QAbstractItemView::PositionAtCenter);
+        }
+    });
+    connect(sourceModel, &AnnotatedSourceModel::sourceShown, this, [this](bool cached) {
+        sourceDock->setWindowTitle(tr("Annotated Source: %1").arg(QFileInfo(sourceModel->fileName()).fileName()));
+        sourceDock->setToolTip(sourceModel->fileName());
+        sourceView->resizeColumnsToContents();
+        if (sourceModel->hottestRow() >= 0) {
+            sourceView->scrollTo(sourceModel->index(sourceModel->hottestRow(), AnnotatedSourceModel::LineColumn),
+                                 QAbstractItemView::PositionAtCenter);
+        }
+        if (!cached) {
+            statusBar()->showMessage(tr("Source cache: %1 of %2 MB")
+                                     .arg(sourceModel->memoryUsage() / 1048576.0, 0, 'f', 1)
+                                     .arg(sourceModel->memoryBudget() / 1048576.0, 0, 'f', 1), 2000);
+        }
+    });
+    connect(sourceModel, &AnnotatedSourceModel::sourceFailed, this,
+            [this](const QString &fileName, const QString &errorString) {
+        statusBar()->showMessage(tr("Could not annotate %1: %2").arg(fileName, errorString), 5000);
+    });
+}
+
+void MainWindow::createCallGraphView()
+{
+    callGraphView = new CallGraphView;
+
+    callGraphEventBox = new QComboBox;
+    callGraphEventBox->setSizeAdjustPolicy(QComboBox::AdjustToContents);
+    callGraphThresholdBox = new QComboBox;
+    callGraphThresholdBox->addItem(tr("All calls"), 0.0);
+    callGraphThresholdBox->addItem(tr("0.1 %"), 0.001);
+    callGraphThresholdBox->addItem(tr("1 %"), 0.01);
+    callGraphThresholdBox->addItem(tr("5 %"), 0.05);
+    callGraphThresholdBox->addItem(tr("10 %"), 0.1);
+    callGraphThresholdBox->setCurrentIndex(2);
+
+    auto *controls = new QHBoxLayout;
+    controls->addWidget(callGraphEventBox);
+    controls->addWidget(new QLabel(tr("Hide calls below")));
+    controls->addWidget(callGraphThresholdBox);
+    controls->addStretch();
+
+    auto *layout = new QVBoxLayout;
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(controls);
+    layout->addWidget(callGraphView);
+    auto *callGraphWidget = new QWidget;
+    callGraphWidget->setLayout(layout);
+
+    callGraphDock = new QDockWidget(tr("Call Graph"), this);
+    callGraphDock->setObjectName("callGraphDock");
+    callGraphDock->setWidget(callGraphWidget);
+    addDockWidget(Qt::BottomDockWidgetArea, callGraphDock);
+
+    connect(flatProfileView->selectionModel(), &QItemSelectionModel::currentRowChanged, this,
+            [this](const QModelIndex &current) {
+        if (current.isValid())
+            callGraphView->setFunction(flatProfileModel->function(current.row()));
+    });
+    connect(callGraphEventBox, &QComboBox::currentIndexChanged, callGraphView, &CallGraphView::setEvent);
+    connect(callGraphThresholdBox, &QComboBox::currentIndexChanged, this, [this](int index) {
+        callGraphView->setThreshold(callGraphThresholdBox->itemData(index).toDouble());
+    });
+    // Following a caller or callee moves the graph, not the flat profile
+    connect(callGraphView, &CallGraphView::functionActivated, callGraphView, &CallGraphView::setFunction);
+    // Both show the same document, whose names the flat profile keeps polling
+    connect(flatProfileModel, &FlatProfileModel::functionNamesChanged, callGraphView->viewport(),
+            qOverload<>(&QWidget::update));
+    connect(callGraphView, &CallGraphView::layoutFinished, this, [this] {
+        statusBar()->showMessage(tr("Call graph: %1 functions, %2 calls in %3 ms")
+                                 .arg(callGraphView->nodeCount()).arg(callGraphView->edgeCount())
+                                 .arg(callGraphView->layoutMilliseconds()), 3000);
+    });
+}
+
+void MainWindow::updateCallGraphEvents()
+{
+    const QSignalBlocker blocker(callGraphEventBox);
+    callGraphEventBox->clear();
+    const QSharedPointer<const ProfileDocument> document = textViewer->document();
+    if (document && document->hasProfile()) {
+        for (const QByteArray &name : document->flatProfile().eventNames())
+            callGraphEventBox->addItem(QString::fromUtf8(name));
+    }
+    callGraphView->setEvent(0);
+}
+
+void MainWindow::createSearchView()
+{
+    searchModel = new TextSearchModel(this);
+
+    searchEdit = new QLineEdit;
+    searchEdit->setPlaceholderText(tr("Find in file"));
+    searchEdit->setClearButtonEnabled(true);
+    regularExpressionCheckBox = new QCheckBox(tr("Regular e&xpression"));
+    caseSensitiveCheckBox = new QCheckBox(tr("Match &case"));
+
+    searchView = new QTableView;
+    searchView->setModel(searchModel);
+    searchView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    searchView->setSelectionMode(QAbstractItemView::SingleSelection);
+    searchView->setWordWrap(false);
+    searchView->setShowGrid(false);
+    searchView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    searchView->verticalHeader()->hide();
+    searchView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    searchView->horizontalHeader()->setSectionResizeMode(TextSearchModel::LineColumn,
+                                                         QHeaderView::ResizeToContents);
+    searchView->horizontalHeader()->setStretchLastSection(true);
+
+    auto *optionsLayout = new QHBoxLayout;
+    optionsLayout->addWidget(searchEdit);
+    optionsLayout->addWidget(regularExpressionCheckBox);
+    optionsLayout->addWidget(caseSensitiveCheckBox);
+    auto *layout = new QVBoxLayout;
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(optionsLayout);
+    layout->addWidget(searchView);
+    auto *searchWidget = new QWidget;
+    searchWidget->setLayout(layout);
+
+    searchDock = new QDockWidget(tr("Find"), this);
+    searchDock->setObjectName("searchDock");
+    searchDock->setWidget(searchWidget);
+    addDockWidget(Qt::BottomDockWidgetArea, searchDock);
+    searchDock->hide();
+
+    connect(searchEdit, &QLineEdit::returnPressed, this, &MainWindow::findInFile);
+    connect(regularExpressionCheckBox, &QCheckBox::toggled, this, &MainWindow::findInFile);
+    connect(caseSensitiveCheckBox, &QCheckBox::toggled, this, &MainWindow::findInFile);
+    connect(searchView->selectionModel(), &QItemSelectionModel::currentRowChanged, this,
+            [this](const QModelIndex &current) {
+        if (!current.isValid())
+            return;
+        const TextSearchModel::Match &match = searchModel->match(current.row());
+        textViewer->showMatch(match.line, match.column, match.length);
+    });
+    // The first match is shown as soon as it arrives
+    connect(searchModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &, int first) {
+        if (first == 0)
+            searchView->setCurrentIndex(searchModel->index(0, TextSearchModel::LineColumn));
+    });
+    connect(searchModel, &TextSearchModel::progress, this, [this](qint64 searchedBytes, qint64 totalBytes) {
+        if (!searchModel->isSearching())
+            return;
+        statusBar()->showMessage(tr("Searching: %1 of %2 MB, %n match(es)", nullptr, searchModel->rowCount())
+                                 .arg(searchedBytes / 1048576.0, 0, 'f', 1)
+                                 .arg(totalBytes / 1048576.0, 0, 'f', 1));
+    });
+    connect(searchModel, &TextSearchModel::finished, this, [this] {
+        QString message = tr("%n match(es) in %1 ms", nullptr, searchModel->rowCount())
+                          .arg(searchModel->searchMilliseconds());
+        if (searchModel->firstMatchMilliseconds() >= 0)
+            message += tr(", the first after %1 ms").arg(searchModel->firstMatchMilliseconds());
+        if (searchModel->isTruncated())
+            message += tr("; stopped at %n match(es)", nullptr, TextSearchModel::MaxMatches);
+        statusBar()->showMessage(message, 5000);
+    });
+}
+
+void MainWindow::createTimingsView()
+{
+    timingsView = new QTreeWidget;
+    timingsView->setHeaderLabels({tr("Phase"), tr("ms"), tr("% of wall")});
+    timingsView->setColumnCount(3);
+    timingsView->setUniformRowHeights(true);
+
+    timingsDock = new QDockWidget(tr("Load Timings"), this);
+    timingsDock->setObjectName("timingsDock");
+    timingsDock->setWidget(timingsView);
+    addDockWidget(Qt::RightDockWidgetArea, timingsDock);
+    timingsDock->hide();
+}
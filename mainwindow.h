@@ -5,11 +5,25 @@
 
 QT_BEGIN_NAMESPACE
 class QAction;
+class QCheckBox;
+class QComboBox;
+class QDockWidget;
+class QLineEdit;
 class QMenu;
+class QStackedWidget;
+class QTableView;
+class QTreeWidget;
 QT_END_NAMESPACE
 
+class AnnotatedSourceModel;
 class Assistant;
+class CallGraphView;
+class FlatProfileModel;
+class ProfileDiffModel;
+class PositionCostModel;
+class ProfileLoader;
 class TextEdit;
+class TextSearchModel;
 
 class MainWindow : public QMainWindow
 {
@@ -19,9 +33,21 @@ public:
     MainWindow();
 private slots:
     void updateWindowTitle(const QString &fileName);
+    void showLoadProgress(qint64 bytesRead, qint64 totalBytes, qint64 lines);
+    void loadFinished(const QString &fileName);
+    void loadFailed(const QString &fileName, const QString &errorString);
     void about();
     void showDocumentation();
     void open();
+    void compareWith();
+    void mergeProfiles();
+    void editDerivedEvent();
+    void filterFunctions(const QString &text);
+    void find();
+    void findInFile();
+    void showTimings();
+    void setTraceRecording(bool recording);
+    void saveTrace();
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -29,16 +55,66 @@ protected:
 private:
     void createActions();
     void createMenus();
+    void createFlatProfileView();
+    void createDiffView();
+    void createSourceView();
+    void createCallGraphView();
+    void updateCallGraphEvents();
+    void createSearchView();
+    void createTimingsView();
 
     TextEdit *textViewer;
     Assistant *assistant;
 
+    FlatProfileModel *flatProfileModel;
+    QLineEdit *functionFilterEdit;
+    QTableView *flatProfileView;
+    QDockWidget *flatProfileDock;
+
+    ProfileLoader *compareLoader;
+    ProfileDiffModel *diffModel;
+    QTableView *diffView;
+    QDockWidget *diffDock;
+
+    AnnotatedSourceModel *sourceModel;
+    QTableView *sourceView;
+    PositionCostModel *positionModel;
+    QTableView *positionView;
+    QComboBox *sourceModeBox;
+    QStackedWidget *sourceStack;
+    QDockWidget *sourceDock;
+
+    CallGraphView *callGraphView;
+    QComboBox *callGraphEventBox;
+    QComboBox *callGraphThresholdBox;
+    QDockWidget *callGraphDock;
+
+    TextSearchModel *searchModel;
+    QLineEdit *searchEdit;
+    QCheckBox *regularExpressionCheckBox;
+    QCheckBox *caseSensitiveCheckBox;
+    QTableView *searchView;
+    QDockWidget *searchDock;
+
+    QTreeWidget *timingsView;
+    QDockWidget *timingsDock;
+
     QMenu *fileMenu;
+    QMenu *viewMenu;
+    QMenu *toolsMenu;
     QMenu *helpMenu;
 
     QAction *assistantAct;
     QAction *clearAct;
     QAction *openAct;
+    QAction *compareAct;
+    QAction *mergeAct;
+    QAction *derivedEventAct;
+    QAction *findAct;
+    QAction *cancelLoadAct;
+    QAction *watchAct;
+    QAction *recordTraceAct;
+    QAction *saveTraceAct;
     QAction *exitAct;
     QAction *aboutAct;
     QAction *aboutQtAct;
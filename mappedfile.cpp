@@ -0,0 +1,54 @@
+#include "mappedfile.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size == 0)
+        return true; // Mapping an empty file fails, but an empty view is fine
+
+    uchar *data = m_file.map(0, m_size);
+    if (!data) {
+        m_errorString = m_file.errorString();
+        m_file.close();
+        m_size = 0;
+        return false;
+    }
+    m_data = reinterpret_cast<const char *>(data);
+    m_errorString.clear();
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+    m_data = nullptr;
+    m_size = 0;
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+void MappedFile::adviseSequential() const
+{
+#ifdef Q_OS_UNIX
+    if (m_data)
+        posix_madvise(const_cast<char *>(m_data), size_t(m_size), POSIX_MADV_SEQUENTIAL);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+
+// Read-only memory mapping of a whole file. The mapped bytes stay valid until
+// close() or destruction, so views into data() must not outlive the object.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isOpen() const { return m_file.isOpen(); }
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_errorString; }
+
+    QByteArrayView data() const { return QByteArrayView(m_data, m_size); }
+    qint64 size() const { return m_size; }
+
+    // Hints to the kernel that the mapping will be read front to back.
+    void adviseSequential() const;
+
+private:
+    Q_DISABLE_COPY(MappedFile)
+
+    QFile m_file;
+    const char *m_data = nullptr;
+    qint64 m_size = 0;
+    QString m_errorString;
+};
+
+#endif // MAPPEDFILE_H
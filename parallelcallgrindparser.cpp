@@ -0,0 +1,330 @@
+#include "parallelcallgrindparser.h"
+#include "callgrindparser.h"
+#include "tracer.h"
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cctype>
+#include <cstring>
+
+static const qint64 MinimumChunkSize = 1 << 20;
+static const int ChunksPerThread = 4;
+
+namespace {
+
+struct Chunk {
+    qint64 begin = 0;
+    qint64 end = 0;
+    CallgrindProfile profile;
+    CallgrindParser parser;
+    bool ok = false;
+    qint64 reportedBytes = 0;
+    qint64 reportedLines = 0;
+    qint64 firstLine = 0;
+    QList<qint64> checkpoints;
+};
+
+inline const char *nextLine(const char *p, const char *end)
+{
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+    return eol ? eol + 1 : end;
+}
+
+// Offset of the first line that is neither blank, a comment nor a "key:" header
+qint64 findHeaderEnd(QByteArrayView data)
+{
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    for (const char *p = begin; p < end; p = nextLine(p, end)) {
+        if (*p == '\n' || *p == '\r' || *p == '#')
+            continue;
+        const char *q = p;
+        while (q < end && (std::isalnum(static_cast<unsigned char>(*q)) || *q == '_'))
+            ++q;
+        if (q == p || q == end || *q != ':')
+            return p - begin;
+    }
+    return data.size();
+}
+
+// Offset of the first "fn=" line starting at or after \a from
+qint64 findFunctionLine(QByteArrayView data, qint64 from)
+{
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    const char *p = begin + from;
+    if (p > begin && p[-1] != '\n')
+        p = nextLine(p, end);
+    for (; p < end; p = nextLine(p, end)) {
+        if (end - p >= 3 && p[0] == 'f' && p[1] == 'n' && p[2] == '=')
+            return p - begin;
+    }
+    return data.size();
+}
+
+} // namespace
+
+bool ParallelCallgrindParser::parseSequentially(QByteArrayView data, CallgrindProfile *profile,
+                                                LineIndex *lineIndex, CallgrindParser *continuation)
+{
+    CallgrindParser parser;
+    parser.setProgressCallback(m_progress);
+    const bool ok = parser.parse(data, profile, lineIndex);
+    m_errorString = parser.errorString();
+    m_canceled = parser.wasCanceled();
+    m_lineCount = parser.lineCount();
+    m_chunkCount = 1;
+    if (ok && continuation) {
+        *continuation = parser;
+        continuation->setProgressCallback({});
+    }
+    return ok;
+}
+
+bool ParallelCallgrindParser::parse(QByteArrayView data, CallgrindProfile *profile, LineIndex *lineIndex,
+                                    CallgrindParser *continuation)
+{
+    m_errorString.clear();
+    m_canceled = false;
+    m_lineCount = 0;
+
+    const int threadCount = m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount();
+    const qint64 headerEnd = findHeaderEnd(data);
+    const qint64 bodySize = data.size() - headerEnd;
+    const int targetChunks = int(qMin<qint64>(qint64(threadCount) * ChunksPerThread,
+                                              bodySize / MinimumChunkSize));
+    if (threadCount < 2 || targetChunks < 2)
+        return parseSequentially(data, profile, lineIndex, continuation);
+
+    QList<qint64> bounds{headerEnd};
+    for (int i = 1; i < targetChunks; ++i) {
+        const qint64 split = findFunctionLine(data, headerEnd + bodySize * i / targetChunks);
+        if (split >= data.size())
+            break;
+        if (split > bounds.last())
+            bounds.append(split);
+    }
+    bounds.append(data.size());
+    if (bounds.size() < 3)
+        return parseSequentially(data, profile, lineIndex, continuation);
+
+    // The header fixes the events and positions every chunk needs
+    CallgrindParser headerParser;
+    if (!headerParser.parse(data.first(headerEnd), profile)) {
+        m_errorString = headerParser.errorString();
+        return false;
+    }
+
+    const qsizetype chunkCount = bounds.size() - 1;
+    QList<Chunk> chunks(chunkCount);
+    QAtomicInteger<qint64> totalBytes = headerEnd;
+    QAtomicInteger<qint64> totalLines = headerParser.lineCount();
+    QAtomicInt canceled = 0;
+    QMutex progressMutex;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    for (qsizetype i = 0; i < chunkCount; ++i) {
+        Chunk &chunk = chunks[i];
+        chunk.begin = bounds.at(i);
+        chunk.end = bounds.at(i + 1);
+        pool.start([&, i] {
+            Chunk &chunk = chunks[i];
+            chunk.profile.setEventNames(profile->eventNames());
+            chunk.profile.setPositionNames(profile->positionNames());
+            chunk.parser.m_chunkMode = true;
+            chunk.parser.setProgressCallback([&](qint64 bytes, qint64 lines) {
+                const qint64 allBytes = totalBytes.fetchAndAddRelaxed(bytes - chunk.reportedBytes)
+                                        + bytes - chunk.reportedBytes;
+                const qint64 allLines = totalLines.fetchAndAddRelaxed(lines - chunk.reportedLines)
+                                        + lines - chunk.reportedLines;
+                chunk.reportedBytes = bytes;
+                chunk.reportedLines = lines;
+                if (m_progress) {
+                    QMutexLocker locker(&progressMutex);
+                    if (!m_progress(allBytes, allLines))
+                        canceled.storeRelaxed(1);
+                }
+                return canceled.loadRelaxed() == 0;
+            });
+            const TraceScope scope("parse chunk", nullptr, "parse");
+            chunk.ok = chunk.parser.parse(data.sliced(chunk.begin, chunk.end - chunk.begin),
+                                          &chunk.profile);
+        });
+    }
+    pool.waitForDone();
+
+    if (canceled.loadRelaxed()) {
+        m_canceled = true;
+        m_errorString = QStringLiteral("canceled");
+        return false;
+    }
+    for (const Chunk &chunk : std::as_const(chunks)) {
+        // Errors are reported with exact line numbers by a sequential run,
+        // and multi-part layouts can only be parsed sequentially anyway
+        if (!chunk.ok)
+            return parseSequentially(data, profile, lineIndex, continuation);
+    }
+
+    m_chunkCount = int(chunkCount);
+    m_lineCount = headerParser.lineCount();
+    for (Chunk &chunk : chunks) {
+        chunk.firstLine = m_lineCount;
+        m_lineCount += chunk.parser.lineCount();
+    }
+
+    if (lineIndex) {
+        // Checkpoints sit on global line numbers, which are only known now
+        for (qsizetype i = 0; i < chunkCount; ++i) {
+            pool.start([&, i] {
+                const TraceScope scope("index chunk", nullptr, "parse");
+                Chunk &chunk = chunks[i];
+                const char *begin = data.data();
+                const char *end = begin + chunk.end;
+                qint64 line = chunk.firstLine;
+                for (const char *p = begin + chunk.begin; p < end; p = nextLine(p, end), ++line) {
+                    if (line % LineIndex::Stride == 0)
+                        chunk.checkpoints.append(p - begin);
+                }
+            });
+        }
+
+        QList<qint64> checkpoints;
+        const char *begin = data.data();
+        qint64 line = 0;
+        for (const char *p = begin; p < begin + headerEnd; p = nextLine(p, begin + headerEnd), ++line) {
+            if (line % LineIndex::Stride == 0)
+                checkpoints.append(p - begin);
+        }
+        pool.waitForDone();
+        for (const Chunk &chunk : std::as_const(chunks))
+            checkpoints.append(chunk.checkpoints);
+        lineIndex->assign(data, std::move(checkpoints), m_lineCount);
+    }
+
+    // Merge in file order so compressed ids resolve exactly as they would in
+    // a sequential parse
+    const TraceScope mergeScope("merge chunks", nullptr, "parse");
+    ChunkedArray<int> compressed[CallgrindProfile::SymbolKindCount];
+    int contextObject = -1;
+    int contextFile = -1;
+    // Positions where the previous chunk left off, which relative positions
+    // at the start of the next one build on
+    const int positionCount = profile->positionCosts().positionCount();
+    QVarLengthArray<quint64, 8> positions(positionCount, 0);
+    QVarLengthArray<int, 4> relativeRanges(positionCount);
+    for (const Chunk &chunk : std::as_const(chunks)) {
+        const CallgrindProfile &local = chunk.profile;
+        const CallgrindParser &parser = chunk.parser;
+
+        QList<int> symbolMap[CallgrindProfile::SymbolKindCount];
+        for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind) {
+            const auto symbolKind = CallgrindProfile::SymbolKind(kind);
+            symbolMap[kind].resize(local.symbolCount(symbolKind), -1);
+            for (const CallgrindParser::SymbolReference &ref : parser.m_unresolved) {
+                if (ref.kind != symbolKind)
+                    continue;
+                const ChunkedArray<int> &table = compressed[kind];
+                symbolMap[kind][ref.symbol] = ref.id < table.size() && table.at(ref.id) >= 0
+                        ? table.at(ref.id)
+                        : profile->addSymbol(symbolKind, QByteArray('(' + QByteArray::number(ref.id) + ')'));
+            }
+        }
+        symbolMap[CallgrindProfile::ObjectSymbol][parser.m_inheritedObject] = contextObject;
+        symbolMap[CallgrindProfile::FileSymbol][parser.m_inheritedFile] = contextFile;
+
+        for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind) {
+            const auto symbolKind = CallgrindProfile::SymbolKind(kind);
+            for (int symbol = 0; symbol < local.symbolCount(symbolKind); ++symbol) {
+                const bool inherited = (kind == CallgrindProfile::ObjectSymbol && symbol == parser.m_inheritedObject)
+                        || (kind == CallgrindProfile::FileSymbol && symbol == parser.m_inheritedFile);
+                if (!inherited && symbolMap[kind].at(symbol) < 0)
+                    symbolMap[kind][symbol] = profile->addSymbol(symbolKind, local.symbolName(symbolKind, symbol));
+            }
+        }
+        for (const CallgrindParser::SymbolReference &ref : parser.m_definitions) {
+            ChunkedArray<int> &table = compressed[ref.kind];
+            if (table.size() <= ref.id)
+                table.resize(ref.id + 1, -1);
+            table[ref.id] = symbolMap[ref.kind].at(ref.symbol);
+        }
+
+        // An inherited object or file that was never set is unknown
+        const auto resolve = [&](CallgrindProfile::SymbolKind kind, int symbol) {
+            const int global = symbolMap[kind].at(symbol);
+            return global >= 0 ? global : profile->addSymbol(kind, "???");
+        };
+
+        QList<int> functionMap(local.functionCount());
+        for (int i = 0; i < local.functionCount(); ++i) {
+            const CallgrindProfile::Function &function = local.function(i);
+            functionMap[i] = profile->addFunction(resolve(CallgrindProfile::ObjectSymbol, function.object),
+                                                  resolve(CallgrindProfile::FileSymbol, function.file),
+                                                  resolve(CallgrindProfile::FunctionSymbol, function.name));
+            profile->addSelfCost(functionMap.at(i), local.selfCosts(i));
+        }
+        QList<int> callMap(local.callCount());
+        for (int i = 0; i < local.callCount(); ++i) {
+            const CallgrindProfile::Call &call = local.call(i);
+            callMap[i] = profile->addCall(functionMap.at(call.caller), functionMap.at(call.callee));
+            profile->addCallCost(callMap.at(i), call.count, local.callCosts(i));
+        }
+        for (auto it = local.headers().cbegin(); it != local.headers().cend(); ++it)
+            profile->setHeader(it.key(), it.value());
+        for (const QByteArray &definition : local.eventDefinitions())
+            profile->addEventDefinition(definition);
+
+        const bool hasPositions = !parser.m_positions.isEmpty();
+        for (int p = 0; p < positionCount; ++p) {
+            const int ranges = hasPositions ? parser.m_relativeRanges.at(p) : -1;
+            relativeRanges[p] = ranges >= 0 ? ranges : local.positionCosts().rangeCount();
+        }
+        profile->positionCosts().append(local.positionCosts(), functionMap, callMap, positions.constData(),
+                                        relativeRanges.constData());
+        for (int p = 0; hasPositions && p < positionCount; ++p) {
+            if (parser.m_relativeRanges.at(p) >= 0)
+                positions[p] = parser.m_positions.at(p);
+            else
+                positions[p] += parser.m_positions.at(p);
+        }
+
+        contextObject = symbolMap[CallgrindProfile::ObjectSymbol].at(parser.m_object);
+        contextFile = symbolMap[CallgrindProfile::FileSymbol].at(parser.m_file);
+
+        if (continuation && &chunk == &chunks.constLast()) {
+            // Where a sequential parse would stand after the last line
+            const auto map = [&](CallgrindProfile::SymbolKind kind, int symbol) {
+                return symbol >= 0 ? symbolMap[kind].at(symbol) : -1;
+            };
+            CallgrindParser &next = *continuation;
+            next = CallgrindParser();
+            next.resume(profile, lineIndex, data.size());
+            next.m_lineNumber = m_lineCount;
+            for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind)
+                next.m_compressed[kind] = compressed[kind];
+            next.m_object = contextObject;
+            next.m_file = contextFile;
+            next.m_functionName = map(CallgrindProfile::FunctionSymbol, parser.m_functionName);
+            next.m_function = parser.m_function >= 0 ? functionMap.at(parser.m_function) : -1;
+            next.m_calledObject = map(CallgrindProfile::ObjectSymbol, parser.m_calledObject);
+            next.m_calledFile = map(CallgrindProfile::FileSymbol, parser.m_calledFile);
+            next.m_calledName = map(CallgrindProfile::FunctionSymbol, parser.m_calledName);
+            next.m_nextLine = parser.m_nextLine;
+            next.m_callCount = parser.m_callCount;
+            next.m_positions = positions;
+            // Targets relative to a chunk's positions move with them
+            next.m_callTarget = parser.m_callTarget;
+            for (qsizetype p = 0; p < next.m_callTarget.size() && p < positionCount; ++p) {
+                if (!(parser.m_rawCallTargets & (1u << p)))
+                    next.m_callTarget[p] += positions.at(p) - parser.m_positions.at(p);
+            }
+            next.m_costs = parser.m_costs;
+        }
+    }
+    profile->positionCosts().squeeze();
+
+    return true;
+}
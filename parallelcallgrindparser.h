@@ -0,0 +1,48 @@
+#ifndef PARALLELCALLGRINDPARSER_H
+#define PARALLELCALLGRINDPARSER_H
+
+#include "callgrindprofile.h"
+#include "lineindex.h"
+
+class CallgrindParser;
+
+#include <QByteArrayView>
+#include <QString>
+
+// Parses a Callgrind profile on all cores. The body of the file is split at
+// fn= lines into chunks that are parsed independently on a thread pool; the
+// per-chunk name and cost tables are then merged in file order, resolving
+// compressed "(id)" references against the definitions of earlier chunks.
+// The result is identical to a sequential CallgrindParser run, which is also
+// what this falls back to for small files and multi-part layouts.
+class ParallelCallgrindParser
+{
+public:
+    // 0 uses QThread::idealThreadCount().
+    void setThreadCount(int count) { m_threadCount = count; }
+    void setProgressCallback(const LoadProgressCallback &callback) { m_progress = callback; }
+
+    // If \a continuation is given it receives the state a sequential parser
+    // would have after the last line, so that text appended to \a data later
+    // can be parsed on its own (see CallgrindParser::resume()).
+    bool parse(QByteArrayView data, CallgrindProfile *profile, LineIndex *lineIndex = nullptr,
+               CallgrindParser *continuation = nullptr);
+
+    QString errorString() const { return m_errorString; }
+    bool wasCanceled() const { return m_canceled; }
+    qint64 lineCount() const { return m_lineCount; }
+    int chunkCount() const { return m_chunkCount; }
+
+private:
+    bool parseSequentially(QByteArrayView data, CallgrindProfile *profile, LineIndex *lineIndex,
+                           CallgrindParser *continuation);
+
+    int m_threadCount = 0;
+    LoadProgressCallback m_progress;
+    QString m_errorString;
+    qint64 m_lineCount = 0;
+    int m_chunkCount = 0;
+    bool m_canceled = false;
+};
+
+#endif // PARALLELCALLGRINDPARSER_H
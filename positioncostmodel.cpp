@@ -0,0 +1,243 @@
+#include "positioncostmodel.h"
+#include "profiledocument.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QLocale>
+
+#include <algorithm>
+#include <numeric>
+
+using namespace Qt::StringLiterals;
+
+PositionCostModel::PositionCostModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void PositionCostModel::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    beginResetModel();
+    m_document = document;
+    m_function = -1;
+    m_table = PositionCosts::Table();
+    m_callees.clear();
+    m_maxSelfCosts.clear();
+    m_rows.clear();
+    m_positionNames.clear();
+    m_totalCosts.clear();
+    if (m_document && m_document->hasProfile()) {
+        const CallgrindProfile &profile = m_document->profile();
+        m_positionNames = profile.positionNames();
+        if (m_positionNames.size() != profile.positionCosts().positionCount())
+            m_positionNames = {"line"};
+        for (int event = 0; event < profile.eventCount(); ++event)
+            m_totalCosts.append(profile.totalCost(event));
+    }
+    endResetModel();
+}
+
+void PositionCostModel::updateDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    const int function = m_function;
+    setDocument(document);
+    setFunction(function);
+}
+
+void PositionCostModel::setFunction(int function)
+{
+    if (!m_document || !m_document->hasProfile() || function < 0
+        || function >= m_document->profile().functionCount()) {
+        return;
+    }
+
+    beginResetModel();
+    const CallgrindProfile &profile = m_document->profile();
+    const PositionCosts &positionCosts = profile.positionCosts();
+    const int positionCount = positionCosts.positionCount();
+    m_function = function;
+    m_table = positionCosts.table(function);
+
+    // Table rows are sorted by position, so call lines find theirs by search
+    m_callees = QList<QList<int>>(m_table.rowCount());
+    const PositionCosts::CallLines calls = positionCosts.callLines(function);
+    for (int line = 0; line < calls.rowCount(); ++line) {
+        const quint64 *positions = calls.positions(line);
+        int first = 0;
+        int count = m_table.rowCount();
+        while (count > 0) {
+            const int step = count / 2;
+            const quint64 *rowPositions = m_table.positions(first + step);
+            if (std::lexicographical_compare(rowPositions, rowPositions + positionCount,
+                                             positions, positions + positionCount)) {
+                first += step + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        if (first == m_table.rowCount())
+            continue;
+        QList<int> &callees = m_callees[first];
+        const int callee = profile.call(calls.call(line)).callee;
+        if (!callees.contains(callee))
+            callees.append(callee);
+    }
+
+    m_maxSelfCosts.fill(0, eventCount());
+    for (int row = 0; row < m_table.rowCount(); ++row) {
+        for (int event = 0; event < eventCount(); ++event)
+            m_maxSelfCosts[event] = qMax(m_maxSelfCosts.at(event), m_table.selfCosts(row)[event]);
+    }
+    m_rows.resize(m_table.rowCount());
+    std::iota(m_rows.begin(), m_rows.end(), 0);
+    endResetModel();
+    sort(m_sortColumn, m_sortOrder);
+}
+
+int PositionCostModel::hottestRow() const
+{
+    if (m_rows.isEmpty() || eventCount() == 0)
+        return -1;
+    const auto hottest = std::max_element(m_rows.cbegin(), m_rows.cend(), [this](int a, int b) {
+        return m_table.selfCosts(a)[0] < m_table.selfCosts(b)[0];
+    });
+    return int(hottest - m_rows.cbegin());
+}
+
+quint64 PositionCostModel::cost(int row, int column) const
+{
+    if (column < firstCostColumn())
+        return m_table.positions(row)[column];
+    const int event = (column - firstCostColumn()) / 2;
+    const bool calls = (column - firstCostColumn()) % 2;
+    return (calls ? m_table.callCosts(row) : m_table.selfCosts(row))[event];
+}
+
+QString PositionCostModel::calleeNames(int row) const
+{
+    QStringList names;
+    const CallgrindProfile &profile = m_document->profile();
+    for (const int callee : m_callees.at(row))
+        names << QString::fromUtf8(m_document->functionNames().name(profile.function(callee).name));
+    return names.join(u", "_s);
+}
+
+int PositionCostModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_rows.size());
+}
+
+int PositionCostModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() || !m_document || !m_document->hasProfile() ? 0 : calleeColumn() + 1;
+}
+
+QVariant PositionCostModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int column = index.column();
+    const int row = m_rows.at(index.row());
+    if (column == calleeColumn()) {
+        if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+            return QVariant();
+        const QString names = calleeNames(row);
+        return names.isEmpty() ? QVariant() : QVariant(names);
+    }
+    if (role == Qt::TextAlignmentRole)
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    if (column < firstCostColumn()) {
+        if (role != Qt::DisplayRole)
+            return QVariant();
+        const quint64 position = cost(row, column);
+        return m_positionNames.at(column) == "instr" ? u"0x"_s + QString::number(position, 16)
+                                                     : QString::number(position);
+    }
+
+    const quint64 value = cost(row, column);
+    if (value == 0)
+        return QVariant();
+    const int event = (column - firstCostColumn()) / 2;
+    const bool calls = (column - firstCostColumn()) % 2;
+    switch (role) {
+    case Qt::DisplayRole:
+        return QLocale().toString(value);
+    case Qt::ToolTipRole: {
+        const quint64 total = m_totalCosts.value(event);
+        if (total == 0)
+            return QVariant();
+        return tr("%1 % of the total").arg(QLocale().toString(100.0 * double(value) / double(total), 'f', 2));
+    }
+    case Qt::BackgroundRole: {
+        // Shade self costs by how hot the position is within the function
+        const quint64 max = m_maxSelfCosts.value(event);
+        if (calls || max == 0)
+            return QVariant();
+        QColor color(Qt::red);
+        color.setAlphaF(0.05f + 0.45f * float(double(value) / double(max)));
+        return QBrush(color);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QVariant PositionCostModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    if (section < firstCostColumn()) {
+        const QByteArray &name = m_positionNames.at(section);
+        return name == "instr" ? tr("Address") : name == "line" ? tr("Line") : QString::fromUtf8(name);
+    }
+    if (section == calleeColumn())
+        return tr("Calls To");
+
+    const int event = (section - firstCostColumn()) / 2;
+    if (!m_document || event >= m_document->profile().eventCount())
+        return QVariant();
+    const QString name = QString::fromUtf8(m_document->profile().eventNames().at(event));
+    return (section - firstCostColumn()) % 2 ? tr("Calls %1").arg(name) : tr("Self %1").arg(name);
+}
+
+void PositionCostModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= calleeColumn())
+        return;
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    // Keep selections and the current index on the same positions
+    const QModelIndexList persistent = persistentIndexList();
+    QList<int> tableRows;
+    tableRows.reserve(persistent.size());
+    for (const QModelIndex &index : persistent)
+        tableRows.append(m_rows.at(index.row()));
+
+    // Ties keep position order
+    std::sort(m_rows.begin(), m_rows.end(), [&](int a, int b) {
+        const quint64 costA = cost(a, column);
+        const quint64 costB = cost(b, column);
+        if (costA != costB)
+            return order == Qt::AscendingOrder ? costA < costB : costA > costB;
+        return a < b;
+    });
+
+    if (!persistent.isEmpty()) {
+        QList<int> rowOf(m_rows.size());
+        for (int row = 0; row < m_rows.size(); ++row)
+            rowOf[m_rows.at(row)] = row;
+        QModelIndexList updated;
+        updated.reserve(persistent.size());
+        for (qsizetype i = 0; i < persistent.size(); ++i)
+            updated.append(index(rowOf.at(tableRows.at(i)), persistent.at(i).column()));
+        changePersistentIndexList(persistent, updated);
+    }
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
@@ -0,0 +1,67 @@
+#ifndef POSITIONCOSTMODEL_H
+#define POSITIONCOSTMODEL_H
+
+#include "positioncosts.h"
+
+#include <QAbstractTableModel>
+#include <QList>
+#include <QSharedPointer>
+
+class ProfileDocument;
+
+// The selected function by position, one row per distinct position: the
+// instruction address in hex and the source line, as the positions: header
+// lists them, then a self and a call cost column per event and the functions
+// called from there. Unlike AnnotatedSourceModel it needs no source file,
+// and it tells apart the instructions of one line.
+//
+// Rows start in position order; sorting by a cost column puts the hottest
+// addresses first.
+class PositionCostModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit PositionCostModel(QObject *parent = nullptr);
+
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+    // Switches to a continuation of the document, as in watch mode, and
+    // shows the same function again with the updated costs
+    void updateDocument(const QSharedPointer<const ProfileDocument> &document);
+    void setFunction(int function);
+    int function() const { return m_function; }
+
+    // Whether the positions include instruction addresses
+    bool hasAddresses() const { return m_positionNames.contains("instr"); }
+    int firstCostColumn() const { return int(m_positionNames.size()); }
+    int calleeColumn() const { return firstCostColumn() + 2 * eventCount(); }
+    // The row of the function's costliest position by the first event, or -1
+    int hottestRow() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+    int eventCount() const { return int(m_totalCosts.size()); }
+    quint64 cost(int row, int column) const;
+    QString calleeNames(int row) const;
+
+    QSharedPointer<const ProfileDocument> m_document;
+    QList<QByteArray> m_positionNames;
+    QList<quint64> m_totalCosts;
+    int m_function = -1;
+    PositionCosts::Table m_table;
+    // Per table row, the functions called there
+    QList<QList<int>> m_callees;
+    QList<quint64> m_maxSelfCosts;
+    // Table rows in the order shown
+    QList<int> m_rows;
+    int m_sortColumn = 0;
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+};
+
+#endif // POSITIONCOSTMODEL_H
@@ -0,0 +1,514 @@
+#include "positioncosts.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+static const int MaxVarintBytes = 10;
+
+static inline quint64 zigzag(quint64 delta)
+{
+    return (delta << 1) ^ quint64(qint64(delta) >> 63);
+}
+
+static inline quint64 unzigzag(quint64 value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static inline uchar *writeVarint(uchar *p, quint64 value)
+{
+    while (value >= 0x80) {
+        *p++ = uchar(value) | 0x80;
+        value >>= 7;
+    }
+    *p++ = uchar(value);
+    return p;
+}
+
+static inline bool readVarint(const uchar *&p, const uchar *end, quint64 *value)
+{
+    quint64 result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uchar byte = *p++;
+        result |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+// Reads the varints of data() from one offset up to another, going on into
+// the next chunk where a range runs past the end of its own
+class DataReader
+{
+public:
+    DataReader(const PositionCosts::Data &data, qint64 offset, qint64 end)
+        : m_data(data), m_chunk(int(offset >> ChunkBits)), m_end(end)
+    {
+        if (m_chunk < m_data.chunkCount())
+            setChunk(offset - (qint64(m_chunk) << ChunkBits));
+    }
+
+    bool readVarint(quint64 *value)
+    {
+        if (m_chunkEnd - m_p >= MaxVarintBytes)
+            return ::readVarint(m_p, m_chunkEnd, value);
+
+        quint64 result = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_p == m_chunkEnd && !nextChunk())
+                return false;
+            const uchar byte = *m_p++;
+            result |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                *value = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static constexpr int ChunkBits = 16;
+    static_assert(PositionCosts::Data::ChunkRows == qsizetype(1) << ChunkBits);
+
+    void setChunk(qint64 offset)
+    {
+        const uchar *data = m_data.chunkData(m_chunk);
+        const qint64 start = qint64(m_chunk) << ChunkBits;
+        m_p = data + offset;
+        m_chunkEnd = data + qMin(m_data.chunkRowCount(m_chunk), qsizetype(m_end - start));
+    }
+    bool nextChunk()
+    {
+        if (m_chunk + 1 >= m_data.chunkCount() || (qint64(m_chunk + 1) << ChunkBits) >= m_end)
+            return false;
+        ++m_chunk;
+        setChunk(0);
+        return true;
+    }
+
+    const PositionCosts::Data &m_data;
+    int m_chunk;
+    qint64 m_end;
+    const uchar *m_p = nullptr;
+    const uchar *m_chunkEnd = nullptr;
+};
+
+} // namespace
+
+void PositionCosts::clear()
+{
+    m_ranges.clear();
+    m_bases.clear();
+    m_data.clear();
+    m_calls.clear();
+    m_firstRange.clear();
+    m_lastRange.clear();
+    m_nextRange.clear();
+    m_open = false;
+}
+
+void PositionCosts::setLayout(int positionCount, int eventCount)
+{
+    if (positionCount != m_positionCount || eventCount != m_eventCount) {
+        clear();
+        m_bases.setWidth(positionCount);
+    }
+    m_positionCount = positionCount;
+    m_eventCount = eventCount;
+}
+
+qint64 PositionCosts::lineCount() const
+{
+    qint64 count = 0;
+    for (qsizetype range = 0; range < m_ranges.size(); ++range)
+        count += m_ranges.at(range).lineCount;
+    return count;
+}
+
+void PositionCosts::link(int range)
+{
+    Q_ASSERT(m_nextRange.size() == range);
+    const int function = m_ranges.at(range).function;
+    if (m_firstRange.size() <= function) {
+        m_firstRange.resize(function + 1, -1);
+        m_lastRange.resize(function + 1, -1);
+    }
+    m_nextRange.append(-1);
+    if (m_lastRange.at(function) >= 0)
+        m_nextRange[m_lastRange.at(function)] = range;
+    else
+        m_firstRange[function] = range;
+    m_lastRange[function] = range;
+}
+
+void PositionCosts::startRange(int function, const quint64 *positions)
+{
+    m_ranges.append(Range{function, 0, m_data.size(), m_calls.size()});
+    m_bases.appendRow(positions);
+    link(int(m_ranges.size() - 1));
+    m_last.clear();
+    m_last.append(positions, m_positionCount);
+    m_open = true;
+}
+
+void PositionCosts::addLine(int function, const quint64 *positions, const CallSite *call, const quint64 *costs)
+{
+    // The first delta shares its varint with the call flag, so deltas too
+    // large for that start a new range, as a change of function does
+    quint64 first = 0;
+    bool fresh = !m_open || m_ranges.constLast().function != function
+            || m_ranges.constLast().lineCount == std::numeric_limits<quint32>::max();
+    if (!fresh) {
+        first = zigzag(positions[0] - m_last.at(0));
+        fresh = (first >> 63) != 0;
+    }
+    if (fresh) {
+        startRange(function, positions);
+        first = 0;
+    }
+
+    QVarLengthArray<uchar, 256> line(MaxVarintBytes * (3 + 2 * m_positionCount + m_eventCount));
+    uchar *p = writeVarint(line.data(), (first << 1) | (call ? 1 : 0));
+    for (int i = 1; i < m_positionCount; ++i)
+        p = writeVarint(p, zigzag(positions[i] - m_last.at(i)));
+    for (int e = 0; e < m_eventCount; ++e)
+        p = writeVarint(p, costs[e]);
+    if (call) {
+        p = writeVarint(p, call->count);
+        p = writeVarint(p, call->rawTargets);
+        for (int i = 0; i < m_positionCount; ++i) {
+            p = writeVarint(p, call->rawTargets & (1u << i) ? call->target[i]
+                                                             : zigzag(call->target[i] - positions[i]));
+        }
+        m_calls.append(call->call);
+    }
+    m_data.appendRows(line.constData(), p - line.constData());
+
+    std::copy(positions, positions + m_positionCount, m_last.begin());
+    ++m_ranges.last().lineCount;
+}
+
+template <typename Visitor>
+bool PositionCosts::decodeRange(int range, Visitor visit) const
+{
+    const Range &r = m_ranges.at(range);
+    const qint64 end = range + 1 < m_ranges.size() ? m_ranges.at(range + 1).offset : m_data.size();
+    DataReader data(m_data, r.offset, end);
+
+    const quint64 *bases = m_bases.constRowData(range);
+    QVarLengthArray<quint64, 4> positions(bases, bases + m_positionCount);
+    QVarLengthArray<quint64, 16> costs(m_eventCount);
+    QVarLengthArray<quint64, 4> target(m_positionCount);
+    CallSite site{-1, 0, target.constData(), 0};
+    qint64 call = r.firstCall;
+    for (quint32 line = 0; line < r.lineCount; ++line) {
+        quint64 header;
+        if (!data.readVarint(&header))
+            return false;
+        positions[0] += unzigzag(header >> 1);
+        for (int i = 1; i < m_positionCount; ++i) {
+            quint64 delta;
+            if (!data.readVarint(&delta))
+                return false;
+            positions[i] += unzigzag(delta);
+        }
+        for (int e = 0; e < m_eventCount; ++e) {
+            if (!data.readVarint(&costs[e]))
+                return false;
+        }
+        if (!(header & 1)) {
+            visit(positions.constData(), nullptr, costs.constData());
+            continue;
+        }
+        quint64 rawTargets;
+        if (call < 0 || call >= m_calls.size() || !data.readVarint(&site.count)
+            || !data.readVarint(&rawTargets)) {
+            return false;
+        }
+        site.call = m_calls.at(call++);
+        site.rawTargets = quint32(rawTargets);
+        for (int i = 0; i < m_positionCount; ++i) {
+            quint64 value;
+            if (!data.readVarint(&value))
+                return false;
+            target[i] = site.rawTargets & (1u << i) ? value : positions[i] + unzigzag(value);
+        }
+        visit(positions.constData(), &site, costs.constData());
+    }
+    return true;
+}
+
+PositionCosts::Table PositionCosts::table(int function) const
+{
+    Table table;
+    table.m_positionCount = m_positionCount;
+    table.m_eventCount = m_eventCount;
+    table.m_stride = m_positionCount + 2 * qsizetype(m_eventCount);
+    if (function < 0 || function >= m_firstRange.size())
+        return table;
+
+    const qsizetype stride = table.m_stride;
+    QList<quint64> lines;
+    for (int range = m_firstRange.at(function); range >= 0; range = m_nextRange.at(range)) {
+        decodeRange(range, [&](const quint64 *positions, const CallSite *call, const quint64 *costs) {
+            const qsizetype row = lines.size();
+            lines.resize(row + stride, 0);
+            quint64 *values = lines.data() + row;
+            std::copy(positions, positions + m_positionCount, values);
+            std::copy(costs, costs + m_eventCount, values + m_positionCount + (call ? m_eventCount : 0));
+        });
+    }
+
+    QList<qsizetype> order(lines.size() / stride);
+    std::iota(order.begin(), order.end(), 0);
+    const auto position = [&](qsizetype line) { return lines.constData() + line * stride; };
+    std::sort(order.begin(), order.end(), [&](qsizetype a, qsizetype b) {
+        return std::lexicographical_compare(position(a), position(a) + m_positionCount,
+                                            position(b), position(b) + m_positionCount);
+    });
+
+    for (const qsizetype line : std::as_const(order)) {
+        const quint64 *values = position(line);
+        const qsizetype size = table.m_values.size();
+        if (size > 0 && std::equal(values, values + m_positionCount, table.m_values.constData() + size - stride)) {
+            quint64 *row = table.m_values.data() + size - stride;
+            for (qsizetype i = m_positionCount; i < stride; ++i)
+                row[i] += values[i];
+        } else {
+            for (qsizetype i = 0; i < stride; ++i)
+                table.m_values.append(values[i]);
+        }
+    }
+    return table;
+}
+
+PositionCosts::CallLines PositionCosts::callLines(int function) const
+{
+    CallLines lines;
+    lines.m_positionCount = m_positionCount;
+    lines.m_stride = 2 + 2 * qsizetype(m_positionCount) + m_eventCount;
+    if (function < 0 || function >= m_firstRange.size())
+        return lines;
+
+    for (int range = m_firstRange.at(function); range >= 0; range = m_nextRange.at(range)) {
+        decodeRange(range, [&](const quint64 *positions, const CallSite *call, const quint64 *costs) {
+            if (!call)
+                return;
+            const qsizetype row = lines.m_values.size();
+            lines.m_values.resize(row + lines.m_stride);
+            quint64 *values = lines.m_values.data() + row;
+            values[0] = quint64(call->call);
+            values[1] = call->count;
+            std::copy(positions, positions + m_positionCount, values + 2);
+            std::copy(call->target, call->target + m_positionCount, values + 2 + m_positionCount);
+            std::copy(costs, costs + m_eventCount, values + 2 + 2 * m_positionCount);
+        });
+    }
+    return lines;
+}
+
+void PositionCosts::alignEvents(const QList<int> &column, int eventCount)
+{
+    PositionCosts aligned;
+    aligned.setLayout(m_positionCount, eventCount);
+    QVarLengthArray<quint64, 16> alignedCosts(eventCount);
+    for (int range = 0; range < m_ranges.size(); ++range) {
+        aligned.breakRange();
+        const int function = m_ranges.at(range).function;
+        decodeRange(range, [&](const quint64 *positions, const CallSite *call, const quint64 *costs) {
+            std::fill(alignedCosts.begin(), alignedCosts.end(), 0);
+            for (int e = 0; e < m_eventCount; ++e)
+                alignedCosts[column.at(e)] = costs[e];
+            aligned.addLine(function, positions, call, alignedCosts.constData());
+        });
+    }
+    aligned.breakRange();
+    *this = std::move(aligned);
+}
+
+void PositionCosts::append(const PositionCosts &other, const QList<int> &functionMap,
+                           const QList<int> &callMap, const quint64 *origin, const int *relativeRanges)
+{
+    if (other.isEmpty())
+        return;
+    Q_ASSERT(other.m_positionCount == m_positionCount && other.m_eventCount == m_eventCount);
+
+    // Only the range where a parse chunk's position turns absolute can start
+    // with a call whose target is still relative to the chunk; it is encoded
+    // again with the target resolved, the others are copied as they are
+    const auto resolvesTargets = [&](int range) {
+        for (int p = 0; origin && p < m_positionCount; ++p) {
+            if (relativeRanges[p] == range)
+                return true;
+        }
+        return false;
+    };
+
+    m_open = false;
+    m_data.reserve(m_data.size() + other.m_data.size());
+    m_calls.reserve(m_calls.size() + other.m_calls.size());
+    m_ranges.reserve(m_ranges.size() + other.m_ranges.size());
+    m_bases.reserve(m_bases.size() + other.m_bases.size());
+    QVarLengthArray<quint64, 4> bases(m_positionCount);
+    QVarLengthArray<quint64, 4> target(m_positionCount);
+    qint64 copied = 0;
+    for (int i = 0; i < other.m_ranges.size(); ++i) {
+        const Range &range = other.m_ranges.at(i);
+        const int function = functionMap.at(range.function);
+        const auto moved = [&](int p) { return origin && i < relativeRanges[p] ? origin[p] : 0; };
+        const qint64 end = i + 1 < other.m_ranges.size() ? other.m_ranges.at(i + 1).offset : other.m_data.size();
+        if (resolvesTargets(i)) {
+            appendData(other.m_data, copied, range.offset);
+            copied = end;
+            other.decodeRange(i, [&](const quint64 *positions, const CallSite *call, const quint64 *costs) {
+                for (int p = 0; p < m_positionCount; ++p)
+                    bases[p] = positions[p] + moved(p);
+                if (!call) {
+                    addLine(function, bases.constData(), nullptr, costs);
+                    return;
+                }
+                // A raw target is absolute in the relative ranges and relative
+                // to the chunk in the others
+                for (int p = 0; p < m_positionCount; ++p) {
+                    if (call->rawTargets & (1u << p))
+                        target[p] = call->target[p] + (i >= relativeRanges[p] ? origin[p] : 0);
+                    else
+                        target[p] = call->target[p] + moved(p);
+                }
+                const CallSite site{callMap.at(call->call), call->count, target.constData(), 0};
+                addLine(function, bases.constData(), &site, costs);
+            });
+            m_open = false;
+            continue;
+        }
+
+        m_ranges.append(Range{function, range.lineCount, m_data.size() + range.offset - copied, m_calls.size()});
+        const quint64 *otherBases = other.m_bases.constRowData(i);
+        for (int p = 0; p < m_positionCount; ++p)
+            bases[p] = otherBases[p] + moved(p);
+        m_bases.appendRow(bases.constData());
+        link(int(m_ranges.size() - 1));
+        const qint64 callEnd = i + 1 < other.m_ranges.size() ? other.m_ranges.at(i + 1).firstCall
+                                                             : other.m_calls.size();
+        for (qint64 call = range.firstCall; call < callEnd; ++call)
+            m_calls.append(callMap.at(other.m_calls.at(call)));
+    }
+    appendData(other.m_data, copied, other.m_data.size());
+}
+
+void PositionCosts::appendData(const Data &data, qint64 begin, qint64 end)
+{
+    while (begin < end) {
+        const int chunk = int(begin / Data::ChunkRows);
+        const qint64 start = qint64(chunk) * Data::ChunkRows;
+        const qint64 count = qMin(end, start + data.chunkRowCount(chunk)) - begin;
+        m_data.appendRows(data.chunkData(chunk) + (begin - start), count);
+        begin += count;
+    }
+}
+
+void PositionCosts::compact()
+{
+    PositionCosts compacted;
+    compacted.setLayout(m_positionCount, m_eventCount);
+    compacted.m_data.reserve(m_data.size());
+    const auto nonZero = [this](const quint64 *costs) {
+        return std::any_of(costs, costs + m_eventCount, [](quint64 cost) { return cost != 0; });
+    };
+    for (int function = 0; function < m_firstRange.size(); ++function) {
+        if (m_firstRange.at(function) < 0)
+            continue;
+        const Table costs = table(function);
+        const CallLines calls = callLines(function);
+
+        // Call lines sorted by position, call and target, so that equal ones
+        // are next to each other and come in the order of the table
+        const auto before = [&](int a, int b) {
+            const quint64 *positionsA = calls.positions(a);
+            const quint64 *positionsB = calls.positions(b);
+            if (!std::equal(positionsA, positionsA + m_positionCount, positionsB)) {
+                return std::lexicographical_compare(positionsA, positionsA + m_positionCount,
+                                                    positionsB, positionsB + m_positionCount);
+            }
+            if (calls.call(a) != calls.call(b))
+                return calls.call(a) < calls.call(b);
+            return std::lexicographical_compare(calls.target(a), calls.target(a) + m_positionCount,
+                                                calls.target(b), calls.target(b) + m_positionCount);
+        };
+        QList<int> order(calls.rowCount());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), before);
+
+        qsizetype next = 0;
+        QVarLengthArray<quint64, 16> callCosts(m_eventCount);
+        for (int row = 0; row < costs.rowCount(); ++row) {
+            const quint64 *positions = costs.positions(row);
+            if (nonZero(costs.selfCosts(row)))
+                compacted.addLine(function, positions, nullptr, costs.selfCosts(row));
+            while (next < order.size()
+                   && std::equal(positions, positions + m_positionCount, calls.positions(order.at(next)))) {
+                const int first = order.at(next);
+                CallSite site{calls.call(first), 0, calls.target(first), 0};
+                std::fill(callCosts.begin(), callCosts.end(), 0);
+                for (; next < order.size() && !before(first, order.at(next)); ++next) {
+                    const int line = order.at(next);
+                    site.count += calls.count(line);
+                    for (int e = 0; e < m_eventCount; ++e)
+                        callCosts[e] += calls.costs(line)[e];
+                }
+                if (site.count != 0 || nonZero(callCosts.constData()))
+                    compacted.addLine(function, positions, &site, callCosts.constData());
+            }
+        }
+    }
+    compacted.breakRange();
+    compacted.squeeze();
+    *this = std::move(compacted);
+}
+
+void PositionCosts::squeeze()
+{
+    m_data.squeeze();
+    m_ranges.squeeze();
+    m_bases.squeeze();
+    m_calls.squeeze();
+    m_nextRange.squeeze();
+}
+
+qint64 PositionCosts::memoryUsage() const
+{
+    return m_data.memoryUsage() + m_ranges.memoryUsage() + m_bases.memoryUsage() + m_calls.memoryUsage()
+            + m_firstRange.memoryUsage() + m_lastRange.memoryUsage() + m_nextRange.memoryUsage();
+}
+
+bool PositionCosts::assign(const Range *ranges, qsizetype rangeCount, const quint64 *bases, QByteArrayView data,
+                           const int *calls, qsizetype callCount)
+{
+    clear();
+    for (qsizetype i = 0; i < rangeCount; ++i) {
+        const qint64 end = i + 1 < rangeCount ? ranges[i + 1].offset : data.size();
+        const qint64 callEnd = i + 1 < rangeCount ? ranges[i + 1].firstCall : callCount;
+        if (ranges[i].function < 0 || ranges[i].offset < 0 || ranges[i].offset > end
+            || ranges[i].firstCall < 0 || ranges[i].firstCall > callEnd) {
+            clear();
+            return false;
+        }
+    }
+    m_data.appendRows(reinterpret_cast<const uchar *>(data.data()), data.size());
+    m_calls.appendRows(calls, callCount);
+    m_ranges.reserve(rangeCount);
+    m_bases.reserve(rangeCount);
+    for (qsizetype range = 0; range < rangeCount; ++range) {
+        m_ranges.append(ranges[range]);
+        m_bases.appendRow(bases + range * m_positionCount);
+        link(int(range));
+    }
+    return true;
+}
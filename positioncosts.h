@@ -0,0 +1,161 @@
+#ifndef POSITIONCOSTS_H
+#define POSITIONCOSTS_H
+
+#include "chunkedarray.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QVarLengthArray>
+
+// Costs by position within each function: instruction address, source line
+// or both, as the positions: header lists them. Cost lines are kept as
+// ranges of consecutive lines of one function. Within a range every line is
+// stored as varint deltas from the line before plus varint costs, so the
+// sequential addresses of a --dump-instr=yes profile take a few bytes a line
+// instead of a record of full words. A call cost line also keeps its call,
+// the count of calls made there and the position called, so a profile
+// written back has its calls where they were made.
+//
+// Ranges and encoded lines are kept in chunks that copies share, so lines
+// added to a copy cost only the chunks they go to. A range's lines may run
+// on into the next chunk of data().
+class PositionCosts
+{
+public:
+    struct Range {
+        int function;
+        quint32 lineCount;
+        qint64 offset; // Into data(); the range ends where the next one starts
+        qint64 firstCall; // Into calls(), for the first call line of the range
+    };
+
+    // The call a call cost line belongs to, how often it was made there and
+    // the positionCount() positions it went to in the callee. Targets are
+    // kept relative to the line, except where bit p of rawTargets is set: in
+    // a parse chunk target[p] is then absolute while the line's position is
+    // still relative to where the chunk starts, or the other way round,
+    // which append() resolves.
+    struct CallSite {
+        int call;
+        quint64 count;
+        const quint64 *target;
+        quint32 rawTargets;
+    };
+
+    // The costs of one function summed per distinct position, sorted by
+    // position. A row holds positionCount() positions, eventCount() self
+    // costs and eventCount() inclusive costs of the calls made there.
+    class Table
+    {
+    public:
+        int rowCount() const { return m_stride ? int(m_values.size() / m_stride) : 0; }
+        const quint64 *positions(int row) const { return m_values.constData() + qsizetype(row) * m_stride; }
+        const quint64 *selfCosts(int row) const { return positions(row) + m_positionCount; }
+        const quint64 *callCosts(int row) const { return selfCosts(row) + m_eventCount; }
+
+    private:
+        friend class PositionCosts;
+
+        int m_positionCount = 0;
+        int m_eventCount = 0;
+        qsizetype m_stride = 0;
+        QList<quint64> m_values;
+    };
+
+    // The call lines of one function, in the order they were added. A row
+    // holds the call, its count, positionCount() positions, positionCount()
+    // target positions and eventCount() costs.
+    class CallLines
+    {
+    public:
+        int rowCount() const { return m_stride ? int(m_values.size() / m_stride) : 0; }
+        int call(int row) const { return int(m_values.at(qsizetype(row) * m_stride)); }
+        quint64 count(int row) const { return m_values.at(qsizetype(row) * m_stride + 1); }
+        const quint64 *positions(int row) const { return m_values.constData() + qsizetype(row) * m_stride + 2; }
+        const quint64 *target(int row) const { return positions(row) + m_positionCount; }
+        const quint64 *costs(int row) const { return target(row) + m_positionCount; }
+
+    private:
+        friend class PositionCosts;
+
+        int m_positionCount = 0;
+        qsizetype m_stride = 0;
+        QList<quint64> m_values;
+    };
+
+    void clear();
+
+    // Costs recorded under one layout cannot be read under another: changing
+    // the number of positions drops them
+    void setLayout(int positionCount, int eventCount);
+    int positionCount() const { return m_positionCount; }
+    int eventCount() const { return m_eventCount; }
+
+    bool isEmpty() const { return m_ranges.isEmpty(); }
+    int rangeCount() const { return int(m_ranges.size()); }
+    qint64 lineCount() const;
+
+    // \a call is null for a self cost line
+    void addLine(int function, const quint64 *positions, const CallSite *call, const quint64 *costs);
+    // Makes the next line start a range of its own
+    void breakRange() { m_open = false; }
+
+    Table table(int function) const;
+    CallLines callLines(int function) const;
+
+    // Rearranges the cost columns: column[e] is where event e goes
+    void alignEvents(const QList<int> &column, int eventCount);
+
+    // Appends the ranges of \a other, which must have the same layout, with
+    // functions renumbered through \a functionMap and calls through
+    // \a callMap. If \a origin is given, the first relativeRanges[p] ranges
+    // of \a other hold position p relative to origin[p], as parse chunks
+    // that start with relative positions do; call targets given the other
+    // way round are resolved then.
+    void append(const PositionCosts &other, const QList<int> &functionMap, const QList<int> &callMap,
+                const quint64 *origin = nullptr, const int *relativeRanges = nullptr);
+
+    // Sums the lines of each function per position, and the call lines per
+    // position, call and target, into one range sorted by position, for
+    // instance after merging several runs
+    void compact();
+    // Releases the spare capacity left from growing while parsing
+    void squeeze();
+
+    qint64 memoryUsage() const;
+
+    // Raw storage, for ProfileIndex. assign() returns false, leaving the
+    // costs empty, if the ranges do not fit the data.
+    using Data = ChunkedArray<uchar, 16>;
+    const ChunkedArray<Range> &ranges() const { return m_ranges; }
+    const ChunkedArray<quint64> &bases() const { return m_bases; }
+    const Data &data() const { return m_data; }
+    const ChunkedArray<int> &calls() const { return m_calls; }
+    bool assign(const Range *ranges, qsizetype rangeCount, const quint64 *bases, QByteArrayView data,
+                const int *calls, qsizetype callCount);
+
+private:
+    template <typename Visitor>
+    bool decodeRange(int range, Visitor visit) const;
+    void startRange(int function, const quint64 *positions);
+    void appendData(const Data &data, qint64 begin, qint64 end);
+    void link(int range);
+
+    int m_positionCount = 1;
+    int m_eventCount = 0;
+
+    ChunkedArray<Range> m_ranges;
+    ChunkedArray<quint64> m_bases; // positionCount() per range
+    Data m_data;
+    ChunkedArray<int> m_calls; // Call of every call line, in the order of data()
+
+    // Ranges of each function, chained in order
+    ChunkedArray<int> m_firstRange;
+    ChunkedArray<int> m_lastRange;
+    ChunkedArray<int> m_nextRange;
+
+    bool m_open = false;
+    QVarLengthArray<quint64, 4> m_last;
+};
+
+#endif // POSITIONCOSTS_H
@@ -0,0 +1,210 @@
+#include "profilediff.h"
+#include "symboldemangler.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace Qt::StringLiterals;
+
+void ProfileDiff::clear()
+{
+    *this = ProfileDiff();
+}
+
+bool ProfileDiff::build(const FlatProfile &before, const FlatProfile &after)
+{
+    clear();
+    const CallgrindProfile *a = before.profile();
+    const CallgrindProfile *b = after.profile();
+    if (!a || !b) {
+        m_errorString = u"both documents need a parsed profile"_s;
+        return false;
+    }
+
+    // Derived events included
+    for (int e = 0; e < before.eventCount(); ++e) {
+        const qsizetype other = after.eventNames().indexOf(before.eventNames().at(e));
+        if (other < 0)
+            continue;
+        m_eventNames.append(before.eventNames().at(e));
+        m_beforeEvents.append(e);
+        m_afterEvents.append(int(other));
+    }
+    if (m_eventNames.isEmpty()) {
+        m_errorString = u"the profiles have no event in common"_s;
+        return false;
+    }
+    m_before = &before;
+    m_after = &after;
+
+    // Translate the second profile's symbol ids into the first one's: one
+    // probe of the first name table per distinct name, not per function
+    QList<int> symbolMap[CallgrindProfile::SymbolKindCount];
+    for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind) {
+        const auto symbolKind = CallgrindProfile::SymbolKind(kind);
+        const int count = b->symbolCount(symbolKind);
+        symbolMap[kind].resize(count);
+        for (int symbol = 0; symbol < count; ++symbol)
+            symbolMap[kind][symbol] = a->findSymbol(symbolKind, b->symbolName(symbolKind, symbol));
+    }
+
+    // Join on the translated (object, file, name) triples through the first
+    // profile's function hash
+    const int beforeCount = a->functionCount();
+    const int afterCount = b->functionCount();
+    m_beforeFunctions.resize(beforeCount);
+    m_afterFunctions.resize(beforeCount, -1);
+    for (int f = 0; f < beforeCount; ++f)
+        m_beforeFunctions[f] = f;
+
+    QList<int> onlyAfter;
+    for (int f = 0; f < afterCount; ++f) {
+        const CallgrindProfile::Function &function = b->function(f);
+        const int object = symbolMap[CallgrindProfile::ObjectSymbol].at(function.object);
+        const int file = symbolMap[CallgrindProfile::FileSymbol].at(function.file);
+        const int name = symbolMap[CallgrindProfile::FunctionSymbol].at(function.name);
+        const int match = object >= 0 && file >= 0 && name >= 0 ? a->findFunction(object, file, name) : -1;
+        if (match >= 0)
+            m_afterFunctions[match] = f;
+        else
+            onlyAfter.append(f);
+    }
+    m_onlyBefore = int(std::count(m_afterFunctions.cbegin(), m_afterFunctions.cend(), -1));
+    m_onlyAfter = int(onlyAfter.size());
+    m_beforeFunctions.resize(beforeCount + onlyAfter.size(), -1);
+    m_afterFunctions.append(onlyAfter);
+
+    // Deltas column by column; each pass reads two columns and writes one
+    const int rows = rowCount();
+    m_selfDeltas.resize(eventCount());
+    m_inclusiveDeltas.resize(eventCount());
+    for (int e = 0; e < eventCount(); ++e) {
+        const auto fill = [&](QList<qint64> &deltas, const QList<quint64> &beforeCosts,
+                              const QList<quint64> &afterCosts) {
+            deltas.resize(rows);
+            for (int row = 0; row < rows; ++row) {
+                const int x = m_beforeFunctions.at(row);
+                const int y = m_afterFunctions.at(row);
+                deltas[row] = qint64((y >= 0 ? afterCosts.at(y) : 0) - (x >= 0 ? beforeCosts.at(x) : 0));
+            }
+        };
+        fill(m_selfDeltas[e], before.selfCosts(m_beforeEvents.at(e)), after.selfCosts(m_afterEvents.at(e)));
+        fill(m_inclusiveDeltas[e], before.inclusiveCosts(m_beforeEvents.at(e)),
+             after.inclusiveCosts(m_afterEvents.at(e)));
+    }
+    return true;
+}
+
+quint64 ProfileDiff::selfCostBefore(int row, int event) const
+{
+    const int function = m_beforeFunctions.at(row);
+    return function >= 0 ? m_before->selfCosts(m_beforeEvents.at(event)).at(function) : 0;
+}
+
+quint64 ProfileDiff::selfCostAfter(int row, int event) const
+{
+    const int function = m_afterFunctions.at(row);
+    return function >= 0 ? m_after->selfCosts(m_afterEvents.at(event)).at(function) : 0;
+}
+
+quint64 ProfileDiff::inclusiveCostBefore(int row, int event) const
+{
+    const int function = m_beforeFunctions.at(row);
+    return function >= 0 ? m_before->inclusiveCosts(m_beforeEvents.at(event)).at(function) : 0;
+}
+
+quint64 ProfileDiff::inclusiveCostAfter(int row, int event) const
+{
+    const int function = m_afterFunctions.at(row);
+    return function >= 0 ? m_after->inclusiveCosts(m_afterEvents.at(event)).at(function) : 0;
+}
+
+double ProfileDiff::relative(qint64 delta, quint64 base)
+{
+    if (base == 0)
+        return delta == 0 ? 0.0 : std::numeric_limits<double>::infinity();
+    return double(delta) / double(base);
+}
+
+void ProfileDiff::setFunctionNames(const SymbolDemangler *before, const SymbolDemangler *after)
+{
+    m_beforeNames = before;
+    m_afterNames = after;
+}
+
+QByteArrayView ProfileDiff::symbolName(int row, CallgrindProfile::SymbolKind kind) const
+{
+    return symbolName(row, kind, true);
+}
+
+QByteArrayView ProfileDiff::symbolName(int row, CallgrindProfile::SymbolKind kind, bool demangled) const
+{
+    const int beforeFunction = m_beforeFunctions.at(row);
+    const CallgrindProfile *profile = beforeFunction >= 0 ? m_before->profile() : m_after->profile();
+    const SymbolDemangler *names = demangled ? (beforeFunction >= 0 ? m_beforeNames : m_afterNames) : nullptr;
+    const CallgrindProfile::Function &f =
+            profile->function(beforeFunction >= 0 ? beforeFunction : m_afterFunctions.at(row));
+    switch (kind) {
+    case CallgrindProfile::ObjectSymbol:
+        return profile->symbolName(kind, f.object);
+    case CallgrindProfile::FileSymbol:
+        return profile->symbolName(kind, f.file);
+    default:
+        return names ? names->name(f.name) : profile->symbolName(CallgrindProfile::FunctionSymbol, f.name);
+    }
+}
+
+template <typename Less>
+static void sortRange(int *begin, int *middle, int *end, Less less)
+{
+    if (middle == end)
+        std::sort(begin, end, less);
+    else
+        std::partial_sort(begin, middle, end, less);
+}
+
+void ProfileDiff::sortRows(int *begin, int *middle, int *end, SortKey key, int event,
+                           Qt::SortOrder order) const
+{
+    const bool ascending = order == Qt::AscendingOrder;
+
+    if (key == SortBySelfDelta || key == SortByInclusiveDelta) {
+        const qint64 *deltas = (key == SortBySelfDelta ? m_selfDeltas : m_inclusiveDeltas).at(event).constData();
+        sortRange(begin, middle, end, [deltas, ascending](int a, int b) {
+            if (deltas[a] != deltas[b])
+                return ascending ? deltas[a] < deltas[b] : deltas[a] > deltas[b];
+            return a < b;
+        });
+        return;
+    }
+
+    if (key == SortByRelativeSelfDelta || key == SortByRelativeInclusiveDelta) {
+        // Computed once per row rather than once per comparison
+        const bool self = key == SortByRelativeSelfDelta;
+        QList<double> ratios(begin == end ? 0 : *std::max_element(begin, end) + 1);
+        for (const int *row = begin; row < end; ++row) {
+            ratios[*row] = self ? relative(selfDelta(*row, event), selfCostBefore(*row, event))
+                                : relative(inclusiveDelta(*row, event), inclusiveCostBefore(*row, event));
+        }
+        const double *values = ratios.constData();
+        sortRange(begin, middle, end, [values, ascending](int a, int b) {
+            if (values[a] != values[b])
+                return ascending ? values[a] < values[b] : values[a] > values[b];
+            return a < b;
+        });
+        return;
+    }
+
+    const CallgrindProfile::SymbolKind kind = key == SortByFile ? CallgrindProfile::FileSymbol
+            : key == SortByObject ? CallgrindProfile::ObjectSymbol
+                                  : CallgrindProfile::FunctionSymbol;
+    // Names still being demangled would change under the sort
+    const bool demangled = (!m_beforeNames || m_beforeNames->isDone())
+            && (!m_afterNames || m_afterNames->isDone());
+    sortRange(begin, middle, end, [this, kind, demangled, ascending](int a, int b) {
+        const int compared = symbolName(a, kind, demangled).compare(symbolName(b, kind, demangled));
+        if (compared != 0)
+            return ascending ? compared < 0 : compared > 0;
+        return a < b;
+    });
+}
@@ -0,0 +1,95 @@
+#ifndef PROFILEDIFF_H
+#define PROFILEDIFF_H
+
+#include "flatprofile.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class SymbolDemangler;
+
+// Function-by-function comparison of two profiles. Functions are matched on
+// their (object, file, function) names with hash joins: every symbol of the
+// second profile is looked up once in the first one's name table, after which
+// functions are joined on their translated symbol ids alone. Functions found
+// in only one profile get a row as well, with zero cost on the other side.
+//
+// Events are matched by name; only events both flat profiles have, derived
+// ones included, are compared.
+// Deltas are stored one column per event, like FlatProfile.
+class ProfileDiff
+{
+public:
+    enum SortKey {
+        SortByFunction,
+        SortByFile,
+        SortByObject,
+        SortBySelfDelta,
+        SortByInclusiveDelta,
+        SortByRelativeSelfDelta,
+        SortByRelativeInclusiveDelta
+    };
+
+    // Both flat profiles must outlive the diff.
+    bool build(const FlatProfile &before, const FlatProfile &after);
+    void clear();
+    QString errorString() const { return m_errorString; }
+
+    const FlatProfile *before() const { return m_before; }
+    const FlatProfile *after() const { return m_after; }
+
+    int eventCount() const { return int(m_eventNames.size()); }
+    const QList<QByteArray> &eventNames() const { return m_eventNames; }
+
+    // Rows are every function of the first profile in its order, then the
+    // functions only the second one has. Indexes are -1 on the missing side.
+    int rowCount() const { return int(m_beforeFunctions.size()); }
+    int beforeFunction(int row) const { return m_beforeFunctions.at(row); }
+    int afterFunction(int row) const { return m_afterFunctions.at(row); }
+    int onlyBeforeCount() const { return m_onlyBefore; }
+    int onlyAfterCount() const { return m_onlyAfter; }
+
+    quint64 selfCostBefore(int row, int event) const;
+    quint64 selfCostAfter(int row, int event) const;
+    quint64 inclusiveCostBefore(int row, int event) const;
+    quint64 inclusiveCostAfter(int row, int event) const;
+    qint64 selfDelta(int row, int event) const { return m_selfDeltas.at(event).at(row); }
+    qint64 inclusiveDelta(int row, int event) const { return m_inclusiveDeltas.at(event).at(row); }
+
+    // \a delta as a fraction of \a base: infinite for costs that only appear
+    // after, 0 when both are zero.
+    static double relative(qint64 delta, quint64 base);
+
+    // Demangled function names of the two profiles, set after build() and
+    // outliving the diff; function names are read raw without them.
+    void setFunctionNames(const SymbolDemangler *before, const SymbolDemangler *after);
+
+    // Name of the row's function, object or file, from whichever side has it.
+    QByteArrayView symbolName(int row, CallgrindProfile::SymbolKind kind) const;
+
+    // As FlatProfile::sortRows(), over diff rows. Function names are sorted
+    // demangled once both sides are done demangling.
+    void sortRows(int *begin, int *middle, int *end, SortKey key, int event,
+                  Qt::SortOrder order) const;
+
+private:
+    QByteArrayView symbolName(int row, CallgrindProfile::SymbolKind kind, bool demangled) const;
+
+    const FlatProfile *m_before = nullptr;
+    const FlatProfile *m_after = nullptr;
+    const SymbolDemangler *m_beforeNames = nullptr;
+    const SymbolDemangler *m_afterNames = nullptr;
+    QList<QByteArray> m_eventNames;
+    QList<int> m_beforeEvents;
+    QList<int> m_afterEvents;
+    QList<int> m_beforeFunctions;
+    QList<int> m_afterFunctions;
+    QList<QList<qint64>> m_selfDeltas;
+    QList<QList<qint64>> m_inclusiveDeltas;
+    int m_onlyBefore = 0;
+    int m_onlyAfter = 0;
+    QString m_errorString;
+};
+
+#endif // PROFILEDIFF_H
@@ -0,0 +1,287 @@
+#include "profilediffmodel.h"
+#include "profiledocument.h"
+
+#include <QBrush>
+#include <QFutureWatcher>
+#include <QLocale>
+#include <QtConcurrent>
+
+#include <cmath>
+#include <numeric>
+
+using namespace Qt::StringLiterals;
+
+// Rows ordered before sort() returns, as in FlatProfileModel
+static const qsizetype ImmediateRows = 1000;
+
+// How often demangled names are picked up, as in FlatProfileModel
+static const int DemangleInterval = 250; // ms
+
+ProfileDiffModel::ProfileDiffModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    m_demangleTimer.setInterval(DemangleInterval);
+    connect(&m_demangleTimer, &QTimer::timeout, this, &ProfileDiffModel::updateDemangledNames);
+}
+
+void ProfileDiffModel::setDocuments(const QSharedPointer<const ProfileDocument> &before,
+                                    const QSharedPointer<const ProfileDocument> &after)
+{
+    clear();
+    m_before = before;
+    m_after = after;
+
+    const int generation = m_generation;
+    auto *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation] {
+        const Result result = watcher->result();
+        watcher->deleteLater();
+        if (generation != m_generation)
+            return;
+        if (!result.ok) {
+            emit diffFailed(result.diff->errorString());
+            return;
+        }
+        setDiff(result.diff);
+        emit diffReady();
+    });
+    watcher->setFuture(QtConcurrent::run([before, after] {
+        Result result;
+        result.diff.reset(new ProfileDiff);
+        result.ok = result.diff->build(before->flatProfile(), after->flatProfile());
+        result.diff->setFunctionNames(&before->functionNames(), &after->functionNames());
+        return result;
+    }));
+}
+
+void ProfileDiffModel::clear()
+{
+    beginResetModel();
+    ++m_generation; // Drops diffs and sorts still running
+    m_demangleTimer.stop();
+    m_diff.reset();
+    m_before.reset();
+    m_after.reset();
+    m_rows.clear();
+    endResetModel();
+}
+
+void ProfileDiffModel::setDiff(const QSharedPointer<const ProfileDiff> &diff)
+{
+    beginResetModel();
+    m_diff = diff;
+    m_rows.resize(diff->rowCount());
+    std::iota(m_rows.begin(), m_rows.end(), 0);
+    endResetModel();
+
+    if (m_sortColumn < 0 || m_sortColumn >= columnCount())
+        m_sortColumn = FirstDeltaColumn + 2; // Inclusive delta of the first event
+    sort(m_sortColumn, m_sortOrder);
+    m_demangledCount = -1;
+    updateDemangledNames();
+}
+
+bool ProfileDiffModel::isDemangled() const
+{
+    return m_before->functionNames().isDone() && m_after->functionNames().isDone();
+}
+
+void ProfileDiffModel::updateDemangledNames()
+{
+    if (!m_diff) {
+        m_demangleTimer.stop();
+        return;
+    }
+    const int demangledCount = m_before->functionNames().doneCount() + m_after->functionNames().doneCount();
+    if (demangledCount != m_demangledCount && m_demangledCount >= 0 && !m_rows.isEmpty())
+        emit dataChanged(index(0, FunctionColumn), index(int(m_rows.size()) - 1, FunctionColumn));
+    m_demangledCount = demangledCount;
+    if (!isDemangled()) {
+        if (!m_demangleTimer.isActive())
+            m_demangleTimer.start();
+        return;
+    }
+    m_demangleTimer.stop();
+    // Rows sorted on raw names are sorted again on the demangled ones
+    if (m_sortColumn == FunctionColumn && !m_sortDemangled)
+        sort(m_sortColumn, m_sortOrder);
+}
+
+int ProfileDiffModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_rows.size());
+}
+
+int ProfileDiffModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() || !m_diff ? 0 : FirstDeltaColumn + ColumnsPerEvent * m_diff->eventCount();
+}
+
+static QString signedNumber(qint64 value)
+{
+    const QString number = QLocale().toString(value);
+    return value > 0 ? u'+' + number : number;
+}
+
+QVariant ProfileDiffModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int column = index.column();
+    const int row = m_rows.at(index.row());
+    if (column < FirstDeltaColumn) {
+        if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+            return QVariant();
+        const auto kind = column == FileColumn ? CallgrindProfile::FileSymbol
+                : column == ObjectColumn ? CallgrindProfile::ObjectSymbol
+                                         : CallgrindProfile::FunctionSymbol;
+        const QString name = QString::fromUtf8(m_diff->symbolName(row, kind));
+        if (role == Qt::ToolTipRole && column == FunctionColumn) {
+            if (m_diff->beforeFunction(row) < 0)
+                return tr("%1\nOnly in %2").arg(name, m_after->fileName());
+            if (m_diff->afterFunction(row) < 0)
+                return tr("%1\nOnly in %2").arg(name, m_before->fileName());
+        }
+        return name;
+    }
+
+    const int event = (column - FirstDeltaColumn) / ColumnsPerEvent;
+    const int kind = (column - FirstDeltaColumn) % ColumnsPerEvent;
+    const bool inclusive = kind >= 2;
+    const qint64 delta = inclusive ? m_diff->inclusiveDelta(row, event) : m_diff->selfDelta(row, event);
+
+    switch (role) {
+    case Qt::TextAlignmentRole:
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    case Qt::ForegroundRole:
+        // Higher cost is a regression
+        if (delta == 0)
+            return QVariant();
+        return QBrush(delta > 0 ? Qt::darkRed : Qt::darkGreen);
+    case Qt::ToolTipRole: {
+        const quint64 before = inclusive ? m_diff->inclusiveCostBefore(row, event)
+                                         : m_diff->selfCostBefore(row, event);
+        const quint64 after = inclusive ? m_diff->inclusiveCostAfter(row, event)
+                                        : m_diff->selfCostAfter(row, event);
+        return tr("%1 → %2").arg(QLocale().toString(before), QLocale().toString(after));
+    }
+    case Qt::DisplayRole:
+        break;
+    default:
+        return QVariant();
+    }
+
+    if (kind % 2 == 0)
+        return signedNumber(delta);
+    const double relative = ProfileDiff::relative(delta, inclusive ? m_diff->inclusiveCostBefore(row, event)
+                                                                   : m_diff->selfCostBefore(row, event));
+    if (std::isinf(relative))
+        return tr("new");
+    return (relative > 0 ? u"+"_s : QString()) + QLocale().toString(relative * 100, 'f', 1) + u" %"_s;
+}
+
+QVariant ProfileDiffModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case FunctionColumn:
+        return tr("Function");
+    case FileColumn:
+        return tr("File");
+    case ObjectColumn:
+        return tr("Object");
+    default:
+        break;
+    }
+
+    const int event = (section - FirstDeltaColumn) / ColumnsPerEvent;
+    if (!m_diff || event >= m_diff->eventCount())
+        return QVariant();
+    const QString name = QString::fromUtf8(m_diff->eventNames().at(event));
+    switch ((section - FirstDeltaColumn) % ColumnsPerEvent) {
+    case 0:
+        return tr("Self Δ %1").arg(name);
+    case 1:
+        return tr("Self Δ% %1").arg(name);
+    case 2:
+        return tr("Incl. Δ %1").arg(name);
+    default:
+        return tr("Incl. Δ% %1").arg(name);
+    }
+}
+
+void ProfileDiffModel::sort(int column, Qt::SortOrder order)
+{
+    if (!m_diff || column < 0 || column >= columnCount())
+        return;
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    ProfileDiff::SortKey key = ProfileDiff::SortByFunction;
+    int event = 0;
+    if (column == FileColumn) {
+        key = ProfileDiff::SortByFile;
+    } else if (column == ObjectColumn) {
+        key = ProfileDiff::SortByObject;
+    } else if (column >= FirstDeltaColumn) {
+        static const ProfileDiff::SortKey keys[ColumnsPerEvent] = {
+            ProfileDiff::SortBySelfDelta, ProfileDiff::SortByRelativeSelfDelta,
+            ProfileDiff::SortByInclusiveDelta, ProfileDiff::SortByRelativeInclusiveDelta
+        };
+        event = (column - FirstDeltaColumn) / ColumnsPerEvent;
+        key = keys[(column - FirstDeltaColumn) % ColumnsPerEvent];
+    }
+
+    const int generation = ++m_generation;
+    m_sortDemangled = isDemangled();
+    QList<int> rows = m_rows;
+    const qsizetype immediate = qMin(ImmediateRows, rows.size());
+    m_diff->sortRows(rows.data(), rows.data() + immediate, rows.data() + rows.size(), key, event, order);
+    setRows(rows);
+    if (immediate == rows.size())
+        return;
+
+    auto *watcher = new QFutureWatcher<QList<int>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation] {
+        const QList<int> sorted = watcher->result();
+        watcher->deleteLater();
+        if (generation == m_generation)
+            setRows(sorted);
+    });
+    watcher->setFuture(QtConcurrent::run([diff = m_diff, before = m_before, after = m_after,
+                                          rows, immediate, key, event, order]() mutable {
+        int *begin = rows.data();
+        int *end = begin + rows.size();
+        diff->sortRows(begin + immediate, end, end, key, event, order);
+        return rows;
+    }));
+}
+
+void ProfileDiffModel::setRows(QList<int> rows)
+{
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    const QModelIndexList persistent = persistentIndexList();
+    QList<int> diffRows;
+    diffRows.reserve(persistent.size());
+    for (const QModelIndex &index : persistent)
+        diffRows.append(m_rows.at(index.row()));
+
+    m_rows = std::move(rows);
+
+    if (!persistent.isEmpty()) {
+        QList<int> rowOf(m_rows.size());
+        for (int row = 0; row < m_rows.size(); ++row)
+            rowOf[m_rows.at(row)] = row;
+        QModelIndexList updated;
+        updated.reserve(persistent.size());
+        for (qsizetype i = 0; i < persistent.size(); ++i)
+            updated.append(index(rowOf.at(diffRows.at(i)), persistent.at(i).column()));
+        changePersistentIndexList(persistent, updated);
+    }
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
@@ -0,0 +1,78 @@
+#ifndef PROFILEDIFFMODEL_H
+#define PROFILEDIFFMODEL_H
+
+#include "profilediff.h"
+
+#include <QAbstractTableModel>
+#include <QList>
+#include <QSharedPointer>
+#include <QTimer>
+
+class ProfileDocument;
+
+// Function-level comparison of two documents: function, file and object,
+// then per common event the self and inclusive deltas, absolute and relative
+// to the first document. The diff is built on a worker thread; sorting works
+// as in FlatProfileModel, as does showing function names demangled.
+class ProfileDiffModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        FunctionColumn,
+        FileColumn,
+        ObjectColumn,
+        FirstDeltaColumn
+    };
+
+    // Columns per event: self delta, relative self delta, inclusive delta,
+    // relative inclusive delta
+    enum { ColumnsPerEvent = 4 };
+
+    explicit ProfileDiffModel(QObject *parent = nullptr);
+
+    void setDocuments(const QSharedPointer<const ProfileDocument> &before,
+                      const QSharedPointer<const ProfileDocument> &after);
+    void clear();
+
+    QSharedPointer<const ProfileDocument> before() const { return m_before; }
+    QSharedPointer<const ProfileDocument> after() const { return m_after; }
+    const ProfileDiff *diff() const { return m_diff.get(); }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+signals:
+    void diffReady();
+    void diffFailed(const QString &errorString);
+
+private:
+    struct Result {
+        QSharedPointer<ProfileDiff> diff;
+        bool ok = false;
+    };
+
+    void setDiff(const QSharedPointer<const ProfileDiff> &diff);
+    void setRows(QList<int> rows);
+    bool isDemangled() const;
+    void updateDemangledNames();
+
+    QSharedPointer<const ProfileDocument> m_before;
+    QSharedPointer<const ProfileDocument> m_after;
+    QSharedPointer<const ProfileDiff> m_diff;
+    QList<int> m_rows;
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::DescendingOrder;
+    int m_generation = 0;
+    // Repaints the function column while names are being demangled
+    QTimer m_demangleTimer;
+    int m_demangledCount = 0;
+    bool m_sortDemangled = false;
+};
+
+#endif // PROFILEDIFFMODEL_H
@@ -0,0 +1,536 @@
+#include "profiledocument.h"
+#include "boundedqueue.h"
+#include "callgrindparser.h"
+#include "parallelcallgrindparser.h"
+#include "profileindex.h"
+#include "streamdecompressor.h"
+
+#include <QScopedPointer>
+#include <QThread>
+
+#include <cstring>
+
+using namespace Qt::StringLiterals;
+
+// Decompressed blocks in flight between the decompressing thread and the
+// parser: enough to smooth out bursts without holding much memory
+static const qint64 BlockSize = 4 << 20;
+static const qsizetype QueuedBlocks = 4;
+
+// Bytes looked at when sniffing a file; valgrind writes its marker first
+static const qint64 HeaderSniffSize = 8 << 10;
+
+// Text is hashed by block as it is read, so that a live update can check
+// all of it again and rehashes only the last, partial block
+static const qint64 HashBlockSize = 1 << 20;
+
+static QString withoutCompressionSuffix(const QString &fileName)
+{
+    for (const QLatin1StringView suffix : {".gz"_L1, ".zst"_L1}) {
+        if (fileName.endsWith(suffix, Qt::CaseInsensitive))
+            return fileName.chopped(suffix.size());
+    }
+    return fileName;
+}
+
+static void indexLines(LineIndex *lineIndex, QByteArrayView lines, qint64 offset)
+{
+    const char *begin = lines.data();
+    const char *end = begin + lines.size();
+    for (const char *p = begin; p < end;) {
+        lineIndex->addLine(offset + (p - begin));
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        p = eol ? eol + 1 : end;
+    }
+}
+
+// Brings \a hashes, of the first \a hashedSize bytes of \a data by block,
+// up to all of it
+static void hashBlocks(QList<size_t> *hashes, QByteArrayView data, qint64 hashedSize)
+{
+    qint64 offset = hashedSize - hashedSize % HashBlockSize;
+    hashes->resize(offset / HashBlockSize);
+    for (; offset < data.size(); offset += HashBlockSize) {
+        const QByteArrayView block = data.sliced(offset, qMin(HashBlockSize, data.size() - offset));
+        hashes->append(qHashBits(block.data(), size_t(block.size())));
+    }
+}
+
+// Whether \a data still starts with the \a size bytes that \a hashes were
+// taken of
+static bool matchesBlocks(QByteArrayView data, qint64 size, const QList<size_t> &hashes)
+{
+    if (data.size() < size)
+        return false;
+    for (qsizetype i = 0; i < hashes.size(); ++i) {
+        const qint64 offset = i * HashBlockSize;
+        const QByteArrayView block = data.sliced(offset, qMin(HashBlockSize, size - offset));
+        if (qHashBits(block.data(), size_t(block.size())) != hashes.at(i))
+            return false;
+    }
+    return true;
+}
+
+bool ProfileDocument::isCallgrindFileName(const QString &fileName)
+{
+    const QString name = withoutCompressionSuffix(fileName);
+    return name.endsWith(".callgrind"_L1, Qt::CaseInsensitive)
+           || name.contains("callgrind.out"_L1);
+}
+
+bool ProfileDocument::isCallgrindHeader(QByteArrayView head)
+{
+    while (!head.isEmpty()) {
+        const qsizetype eol = head.indexOf('\n');
+        QByteArrayView line = eol < 0 ? head : head.first(eol);
+        head = eol < 0 ? QByteArrayView() : head.sliced(eol + 1);
+        if (line.endsWith('\r'))
+            line.chop(1);
+        if (line.isEmpty())
+            continue;
+        if (line.startsWith('#')) {
+            if (line.startsWith("# callgrind format"))
+                return true;
+            continue;
+        }
+
+        // Anything but a "key: value" header line ends the search
+        const qsizetype colon = line.indexOf(':');
+        if (colon <= 0)
+            return false;
+        const QByteArrayView key = line.first(colon);
+        if (key == "events")
+            return true;
+        for (const char c : key) {
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+                return false;
+        }
+    }
+    return false;
+}
+
+bool ProfileDocument::isCallgrindFile(const QString &fileName)
+{
+    MappedFile file;
+    if (!file.open(fileName))
+        return false;
+    if (StreamDecompressor::detectFormat(file.data()) == StreamDecompressor::Uncompressed)
+        return isCallgrindHeader(file.data().first(qMin(file.size(), HeaderSniffSize)));
+
+    StreamDecompressor decompressor;
+    if (!decompressor.open(file.data()))
+        return false;
+    QByteArray head(HeaderSniffSize, Qt::Uninitialized);
+    const qint64 size = decompressor.read(head.data(), head.size());
+    return size > 0 && isCallgrindHeader(QByteArrayView(head.constData(), size));
+}
+
+bool ProfileDocument::isCompressedFile(const QString &fileName)
+{
+    MappedFile file;
+    return file.open(fileName) && StreamDecompressor::detectFormat(file.data()) != StreamDecompressor::Uncompressed;
+}
+
+bool ProfileDocument::open(const QString &fileName, bool parseProfile,
+                           const LoadProgressCallback &progress)
+{
+    m_timings.begin();
+    const TraceScope scope("open");
+    const bool opened = openFile(fileName, parseProfile, progress);
+    m_timings.end();
+    return opened;
+}
+
+bool ProfileDocument::openFile(const QString &fileName, bool parseProfile,
+                               const LoadProgressCallback &progress)
+{
+    TraceScope mapScope("map", &m_timings);
+    if (!m_file.open(fileName))
+        return fail(m_file.errorString());
+    mapScope.finish();
+    m_profileFile = parseProfile;
+
+    if (StreamDecompressor::detectFormat(m_file.data()) != StreamDecompressor::Uncompressed)
+        return openCompressed(parseProfile, progress);
+    m_data = m_file.data();
+
+    if (parseProfile) {
+        if (parseData(true, progress))
+            return true;
+        if (!isOpen())
+            return false;
+        // Keep showing the text, the index stopped at the bad line
+    }
+
+    // A text that can be continued is hashed alongside
+    const bool appendable = !parseProfile && (m_data.isEmpty() || m_data.endsWith('\n'));
+    if (appendable)
+        m_pool.start([this] { hashBlocks(&m_blockHashes, m_data, 0); });
+    TraceScope indexLinesScope("index lines", &m_timings);
+    const bool indexed = m_lineIndex.build(m_data, progress);
+    m_pool.waitForDone();
+    if (!indexed)
+        return fail(u"canceled"_s, true);
+    indexLinesScope.finish();
+    m_appendable = appendable;
+    return true;
+}
+
+bool ProfileDocument::openProfile(const ProfileDocument &text, const LoadProgressCallback &progress)
+{
+    m_timings.begin();
+    m_timings.add(text.m_timings);
+    const TraceScope scope("open profile");
+    const bool opened = openProfileFile(text, progress);
+    m_timings.end();
+    return opened;
+}
+
+bool ProfileDocument::openProfileFile(const ProfileDocument &text, const LoadProgressCallback &progress)
+{
+    if (text.isCompressed())
+        return openFile(text.fileName(), true, progress);
+
+    TraceScope mapScope("map", &m_timings);
+    if (!m_file.open(text.fileName()))
+        return fail(m_file.errorString());
+    mapScope.finish();
+    // Lines added since text was opened are left to a live update
+    if (m_file.data().size() < text.size())
+        return fail(u"the file was replaced"_s);
+    m_data = m_file.data().first(text.size());
+    m_profileFile = true;
+    m_lineIndex.assign(m_data, text.m_lineIndex.checkpoints(), text.m_lineIndex.lineCount());
+    if (text.canAppend())
+        m_blockHashes = text.m_blockHashes;
+
+    parseData(false, progress);
+    return isOpen();
+}
+
+// Restores the profile of data() from a matching index, or parses it, and
+// finishes it. Returns false with profileErrorString() set if it is no
+// valid profile, and closes the document if \a progress canceled the parse.
+// With \a indexLines the parse also builds the line index.
+bool ProfileDocument::parseData(bool indexLines, const LoadProgressCallback &progress)
+{
+    // A matching index from an earlier open skips parsing altogether
+    const ProfileIndex::Stamp stamp = ProfileIndex::stamp(fileName(), m_data);
+    const QString indexFileName = ProfileIndex::defaultFileName(fileName());
+    ProfileIndex index;
+    // Without indexLines the line index is built already and stays as it is
+    LineIndex indexedLines;
+    TraceScope indexScope("load index", &m_timings);
+    if (!indexFileName.isEmpty()
+        && index.load(indexFileName, stamp, m_data, &m_profile, indexLines ? &m_lineIndex : &indexedLines)) {
+        indexScope.finish();
+        m_loadedFromIndex = true;
+        finishProfile();
+        return true;
+    }
+    indexScope.finish();
+
+    ParallelCallgrindParser parser;
+    parser.setProgressCallback(progress);
+    QSharedPointer<CallgrindParser> continuation(new CallgrindParser);
+    TraceScope parseScope("parse", &m_timings);
+    const bool parsed = parser.parse(m_data, &m_profile, indexLines ? &m_lineIndex : nullptr,
+                                     continuation.get());
+    parseScope.finish();
+    if (parsed) {
+        finishProfile();
+        // A final line without its newline may still be being written
+        if (m_data.isEmpty() || m_data.endsWith('\n')) {
+            m_parser = continuation;
+            // Unless taken over from the text this was parsed from
+            if (m_blockHashes.isEmpty())
+                hashBlocks(&m_blockHashes, m_data, 0);
+            m_appendable = true;
+        }
+        // Best effort; the cache directory may be full or read-only
+        if (!indexFileName.isEmpty()) {
+            const TraceScope saveScope("save index", &m_timings);
+            index.save(indexFileName, stamp, m_profile, m_lineIndex);
+        }
+        return true;
+    }
+    if (parser.wasCanceled())
+        return fail(parser.errorString(), true);
+
+    m_profileErrorString = parser.errorString();
+    m_profile.clear();
+    return false;
+}
+
+bool ProfileDocument::openAppended(const ProfileDocument &previous, const QStringList &partFileNames,
+                                   const LoadProgressCallback &progress)
+{
+    m_timings.begin();
+    const TraceScope scope("open appended");
+    const bool opened = openAppendedFile(previous, partFileNames, progress);
+    m_timings.end();
+    return opened;
+}
+
+bool ProfileDocument::openAppendedFile(const ProfileDocument &previous, const QStringList &partFileNames,
+                                       const LoadProgressCallback &progress)
+{
+    if (!previous.canAppend())
+        return fail(u"the previous document cannot be continued"_s);
+    if (!m_file.open(previous.fileName()))
+        return fail(m_file.errorString());
+
+    // The mapping of previous sees the pages of the file as they are now,
+    // so a file rewritten in place is told by the hashes of its text as it
+    // was read: every block of the old extent must hash the same again
+    const QByteArrayView data = m_file.data();
+    const QByteArrayView old = previous.m_data;
+    TraceScope checkScope("check unchanged", &m_timings);
+    if (!matchesBlocks(data, old.size(), previous.m_blockHashes))
+        return fail(u"the file was replaced"_s);
+    checkScope.finish();
+
+    // Only complete lines; a partial last line waits for the next update
+    const qint64 end = qMax(old.size(), data.lastIndexOf('\n') + 1);
+    m_data = data.first(end);
+    const QByteArrayView appended = m_data.sliced(old.size());
+    m_profileFile = previous.m_profileFile;
+    m_profileErrorString = previous.m_profileErrorString;
+    m_lineIndex.assign(m_data, previous.m_lineIndex.checkpoints(), previous.m_lineIndex.lineCount());
+
+    if (!previous.m_parser) {
+        const TraceScope indexLinesScope("index lines", &m_timings);
+        indexLines(&m_lineIndex, appended, old.size());
+        m_blockHashes = previous.m_blockHashes;
+        hashBlocks(&m_blockHashes, m_data, old.size());
+        m_appendable = true;
+        return true;
+    }
+
+    TraceScope copyScope("copy profile", &m_timings);
+    m_profile = previous.m_profile;
+    copyScope.finish();
+    QSharedPointer<CallgrindParser> parser(new CallgrindParser(*previous.m_parser));
+    parser->setProgressCallback(progress);
+    parser->resume(&m_profile, &m_lineIndex, old.size());
+    TraceScope parseScope("parse", &m_timings);
+    if (!parser->feed(appended))
+        return fail(parser->errorString(), parser->wasCanceled());
+    parseScope.finish();
+    parser->setProgressCallback({});
+
+    m_partFileNames = previous.m_partFileNames;
+    for (const QString &partFileName : partFileNames) {
+        const TraceScope partScope("parse parts", &m_timings);
+        CallgrindParser partParser;
+        if (!partParser.parseFile(partFileName, &m_profile))
+            return fail(u"%1: %2"_s.arg(partFileName, partParser.errorString()));
+        m_partFileNames.append(partFileName);
+    }
+
+    m_parser = parser;
+    m_blockHashes = previous.m_blockHashes;
+    hashBlocks(&m_blockHashes, m_data, old.size());
+    m_appendable = true;
+    finishProfile(&previous);
+    return true;
+}
+
+// Decompression runs on its own thread and hands blocks to this one through
+// a bounded queue, so parsing overlaps with it and never waits for the whole
+// file. Progress is reported in compressed bytes, which is what the caller
+// knows the total of.
+bool ProfileDocument::openCompressed(bool parseProfile, const LoadProgressCallback &progress)
+{
+    StreamDecompressor decompressor;
+    if (!decompressor.open(m_file.data()))
+        return fail(decompressor.errorString());
+    m_file.adviseSequential();
+    m_compressed = true;
+    // Text that is only parsed is dropped as it is consumed
+    const bool keepText = m_keepsText || !parseProfile;
+    if (keepText)
+        m_contents.reserve(decompressor.sizeHint());
+
+    struct Block {
+        QByteArray data;
+        qint64 inputPosition = 0;
+    };
+    BoundedQueue<Block> queue(QueuedBlocks);
+    QString decompressionError;
+    // Timed apart from m_timings, which belongs to this thread
+    PhaseTimings decompressionTimings;
+    QScopedPointer<QThread> producer(QThread::create([&] {
+        for (;;) {
+            Block block;
+            block.data.resize(BlockSize);
+            TraceScope blockScope("decompress", &decompressionTimings);
+            const qint64 size = decompressor.read(block.data.data(), BlockSize);
+            blockScope.finish();
+            if (size < 0)
+                decompressionError = decompressor.errorString();
+            if (size <= 0)
+                break;
+            block.data.resize(size);
+            block.inputPosition = decompressor.inputPosition();
+            if (!queue.push(std::move(block)))
+                break; // Canceled
+        }
+        queue.close();
+    }));
+    producer->setObjectName(u"decompressor"_s);
+    producer->start();
+
+    CallgrindParser parser;
+    bool parsing = parseProfile;
+    m_lineIndex.beginBuild(QByteArrayView());
+    if (parsing)
+        parser.begin(&m_profile, keepText ? &m_lineIndex : nullptr);
+
+    // Complete lines go to the parser, or just the line index, as they
+    // arrive. m_contents starts at contentsStart of the decompressed text.
+    qint64 contentsStart = 0;
+    qint64 consumed = 0;
+    const auto consume = [&](qint64 end) {
+        const TraceScope consumeScope(parsing ? "parse" : "index lines", &m_timings);
+        const QByteArrayView lines = QByteArrayView(m_contents).sliced(consumed - contentsStart, end - consumed);
+        if (parsing && !parser.feed(lines)) {
+            // Keep showing the text; it is indexed again once complete
+            m_profileErrorString = parser.errorString();
+            m_profile.clear();
+            parsing = false;
+        } else if (!parseProfile) {
+            indexLines(&m_lineIndex, lines, consumed);
+        }
+        consumed = end;
+        if (!keepText) {
+            m_contents.remove(0, consumed - contentsStart);
+            contentsStart = consumed;
+        }
+    };
+
+    Block block;
+    bool canceled = false;
+    for (;;) {
+        TraceScope waitScope("wait for decompression", &m_timings);
+        if (!queue.pop(&block))
+            break;
+        waitScope.finish();
+        TraceScope copyScope("copy", &m_timings);
+        m_contents.append(block.data);
+        copyScope.finish();
+        const qsizetype lastNewline = m_contents.lastIndexOf('\n');
+        if (lastNewline >= 0 && contentsStart + lastNewline >= consumed)
+            consume(contentsStart + lastNewline + 1);
+        if (progress && !progress(block.inputPosition, keepText ? m_lineIndex.lineCount() : parser.lineCount())) {
+            canceled = true;
+            queue.close();
+            break;
+        }
+    }
+    producer->wait();
+    m_timings.add(decompressionTimings);
+
+    if (canceled)
+        return fail(u"canceled"_s, true);
+    if (!decompressionError.isEmpty())
+        return fail(decompressionError);
+    if (consumed < contentsStart + m_contents.size())
+        consume(contentsStart + m_contents.size());
+
+    if (!keepText) {
+        m_contents.clear();
+        m_lineIndex.clear();
+        if (parsing)
+            finishProfile();
+        return true;
+    }
+    m_data = m_contents;
+    if (parsing) {
+        m_lineIndex.assign(m_data, m_lineIndex.checkpoints(), m_lineIndex.lineCount());
+        finishProfile();
+    } else if (parseProfile) {
+        const TraceScope indexLinesScope("index lines", &m_timings);
+        m_lineIndex.build(m_data);
+    } else {
+        m_lineIndex.assign(m_data, m_lineIndex.checkpoints(), m_lineIndex.lineCount());
+    }
+    return true;
+}
+
+void ProfileDocument::finishProfile(const ProfileDocument *previous)
+{
+    m_hasProfile = true;
+    m_functionNames.start(m_profile.symbols(CallgrindProfile::FunctionSymbol),
+                          previous ? &previous->m_functionNames : nullptr);
+
+    // The name index does not depend on costs, so it is built alongside the
+    // call graph; its phase is timed apart from m_timings
+    const SymbolTable &names = m_profile.symbols(CallgrindProfile::FunctionSymbol);
+    if (previous && previous->m_functionNameIndex && previous->m_functionNameIndex->covers(names.count()))
+        m_functionNameIndex = previous->m_functionNameIndex;
+    PhaseTimings nameIndexTimings;
+    if (!m_functionNameIndex) {
+        const QSharedPointer<TrigramIndex> index(new TrigramIndex);
+        m_functionNameIndex = index;
+        m_pool.start([index, &names, &nameIndexTimings] {
+            const TraceScope scope("index names", &nameIndexTimings);
+            index->build(names);
+        });
+    }
+
+    // A live update shares the graph and columns of the previous document
+    // and works on the changed functions and calls only
+    TraceScope callGraphScope("call graph", &m_timings);
+    QList<int> changedFunctions;
+    QList<int> changedCalls;
+    const bool continued = previous && previous->m_hasProfile
+            && m_profile.eventNames() == previous->m_profile.eventNames();
+    if (continued) {
+        changedFunctions = m_profile.changedFunctions(previous->m_profile);
+        changedCalls = m_profile.changedCalls(previous->m_profile);
+    }
+    const bool updated = continued
+            && m_callGraph.update(m_profile, previous->m_callGraph, changedCalls, &changedFunctions);
+    if (!continued)
+        m_callGraph.build(m_profile);
+    callGraphScope.finish();
+    TraceScope flatProfileScope("flat profile", &m_timings);
+    if (updated)
+        m_flatProfile.update(m_callGraph, previous->m_flatProfile, changedFunctions, changedCalls);
+    else
+        m_flatProfile.build(m_callGraph);
+    flatProfileScope.finish();
+
+    m_pool.waitForDone();
+    m_timings.add(nameIndexTimings);
+}
+
+const TrigramIndex &ProfileDocument::functionNameIndex() const
+{
+    static const TrigramIndex empty;
+    return m_functionNameIndex ? *m_functionNameIndex : empty;
+}
+
+bool ProfileDocument::fail(const QString &errorString, bool canceled)
+{
+    m_errorString = errorString;
+    m_canceled = canceled;
+    m_lineIndex.clear();
+    m_functionNameIndex.reset();
+    m_functionNames.clear();
+    m_flatProfile.clear();
+    m_callGraph.clear();
+    m_profile.clear();
+    m_profileFile = false;
+    m_hasProfile = false;
+    m_data = QByteArrayView();
+    m_contents.clear();
+    m_compressed = false;
+    m_parser.reset();
+    m_blockHashes.clear();
+    m_partFileNames.clear();
+    m_appendable = false;
+    m_file.close();
+    return false;
+}
@@ -0,0 +1,150 @@
+#ifndef PROFILEDOCUMENT_H
+#define PROFILEDOCUMENT_H
+
+#include "callgraph.h"
+#include "callgrindprofile.h"
+#include "flatprofile.h"
+#include "lineindex.h"
+#include "mappedfile.h"
+#include "symboldemangler.h"
+#include "tracer.h"
+#include "trigramindex.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+class CallgrindParser;
+
+// An opened profile: the file mapping, its line index and, for Callgrind
+// files, the parsed profile. Documents are immutable once opened and shared
+// between the view and background workers through QSharedPointer, which
+// keeps the mapping alive while a worker still reads from it.
+//
+// gzip and Zstandard files are decompressed into memory while they are
+// parsed; data() is then the decompressed text, unless setKeepsText(false)
+// said that no text view needs it.
+class ProfileDocument
+{
+public:
+    static bool isCallgrindFileName(const QString &fileName);
+
+    // Recognizes a profile by its first lines rather than its name: the
+    // "# callgrind format" marker or an events: line among the header lines.
+    // isCallgrindFile() decompresses the start of gzip and Zstandard files.
+    static bool isCallgrindHeader(QByteArrayView head);
+    static bool isCallgrindFile(const QString &fileName);
+    // Whether the file is gzip or Zstandard compressed
+    static bool isCompressedFile(const QString &fileName);
+
+    // Maps the file and indexes its lines in one pass. With \a parseProfile
+    // the same pass also parses it; a malformed profile still opens as text,
+    // with profileErrorString() set. \a progress may cancel the load.
+    //
+    // Parsed profiles are saved as a ProfileIndex in the cache directory and
+    // restored from there while the file is unchanged.
+    bool open(const QString &fileName, bool parseProfile = false,
+              const LoadProgressCallback &progress = {});
+
+    // Parses the profile of \a text, an uncompressed file opened without
+    // parsing, and takes over its line index, so that the text can be shown
+    // while this runs; a compressed file is opened again in full. As with
+    // open(), a malformed profile still opens as text.
+    bool openProfile(const ProfileDocument &text, const LoadProgressCallback &progress = {});
+
+    // Whether open() keeps the decompressed text of a compressed profile it
+    // parses. Without it only the partial last line is held between blocks,
+    // and data() and the line index stay empty. On by default.
+    void setKeepsText(bool keepsText) { m_keepsText = keepsText; }
+
+    // Live tail. Opens the grown file of \a previous, indexing and parsing
+    // only the complete lines appended since, into a copy of its profile
+    // that shares all it does not change; the call graph and flat profile
+    // are only computed again for the functions and calls that changed.
+    // \a partFileNames, new dump parts of the same run, are parsed into the
+    // profile as well. Fails if the file no longer starts with the text of
+    // \a previous, all of which is hashed again for this; it then has to be
+    // opened again in full.
+    bool openAppended(const ProfileDocument &previous, const QStringList &partFileNames,
+                      const LoadProgressCallback &progress = {});
+
+    // Whether openAppended() can continue from this document: it must be an
+    // uncompressed file ending at a line boundary and, if it has a profile,
+    // one whose parse state was kept.
+    bool canAppend() const { return m_appendable; }
+    QStringList partFileNames() const { return m_partFileNames; }
+
+    bool isOpen() const { return m_file.isOpen(); }
+    bool wasCanceled() const { return m_canceled; }
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_errorString; }
+    qint64 size() const { return m_data.size(); }
+    bool isCompressed() const { return m_compressed; }
+
+    QByteArrayView data() const { return m_data; }
+    const LineIndex &lineIndex() const { return m_lineIndex; }
+    qint64 lineCount() const { return m_lineIndex.lineCount(); }
+    QByteArrayView line(qint64 line) const { return m_lineIndex.line(line); }
+
+    // Whether the file was opened as a profile, even one that failed to parse
+    bool isProfileFile() const { return m_profileFile; }
+    bool hasProfile() const { return m_hasProfile; }
+    const CallgrindProfile &profile() const { return m_profile; }
+    const CallGraph &callGraph() const { return m_callGraph; }
+    const FlatProfile &flatProfile() const { return m_flatProfile; }
+    // Function names by substring, built while the profile is loaded. A live
+    // update keeps the index of the document it continues, shared, until
+    // enough names were added since to make rebuilding it worthwhile.
+    const TrigramIndex &functionNameIndex() const;
+    // Function names with C++ symbols demangled; demangling goes on after
+    // the load and names read raw until theirs is done
+    const SymbolDemangler &functionNames() const { return m_functionNames; }
+    QString profileErrorString() const { return m_profileErrorString; }
+    bool loadedFromIndex() const { return m_loadedFromIndex; }
+
+    // Where the time of open() or openAppended() went
+    const PhaseTimings &timings() const { return m_timings; }
+
+private:
+    bool openFile(const QString &fileName, bool parseProfile, const LoadProgressCallback &progress);
+    bool openAppendedFile(const ProfileDocument &previous, const QStringList &partFileNames,
+                          const LoadProgressCallback &progress);
+    bool openProfileFile(const ProfileDocument &text, const LoadProgressCallback &progress);
+    bool parseData(bool indexLines, const LoadProgressCallback &progress);
+    bool openCompressed(bool parseProfile, const LoadProgressCallback &progress);
+    void finishProfile(const ProfileDocument *previous = nullptr);
+    bool fail(const QString &errorString, bool canceled = false);
+
+    MappedFile m_file;
+    QByteArray m_contents;
+    QByteArrayView m_data;
+    LineIndex m_lineIndex;
+    CallgrindProfile m_profile;
+    CallGraph m_callGraph;
+    FlatProfile m_flatProfile;
+    QSharedPointer<const TrigramIndex> m_functionNameIndex;
+    SymbolDemangler m_functionNames;
+    QString m_errorString;
+    QString m_profileErrorString;
+    bool m_profileFile = false;
+    bool m_hasProfile = false;
+    bool m_loadedFromIndex = false;
+    bool m_compressed = false;
+    bool m_canceled = false;
+    bool m_keepsText = true;
+    PhaseTimings m_timings;
+
+    // Parser state after the last line, and hashes of data() by block as it
+    // was read, for openAppended()
+    QSharedPointer<const CallgrindParser> m_parser;
+    QList<size_t> m_blockHashes;
+    QStringList m_partFileNames;
+    bool m_appendable = false;
+
+    QThreadPool m_pool;
+};
+
+#endif // PROFILEDOCUMENT_H
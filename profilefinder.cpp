@@ -0,0 +1,116 @@
+#include "profilefinder.h"
+#include "profiledocument.h"
+#include "tracer.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+// A batch is handed over when it is this large or this old, whichever comes
+// first, so results show up promptly without flooding the event loop
+static const qsizetype BatchSize = 256;
+static const qint64 BatchInterval = 100; // ms
+
+// Total entries kept in cached listings
+static const qsizetype CacheCapacity = 1000000;
+
+ProfileFinder::ProfileFinder(QObject *parent)
+    : QObject(parent)
+    , m_cache(CacheCapacity)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+ProfileFinder::~ProfileFinder()
+{
+    cancel();
+}
+
+void ProfileFinder::find(const QString &directory, bool rescan)
+{
+    cancel();
+
+    const QString path = QDir::cleanPath(QFileInfo(directory).absoluteFilePath());
+    const int generation = m_generation;
+    m_directory = path;
+    m_entries.clear();
+    m_scanMilliseconds = -1;
+
+    if (rescan) {
+        m_cache.remove(path);
+    } else if (const QList<Entry> *cached = m_cache.object(path)) {
+        m_entries = *cached;
+        if (!m_entries.isEmpty())
+            emit entriesFound(0, m_entries.size());
+        emit finished();
+        return;
+    }
+
+    const QSharedPointer<QAtomicInt> cancelFlag(new QAtomicInt(0));
+    m_cancelFlag = cancelFlag;
+    m_finding = true;
+    m_scanTimer.start();
+
+    m_pool.start([this, path, generation, cancelFlag] {
+        const TraceScope scope("scan directory", nullptr, "find");
+        const qsizetype prefix = path.endsWith(u'/') ? path.size() : path.size() + 1;
+        QDirIterator it(path, QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        QList<Entry> batch;
+        QElapsedTimer age;
+        age.start();
+
+        const auto flush = [&](bool done) {
+            // Reading the first few KB of each file dominates; do a whole
+            // batch at once so slow disks and network mounts overlap requests
+            const TraceScope sniffScope("sniff headers", nullptr, "find");
+            QtConcurrent::blockingMap(batch, [&path](Entry &entry) {
+                entry.isProfile = ProfileDocument::isCallgrindFile(path + u'/' + entry.path);
+            });
+            QMetaObject::invokeMethod(this, [this, generation, batch, done] {
+                deliver(generation, batch, done);
+            }, Qt::QueuedConnection);
+            batch.clear();
+            age.restart();
+        };
+
+        while (it.hasNext()) {
+            if (cancelFlag->loadRelaxed() != 0)
+                return;
+            batch.append({it.next().mid(prefix)});
+            if (batch.size() >= BatchSize || age.elapsed() >= BatchInterval)
+                flush(false);
+        }
+        flush(true);
+    });
+}
+
+void ProfileFinder::cancel()
+{
+    // The worker stops at its next file; whatever it already sent is ignored
+    if (m_cancelFlag)
+        m_cancelFlag->storeRelaxed(1);
+    m_cancelFlag.reset();
+    ++m_generation;
+    m_finding = false;
+}
+
+void ProfileFinder::deliver(int generation, const QList<Entry> &batch, bool done)
+{
+    if (generation != m_generation)
+        return; // Canceled or superseded
+
+    const qsizetype first = m_entries.size();
+    m_entries.append(batch);
+    if (!batch.isEmpty())
+        emit entriesFound(first, batch.size());
+
+    if (done) {
+        m_finding = false;
+        m_scanMilliseconds = m_scanTimer.elapsed();
+        m_cancelFlag.reset();
+        m_cache.insert(m_directory, new QList<Entry>(m_entries), qMax<qsizetype>(1, m_entries.size()));
+        emit finished();
+    }
+}
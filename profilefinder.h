@@ -0,0 +1,61 @@
+#ifndef PROFILEFINDER_H
+#define PROFILEFINDER_H
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// Lists the files below a directory on a worker thread and tells Callgrind
+// profiles apart by their headers. Entries arrive in batches while the scan
+// runs. Completed listings are cached, so filtering them again or returning
+// to a directory does not touch the file system.
+class ProfileFinder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString path; // Relative to the directory, with '/' separators
+        bool isProfile = false;
+    };
+
+    explicit ProfileFinder(QObject *parent = nullptr);
+    ~ProfileFinder() override;
+
+    // Starts listing \a directory, canceling any scan still running. A cached
+    // listing is delivered before find() returns unless \a rescan is set.
+    void find(const QString &directory, bool rescan = false);
+    void cancel();
+    bool isFinding() const { return m_finding; }
+
+    QString directory() const { return m_directory; }
+    const QList<Entry> &entries() const { return m_entries; }
+
+    // How long the last finished scan took; -1 if it came from the cache
+    qint64 scanMilliseconds() const { return m_scanMilliseconds; }
+
+signals:
+    // entries() grew by \a count entries starting at \a first
+    void entriesFound(qsizetype first, qsizetype count);
+    void finished();
+
+private:
+    void deliver(int generation, const QList<Entry> &batch, bool done);
+
+    QString m_directory;
+    QList<Entry> m_entries;
+    QCache<QString, QList<Entry>> m_cache;
+    QSharedPointer<QAtomicInt> m_cancelFlag;
+    QElapsedTimer m_scanTimer;
+    qint64 m_scanMilliseconds = -1;
+    int m_generation = 0;
+    bool m_finding = false;
+
+    QThreadPool m_pool;
+};
+
+#endif // PROFILEFINDER_H
@@ -0,0 +1,416 @@
+#include "profileindex.h"
+#include "mappedfile.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cstring>
+
+using namespace Qt::StringLiterals;
+
+static const char Magic[8] = {'C', 'G', 'I', 'N', 'D', 'E', 'X', '\n'};
+static const quint32 Version = 4;
+static const quint32 ByteOrderMark = 0x01020304;
+
+static const int HashBlocks = 64;
+static const qint64 HashBlockSize = 4096;
+
+namespace {
+
+// Everything after the fixed header is a sequence of arrays, each a quint64
+// byte count followed by the bytes padded to a multiple of 8.
+class IndexWriter
+{
+public:
+    void writeBytes(const void *bytes, qint64 size)
+    {
+        const quint64 count = quint64(size);
+        m_data.append(reinterpret_cast<const char *>(&count), sizeof(count));
+        m_data.append(static_cast<const char *>(bytes), size);
+        m_data.append((8 - size % 8) % 8, '\0');
+    }
+
+    template <typename T>
+    void writeArray(const QList<T> &values)
+    {
+        writeBytes(values.constData(), values.size() * qint64(sizeof(T)));
+    }
+
+    // Chunk by chunk, as one array
+    template <typename T, int ChunkBits>
+    void writeArray(const ChunkedArray<T, ChunkBits> &values)
+    {
+        const quint64 size = quint64(values.size()) * values.width() * sizeof(T);
+        m_data.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        for (int chunk = 0; chunk < values.chunkCount(); ++chunk) {
+            m_data.append(reinterpret_cast<const char *>(values.chunkData(chunk)),
+                          values.chunkRowCount(chunk) * values.width() * qsizetype(sizeof(T)));
+        }
+        m_data.append((8 - size % 8) % 8, '\0');
+    }
+
+    // \a count rows of \a width values, as one array; \a row(i) points to
+    // the values of row i
+    template <typename Row>
+    void writeRows(qsizetype count, qsizetype width, Row row)
+    {
+        const quint64 size = quint64(count) * width * sizeof(quint64);
+        m_data.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        for (qsizetype i = 0; i < count; ++i)
+            m_data.append(reinterpret_cast<const char *>(row(i)), width * qsizetype(sizeof(quint64)));
+        m_data.append((8 - size % 8) % 8, '\0');
+    }
+
+    // A string table: the offsets of count + 1 boundaries, then the text
+    void writeStrings(const QList<QByteArray> &strings)
+    {
+        QList<quint64> offsets{0};
+        QByteArray text;
+        for (const QByteArray &string : strings) {
+            text += string;
+            offsets.append(quint64(text.size()));
+        }
+        writeArray(offsets);
+        writeBytes(text.constData(), text.size());
+    }
+
+    void writeSymbols(const SymbolTable &symbols)
+    {
+        QList<quint64> offsets{0};
+        offsets.reserve(qsizetype(symbols.count()) + 1);
+        QByteArray text;
+        text.reserve(symbols.memoryUsage().nameBytes);
+        for (int symbol = 0; symbol < symbols.count(); ++symbol) {
+            text += symbols.name(symbol);
+            offsets.append(quint64(text.size()));
+        }
+        writeArray(offsets);
+        writeBytes(text.constData(), text.size());
+    }
+
+    QByteArray &data() { return m_data; }
+
+private:
+    QByteArray m_data;
+};
+
+class IndexReader
+{
+public:
+    explicit IndexReader(QByteArrayView data) : m_p(data.data()), m_end(data.data() + data.size()) {}
+
+    bool readBytes(QByteArrayView *bytes)
+    {
+        quint64 count;
+        if (m_end - m_p < qint64(sizeof(count)))
+            return false;
+        std::memcpy(&count, m_p, sizeof(count));
+        m_p += sizeof(count);
+        const quint64 padded = count + (8 - count % 8) % 8;
+        if (padded > quint64(m_end - m_p))
+            return false;
+        *bytes = QByteArrayView(m_p, qsizetype(count));
+        m_p += padded;
+        return true;
+    }
+
+    // Arrays stay 8-byte aligned in the mapping, so they can be used in place
+    template <typename T>
+    bool readArray(const T **values, qsizetype *count)
+    {
+        QByteArrayView bytes;
+        if (!readBytes(&bytes) || bytes.size() % qsizetype(sizeof(T)) != 0)
+            return false;
+        *values = reinterpret_cast<const T *>(bytes.data());
+        *count = bytes.size() / qsizetype(sizeof(T));
+        return true;
+    }
+
+    bool readStrings(QList<QByteArray> *strings)
+    {
+        const quint64 *offsets;
+        qsizetype count;
+        QByteArrayView text;
+        if (!readArray(&offsets, &count) || count < 1 || !readBytes(&text))
+            return false;
+        strings->clear();
+        strings->reserve(count - 1);
+        for (qsizetype i = 0; i + 1 < count; ++i) {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > quint64(text.size()))
+                return false;
+            strings->append(text.sliced(qsizetype(offsets[i]), qsizetype(offsets[i + 1] - offsets[i])).toByteArray());
+        }
+        return true;
+    }
+
+    bool readSymbols(CallgrindProfile *profile, CallgrindProfile::SymbolKind kind)
+    {
+        // Interned straight from the mapped index, without a copy per name
+        const quint64 *offsets;
+        qsizetype count;
+        QByteArrayView text;
+        if (!readArray(&offsets, &count) || count < 1 || !readBytes(&text))
+            return false;
+        profile->reserveSymbols(kind, int(count - 1));
+        for (qsizetype i = 0; i + 1 < count; ++i) {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > quint64(text.size()))
+                return false;
+            profile->addSymbol(kind, text.sliced(qsizetype(offsets[i]), qsizetype(offsets[i + 1] - offsets[i])));
+        }
+        return profile->symbolCount(kind) == count - 1;
+    }
+
+private:
+    const char *m_p;
+    const char *m_end;
+};
+
+struct IndexHeader {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    qint64 size;
+    qint64 modified;
+    char hash[32];
+};
+
+} // namespace
+
+ProfileIndex::Stamp ProfileIndex::stamp(const QString &fileName, QByteArrayView data)
+{
+    Stamp stamp;
+    stamp.size = data.size();
+    stamp.modified = QFileInfo(fileName).lastModified().toMSecsSinceEpoch();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (data.size() <= HashBlocks * HashBlockSize) {
+        hash.addData(data);
+    } else {
+        // The first block starts the data and the last one ends it, where a
+        // live tail continues
+        const qint64 span = data.size() - HashBlockSize;
+        for (int i = 0; i < HashBlocks; ++i)
+            hash.addData(data.sliced(span * i / (HashBlocks - 1), HashBlockSize));
+    }
+    stamp.hash = hash.result();
+    return stamp;
+}
+
+QString ProfileIndex::defaultFileName(const QString &profileFileName)
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cacheDir.isEmpty())
+        return QString();
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(profileFileName).absoluteFilePath().toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return cacheDir + "/profile-index/"_L1 + QString::fromLatin1(key) + ".cgindex"_L1;
+}
+
+bool ProfileIndex::save(const QString &indexFileName, const Stamp &stamp,
+                        const CallgrindProfile &profile, const LineIndex &lineIndex)
+{
+    IndexHeader header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.size = stamp.size;
+    header.modified = stamp.modified;
+    std::memcpy(header.hash, stamp.hash.constData(), qMin(stamp.hash.size(), qsizetype(sizeof(header.hash))));
+
+    IndexWriter writer;
+    writer.data().append(reinterpret_cast<const char *>(&header), sizeof(header));
+    writer.writeStrings(profile.eventNames());
+    writer.writeStrings(profile.positionNames());
+    writer.writeStrings(profile.headers().keys());
+    writer.writeStrings(profile.headers().values());
+    writer.writeStrings(profile.eventDefinitions());
+    for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind)
+        writer.writeSymbols(profile.symbols(CallgrindProfile::SymbolKind(kind)));
+
+    const int eventCount = profile.eventCount();
+    QList<qint32> functions;
+    functions.reserve(qsizetype(profile.functionCount()) * 3);
+    for (int i = 0; i < profile.functionCount(); ++i) {
+        const CallgrindProfile::Function &function = profile.function(i);
+        functions << function.object << function.file << function.name;
+    }
+    writer.writeArray(functions);
+    writer.writeRows(profile.functionCount(), eventCount,
+                     [&](qsizetype i) { return profile.selfCosts(int(i)); });
+
+    QList<qint32> arcs;
+    QList<quint64> callCounts;
+    arcs.reserve(qsizetype(profile.callCount()) * 2);
+    callCounts.reserve(profile.callCount());
+    for (int i = 0; i < profile.callCount(); ++i) {
+        const CallgrindProfile::Call &call = profile.call(i);
+        arcs << call.caller << call.callee;
+        callCounts << call.count;
+    }
+    writer.writeArray(arcs);
+    writer.writeArray(callCounts);
+    writer.writeRows(profile.callCount(), eventCount,
+                     [&](qsizetype i) { return profile.callCosts(int(i)); });
+
+    const PositionCosts &positionCosts = profile.positionCosts();
+    writer.writeArray(positionCosts.ranges());
+    writer.writeArray(positionCosts.bases());
+    writer.writeArray(positionCosts.data());
+    writer.writeArray(positionCosts.calls());
+
+    const qint64 lineCount = lineIndex.lineCount();
+    writer.writeBytes(&lineCount, sizeof(lineCount));
+    writer.writeArray(lineIndex.checkpoints());
+
+    if (!QDir().mkpath(QFileInfo(indexFileName).absolutePath()))
+        return fail(u"cannot create the index directory"_s);
+    QSaveFile file(indexFileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(writer.data()) != writer.data().size()
+        || !file.commit()) {
+        return fail(file.errorString());
+    }
+    m_errorString.clear();
+    return true;
+}
+
+bool ProfileIndex::load(const QString &indexFileName, const Stamp &stamp, QByteArrayView data,
+                        CallgrindProfile *profile, LineIndex *lineIndex)
+{
+    profile->clear();
+    lineIndex->clear();
+
+    MappedFile file;
+    if (!file.open(indexFileName))
+        return fail(file.errorString());
+
+    IndexHeader header;
+    if (file.size() < qint64(sizeof(header)))
+        return fail(u"truncated index"_s);
+    std::memcpy(&header, file.data().data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+        || header.byteOrder != ByteOrderMark) {
+        return fail(u"unsupported index format"_s);
+    }
+    if (header.size != stamp.size || header.modified != stamp.modified
+        || QByteArrayView(header.hash, qMin(stamp.hash.size(), qsizetype(sizeof(header.hash)))) != stamp.hash) {
+        return fail(u"index is out of date"_s);
+    }
+
+    IndexReader reader(file.data().sliced(sizeof(header)));
+    const auto corrupt = [&] {
+        profile->clear();
+        lineIndex->clear();
+        return fail(u"corrupt index"_s);
+    };
+
+    QList<QByteArray> strings;
+    if (!reader.readStrings(&strings))
+        return corrupt();
+    profile->setEventNames(strings);
+    if (!reader.readStrings(&strings))
+        return corrupt();
+    profile->setPositionNames(strings);
+    QList<QByteArray> values;
+    if (!reader.readStrings(&strings) || !reader.readStrings(&values) || strings.size() != values.size())
+        return corrupt();
+    for (qsizetype i = 0; i < strings.size(); ++i)
+        profile->setHeader(strings.at(i), values.at(i));
+    if (!reader.readStrings(&strings))
+        return corrupt();
+    for (const QByteArray &definition : std::as_const(strings))
+        profile->addEventDefinition(definition);
+    for (int kind = 0; kind < CallgrindProfile::SymbolKindCount; ++kind) {
+        if (!reader.readSymbols(profile, CallgrindProfile::SymbolKind(kind)))
+            return corrupt();
+    }
+
+    const qsizetype eventCount = profile->eventCount();
+    const qint32 *functions;
+    const quint64 *selfCosts;
+    qsizetype functionValues, selfCostCount;
+    if (!reader.readArray(&functions, &functionValues) || functionValues % 3 != 0
+        || !reader.readArray(&selfCosts, &selfCostCount) || selfCostCount != functionValues / 3 * eventCount) {
+        return corrupt();
+    }
+    for (qsizetype i = 0; i < functionValues; i += 3) {
+        if (uint(functions[i]) >= uint(profile->symbolCount(CallgrindProfile::ObjectSymbol))
+            || uint(functions[i + 1]) >= uint(profile->symbolCount(CallgrindProfile::FileSymbol))
+            || uint(functions[i + 2]) >= uint(profile->symbolCount(CallgrindProfile::FunctionSymbol))) {
+            return corrupt();
+        }
+        const int function = profile->addFunction(functions[i], functions[i + 1], functions[i + 2]);
+        if (function != i / 3)
+            return corrupt();
+        profile->addSelfCost(function, selfCosts + i / 3 * eventCount);
+    }
+
+    const qint32 *arcs;
+    const quint64 *callCounts;
+    const quint64 *callCosts;
+    qsizetype arcValues, callCount, callCostCount;
+    if (!reader.readArray(&arcs, &arcValues) || !reader.readArray(&callCounts, &callCount)
+        || arcValues != callCount * 2 || !reader.readArray(&callCosts, &callCostCount)
+        || callCostCount != callCount * eventCount) {
+        return corrupt();
+    }
+    for (qsizetype i = 0; i < callCount; ++i) {
+        if (uint(arcs[2 * i]) >= uint(profile->functionCount())
+            || uint(arcs[2 * i + 1]) >= uint(profile->functionCount())) {
+            return corrupt();
+        }
+        const int call = profile->addCall(arcs[2 * i], arcs[2 * i + 1]);
+        if (call != i)
+            return corrupt();
+        profile->addCallCost(call, callCounts[i], callCosts + i * eventCount);
+    }
+
+    const PositionCosts::Range *ranges;
+    const quint64 *bases;
+    const qint32 *positionCalls;
+    qsizetype rangeCount, baseCount, positionCallCount;
+    QByteArrayView positionData;
+    if (!reader.readArray(&ranges, &rangeCount) || !reader.readArray(&bases, &baseCount)
+        || baseCount != rangeCount * profile->positionCosts().positionCount()
+        || !reader.readBytes(&positionData) || !reader.readArray(&positionCalls, &positionCallCount)) {
+        return corrupt();
+    }
+    for (qsizetype i = 0; i < rangeCount; ++i) {
+        if (uint(ranges[i].function) >= uint(profile->functionCount()))
+            return corrupt();
+    }
+    for (qsizetype i = 0; i < positionCallCount; ++i) {
+        if (uint(positionCalls[i]) >= uint(profile->callCount()))
+            return corrupt();
+    }
+    if (!profile->positionCosts().assign(ranges, rangeCount, bases, positionData, positionCalls,
+                                         positionCallCount)) {
+        return corrupt();
+    }
+
+    const qint64 *lineCount;
+    const qint64 *checkpoints;
+    qsizetype lineCountValues, checkpointCount;
+    if (!reader.readArray(&lineCount, &lineCountValues) || lineCountValues != 1
+        || !reader.readArray(&checkpoints, &checkpointCount)
+        || checkpointCount != (*lineCount + LineIndex::Stride - 1) / LineIndex::Stride) {
+        return corrupt();
+    }
+    for (qsizetype i = 0; i < checkpointCount; ++i) {
+        if (checkpoints[i] < 0 || checkpoints[i] >= data.size() || (i > 0 && checkpoints[i] <= checkpoints[i - 1]))
+            return corrupt();
+    }
+    lineIndex->assign(data, QList<qint64>(checkpoints, checkpoints + checkpointCount), *lineCount);
+
+    m_errorString.clear();
+    return true;
+}
+
+bool ProfileIndex::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
@@ -0,0 +1,50 @@
+#ifndef PROFILEINDEX_H
+#define PROFILEINDEX_H
+
+#include "callgrindprofile.h"
+#include "lineindex.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+// Binary sidecar for a parsed profile: the string tables, the function and
+// call cost arrays and the line index, laid out as 8-byte aligned native
+// arrays so that a later open only maps the file and copies them out.
+//
+// An index belongs to one version of one file. It is rejected unless the
+// size, modification time and a hash of sampled content all match.
+class ProfileIndex
+{
+public:
+    struct Stamp {
+        qint64 size = 0;
+        qint64 modified = 0;
+        QByteArray hash;
+    };
+
+    // Hashes 64 blocks of 4 kB spread evenly over \a data (all of it for
+    // small files), so stamping a multi-gigabyte file costs a few page reads.
+    static Stamp stamp(const QString &fileName, QByteArrayView data);
+
+    // Location in the user's cache directory, keyed by the absolute path of
+    // the profile; empty if there is no writable cache directory.
+    static QString defaultFileName(const QString &profileFileName);
+
+    bool save(const QString &indexFileName, const Stamp &stamp,
+              const CallgrindProfile &profile, const LineIndex &lineIndex);
+
+    // \a data is the profile's contents, which the restored line index points
+    // into. On failure \a profile and \a lineIndex are left cleared.
+    bool load(const QString &indexFileName, const Stamp &stamp, QByteArrayView data,
+              CallgrindProfile *profile, LineIndex *lineIndex);
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    bool fail(const QString &message);
+
+    QString m_errorString;
+};
+
+#endif // PROFILEINDEX_H
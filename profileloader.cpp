@@ -0,0 +1,161 @@
+#include "profileloader.h"
+#include "callgrindwriter.h"
+#include "profiledocument.h"
+#include "profilemerger.h"
+#include "tracer.h"
+
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+namespace {
+
+struct LoadResult {
+    QSharedPointer<ProfileDocument> document;
+    QString errorString;
+};
+
+} // namespace
+
+ProfileLoader::ProfileLoader(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+ProfileLoader::~ProfileLoader()
+{
+    cancel();
+}
+
+void ProfileLoader::load(const QString &fileName)
+{
+    const bool keepsText = m_keepsText;
+    start(fileName, QFileInfo(fileName).size(), [fileName, keepsText](const LoadProgressCallback &progress,
+                                                                     const TextCallback &textLoaded, QString *) {
+        const bool parseProfile = ProfileDocument::isCallgrindFileName(fileName)
+                                  || ProfileDocument::isCallgrindFile(fileName);
+        return open(fileName, parseProfile, keepsText, progress, textLoaded);
+    });
+}
+
+void ProfileLoader::load(const QString &fileName, bool parseProfile)
+{
+    const bool keepsText = m_keepsText;
+    start(fileName, QFileInfo(fileName).size(), [fileName, parseProfile, keepsText](
+                                                        const LoadProgressCallback &progress,
+                                                        const TextCallback &textLoaded, QString *) {
+        return open(fileName, parseProfile, keepsText, progress, textLoaded);
+    });
+}
+
+void ProfileLoader::merge(const QStringList &fileNames, const QString &outputFileName)
+{
+    qint64 totalBytes = 0;
+    for (const QString &fileName : fileNames)
+        totalBytes += QFileInfo(fileName).size();
+
+    const bool keepsText = m_keepsText;
+    start(outputFileName, totalBytes, [fileNames, outputFileName, keepsText](const LoadProgressCallback &progress,
+                                                                             const TextCallback &textLoaded,
+                                                                             QString *errorString) {
+        CallgrindProfile profile;
+        ProfileMerger merger;
+        merger.setProgressCallback(progress);
+        TraceScope mergeScope("merge profiles", nullptr, "merge");
+        if (!merger.merge(fileNames, &profile)) {
+            *errorString = merger.errorString();
+            return QSharedPointer<ProfileDocument>();
+        }
+        mergeScope.finish();
+        TraceScope saveScope("save merged profile", nullptr, "merge");
+        CallgrindWriter writer;
+        if (!writer.save(profile, outputFileName)) {
+            *errorString = writer.errorString();
+            return QSharedPointer<ProfileDocument>();
+        }
+        profile.clear();
+        saveScope.finish();
+
+        return open(outputFileName, true, keepsText, progress, textLoaded);
+    });
+}
+
+QSharedPointer<ProfileDocument> ProfileLoader::open(const QString &fileName, bool parseProfile, bool keepsText,
+                                                    const LoadProgressCallback &progress,
+                                                    const TextCallback &textLoaded)
+{
+    QSharedPointer<ProfileDocument> document(new ProfileDocument);
+    document->setKeepsText(keepsText);
+    // A compressed profile only has its text once it is decompressed, which
+    // the parse does as it goes
+    if (!parseProfile || !keepsText || ProfileDocument::isCompressedFile(fileName)) {
+        document->open(fileName, parseProfile, progress);
+        return document;
+    }
+
+    QSharedPointer<ProfileDocument> text(new ProfileDocument);
+    if (!text->open(fileName, false, progress))
+        return text;
+    textLoaded(text);
+    document->openProfile(*text, progress);
+    return document;
+}
+
+void ProfileLoader::start(const QString &fileName, qint64 totalBytes, const Task &task)
+{
+    cancel();
+
+    const QSharedPointer<QAtomicInt> cancelFlag(new QAtomicInt(0));
+    const int generation = ++m_generation;
+    m_cancelFlag = cancelFlag;
+    m_loading = true;
+
+    const auto reportProgress = [this, generation, totalBytes, cancelFlag](qint64 bytes, qint64 lines) {
+        QMetaObject::invokeMethod(this, [this, generation, bytes, totalBytes, lines] {
+            if (generation == m_generation)
+                emit progress(bytes, totalBytes, lines);
+        }, Qt::QueuedConnection);
+        return cancelFlag->loadRelaxed() == 0;
+    };
+
+    const auto reportText = [this, generation](const QSharedPointer<const ProfileDocument> &text) {
+        QMetaObject::invokeMethod(this, [this, generation, text] {
+            if (generation == m_generation)
+                emit textLoaded(text);
+        }, Qt::QueuedConnection);
+    };
+
+    QFuture<LoadResult> future = QtConcurrent::run(&m_pool, [task, reportProgress, reportText] {
+        LoadResult result;
+        result.document = task(reportProgress, reportText, &result.errorString);
+        return result;
+    });
+
+    auto *watcher = new QFutureWatcher<LoadResult>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, fileName, cancelFlag] {
+        const LoadResult result = watcher->result();
+        watcher->deleteLater();
+        if (generation != m_generation)
+            return; // Superseded by a later load
+
+        m_loading = false;
+        const QSharedPointer<ProfileDocument> &document = result.document;
+        if (document ? document->wasCanceled() : cancelFlag->loadRelaxed() != 0)
+            emit canceled(fileName);
+        else if (!document)
+            emit failed(fileName, result.errorString);
+        else if (!document->isOpen())
+            emit failed(fileName, document->errorString());
+        else
+            emit loaded(document);
+    });
+    watcher->setFuture(future);
+}
+
+void ProfileLoader::cancel()
+{
+    // The worker notices at its next progress report and finishes early
+    if (m_cancelFlag)
+        m_cancelFlag->storeRelaxed(1);
+}
@@ -0,0 +1,74 @@
+#ifndef PROFILELOADER_H
+#define PROFILELOADER_H
+
+#include "lineindex.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <functional>
+
+class ProfileDocument;
+
+// Opens ProfileDocuments on a worker thread. Progress is reported in bytes and
+// lines, and a load can be canceled at any time; starting a new load cancels
+// the previous one. Only the most recent load ever reports back.
+//
+// An uncompressed profile is opened as text first, which only takes indexing
+// its lines, and textLoaded() hands that out while the profile is parsed
+// and analyzed; loaded() then follows with the same lines and the profile.
+class ProfileLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProfileLoader(QObject *parent = nullptr);
+    ~ProfileLoader() override;
+
+    // Parses the file if it is a profile by its name or, sniffed on the
+    // worker, by its first lines
+    void load(const QString &fileName);
+    void load(const QString &fileName, bool parseProfile);
+
+    // Sums the profiles \a fileNames with ProfileMerger, saves the result
+    // as \a outputFileName and loads that. Progress covers the inputs
+    // first, then the saved file.
+    void merge(const QStringList &fileNames, const QString &outputFileName);
+    void cancel();
+    bool isLoading() const { return m_loading; }
+
+    // For loaders whose documents are never shown as text, such as the
+    // other side of a comparison; see ProfileDocument::setKeepsText()
+    void setKeepsText(bool keepsText) { m_keepsText = keepsText; }
+
+signals:
+    void progress(qint64 bytesRead, qint64 totalBytes, qint64 lines);
+    void textLoaded(const QSharedPointer<const ProfileDocument> &document);
+    void loaded(const QSharedPointer<const ProfileDocument> &document);
+    void failed(const QString &fileName, const QString &errorString);
+    void canceled(const QString &fileName);
+
+private:
+    using TextCallback = std::function<void(const QSharedPointer<const ProfileDocument> &text)>;
+    // Runs on the pool; returns nullptr with \a errorString set if it fails
+    // before a document could be opened
+    using Task = std::function<QSharedPointer<ProfileDocument>(const LoadProgressCallback &progress,
+                                                               const TextCallback &textLoaded,
+                                                               QString *errorString)>;
+    static QSharedPointer<ProfileDocument> open(const QString &fileName, bool parseProfile, bool keepsText,
+                                                const LoadProgressCallback &progress,
+                                                const TextCallback &textLoaded);
+    void start(const QString &fileName, qint64 totalBytes, const Task &task);
+
+    QSharedPointer<QAtomicInt> m_cancelFlag;
+    int m_generation = 0;
+    bool m_loading = false;
+    bool m_keepsText = true;
+
+    QThreadPool m_pool;
+};
+
+#endif // PROFILELOADER_H
@@ -0,0 +1,201 @@
+#include "profilemerger.h"
+#include "callgrindparser.h"
+#include "mappedfile.h"
+#include "streamdecompressor.h"
+#include "tracer.h"
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+
+using namespace Qt::StringLiterals;
+
+// Decompressed text handed to the parser at a time
+static const qint64 BlockSize = 4 << 20;
+
+namespace {
+
+struct FileResult {
+    QList<QByteArray> eventNames;
+    QByteArray command;
+    QString errorString;
+    bool failed = false;
+};
+
+// Parses one file into \a profile, decompressing it on the fly. \a progress
+// is called with the input bytes read so far and may cancel.
+bool parseFile(const QString &fileName, CallgrindProfile *profile,
+               const LoadProgressCallback &progress, FileResult *result)
+{
+    const auto fail = [result](const QString &errorString) {
+        result->errorString = errorString;
+        result->failed = true;
+        return false;
+    };
+
+    MappedFile file;
+    if (!file.open(fileName))
+        return fail(file.errorString());
+    file.adviseSequential();
+
+    CallgrindParser parser;
+    const auto feedFailed = [&] {
+        return parser.wasCanceled() ? false : fail(parser.errorString());
+    };
+
+    if (StreamDecompressor::detectFormat(file.data()) == StreamDecompressor::Uncompressed) {
+        parser.setProgressCallback(progress);
+        if (!parser.parse(file.data(), profile))
+            return feedFailed();
+        return progress(file.size(), parser.lineCount());
+    }
+
+    StreamDecompressor decompressor;
+    if (!decompressor.open(file.data()))
+        return fail(decompressor.errorString());
+    parser.setProgressCallback([&](qint64, qint64 lines) {
+        return progress(decompressor.inputPosition(), lines);
+    });
+    parser.begin(profile);
+
+    // Only complete lines go to the parser; the rest waits for the next block
+    QByteArray pending;
+    for (;;) {
+        const qsizetype kept = pending.size();
+        pending.resize(kept + BlockSize);
+        const qint64 size = decompressor.read(pending.data() + kept, BlockSize);
+        if (size < 0)
+            return fail(decompressor.errorString());
+        pending.resize(kept + size);
+        if (size == 0)
+            break;
+        const qsizetype lastNewline = pending.lastIndexOf('\n');
+        if (lastNewline < 0)
+            continue;
+        if (!parser.feed(QByteArrayView(pending).first(lastNewline + 1)))
+            return feedFailed();
+        pending.remove(0, lastNewline + 1);
+    }
+    if (!pending.isEmpty() && !parser.feed(pending))
+        return feedFailed();
+    return progress(file.size(), parser.lineCount());
+}
+
+} // namespace
+
+bool ProfileMerger::merge(const QStringList &fileNames, CallgrindProfile *profile)
+{
+    profile->clear();
+    m_errorString.clear();
+    m_canceled = false;
+    m_lineCount = 0;
+    if (fileNames.isEmpty()) {
+        m_errorString = u"no profiles to merge"_s;
+        return false;
+    }
+
+    const int fileCount = int(fileNames.size());
+    const int threadCount = qBound(1, m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount(),
+                                   fileCount);
+
+    // Each thread takes a contiguous run of files, so that merging the
+    // tables in thread order adds functions in the same order a single
+    // thread would, and the result does not depend on the thread count
+    QList<FileResult> results(fileCount);
+    QList<CallgrindProfile> tables(threadCount);
+    QAtomicInteger<qint64> totalBytes = 0;
+    QAtomicInteger<qint64> totalLines = 0;
+    QAtomicInt stop = 0;
+    QAtomicInt canceled = 0;
+    QMutex progressMutex;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    for (int t = 0; t < threadCount; ++t) {
+        pool.start([&, t] {
+            const int first = int(qint64(fileCount) * t / threadCount);
+            const int last = int(qint64(fileCount) * (t + 1) / threadCount);
+            for (int i = first; i < last && stop.loadRelaxed() == 0; ++i) {
+                qint64 reportedBytes = 0;
+                qint64 reportedLines = 0;
+                const auto report = [&](qint64 bytes, qint64 lines) {
+                    const qint64 allBytes = totalBytes.fetchAndAddRelaxed(bytes - reportedBytes)
+                                            + bytes - reportedBytes;
+                    const qint64 allLines = totalLines.fetchAndAddRelaxed(lines - reportedLines)
+                                            + lines - reportedLines;
+                    reportedBytes = bytes;
+                    reportedLines = lines;
+                    if (m_progress) {
+                        QMutexLocker locker(&progressMutex);
+                        if (!m_progress(allBytes, allLines)) {
+                            canceled.storeRelaxed(1);
+                            stop.storeRelaxed(1);
+                        }
+                    }
+                    return stop.loadRelaxed() == 0;
+                };
+
+                CallgrindProfile part;
+                FileResult &result = results[i];
+                TraceScope parseScope("parse file", nullptr, "merge");
+                if (!parseFile(fileNames.at(i), &part, report, &result)) {
+                    stop.storeRelaxed(1);
+                    return;
+                }
+                parseScope.finish();
+                result.eventNames = part.eventNames();
+                result.command = part.header("cmd");
+                const TraceScope mergeScope("merge file", nullptr, "merge");
+                tables[t].merge(part);
+            }
+            // Every file added its own cost lines; sum them per position
+            const TraceScope compactScope("compact positions", nullptr, "merge");
+            tables[t].positionCosts().compact();
+        });
+    }
+    pool.waitForDone();
+
+    if (canceled.loadRelaxed()) {
+        m_canceled = true;
+        m_errorString = u"canceled"_s;
+        return false;
+    }
+    for (int i = 0; i < fileCount; ++i) {
+        if (results.at(i).failed) {
+            m_errorString = u"%1: %2"_s.arg(fileNames.at(i), results.at(i).errorString);
+            return false;
+        }
+    }
+
+    // Tree reduction: each round merges pairs of neighbouring tables in
+    // parallel, halving their number
+    for (int step = 1; step < threadCount; step *= 2) {
+        for (int t = 0; t + step < threadCount; t += 2 * step) {
+            pool.start([&, t, step] {
+                const TraceScope scope("reduce", nullptr, "merge");
+                tables[t].merge(tables.at(t + step));
+                tables[t + step].clear();
+                tables[t].positionCosts().compact();
+            });
+        }
+        pool.waitForDone();
+    }
+
+    // Tables picked up events in the order their own files listed them
+    QList<QByteArray> eventNames;
+    for (const FileResult &result : std::as_const(results)) {
+        for (const QByteArray &name : result.eventNames) {
+            if (!eventNames.contains(name))
+                eventNames.append(name);
+        }
+    }
+    tables[0].alignEvents(eventNames);
+    *profile = std::move(tables[0]);
+
+    if (!results.constFirst().command.isEmpty())
+        profile->setHeader("cmd", results.constFirst().command);
+    profile->setHeader("desc", "Merged from " + QByteArray::number(fileCount) + " profiles");
+    m_lineCount = totalLines.loadRelaxed();
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef PROFILEMERGER_H
+#define PROFILEMERGER_H
+
+#include "callgrindprofile.h"
+#include "lineindex.h"
+
+#include <QString>
+#include <QStringList>
+
+// Sums many profiles into one, typically one callgrind.out.<pid> per worker
+// process of a job. Files are parsed on a thread pool; every thread adds the
+// profiles it parsed into a table of its own, and the tables are then
+// combined pairwise, in parallel, until one is left.
+//
+// Events are matched by name, so profiles recording different events merge
+// with zero cost where one is missing; the result lists the events in the
+// order they first appear in the files. gzip and Zstandard files are
+// decompressed block by block.
+class ProfileMerger
+{
+public:
+    // 0 uses QThread::idealThreadCount(); never more threads than files.
+    void setThreadCount(int count) { m_threadCount = count; }
+
+    // Reports the input bytes and lines read so far over all files.
+    void setProgressCallback(const LoadProgressCallback &callback) { m_progress = callback; }
+
+    bool merge(const QStringList &fileNames, CallgrindProfile *profile);
+
+    QString errorString() const { return m_errorString; }
+    bool wasCanceled() const { return m_canceled; }
+    qint64 lineCount() const { return m_lineCount; }
+
+private:
+    int m_threadCount = 0;
+    LoadProgressCallback m_progress;
+    QString m_errorString;
+    qint64 m_lineCount = 0;
+    bool m_canceled = false;
+};
+
+#endif // PROFILEMERGER_H
@@ -0,0 +1,181 @@
+#include "profilewatcher.h"
+#include "profiledocument.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include <algorithm>
+
+using namespace Qt::StringLiterals;
+
+// Notifications arrive for every write; a check runs once they pause this long
+static const int CheckDelay = 300; // ms
+
+// Polled as well, for file systems that do not report changes
+static const int PollInterval = 2000; // ms
+
+// Dump parts of the run \a fileName belongs to, other than \a fileName itself
+static QStringList partFileNames(const QString &fileName, const QString &prefix)
+{
+    const QFileInfo info(fileName);
+    const QDir directory = info.dir();
+    QStringList parts;
+    const QStringList names = directory.entryList({prefix + u'*'}, QDir::Files);
+    for (const QString &name : names) {
+        const QStringView number = QStringView(name).sliced(prefix.size());
+        if (!number.isEmpty() && name != info.fileName()
+            && std::all_of(number.begin(), number.end(), [](QChar c) { return c.isDigit(); })) {
+            parts.append(directory.filePath(name));
+        }
+    }
+    return parts;
+}
+
+ProfileWatcher::ProfileWatcher(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+    m_checkTimer.setSingleShot(true);
+    m_checkTimer.setInterval(CheckDelay);
+    m_pollTimer.setInterval(PollInterval);
+
+    connect(&m_checkTimer, &QTimer::timeout, this, &ProfileWatcher::check);
+    connect(&m_pollTimer, &QTimer::timeout, this, &ProfileWatcher::check);
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &ProfileWatcher::scheduleCheck);
+    connect(&m_fileWatcher, &QFileSystemWatcher::directoryChanged, this, &ProfileWatcher::scheduleCheck);
+}
+
+ProfileWatcher::~ProfileWatcher()
+{
+    stop();
+}
+
+bool ProfileWatcher::isCompleteDump(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(qMax<qint64>(0, file.size() - 512)))
+        return false;
+    const QByteArray tail = file.read(512);
+    if (!tail.endsWith('\n'))
+        return false;
+    const QByteArrayView lastLine = QByteArrayView(tail).sliced(tail.lastIndexOf('\n', tail.size() - 2) + 1);
+    return lastLine.startsWith("totals:") || lastLine.startsWith("summary:");
+}
+
+void ProfileWatcher::watch(const QSharedPointer<const ProfileDocument> &document)
+{
+    stop();
+    m_document = document;
+
+    // callgrind.out.<pid> has parts callgrind.out.<pid>.<n>, and so do they
+    const QFileInfo info(document->fileName());
+    static const QRegularExpression partPattern(u"^(.+\\.\\d+)\\.\\d+$"_s);
+    const QRegularExpressionMatch match = partPattern.match(info.fileName());
+    m_partPrefix = (match.hasMatch() ? match.captured(1) : info.fileName()) + u'.';
+
+    // Only parts written from now on are added; the ones already there are
+    // separate dumps the user can open on their own
+    const QStringList parts = partFileNames(document->fileName(), m_partPrefix);
+    m_knownParts = QSet<QString>(parts.cbegin(), parts.cend());
+    m_fileSize = document->isCompressed() ? info.size() : document->size();
+
+    m_fileWatcher.addPath(info.absoluteFilePath());
+    m_fileWatcher.addPath(info.absolutePath());
+    m_pollTimer.start();
+
+    // Catches up with anything written while the document was loading
+    scheduleCheck();
+}
+
+void ProfileWatcher::stop()
+{
+    // A check still running reports to a generation nobody waits for
+    ++m_generation;
+    m_document.reset();
+    m_knownParts.clear();
+    m_checking = false;
+    m_checkPending = false;
+    m_checkTimer.stop();
+    m_pollTimer.stop();
+    const QStringList paths = m_fileWatcher.files() + m_fileWatcher.directories();
+    if (!paths.isEmpty())
+        m_fileWatcher.removePaths(paths);
+}
+
+void ProfileWatcher::scheduleCheck()
+{
+    m_checkTimer.start();
+}
+
+void ProfileWatcher::check()
+{
+    if (!m_document)
+        return;
+    if (m_checking) {
+        m_checkPending = true;
+        return;
+    }
+    m_checking = true;
+
+    m_pool.start([this, generation = m_generation, document = m_document, prefix = m_partPrefix,
+                  known = m_knownParts, fileSize = m_fileSize] {
+        Update update;
+        const QFileInfo info(document->fileName());
+        if (info.exists()) {
+            update.fileSize = info.size();
+            for (const QString &part : partFileNames(document->fileName(), prefix)) {
+                if (!known.contains(part) && isCompleteDump(part))
+                    update.newParts.append(part);
+            }
+
+            if (update.fileSize != fileSize || !update.newParts.isEmpty()) {
+                if (document->canAppend()) {
+                    update.document.reset(new ProfileDocument);
+                    if (!update.document->openAppended(*document, update.newParts)) {
+                        update.document.reset();
+                        update.reload = true;
+                    }
+                } else {
+                    // Parts alone cannot be added without the parse state
+                    update.reload = update.fileSize != fileSize;
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, update] {
+            finishCheck(generation, update);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ProfileWatcher::finishCheck(int generation, const Update &update)
+{
+    if (generation != m_generation)
+        return;
+    m_checking = false;
+    if (update.fileSize >= 0)
+        m_fileSize = update.fileSize;
+    for (const QString &part : update.newParts)
+        m_knownParts.insert(part);
+
+    if (update.reload) {
+        // The reloaded document is watched again once it is open
+        const QString fileName = m_document->fileName();
+        stop();
+        emit reloadNeeded(fileName);
+        return;
+    }
+
+    if (update.document
+        && (update.document->size() != m_document->size() || !update.newParts.isEmpty())) {
+        m_document = update.document;
+        emit updated(m_document);
+    }
+
+    if (m_checkPending) {
+        m_checkPending = false;
+        check();
+    }
+}
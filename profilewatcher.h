@@ -0,0 +1,67 @@
+#ifndef PROFILEWATCHER_H
+#define PROFILEWATCHER_H
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QTimer>
+
+class ProfileDocument;
+
+// Follows the file behind a document while callgrind is still writing it.
+// Appended lines, and new dump parts of the same run next to it
+// (callgrind.out.<pid>.<n>), are parsed on a worker thread into a new
+// document that continues the current one; updated() hands it over. When
+// the document cannot be continued, reloadNeeded() asks for a full open.
+class ProfileWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProfileWatcher(QObject *parent = nullptr);
+    ~ProfileWatcher() override;
+
+    // Starts following \a document, or the file it was opened from if it
+    // is replaced by a reload.
+    void watch(const QSharedPointer<const ProfileDocument> &document);
+    void stop();
+    bool isWatching() const { return !m_document.isNull(); }
+
+    // Whether \a fileName is a complete dump: callgrind ends every dump with
+    // its totals: (or older summary:) line.
+    static bool isCompleteDump(const QString &fileName);
+
+signals:
+    void updated(const QSharedPointer<const ProfileDocument> &document);
+    void reloadNeeded(const QString &fileName);
+
+private:
+    struct Update {
+        QSharedPointer<ProfileDocument> document;
+        QStringList newParts;
+        qint64 fileSize = -1;
+        bool reload = false;
+    };
+
+    void scheduleCheck();
+    void check();
+    void finishCheck(int generation, const Update &update);
+
+    QSharedPointer<const ProfileDocument> m_document;
+    QString m_partPrefix;
+    QSet<QString> m_knownParts;
+    qint64 m_fileSize = -1;
+    int m_generation = 0;
+    bool m_checking = false;
+    bool m_checkPending = false;
+
+    QFileSystemWatcher m_fileWatcher;
+    QTimer m_checkTimer;
+    QTimer m_pollTimer;
+
+    QThreadPool m_pool;
+};
+
+#endif // PROFILEWATCHER_H
@@ -0,0 +1,208 @@
+#include "streamdecompressor.h"
+
+#ifdef CALLGRIND_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CALLGRIND_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <QtEndian>
+
+#include <cstring>
+
+using namespace Qt::StringLiterals;
+
+// zlib counts in 32-bit units, so large inputs are handed over in slices
+static const qint64 MaxZlibInput = 1 << 30;
+
+struct StreamDecompressor::Stream {
+    Format format = Uncompressed;
+    bool finished = false;
+#ifdef CALLGRIND_HAVE_ZLIB
+    z_stream zlib = {};
+    bool zlibInitialized = false;
+#endif
+#ifdef CALLGRIND_HAVE_ZSTD
+    ZSTD_DStream *zstd = nullptr;
+#endif
+
+    ~Stream()
+    {
+#ifdef CALLGRIND_HAVE_ZLIB
+        if (zlibInitialized)
+            inflateEnd(&zlib);
+#endif
+#ifdef CALLGRIND_HAVE_ZSTD
+        ZSTD_freeDStream(zstd);
+#endif
+    }
+};
+
+StreamDecompressor::Format StreamDecompressor::detectFormat(QByteArrayView data)
+{
+    if (data.size() >= 2 && uchar(data[0]) == 0x1f && uchar(data[1]) == 0x8b)
+        return Gzip;
+    if (data.size() >= 4 && qFromLittleEndian<quint32>(data.data()) == 0xfd2fb528)
+        return Zstd;
+    return Uncompressed;
+}
+
+bool StreamDecompressor::isSupported(Format format)
+{
+    switch (format) {
+    case Uncompressed:
+        return true;
+    case Gzip:
+#ifdef CALLGRIND_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case Zstd:
+#ifdef CALLGRIND_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+StreamDecompressor::StreamDecompressor() = default;
+
+StreamDecompressor::~StreamDecompressor() = default;
+
+bool StreamDecompressor::open(QByteArrayView input)
+{
+    m_stream.reset(new Stream);
+    m_input = input;
+    m_inputPosition = 0;
+    m_sizeHint = 0;
+    m_errorString.clear();
+
+    const Format format = detectFormat(input);
+    m_stream->format = format;
+    switch (format) {
+    case Uncompressed:
+        m_sizeHint = input.size();
+        return true;
+    case Gzip:
+#ifdef CALLGRIND_HAVE_ZLIB
+        // 16 + MAX_WBITS: expect a gzip header and trailer
+        if (inflateInit2(&m_stream->zlib, 16 + MAX_WBITS) != Z_OK)
+            return fail(u"cannot initialize zlib"_s);
+        m_stream->zlibInitialized = true;
+        // ISIZE, the last four bytes of the (last) member
+        if (input.size() >= 18)
+            m_sizeHint = qFromLittleEndian<quint32>(input.data() + input.size() - 4);
+        return true;
+#else
+        return fail(u"gzip support is not available in this build"_s);
+#endif
+    case Zstd:
+#ifdef CALLGRIND_HAVE_ZSTD
+        m_stream->zstd = ZSTD_createDStream();
+        if (!m_stream->zstd || ZSTD_isError(ZSTD_initDStream(m_stream->zstd)))
+            return fail(u"cannot initialize zstd"_s);
+        {
+            const unsigned long long size = ZSTD_getFrameContentSize(input.data(), size_t(input.size()));
+            if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR)
+                m_sizeHint = qint64(size);
+        }
+        return true;
+#else
+        return fail(u"Zstandard support is not available in this build"_s);
+#endif
+    }
+    return fail(u"unknown compression format"_s);
+}
+
+qint64 StreamDecompressor::read(char *buffer, qint64 size)
+{
+    if (!m_stream || !m_errorString.isEmpty())
+        return -1;
+    if (m_stream->finished || size <= 0)
+        return 0;
+
+    switch (m_stream->format) {
+    case Uncompressed: {
+        const qint64 count = qMin(size, m_input.size() - m_inputPosition);
+        std::memcpy(buffer, m_input.data() + m_inputPosition, size_t(count));
+        m_inputPosition += count;
+        m_stream->finished = m_inputPosition == m_input.size();
+        return count;
+    }
+    case Gzip: {
+#ifdef CALLGRIND_HAVE_ZLIB
+        z_stream &zlib = m_stream->zlib;
+        zlib.next_out = reinterpret_cast<Bytef *>(buffer);
+        zlib.avail_out = uInt(qMin(size, MaxZlibInput));
+        while (zlib.avail_out > 0) {
+            if (zlib.avail_in == 0 && m_inputPosition < m_input.size()) {
+                const qint64 count = qMin(m_input.size() - m_inputPosition, MaxZlibInput);
+                zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m_input.data() + m_inputPosition));
+                zlib.avail_in = uInt(count);
+                m_inputPosition += count;
+            }
+            const bool inputLeft = zlib.avail_in > 0 || m_inputPosition < m_input.size();
+            const int result = inflate(&zlib, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                if (zlib.avail_in == 0 && m_inputPosition == m_input.size()) {
+                    m_stream->finished = true;
+                    break;
+                }
+                // Concatenated members, as written by pigz or by appending
+                inflateReset(&zlib);
+            } else if (result == Z_BUF_ERROR && !inputLeft) {
+                fail(u"truncated gzip stream"_s);
+                return -1;
+            } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                fail(zlib.msg ? QString::fromLatin1(zlib.msg) : u"corrupt gzip stream"_s);
+                return -1;
+            }
+        }
+        return qint64(zlib.next_out - reinterpret_cast<Bytef *>(buffer));
+#else
+        return -1;
+#endif
+    }
+    case Zstd: {
+#ifdef CALLGRIND_HAVE_ZSTD
+        ZSTD_outBuffer out = {buffer, size_t(size), 0};
+        while (out.pos < out.size) {
+            ZSTD_inBuffer in = {m_input.data(), size_t(m_input.size()), size_t(m_inputPosition)};
+            const size_t produced = out.pos;
+            const size_t result = ZSTD_decompressStream(m_stream->zstd, &out, &in);
+            if (ZSTD_isError(result)) {
+                fail(QString::fromLatin1(ZSTD_getErrorName(result)));
+                return -1;
+            }
+            const bool progressed = out.pos > produced || qint64(in.pos) > m_inputPosition;
+            m_inputPosition = qint64(in.pos);
+            if (m_inputPosition == m_input.size()) {
+                // 0 means the last frame is complete and fully flushed
+                if (result == 0) {
+                    m_stream->finished = true;
+                    break;
+                }
+                if (!progressed) {
+                    fail(u"truncated Zstandard stream"_s);
+                    return -1;
+                }
+            }
+        }
+        return qint64(out.pos);
+#else
+        return -1;
+#endif
+    }
+    }
+    return -1;
+}
+
+bool StreamDecompressor::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
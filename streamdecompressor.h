@@ -0,0 +1,56 @@
+#ifndef STREAMDECOMPRESSOR_H
+#define STREAMDECOMPRESSOR_H
+
+#include <QByteArrayView>
+#include <QScopedPointer>
+#include <QString>
+
+// Incremental gzip or Zstandard decompression of an in-memory input, normally
+// a file mapping. Support for each format depends on the libraries found at
+// build time (CALLGRIND_HAVE_ZLIB, CALLGRIND_HAVE_ZSTD).
+class StreamDecompressor
+{
+public:
+    enum Format {
+        Uncompressed,
+        Gzip,
+        Zstd
+    };
+
+    // Detects the format from the magic bytes at the start of \a data.
+    static Format detectFormat(QByteArrayView data);
+    static bool isSupported(Format format);
+
+    StreamDecompressor();
+    ~StreamDecompressor();
+
+    // \a input must stay valid until the decompressor is destroyed.
+    bool open(QByteArrayView input);
+
+    // Decompresses up to \a size bytes into \a buffer. Returns the number of
+    // bytes written, 0 at the end of the input or -1 on error.
+    qint64 read(char *buffer, qint64 size);
+
+    // Compressed bytes consumed so far.
+    qint64 inputPosition() const { return m_inputPosition; }
+
+    // Expected decompressed size if the format records it, otherwise 0. Only
+    // meant for preallocation; gzip stores the size modulo 4 GB.
+    qint64 sizeHint() const { return m_sizeHint; }
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    Q_DISABLE_COPY(StreamDecompressor)
+
+    struct Stream;
+    bool fail(const QString &message);
+
+    QScopedPointer<Stream> m_stream;
+    QByteArrayView m_input;
+    qint64 m_inputPosition = 0;
+    qint64 m_sizeHint = 0;
+    QString m_errorString;
+};
+
+#endif // STREAMDECOMPRESSOR_H
@@ -0,0 +1,226 @@
+#include "symboldemangler.h"
+#include "symboltable.h"
+#include "tracer.h"
+#include "trigramindex.h"
+
+#include <cstdlib>
+
+#ifdef CALLGRIND_HAVE_CXXABI
+#include <cxxabi.h>
+#endif
+
+// Symbols per batch: a few milliseconds of work when all are mangled
+static const int BatchSymbols = 4096;
+
+struct SymbolDemangler::Batch {
+    mutable QAtomicInt ref{1};
+    // The demangled names back to back. offsets has an entry per symbol of
+    // the batch and one for the end, or none if no name was mangled; a
+    // symbol with an empty range keeps its name.
+    QByteArray names;
+    QList<quint32> offsets;
+};
+
+namespace {
+
+// Appends demangled names to one array, reusing __cxa_demangle's output
+// buffer so that a batch does not allocate per name
+class Demangler
+{
+public:
+    ~Demangler() { std::free(m_output); }
+    bool append(QByteArrayView name, QByteArray *out);
+
+private:
+    QByteArray m_input;
+    char *m_output = nullptr;
+    size_t m_outputSize = 0;
+};
+
+// callgrind --separate-recs appends the recursion level as "'2"
+qsizetype recursionSuffix(QByteArrayView name)
+{
+    qsizetype end = name.size();
+    while (end > 0 && name.at(end - 1) >= '0' && name.at(end - 1) <= '9')
+        --end;
+    return end > 1 && end < name.size() && name.at(end - 1) == '\'' ? end - 1 : name.size();
+}
+
+bool Demangler::append(QByteArrayView name, QByteArray *out)
+{
+#ifdef CALLGRIND_HAVE_CXXABI
+    const qsizetype end = recursionSuffix(name);
+    m_input = name.first(end).toByteArray(); // Null-terminated
+    int status = 0;
+    char *output = abi::__cxa_demangle(m_input.constData(), m_output, &m_outputSize, &status);
+    if (!output)
+        return false;
+    m_output = output;
+    out->append(output);
+    out->append(name.sliced(end));
+    return true;
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(out);
+    return false;
+#endif
+}
+
+} // namespace
+
+SymbolDemangler::~SymbolDemangler()
+{
+    clear();
+}
+
+bool SymbolDemangler::isMangled(QByteArrayView name)
+{
+    return name.size() > 2 && name.at(0) == '_' && name.at(1) == 'Z';
+}
+
+QByteArray SymbolDemangler::demangle(QByteArrayView name)
+{
+    QByteArray demangled;
+    Demangler demangler;
+    if (isMangled(name))
+        demangler.append(name, &demangled);
+    return demangled;
+}
+
+void SymbolDemangler::start(const SymbolTable &symbols, const SymbolDemangler *previous)
+{
+    clear();
+    m_symbols = &symbols;
+    m_symbolCount = symbols.count();
+    const int batchCount = (m_symbolCount + BatchSymbols - 1) / BatchSymbols;
+    m_batches.resize(batchCount);
+
+    // Workers only touch their own entry, never the list
+    QAtomicPointer<const Batch> *batches = m_batches.data();
+    int reused = 0;
+    for (int b = 0; b < batchCount; ++b) {
+        const int first = b * BatchSymbols;
+        const int count = qMin(BatchSymbols, m_symbolCount - first);
+        const Batch *done = previous && b < previous->m_batches.size()
+                && qMin(BatchSymbols, previous->m_symbolCount - first) == count
+                ? previous->m_batches.at(b).loadAcquire() : nullptr;
+        if (done) {
+            done->ref.ref();
+            batches[b].storeRelaxed(done);
+            reused += count;
+        }
+    }
+    if (previous && previous->isDone())
+        m_previousNameIndex = previous->m_nameIndex;
+    m_pendingCount.storeRelaxed(m_symbolCount - reused);
+
+    if (reused == m_symbolCount) {
+        // Only the names are left to index
+        m_pool.start([this] {
+            indexNames();
+            m_doneCount.storeRelease(m_symbolCount);
+        });
+        return;
+    }
+    m_doneCount.storeRelease(reused);
+    for (int b = 0; b < batchCount; ++b) {
+        if (batches[b].loadRelaxed())
+            continue;
+        const int first = b * BatchSymbols;
+        const int count = qMin(BatchSymbols, m_symbolCount - first);
+        m_pool.start([this, batches, b, first, count] {
+            if (m_canceled.loadRelaxed() != 0)
+                return;
+            const TraceScope scope("demangle", nullptr, "names");
+            batches[b].storeRelease(demangleBatch(*m_symbols, first, count));
+            if (m_pendingCount.fetchAndAddOrdered(-count) == count)
+                indexNames();
+            m_doneCount.fetchAndAddRelease(count);
+        });
+    }
+}
+
+void SymbolDemangler::clear()
+{
+    m_canceled.storeRelaxed(1);
+    m_pool.waitForDone();
+    m_canceled.storeRelaxed(0);
+    for (const QAtomicPointer<const Batch> &batch : std::as_const(m_batches))
+        release(batch.loadRelaxed());
+    m_batches.clear();
+    m_symbols = nullptr;
+    m_symbolCount = 0;
+    m_doneCount.storeRelaxed(0);
+    m_pendingCount.storeRelaxed(0);
+    m_previousNameIndex.reset();
+    m_nameIndex.reset();
+}
+
+void SymbolDemangler::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+QSharedPointer<const TrigramIndex> SymbolDemangler::nameIndex() const
+{
+    return isDone() ? m_nameIndex : QSharedPointer<const TrigramIndex>();
+}
+
+QByteArrayView SymbolDemangler::name(int symbol) const
+{
+    const Batch *batch = m_batches.at(symbol / BatchSymbols).loadAcquire();
+    if (batch && !batch->offsets.isEmpty()) {
+        const int i = symbol % BatchSymbols;
+        const quint32 begin = batch->offsets.at(i);
+        const quint32 end = batch->offsets.at(i + 1);
+        if (end > begin)
+            return QByteArrayView(batch->names.constData() + begin, end - begin);
+    }
+    return m_symbols->name(symbol);
+}
+
+SymbolDemangler::Batch *SymbolDemangler::demangleBatch(const SymbolTable &symbols, int first, int count)
+{
+    auto *batch = new Batch;
+    Demangler demangler;
+    for (int i = 0; i < count; ++i) {
+        const QByteArrayView name = symbols.name(first + i);
+        if (!batch->offsets.isEmpty())
+            batch->offsets[i] = quint32(batch->names.size());
+        if (!isMangled(name))
+            continue;
+        if (batch->offsets.isEmpty())
+            batch->offsets.resize(count + 1); // Zeros: no name before this one
+        demangler.append(name, &batch->names);
+    }
+    if (!batch->offsets.isEmpty())
+        batch->offsets[count] = quint32(batch->names.size());
+    batch->names.squeeze();
+    return batch;
+}
+
+// Runs once every batch is published
+void SymbolDemangler::indexNames()
+{
+    if (m_canceled.loadRelaxed() != 0)
+        return;
+    bool mangled = false;
+    for (const QAtomicPointer<const Batch> &batch : std::as_const(m_batches))
+        mangled = mangled || !batch.loadAcquire()->offsets.isEmpty();
+    if (!mangled)
+        return;
+    if (m_previousNameIndex && m_previousNameIndex->covers(m_symbolCount)) {
+        m_nameIndex = m_previousNameIndex;
+        return;
+    }
+    const TraceScope scope("index demangled names", nullptr, "names");
+    const QSharedPointer<TrigramIndex> index(new TrigramIndex);
+    index->build(*this);
+    m_nameIndex = index;
+}
+
+void SymbolDemangler::release(const Batch *batch)
+{
+    if (batch && !batch->ref.deref())
+        delete batch;
+}
@@ -0,0 +1,77 @@
+#ifndef SYMBOLDEMANGLER_H
+#define SYMBOLDEMANGLER_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+class SymbolTable;
+class TrigramIndex;
+
+// Demangled names for the C++ symbols ("_Z...") of a SymbolTable, as written
+// by callgrind --demangle=no and by other tools. start() hands the table to
+// a thread pool in batches of consecutive symbols, and every batch is
+// published on its own once it is done. name() never waits: until its batch
+// is published, and for names that are not mangled, it returns the raw name.
+//
+// Batches are immutable once published and shared with the demangler of a
+// continued table, so a live tail only demangles the symbols it added. The
+// last batch also indexes the demangled names for substring lookup before
+// the demangler counts as done.
+class SymbolDemangler
+{
+public:
+    ~SymbolDemangler();
+
+    static bool isMangled(QByteArrayView name);
+    // The demangled \a name, or an empty array if it is not a mangled name.
+    // A callgrind recursion suffix such as "'2" is kept.
+    static QByteArray demangle(QByteArrayView name);
+
+    // Starts demangling \a symbols, which must not change until clear() or
+    // the destructor. Batches \a previous has done for the same symbols, a
+    // table that \a symbols continues, are taken over.
+    void start(const SymbolTable &symbols, const SymbolDemangler *previous = nullptr);
+    // Stops the batches not yet started and waits for the running ones
+    void clear();
+    void waitForDone();
+
+    // The demangled name of \a symbol if it is ready, otherwise its name
+    QByteArrayView name(int symbol) const;
+
+    int symbolCount() const { return m_symbolCount; }
+    // Symbols whose batch is published, the last one once the names are
+    // indexed; only grows until clear()
+    int doneCount() const { return m_doneCount.loadAcquire(); }
+    bool isDone() const { return doneCount() == m_symbolCount; }
+
+    // The demangled names by substring once isDone(), otherwise null. Also
+    // null if no name is mangled: the table's own index serves then. The
+    // index of \a previous is kept while it covers the continued table.
+    QSharedPointer<const TrigramIndex> nameIndex() const;
+
+private:
+    struct Batch;
+
+    static Batch *demangleBatch(const SymbolTable &symbols, int first, int count);
+    static void release(const Batch *batch);
+    void indexNames();
+
+    const SymbolTable *m_symbols = nullptr;
+    int m_symbolCount = 0;
+    QList<QAtomicPointer<const Batch>> m_batches;
+    QAtomicInt m_doneCount;
+    // Symbols whose batch is still being demangled
+    QAtomicInt m_pendingCount;
+    QAtomicInt m_canceled;
+    QSharedPointer<const TrigramIndex> m_previousNameIndex;
+    QSharedPointer<const TrigramIndex> m_nameIndex;
+
+    QThreadPool m_pool;
+};
+
+#endif // SYMBOLDEMANGLER_H
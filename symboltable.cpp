@@ -0,0 +1,111 @@
+#include "symboltable.h"
+
+#include <QHashFunctions>
+
+// Arena blocks start small, since the parallel parser keeps a table per
+// chunk, and double up to MaxBlockSize. Longer names get a block of their own.
+static const qsizetype MinBlockSize = 4 << 10;
+static const qsizetype MaxBlockSize = 1 << 20;
+
+void SymbolTable::clear()
+{
+    m_blocks.clear();
+    m_entries.clear();
+    m_slots.clear();
+}
+
+void SymbolTable::reserve(int count)
+{
+    m_entries.reserve(count);
+    qsizetype slotCount = 16;
+    while (slotCount < qsizetype(count) * 2)
+        slotCount *= 2;
+    if (slotCount > m_slots.size())
+        rehash(slotCount);
+}
+
+quint32 SymbolTable::hash(QByteArrayView name)
+{
+    return quint32(qHash(name));
+}
+
+int SymbolTable::findSlot(QByteArrayView name, quint32 hash) const
+{
+    // Linear probing; the table is at most half full, so runs stay short
+    const qsizetype mask = m_slots.size() - 1;
+    for (qsizetype slot = hash & mask;; slot = (slot + 1) & mask) {
+        const int symbol = m_slots.at(slot);
+        if (symbol < 0)
+            return int(slot);
+        const Entry &entry = m_entries.at(symbol);
+        if (entry.hash == hash && entry.length == quint32(name.size())
+            && this->name(symbol) == name) {
+            return int(slot);
+        }
+    }
+}
+
+int SymbolTable::find(QByteArrayView name) const
+{
+    if (m_slots.isEmpty())
+        return -1;
+    return m_slots.at(findSlot(name, hash(name)));
+}
+
+int SymbolTable::insert(QByteArrayView name)
+{
+    if (m_slots.isEmpty())
+        rehash(16);
+    const quint32 nameHash = hash(name);
+    int slot = findSlot(name, nameHash);
+    if (m_slots.at(slot) >= 0)
+        return m_slots.at(slot);
+
+    if (qsizetype(m_entries.size() + 1) * 2 > m_slots.size()) {
+        rehash(m_slots.size() * 2);
+        slot = findSlot(name, nameHash);
+    }
+
+    // A block a copy still holds is left alone rather than detached, which
+    // would move the names that copy has handed out
+    if (m_blocks.isEmpty() || m_blocks.constLast()->ref.loadRelaxed() != 1
+        || m_blocks.constLast()->bytes.capacity() - m_blocks.constLast()->bytes.size() < name.size()) {
+        const qsizetype size = qMin(MinBlockSize << qMin(m_blocks.size(), qsizetype(8)), MaxBlockSize);
+        QExplicitlySharedDataPointer<Block> block(new Block);
+        block->bytes.reserve(qMax(size, name.size()));
+        m_blocks.append(block);
+    }
+    QByteArray &block = m_blocks.last()->bytes;
+    const Entry entry{quint32(m_blocks.size() - 1), quint32(block.size()), quint32(name.size()),
+                      nameHash};
+    block.append(name);
+
+    const int symbol = int(m_entries.size());
+    m_entries.append(entry);
+    m_slots[slot] = symbol;
+    return symbol;
+}
+
+void SymbolTable::rehash(qsizetype slotCount)
+{
+    m_slots.fill(-1, slotCount);
+    const qsizetype mask = slotCount - 1;
+    for (qsizetype symbol = 0; symbol < m_entries.size(); ++symbol) {
+        qsizetype slot = m_entries.at(symbol).hash & mask;
+        while (m_slots.at(slot) >= 0)
+            slot = (slot + 1) & mask;
+        m_slots[slot] = int(symbol);
+    }
+}
+
+SymbolTable::MemoryUsage SymbolTable::memoryUsage() const
+{
+    MemoryUsage usage;
+    for (const QExplicitlySharedDataPointer<Block> &block : m_blocks) {
+        usage.nameBytes += block->bytes.size();
+        usage.arenaBytes += block->bytes.capacity();
+    }
+    usage.entryBytes = m_entries.memoryUsage();
+    usage.indexBytes = m_slots.memoryUsage();
+    return usage;
+}
@@ -0,0 +1,77 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include "chunkedarray.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QExplicitlySharedDataPointer>
+#include <QList>
+#include <QSharedData>
+
+// Interned names of one kind, such as the function names of a profile, each
+// referred to by a dense handle in insertion order. The bytes are appended to
+// a few large arena blocks rather than allocated one string at a time, and
+// the lookup table is an open-addressing array of handles, so a name costs
+// its length plus about 24 bytes.
+//
+// Copies share the blocks, and the entries and slots chunk by chunk, so a
+// copy that adds a few names costs the chunks those touch. A block is only
+// ever written to by a table that holds it alone and never moves, so the
+// view name() returns stays valid for as long as the table it came from,
+// whatever copies of it do meanwhile; clear() and assigning to the table
+// end it.
+class SymbolTable
+{
+public:
+    struct MemoryUsage {
+        qint64 nameBytes = 0;   // Sum of the name lengths
+        qint64 arenaBytes = 0;  // Allocated arena blocks
+        qint64 entryBytes = 0;  // Per-symbol offsets and hashes
+        qint64 indexBytes = 0;  // Hash table slots
+
+        qint64 total() const { return arenaBytes + entryBytes + indexBytes; }
+    };
+
+    void clear();
+    void reserve(int count);
+
+    int count() const { return int(m_entries.size()); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+    QByteArrayView name(int symbol) const
+    {
+        const Entry &entry = m_entries.at(symbol);
+        return QByteArrayView(m_blocks.at(entry.block)->bytes.constData() + entry.offset, entry.length);
+    }
+
+    // The handle of \a name, or -1 if it has not been added
+    int find(QByteArrayView name) const;
+    // The handle of \a name, adding it if needed
+    int insert(QByteArrayView name);
+
+    MemoryUsage memoryUsage() const;
+
+private:
+    // Reserved up front and never grown past that, so its bytes stay put
+    struct Block : QSharedData {
+        QByteArray bytes;
+    };
+
+    struct Entry {
+        quint32 block;
+        quint32 offset;
+        quint32 length;
+        quint32 hash;
+    };
+
+    static quint32 hash(QByteArrayView name);
+    int findSlot(QByteArrayView name, quint32 hash) const;
+    void rehash(qsizetype slotCount);
+
+    QList<QExplicitlySharedDataPointer<Block>> m_blocks;
+    ChunkedArray<Entry> m_entries;
+    ChunkedArray<int> m_slots;
+};
+
+#endif // SYMBOLTABLE_H
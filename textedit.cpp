@@ -1,60 +1,395 @@
 #include "textedit.h"
-#include <QFile>
-#include <QFileInfo>
+#include "profileloader.h"
+#include "profilewatcher.h"
 #include <QDebug>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTextLayout>
+#include <QtMath>
+
+#include <climits>
+
+// Lines kept highlighted, and how many pages around the viewport to prefetch
+static const int TokenCacheLines = 20000;
+static const int PrefetchPages = 4;
 
 TextEdit::TextEdit(QWidget *parent)
-    : QTextEdit(parent), m_highlighter(nullptr)
+    : QAbstractScrollArea(parent)
+    , m_loader(new ProfileLoader(this))
+    , m_watcher(new ProfileWatcher(this))
+    , m_tokenCache(TokenCacheLines)
 {
-    setReadOnly(true);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setAutoFillBackground(true);
+
+    m_highlightPool.setMaxThreadCount(1);
+    m_prefetchTimer.setSingleShot(true);
+    m_prefetchTimer.setInterval(30);
+    connect(&m_prefetchTimer, &QTimer::timeout, this, &TextEdit::prefetchHighlighting);
+
+    connect(m_loader, &ProfileLoader::progress, this, &TextEdit::loadProgress);
+    connect(m_loader, &ProfileLoader::textLoaded, this, &TextEdit::showText);
+    connect(m_loader, &ProfileLoader::loaded, this, &TextEdit::setDocument);
+    connect(m_loader, &ProfileLoader::failed, this, [this](const QString &fileName, const QString &errorString) {
+        m_showingText = false;
+        emit loadFailed(fileName, errorString);
+    });
+    connect(m_loader, &ProfileLoader::canceled, this, [this](const QString &fileName) {
+        m_showingText = false;
+        emit loadFailed(fileName, tr("Loading canceled"));
+    });
+    connect(m_watcher, &ProfileWatcher::updated, this, &TextEdit::updateDocument);
+    connect(m_watcher, &ProfileWatcher::reloadNeeded, this, &TextEdit::reload);
 }
 
 void TextEdit::setContents(const QString &fileName, bool enableHighlighting)
 {
-    // Clear existing content and highlighter
-    clear();
-    if (m_highlighter) {
-        delete m_highlighter;
-        m_highlighter = nullptr;
+    m_highlightingRequested = enableHighlighting;
+    m_reloading = false;
+    m_showingText = false;
+    m_loader->load(fileName);
+    emit loadStarted(fileName);
+}
+
+void TextEdit::setMergedContents(const QStringList &fileNames, const QString &outputFileName,
+                                 bool enableHighlighting)
+{
+    m_highlightingRequested = enableHighlighting;
+    m_reloading = false;
+    m_showingText = false;
+    m_loader->merge(fileNames, outputFileName);
+    emit loadStarted(outputFileName);
+}
+
+void TextEdit::setWatching(bool watching)
+{
+    m_watching = watching;
+    if (watching && m_document)
+        m_watcher->watch(m_document);
+    else
+        m_watcher->stop();
+}
+
+// The file changed in a way that cannot be followed line by line, such as
+// being rewritten; it is opened again without leaving the current position
+void TextEdit::reload(const QString &fileName)
+{
+    m_reloading = true;
+    m_showingText = false;
+    m_loader->load(fileName);
+    emit loadStarted(fileName);
+}
+
+bool TextEdit::isLoading() const
+{
+    return m_loader->isLoading();
+}
+
+void TextEdit::cancelLoading()
+{
+    m_loader->cancel();
+}
+
+void TextEdit::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    if (m_showingText) {
+        // The same lines as shown, now with their profile; the view stays
+        m_showingText = false;
+        m_document = document;
+        viewport()->update();
+    } else {
+        showDocument(document, document->isProfileFile());
     }
+    if (m_watching)
+        m_watcher->watch(document);
+
+    emit documentChanged();
+    emit fileNameChanged(document->fileName());
+    emit loadFinished(document->fileName());
+}
 
-    QFileInfo fi(fileName);
-    srcUrl = QUrl::fromLocalFile(fi.absoluteFilePath());
+// Only profiles are loaded in two steps, so the text is highlighted as one
+void TextEdit::showText(const QSharedPointer<const ProfileDocument> &document)
+{
+    showDocument(document, true);
+    m_showingText = true;
+    // Not watched until the profile is there: updates continue the profile
+    m_watcher->stop();
+
+    emit documentChanged();
+    emit fileNameChanged(document->fileName());
+}
 
-    if (enableHighlighting && (fileName.endsWith(".callgrind", Qt::CaseInsensitive) ||
-                               fileName.contains("callgrind.out"))) {
-        qDebug() << "Initializing Callgrind highlighter for:" << fileName;
-        m_highlighter = new CallgrindSyntaxHighlighter(document());
+void TextEdit::showDocument(const QSharedPointer<const ProfileDocument> &document, bool highlight)
+{
+    // Clear existing content and highlighter
+    resetHighlighting();
+    m_highlighter.reset();
+    if (m_highlightingRequested && highlight) {
+        qDebug() << "Initializing Callgrind highlighter for:" << document->fileName();
+        m_highlighter.reset(new CallgrindSyntaxHighlighter);
     }
 
-    QFile file(fileName);
-    if (file.open(QIODevice::ReadOnly)) {
-        QString content = QString::fromUtf8(file.readAll());
-        if (fileName.endsWith(".html")) {
-            setHtml(content);
-        } else {
-            setPlainText(content);
-        }
+    m_document = document;
+    m_maxLineWidth = 0;
+    m_matchLine = -1;
+    m_firstPaintPending = true;
+    m_firstPaintTimings = PhaseTimings();
+    if (!m_reloading) {
+        verticalScrollBar()->setValue(0);
+        horizontalScrollBar()->setValue(0);
     }
+    m_reloading = false;
+    updateScrollBars();
+    viewport()->update();
+    m_prefetchTimer.start();
+}
 
-    emit fileNameChanged(fileName);
+void TextEdit::updateDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    // Existing lines are unchanged, so their cached tokens stay valid
+    QScrollBar *scrollBar = verticalScrollBar();
+    const bool following = scrollBar->value() == scrollBar->maximum();
+    m_document = document;
+    updateScrollBars();
+    if (following)
+        scrollBar->setValue(scrollBar->maximum());
+    viewport()->update();
+    m_prefetchTimer.start();
+    emit documentUpdated();
 }
 
 void TextEdit::clearHighlighter()
 {
-    // Delete the highlighter if it exists
-    if (m_highlighter) {
-        delete m_highlighter;
-        m_highlighter = nullptr;
+    m_highlightingRequested = false;
+    m_highlighter.reset();
+    resetHighlighting();
+    viewport()->update();
+}
+
+void TextEdit::clear()
+{
+    m_loader->cancel();
+    m_showingText = false;
+    m_watcher->stop();
+    m_highlighter.reset();
+    resetHighlighting();
+    m_document.reset();
+    m_maxLineWidth = 0;
+    m_matchLine = -1;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+    emit documentChanged();
+}
+
+void TextEdit::showMatch(qint64 line, qint64 column, qint64 length)
+{
+    if (!m_document || line < 0 || line >= lineCount())
+        return;
+    const QByteArrayView bytes = m_document->line(line);
+    column = qBound<qint64>(0, column, bytes.size());
+    length = qBound<qint64>(0, length, bytes.size() - column);
+    m_matchLine = line;
+    m_matchStart = int(QString::fromUtf8(bytes.first(column)).size());
+    m_matchLength = int(QString::fromUtf8(bytes.sliced(column, length)).size());
+
+    verticalScrollBar()->setValue(int(qMin<qint64>(qMax<qint64>(0, line - visibleLineCount() / 2), INT_MAX)));
+
+    // The view only moves sideways if the match is outside it
+    QTextLayout layout(QString::fromUtf8(bytes), font());
+    layout.beginLayout();
+    QTextLine textLine = layout.createLine();
+    layout.endLayout();
+    if (textLine.isValid()) {
+        m_maxLineWidth = qMax(m_maxLineWidth, qCeil(textLine.naturalTextWidth()) + 8);
+        updateScrollBars();
+        QScrollBar *scrollBar = horizontalScrollBar();
+        const int width = viewport()->width();
+        const int x = 4 + qFloor(textLine.cursorToX(m_matchStart));
+        const int right = 4 + qCeil(textLine.cursorToX(m_matchStart + m_matchLength));
+        if (x < scrollBar->value() || right > scrollBar->value() + width)
+            scrollBar->setValue(qMax(0, x - width / 4));
+    }
+    viewport()->update();
+}
+
+void TextEdit::resetHighlighting()
+{
+    // Results of jobs still running for the old content are dropped on arrival
+    ++m_generation;
+    m_tokenCache.clear();
+    m_prefetchTimer.stop();
+}
+
+int TextEdit::visibleLineCount() const
+{
+    return qMax(1, viewport()->height() / fontMetrics().lineSpacing());
+}
+
+void TextEdit::updateScrollBars()
+{
+    const int pageLines = visibleLineCount();
+    const qint64 maxLine = qMax<qint64>(0, lineCount() - pageLines);
+    verticalScrollBar()->setRange(0, int(qMin<qint64>(maxLine, INT_MAX)));
+    verticalScrollBar()->setPageStep(pageLines);
+    verticalScrollBar()->setSingleStep(1);
+
+    const int width = viewport()->width();
+    horizontalScrollBar()->setRange(0, qMax(0, m_maxLineWidth - width));
+    horizontalScrollBar()->setPageStep(width);
+    horizontalScrollBar()->setSingleStep(fontMetrics().averageCharWidth());
+}
+
+const CallgrindLexer::Tokens *TextEdit::tokensForLine(qint64 line, const QString &text)
+{
+    if (CallgrindLexer::Tokens *tokens = m_tokenCache.object(line))
+        return tokens;
+
+    auto *tokens = new CallgrindLexer::Tokens;
+    CallgrindLexer::tokenize(text, *tokens);
+    m_tokenCache.insert(line, tokens);
+    return tokens;
+}
+
+void TextEdit::prefetchHighlighting()
+{
+    if (!m_highlighter || !m_document || m_prefetchRunning)
+        return;
+
+    const qint64 pageLines = visibleLineCount();
+    const qint64 top = verticalScrollBar()->value();
+    qint64 first = qMax<qint64>(0, top - PrefetchPages * pageLines);
+    qint64 last = qMin(lineCount(), top + (PrefetchPages + 1) * pageLines);
+    while (first < last && m_tokenCache.contains(first))
+        ++first;
+    while (last > first && m_tokenCache.contains(last - 1))
+        --last;
+    if (first == last)
+        return;
+
+    m_prefetchRunning = true;
+    m_highlightPool.start([this, document = m_document, generation = m_generation, first, last] {
+        TraceScope scope("prefetch highlighting", nullptr, "view");
+        QList<CallgrindLexer::Tokens> result;
+        result.reserve(last - first);
+        for (qint64 line = first; line < last; ++line) {
+            CallgrindLexer::Tokens tokens;
+            CallgrindLexer::tokenize(QString::fromUtf8(document->line(line)), tokens);
+            result.append(tokens);
+        }
+        scope.finish();
+        QMetaObject::invokeMethod(this, [this, generation, first, result] {
+            applyPrefetchedTokens(generation, first, result);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TextEdit::applyPrefetchedTokens(int generation, qint64 first,
+                                     const QList<CallgrindLexer::Tokens> &tokens)
+{
+    m_prefetchRunning = false;
+    if (generation != m_generation)
+        return;
+
+    for (qsizetype i = 0; i < tokens.size(); ++i) {
+        if (!m_tokenCache.contains(first + i))
+            m_tokenCache.insert(first + i, new CallgrindLexer::Tokens(tokens.at(i)));
     }
+
+    // The view may have moved on while the job was running
+    m_prefetchTimer.start();
 }
 
-QVariant TextEdit::loadResource(int type, const QUrl &name)
+void TextEdit::paintEvent(QPaintEvent *)
 {
-    if (type == QTextDocument::ImageResource) {
-        QFile file(srcUrl.resolved(name).toLocalFile());
-        if (file.open(QIODevice::ReadOnly))
-            return file.readAll();
+    const TraceScope scope("paint", nullptr, "view");
+    // The first screen of a document is broken down for the load timings
+    PhaseTimings *timings = m_firstPaintPending && m_document ? &m_firstPaintTimings : nullptr;
+    if (timings)
+        timings->begin();
+
+    QPainter painter(viewport());
+    painter.setPen(palette().color(QPalette::Text));
+
+    const int lineHeight = fontMetrics().lineSpacing();
+    const int left = 4 - horizontalScrollBar()->value();
+    const qint64 first = verticalScrollBar()->value();
+    const qint64 last = qMin(lineCount(), first + visibleLineCount() + 1);
+
+    int maxWidth = m_maxLineWidth;
+    int y = 0;
+    for (qint64 line = first; line < last; ++line, y += lineHeight) {
+        TraceScope decodeScope("decode", timings, nullptr);
+        const QString text = QString::fromUtf8(m_document->line(line));
+        decodeScope.finish();
+
+        QTextLayout layout(text, font());
+        if (m_highlighter) {
+            const TraceScope highlightScope("highlight", timings, nullptr);
+            layout.setFormats(m_highlighter->formatRanges(*tokensForLine(line, text)));
+        }
+        TraceScope layoutScope("layout", timings, nullptr);
+        layout.beginLayout();
+        QTextLine textLine = layout.createLine();
+        layout.endLayout();
+        layoutScope.finish();
+        if (!textLine.isValid())
+            continue;
+
+        QList<QTextLayout::FormatRange> selections;
+        if (line == m_matchLine) {
+            QTextLayout::FormatRange match;
+            match.start = m_matchStart;
+            match.length = m_matchLength;
+            match.format.setBackground(palette().highlight());
+            match.format.setForeground(palette().highlightedText());
+            selections.append(match);
+        }
+        const TraceScope drawScope("draw", timings, nullptr);
+        layout.draw(&painter, QPointF(left, y), selections);
+        maxWidth = qMax(maxWidth, qCeil(textLine.naturalTextWidth()) + 8);
+    }
+
+    // Line widths are only known once a line has been laid out
+    if (maxWidth != m_maxLineWidth) {
+        m_maxLineWidth = maxWidth;
+        updateScrollBars();
+    }
+
+    if (timings) {
+        timings->end();
+        m_firstPaintPending = false;
+        emit firstPainted();
     }
-    return QTextEdit::loadResource(type, name);
-}
\ No newline at end of file
+}
+
+void TextEdit::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+    m_prefetchTimer.start();
+}
+
+void TextEdit::scrollContentsBy(int, int dy)
+{
+    viewport()->update();
+    if (dy != 0)
+        m_prefetchTimer.start();
+}
+
+void TextEdit::keyPressEvent(QKeyEvent *event)
+{
+    // Arrow and page keys are handled by QAbstractScrollArea
+    if (event->key() == Qt::Key_Home)
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderToMinimum);
+    else if (event->key() == Qt::Key_End)
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderToMaximum);
+    else
+        QAbstractScrollArea::keyPressEvent(event);
+}
@@ -1,25 +1,120 @@
 #ifndef TEXTEDIT_H
 #define TEXTEDIT_H
 
-#include <QTextEdit>
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QTimer>
 #include "callgrindhighlighter.h"
+#include "profiledocument.h"
+#include "tracer.h"
 
-class TextEdit : public QTextEdit
+class ProfileLoader;
+class ProfileWatcher;
+
+// Read-only text view over a memory-mapped file. Only the lines inside the
+// viewport are decoded, laid out and highlighted, so opening and scrolling
+// cost the same regardless of the file size.
+//
+// Highlighting is viewport-first: visible lines missing from the token cache
+// are lexed while painting, and once scrolling settles the surrounding pages
+// are lexed on a worker thread. Lines that never come near the viewport are
+// never highlighted.
+//
+// setContents() loads on a worker thread; the current document stays on
+// screen until the lines of the new one are indexed and then is replaced in
+// one step. A profile's text is shown while its profile is analyzed, and
+// documentChanged() is emitted again, without moving the view, once the
+// profile is ready.
+//
+// In watch mode lines appended to the file are parsed in the background and
+// added below the existing ones; the scroll position and the highlighting
+// of the lines already seen are kept, and a view left at the end follows
+// the new lines.
+class TextEdit : public QAbstractScrollArea
 {
     Q_OBJECT
 public:
     explicit TextEdit(QWidget *parent = nullptr);
     void setContents(const QString &fileName, bool enableHighlighting);
-    void clearHighlighter();  // Declare the clearHighlighter() method
+    // Shows the sum of the profiles \a fileNames, once saved as \a outputFileName
+    void setMergedContents(const QStringList &fileNames, const QString &outputFileName,
+                           bool enableHighlighting);
+    void clearHighlighter();
+    bool isLoading() const;
+
+    void setWatching(bool watching);
+    bool isWatching() const { return m_watching; }
+
+    QSharedPointer<const ProfileDocument> document() const { return m_document; }
+    qint64 lineCount() const { return m_document ? m_document->lineCount() : 0; }
+
+    // Scrolls \a line into the middle of the view and marks the \a length
+    // bytes from byte \a column of it, as a search match
+    void showMatch(qint64 line, qint64 column, qint64 length);
+
+    // Decoding, highlighting and layout of the first screen of the current
+    // document; valid once firstPainted() has been emitted
+    const PhaseTimings &firstPaintTimings() const { return m_firstPaintTimings; }
+
+public slots:
+    void clear();
+    void cancelLoading();
 
 signals:
     void fileNameChanged(const QString &fileName);
+    void documentChanged();
+    void documentUpdated();
+    void loadStarted(const QString &fileName);
+    void loadProgress(qint64 bytesRead, qint64 totalBytes, qint64 lines);
+    void loadFinished(const QString &fileName);
+    void loadFailed(const QString &fileName, const QString &errorString);
+    void firstPainted();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
 
 private:
-    CallgrindSyntaxHighlighter *m_highlighter = nullptr;
-    QUrl srcUrl;
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+    void showText(const QSharedPointer<const ProfileDocument> &document);
+    void showDocument(const QSharedPointer<const ProfileDocument> &document, bool highlight);
+    void updateDocument(const QSharedPointer<const ProfileDocument> &document);
+    void reload(const QString &fileName);
+    void updateScrollBars();
+    int visibleLineCount() const;
+    const CallgrindLexer::Tokens *tokensForLine(qint64 line, const QString &text);
+    void prefetchHighlighting();
+    void applyPrefetchedTokens(int generation, qint64 first, const QList<CallgrindLexer::Tokens> &tokens);
+    void resetHighlighting();
+
+    ProfileLoader *m_loader;
+    ProfileWatcher *m_watcher;
+    bool m_watching = false;
+    bool m_reloading = false;
+    // Whether the text shown is that of the profile being loaded
+    bool m_showingText = false;
+    QSharedPointer<const ProfileDocument> m_document;
+    QScopedPointer<CallgrindSyntaxHighlighter> m_highlighter;
+    bool m_highlightingRequested = false;
+    QCache<qint64, CallgrindLexer::Tokens> m_tokenCache;
+    QTimer m_prefetchTimer;
+    int m_generation = 0;
+    bool m_prefetchRunning = false;
+    int m_maxLineWidth = 0;
+    qint64 m_matchLine = -1;
+    int m_matchStart = 0;
+    int m_matchLength = 0;
+    bool m_firstPaintPending = false;
+    PhaseTimings m_firstPaintTimings;
 
-    QVariant loadResource(int type, const QUrl &name) override;
+    // Declared last so that it is destroyed, and waits for running jobs,
+    // before the members those jobs report back into
+    QThreadPool m_highlightPool;
 };
 
 #endif // TEXTEDIT_H
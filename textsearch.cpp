@@ -0,0 +1,316 @@
+#include "textsearch.h"
+
+#include <cstring>
+
+using namespace Qt::StringLiterals;
+
+static bool isAscii(QByteArrayView text)
+{
+    for (const char c : text) {
+        if (uchar(c) >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+static char toLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+static char toUpperAscii(char c)
+{
+    return c >= 'a' && c <= 'z' ? char(c - 'a' + 'A') : c;
+}
+
+// How common a byte is in Callgrind text: digits and spaces fill the cost
+// lines, lower case letters most names. The byte scanned for is the rarest
+// one of the pattern, so that the fewest candidates need comparing.
+static int byteFrequency(char c)
+{
+    if ((c >= '0' && c <= '9') || c == ' ' || c == '+' || c == '-' || c == '=' || c == '(' || c == ')')
+        return 3;
+    if ((c >= 'a' && c <= 'z') || c == '_' || c == ':')
+        return 2;
+    return 1;
+}
+
+// memchr for either of two bytes. Whole blocks are tested with a loop
+// without branches, which the compiler vectorizes, and only the block with
+// a hit is searched byte by byte.
+static const char *findEither(const char *p, const char *end, char a, char b)
+{
+    if (a == b)
+        return static_cast<const char *>(std::memchr(p, a, size_t(end - p)));
+    while (end - p >= 64) {
+        uchar hit = 0;
+        for (int i = 0; i < 64; ++i)
+            hit |= uchar(p[i] == a) | uchar(p[i] == b);
+        if (hit)
+            break;
+        p += 64;
+    }
+    for (; p < end; ++p) {
+        if (*p == a || *p == b)
+            return p;
+    }
+    return nullptr;
+}
+
+static qsizetype utf8Length(QStringView text)
+{
+    qsizetype length = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const char16_t c = text.at(i).unicode();
+        if (c < 0x80) {
+            length += 1;
+        } else if (c < 0x800) {
+            length += 2;
+        } else if (QChar::isHighSurrogate(c) && i + 1 < text.size() && QChar::isLowSurrogate(text.at(i + 1).unicode())) {
+            length += 4;
+            ++i;
+        } else {
+            length += 3;
+        }
+    }
+    return length;
+}
+
+// The longest run of literal characters every match of \a pattern contains,
+// or nothing if that is not obvious: alternatives, inline options and
+// optional groups change what is required, so only runs outside groups and
+// without a quantifier that allows zero repetitions count.
+static QByteArray requiredLiteral(const QString &pattern, bool caseSensitive)
+{
+    if (pattern.contains(u'|') || pattern.contains(u"(?"_s))
+        return QByteArray();
+
+    QString best;
+    QString run;
+    int depth = 0;
+    const auto endRun = [&] {
+        if (depth == 0 && run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+    const auto isQuantifier = [&](qsizetype i) {
+        return i < pattern.size() && (pattern.at(i) == u'?' || pattern.at(i) == u'*' || pattern.at(i) == u'{');
+    };
+
+    for (qsizetype i = 0; i < pattern.size(); ++i) {
+        QChar c = pattern.at(i);
+        bool literal = true;
+        if (c == u'\\') {
+            if (++i == pattern.size())
+                break;
+            c = pattern.at(i);
+            // \d, \b, \1 and the like are classes, assertions or references
+            literal = !c.isLetterOrNumber();
+            // Skip the argument of \x41, \p{L}, \k<name>, \cA and the like
+            if (u"xopPNgkc"_s.contains(c) || c.isDigit()) {
+                const QChar open = i + 1 < pattern.size() ? pattern.at(i + 1) : QChar();
+                if (open == u'{' || open == u'<' || open == u'\'') {
+                    const QChar close = open == u'{' ? u'}' : open == u'<' ? u'>' : u'\'';
+                    i = pattern.indexOf(close, i + 2);
+                    if (i < 0)
+                        i = pattern.size();
+                } else if (c == u'c') {
+                    ++i;
+                } else {
+                    while (i + 1 < pattern.size() && pattern.at(i + 1).isLetterOrNumber())
+                        ++i;
+                }
+            }
+        } else if (c == u'{') {
+            // The bounds of a quantifier
+            i = pattern.indexOf(u'}', i);
+            if (i < 0)
+                i = pattern.size();
+            literal = false;
+        } else if (c == u'[') {
+            // A class matches one of several characters
+            if (i + 1 < pattern.size() && pattern.at(i + 1) == u'^')
+                ++i;
+            if (i + 1 < pattern.size() && pattern.at(i + 1) == u']')
+                ++i;
+            while (++i < pattern.size() && pattern.at(i) != u']') {
+                if (pattern.at(i) == u'\\')
+                    ++i;
+            }
+            literal = false;
+        } else if (c == u'(') {
+            endRun();
+            ++depth;
+            continue;
+        } else if (c == u')') {
+            endRun();
+            --depth;
+            continue;
+        } else {
+            literal = !u".^$*+?}"_s.contains(c);
+        }
+
+        // Outside ASCII, k and s have case variants too: KELVIN SIGN and LONG S
+        if (!caseSensitive && (c.unicode() >= 0x80 || c.toLower() == u'k' || c.toLower() == u's'))
+            literal = false;
+        if (!literal || isQuantifier(i + 1)) {
+            endRun();
+            continue;
+        }
+        run += caseSensitive ? c : c.toLower();
+        if (i + 1 < pattern.size() && pattern.at(i + 1) == u'+')
+            endRun();
+    }
+    endRun();
+    return best.toUtf8();
+}
+
+bool TextSearch::setPattern(const QString &pattern, bool regularExpression, bool caseSensitive)
+{
+    m_pattern = pattern;
+    m_isRegularExpression = regularExpression;
+    m_caseSensitive = caseSensitive;
+    m_errorString.clear();
+    m_regularExpression = QRegularExpression();
+    m_useRegularExpression = false;
+    m_literal.clear();
+    if (pattern.isEmpty())
+        return fail(u"empty pattern"_s);
+    if (pattern.contains(u'\n'))
+        return fail(u"patterns cannot span lines"_s);
+
+    if (!regularExpression) {
+        m_literal = pattern.toUtf8();
+        // Only ASCII is folded byte by byte; other text is left to the regex
+        // engine, which knows the Unicode case mappings
+        if (!caseSensitive && !isAscii(m_literal)) {
+            m_literal.clear();
+            m_useRegularExpression = true;
+            m_regularExpression.setPattern(QRegularExpression::escape(pattern));
+        } else if (!caseSensitive) {
+            m_literal = m_literal.toLower();
+        }
+    } else {
+        m_useRegularExpression = true;
+        m_regularExpression.setPattern(pattern);
+        m_literal = requiredLiteral(pattern, caseSensitive);
+    }
+    if (m_useRegularExpression) {
+        if (!caseSensitive)
+            m_regularExpression.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        if (!m_regularExpression.isValid()) {
+            return fail(u"%1 at offset %2"_s.arg(m_regularExpression.errorString())
+                        .arg(m_regularExpression.patternErrorOffset()));
+        }
+        m_regularExpression.optimize();
+    }
+
+    m_scanIndex = 0;
+    for (qsizetype i = 1; i < m_literal.size(); ++i) {
+        if (byteFrequency(m_literal.at(i)) < byteFrequency(m_literal.at(m_scanIndex)))
+            m_scanIndex = i;
+    }
+    m_scanByte = m_literal.isEmpty() ? 0 : m_literal.at(m_scanIndex);
+    m_scanAlternative = caseSensitive ? m_scanByte : toUpperAscii(m_scanByte);
+    return true;
+}
+
+const char *TextSearch::findLiteral(const char *p, const char *end) const
+{
+    const qsizetype length = m_literal.size();
+    const char *literal = m_literal.constData();
+    while (end - p >= length) {
+        const char *hit = findEither(p + m_scanIndex, end - length + m_scanIndex + 1, m_scanByte,
+                                     m_scanAlternative);
+        if (!hit)
+            return nullptr;
+        const char *candidate = hit - m_scanIndex;
+        if (m_caseSensitive) {
+            if (std::memcmp(candidate, literal, size_t(length)) == 0)
+                return candidate;
+        } else {
+            qsizetype i = 0;
+            while (i < length && toLowerAscii(candidate[i]) == literal[i])
+                ++i;
+            if (i == length)
+                return candidate;
+        }
+        p = candidate + 1;
+    }
+    return nullptr;
+}
+
+bool TextSearch::matchLine(const char *begin, const char *line, const char *end,
+                           const MatchCallback &found) const
+{
+    const char *textEnd = end > line && end[-1] == '\r' ? end - 1 : end;
+    const QString text = QString::fromUtf8(line, textEnd - line);
+    const bool ascii = text.size() == textEnd - line;
+    QRegularExpressionMatchIterator it = m_regularExpression.globalMatch(text);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        if (match.capturedLength() == 0)
+            continue;
+        qint64 start = match.capturedStart();
+        qint64 length = match.capturedLength();
+        if (!ascii) {
+            const QStringView view(text);
+            start = utf8Length(view.first(start));
+            length = utf8Length(view.sliced(match.capturedStart(), length));
+        }
+        // Invalid UTF-8 decodes to longer replacement characters
+        start = qMin<qint64>(start, textEnd - line);
+        length = qMin<qint64>(length, textEnd - line - start);
+        if (!found({line - begin + start, length}))
+            return false;
+    }
+    return true;
+}
+
+qint64 TextSearch::search(QByteArrayView data, qint64 from, qint64 maxBytes, const MatchCallback &found) const
+{
+    if (!m_useRegularExpression && m_literal.isEmpty())
+        return data.size(); // No valid pattern
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    const char *p = begin + from;
+    const char *stop = end;
+    if (maxBytes < end - p) {
+        stop = static_cast<const char *>(std::memchr(p + maxBytes, '\n', size_t(end - p - maxBytes)));
+        stop = stop ? stop + 1 : end;
+    }
+
+    if (!m_useRegularExpression) {
+        const qsizetype length = m_literal.size();
+        for (const char *hit; (hit = findLiteral(p, stop)); p = hit + length) {
+            if (!found({hit - begin, length}))
+                return -1;
+        }
+        return stop - begin;
+    }
+
+    while (p < stop) {
+        const char *line = p;
+        if (!m_literal.isEmpty()) {
+            const char *hit = findLiteral(p, stop);
+            if (!hit)
+                break;
+            line = hit;
+            while (line > p && line[-1] != '\n')
+                --line;
+        }
+        const char *eol = static_cast<const char *>(std::memchr(line, '\n', size_t(stop - line)));
+        if (!matchLine(begin, line, eol ? eol : stop, found))
+            return -1;
+        p = eol ? eol + 1 : stop;
+    }
+    return stop - begin;
+}
+
+bool TextSearch::fail(const QString &errorString)
+{
+    m_errorString = errorString;
+    m_useRegularExpression = false;
+    m_literal.clear();
+    return false;
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QRegularExpression>
+#include <QString>
+
+#include <functional>
+
+// Finds a pattern in raw UTF-8 text, such as a mapped profile, without
+// decoding it first. Matches never span lines.
+//
+// Plain text is searched for byte by byte: memchr, which the C library
+// vectorizes, skips to the next occurrence of the pattern's rarest byte,
+// and only there are the remaining bytes compared. Regular expressions are
+// prefiltered the same way with a literal that every match must contain;
+// only the lines holding it are decoded and given to the regex engine.
+class TextSearch
+{
+public:
+    // Byte offsets into the searched data
+    struct Match {
+        qint64 offset;
+        qint64 length;
+    };
+    // Called for every match in order; returning false stops the search.
+    using MatchCallback = std::function<bool(const Match &match)>;
+
+    // Returns false, with errorString() set, for an empty pattern or an
+    // invalid regular expression. Plain text ignores case by folding ASCII
+    // letters only.
+    bool setPattern(const QString &pattern, bool regularExpression = false, bool caseSensitive = true);
+    QString pattern() const { return m_pattern; }
+    bool isRegularExpression() const { return m_isRegularExpression; }
+    bool isCaseSensitive() const { return m_caseSensitive; }
+    QString errorString() const { return m_errorString; }
+
+    // What the byte scan looks for; for a regular expression without a
+    // required literal it is empty and every line is matched
+    QByteArray prefilter() const { return m_literal; }
+
+    // Searches \a data from \a from, which must be a line start, up to the
+    // end of the line reaching \a maxBytes further. Returns the offset of the
+    // line start to continue from, data.size() at the end, or -1 if \a found
+    // stopped the search.
+    qint64 search(QByteArrayView data, qint64 from, qint64 maxBytes, const MatchCallback &found) const;
+
+private:
+    const char *findLiteral(const char *p, const char *end) const;
+    bool matchLine(const char *begin, const char *line, const char *end, const MatchCallback &found) const;
+    bool fail(const QString &errorString);
+
+    QString m_pattern;
+    bool m_isRegularExpression = false;
+    bool m_caseSensitive = true;
+    QString m_errorString;
+    QRegularExpression m_regularExpression;
+    bool m_useRegularExpression = false;
+    // Lower case when folding
+    QByteArray m_literal;
+    qsizetype m_scanIndex = 0;
+    char m_scanByte = 0;
+    char m_scanAlternative = 0;
+};
+
+#endif // TEXTSEARCH_H
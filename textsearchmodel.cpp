@@ -0,0 +1,180 @@
+#include "textsearchmodel.h"
+#include "profiledocument.h"
+#include "tracer.h"
+
+// Bytes searched between checks for cancellation and progress reports
+static const qint64 ChunkBytes = 4 << 20;
+
+// As in ProfileFinder: a batch is handed over when it is this large or this
+// old, whichever comes first. The first match is handed over on its own.
+static const qsizetype BatchSize = 256;
+static const qint64 BatchInterval = 100; // ms
+
+// Bytes of the line shown before and after the match
+static const qint64 ContextBefore = 40;
+static const qint64 ContextAfter = 160;
+
+TextSearchModel::TextSearchModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+TextSearchModel::~TextSearchModel()
+{
+    cancel();
+}
+
+void TextSearchModel::setDocument(const QSharedPointer<const ProfileDocument> &document)
+{
+    cancel();
+    clear();
+    m_document = document;
+}
+
+bool TextSearchModel::search(const QString &pattern, bool regularExpression, bool caseSensitive)
+{
+    cancel();
+    clear();
+    TextSearch textSearch;
+    if (!textSearch.setPattern(pattern, regularExpression, caseSensitive)) {
+        m_errorString = textSearch.errorString();
+        return false;
+    }
+    m_errorString.clear();
+    if (!m_document)
+        return true;
+
+    const QSharedPointer<QAtomicInt> cancelFlag(new QAtomicInt(0));
+    const int generation = m_generation;
+    m_cancelFlag = cancelFlag;
+    m_searching = true;
+    m_searchTimer.start();
+
+    m_pool.start([this, document = m_document, textSearch, generation, cancelFlag] {
+        const TraceScope scope("search text", nullptr, "find");
+        const QByteArrayView data = document->data();
+        const LineIndex &lines = document->lineIndex();
+        QList<Match> batch;
+        QElapsedTimer age;
+        age.start();
+        int count = 0;
+
+        const auto flush = [&](qint64 searchedBytes, bool done) {
+            QMetaObject::invokeMethod(this, [this, generation, batch, searchedBytes, done] {
+                deliver(generation, batch, searchedBytes, done);
+            }, Qt::QueuedConnection);
+            batch.clear();
+            age.restart();
+        };
+
+        qint64 from = 0;
+        while (from >= 0 && from < data.size()) {
+            if (cancelFlag->loadRelaxed() != 0)
+                return;
+            from = textSearch.search(data, from, ChunkBytes, [&](const TextSearch::Match &match) {
+                const qint64 line = lines.lineAt(match.offset);
+                batch.append({line, match.offset - lines.lineStart(line), match.length});
+                if (++count == MaxMatches)
+                    return false;
+                if (count == 1 || batch.size() >= BatchSize || age.elapsed() >= BatchInterval)
+                    flush(match.offset, false);
+                return cancelFlag->loadRelaxed() == 0;
+            });
+            // Chunks without matches still report progress
+            if (from >= 0 && age.elapsed() >= BatchInterval)
+                flush(from, false);
+        }
+        flush(data.size(), true);
+    });
+    return true;
+}
+
+void TextSearchModel::cancel()
+{
+    // The worker stops within a chunk; whatever it already sent is ignored
+    if (m_cancelFlag)
+        m_cancelFlag->storeRelaxed(1);
+    m_cancelFlag.reset();
+    ++m_generation;
+    m_searching = false;
+}
+
+void TextSearchModel::clear()
+{
+    beginResetModel();
+    m_matches.clear();
+    m_firstMatchMilliseconds = -1;
+    m_searchMilliseconds = -1;
+    endResetModel();
+}
+
+void TextSearchModel::deliver(int generation, const QList<Match> &batch, qint64 searchedBytes, bool done)
+{
+    if (generation != m_generation)
+        return; // Canceled or superseded
+
+    if (!batch.isEmpty()) {
+        if (m_matches.isEmpty())
+            m_firstMatchMilliseconds = m_searchTimer.elapsed();
+        const int first = int(m_matches.size());
+        beginInsertRows(QModelIndex(), first, first + int(batch.size()) - 1);
+        m_matches.append(batch);
+        endInsertRows();
+    }
+    emit progress(searchedBytes, m_document->size());
+
+    if (done) {
+        m_searching = false;
+        m_searchMilliseconds = m_searchTimer.elapsed();
+        m_cancelFlag.reset();
+        emit finished();
+    }
+}
+
+int TextSearchModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_matches.size());
+}
+
+int TextSearchModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant TextSearchModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const Match &match = m_matches.at(index.row());
+    if (index.column() == LineColumn) {
+        if (role == Qt::TextAlignmentRole)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        return role == Qt::DisplayRole ? QVariant(match.line + 1) : QVariant();
+    }
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    // Long lines are cut around the match, at UTF-8 character boundaries
+    const QByteArrayView line = m_document->line(match.line);
+    qint64 begin = qMax<qint64>(0, match.column - ContextBefore);
+    qint64 end = qMin<qint64>(line.size(), match.column + match.length + ContextAfter);
+    while (begin > 0 && (uchar(line.at(begin)) & 0xc0) == 0x80)
+        --begin;
+    while (end < line.size() && (uchar(line.at(end)) & 0xc0) == 0x80)
+        ++end;
+    QString text = QString::fromUtf8(line.sliced(begin, end - begin));
+    if (begin > 0)
+        text.prepend(u'…');
+    if (end < line.size())
+        text.append(u'…');
+    return text;
+}
+
+QVariant TextSearchModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    return section == LineColumn ? tr("Line") : tr("Text");
+}
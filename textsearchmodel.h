@@ -0,0 +1,84 @@
+#ifndef TEXTSEARCHMODEL_H
+#define TEXTSEARCHMODEL_H
+
+#include "textsearch.h"
+
+#include <QAbstractTableModel>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+class ProfileDocument;
+
+// The matches of a TextSearch in the open document, one row per match with
+// its line number and text. The search runs over the document's bytes on a
+// worker thread and matches arrive in batches while it runs, the first one
+// as soon as it is found.
+class TextSearchModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        LineColumn,
+        TextColumn,
+        ColumnCount
+    };
+
+    struct Match {
+        qint64 line;
+        qint64 column; // Byte offset within the line
+        qint64 length;
+    };
+
+    // The search stops after this many matches
+    static const int MaxMatches = 1000000;
+
+    explicit TextSearchModel(QObject *parent = nullptr);
+    ~TextSearchModel() override;
+
+    // Cancels the search and clears the matches
+    void setDocument(const QSharedPointer<const ProfileDocument> &document);
+    // Starts searching, canceling any search still running. Returns false,
+    // with errorString() set, for an invalid pattern.
+    bool search(const QString &pattern, bool regularExpression, bool caseSensitive);
+    void cancel();
+    void clear();
+
+    bool isSearching() const { return m_searching; }
+    QString errorString() const { return m_errorString; }
+    const Match &match(int row) const { return m_matches.at(row); }
+    // Whether the search stopped at MaxMatches
+    bool isTruncated() const { return m_matches.size() >= MaxMatches; }
+    qint64 firstMatchMilliseconds() const { return m_firstMatchMilliseconds; }
+    qint64 searchMilliseconds() const { return m_searchMilliseconds; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+signals:
+    void progress(qint64 searchedBytes, qint64 totalBytes);
+    void finished();
+
+private:
+    void deliver(int generation, const QList<Match> &batch, qint64 searchedBytes, bool done);
+
+    QSharedPointer<const ProfileDocument> m_document;
+    QList<Match> m_matches;
+    QString m_errorString;
+    QSharedPointer<QAtomicInt> m_cancelFlag;
+    QElapsedTimer m_searchTimer;
+    qint64 m_firstMatchMilliseconds = -1;
+    qint64 m_searchMilliseconds = -1;
+    int m_generation = 0;
+    bool m_searching = false;
+
+    QThreadPool m_pool;
+};
+
+#endif // TEXTSEARCHMODEL_H
@@ -0,0 +1,229 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX) && !defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+// Events kept while recording; a long session drops the rest rather than
+// growing without bound
+static const qsizetype MaxEvents = 1 << 20;
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    int thread;
+    qint64 start;
+    qint64 duration;
+};
+
+struct TraceLog {
+    QMutex mutex;
+    QList<TraceEvent> events;
+    QList<QString> threadNames;
+};
+
+TraceLog &traceLog()
+{
+    static TraceLog log;
+    return log;
+}
+
+const QElapsedTimer &traceClock()
+{
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+QByteArray jsonString(const QString &text)
+{
+    QByteArray escaped = "\"";
+    for (const char c : text.toUtf8()) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if (uchar(c) >= 0x20)
+            escaped += c;
+    }
+    return escaped + '"';
+}
+
+} // namespace
+
+QAtomicInt Tracer::s_recording;
+
+void PhaseTimings::begin()
+{
+    m_phases.clear();
+    m_wallNanoseconds = 0;
+    m_peakRssKb = -1;
+    m_wallClock.start();
+}
+
+void PhaseTimings::end()
+{
+    m_wallNanoseconds = m_wallClock.isValid() ? m_wallClock.nsecsElapsed() : 0;
+    m_peakRssKb = Tracer::peakRssKb();
+}
+
+void PhaseTimings::add(const char *name, qint64 nanoseconds)
+{
+    for (Phase &phase : m_phases) {
+        if (std::strcmp(phase.name, name) == 0) {
+            phase.nanoseconds += nanoseconds;
+            return;
+        }
+    }
+    m_phases.append({name, nanoseconds});
+}
+
+void PhaseTimings::add(const PhaseTimings &other)
+{
+    for (const Phase &phase : other.m_phases)
+        add(phase.name, phase.nanoseconds);
+}
+
+void Tracer::setRecording(bool recording)
+{
+    traceClock();
+    s_recording.storeRelaxed(recording ? 1 : 0);
+}
+
+void Tracer::clear()
+{
+    TraceLog &log = traceLog();
+    const QMutexLocker locker(&log.mutex);
+    log.events.clear();
+}
+
+qsizetype Tracer::eventCount()
+{
+    TraceLog &log = traceLog();
+    const QMutexLocker locker(&log.mutex);
+    return log.events.size();
+}
+
+qint64 Tracer::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void Tracer::addEvent(const char *name, const char *category, qint64 start, qint64 duration)
+{
+    // Threads are numbered in the order they first record an event
+    static thread_local int thread = -1;
+    TraceLog &log = traceLog();
+    const QMutexLocker locker(&log.mutex);
+    if (log.events.size() >= MaxEvents)
+        return;
+    if (thread < 0) {
+        thread = int(log.threadNames.size());
+        QThread *current = QThread::currentThread();
+        QString threadName = current->objectName();
+        if (QCoreApplication::instance() && current == QCoreApplication::instance()->thread())
+            threadName = QStringLiteral("main");
+        else if (threadName.isEmpty())
+            threadName = QStringLiteral("thread %1").arg(thread);
+        log.threadNames.append(threadName);
+    }
+    log.events.append({name, category, thread, start, duration});
+}
+
+bool Tracer::writeChromeTrace(QIODevice *device)
+{
+    TraceLog &log = traceLog();
+    const QMutexLocker locker(&log.mutex);
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+    QByteArray buffer = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (qsizetype thread = 0; thread < log.threadNames.size(); ++thread) {
+        buffer += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":"
+                  + QByteArray::number(thread) + ",\"args\":{\"name\":"
+                  + jsonString(log.threadNames.at(thread)) + "}},\n";
+    }
+    for (qsizetype i = 0; i < log.events.size(); ++i) {
+        const TraceEvent &event = log.events.at(i);
+        // Timestamps are in microseconds
+        buffer += "{\"name\":\"" + QByteArray(event.name) + "\",\"cat\":\"" + QByteArray(event.category)
+                  + "\",\"ph\":\"X\",\"ts\":" + QByteArray::number(double(event.start) / 1000, 'f', 3)
+                  + ",\"dur\":" + QByteArray::number(double(event.duration) / 1000, 'f', 3)
+                  + ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(event.thread) + '}';
+        if (i + 1 < log.events.size())
+            buffer += ',';
+        buffer += '\n';
+        if (buffer.size() >= (1 << 20)) {
+            if (device->write(buffer) != buffer.size())
+                return false;
+            buffer.clear();
+        }
+    }
+    buffer += "]}\n";
+    return device->write(buffer) == buffer.size();
+}
+
+bool Tracer::saveChromeTrace(const QString &fileName, QString *errorString)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || !writeChromeTrace(&file) || !file.commit()) {
+        *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+qint64 Tracer::peakRssKb()
+{
+#if defined(Q_OS_LINUX)
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return qint64(counters.PeakWorkingSetSize / 1024);
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef Q_OS_DARWIN
+    return qint64(usage.ru_maxrss / 1024); // Bytes on macOS
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+void TraceScope::finish()
+{
+    if (m_start < 0)
+        return;
+    const qint64 duration = Tracer::now() - m_start;
+    if (m_timings)
+        m_timings->add(m_name, duration);
+    if (m_category && Tracer::isRecording())
+        Tracer::addEvent(m_name, m_category, m_start, duration);
+    m_start = -1;
+}
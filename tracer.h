@@ -0,0 +1,99 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// Where the time of one operation, such as opening a document, went. Phases
+// with the same name add up, and are listed in the order they first ended.
+// Not thread-safe: phases timed on other threads are collected in timings of
+// their own and added once those threads are done.
+class PhaseTimings
+{
+public:
+    struct Phase {
+        const char *name;
+        qint64 nanoseconds;
+    };
+
+    // Clears the phases and starts the wall clock
+    void begin();
+    // Stops the wall clock and samples the memory high-water mark
+    void end();
+
+    void add(const char *name, qint64 nanoseconds);
+    void add(const PhaseTimings &other);
+
+    const QList<Phase> &phases() const { return m_phases; }
+    qint64 wallNanoseconds() const { return m_wallNanoseconds; }
+    qint64 peakRssKb() const { return m_peakRssKb; }
+
+private:
+    QList<Phase> m_phases;
+    QElapsedTimer m_wallClock;
+    qint64 m_wallNanoseconds = 0;
+    qint64 m_peakRssKb = -1;
+};
+
+// Process-wide recording of trace events, written out in the Chrome
+// trace-event format for chrome://tracing or Perfetto. Recording is off
+// until enabled; TraceScope then costs one atomic load per scope.
+class Tracer
+{
+public:
+    static void setRecording(bool recording);
+    static bool isRecording() { return s_recording.loadRelaxed() != 0; }
+    static void clear();
+    static qsizetype eventCount();
+
+    // Nanoseconds on the clock that events are recorded against
+    static qint64 now();
+    static void addEvent(const char *name, const char *category, qint64 start, qint64 duration);
+
+    static bool writeChromeTrace(QIODevice *device);
+    static bool saveChromeTrace(const QString &fileName, QString *errorString);
+
+    // The most memory the process has had resident, in kB; -1 if unknown
+    static qint64 peakRssKb();
+
+private:
+    static QAtomicInt s_recording;
+};
+
+// Times the enclosing scope as the phase \a name. The duration is added to
+// \a timings, if given, and recorded as a trace event while the Tracer is
+// recording. A null \a category leaves phases too fine-grained for a trace,
+// such as per-line work, out of it. \a name and \a category must outlive
+// the trace, which string literals do.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, PhaseTimings *timings = nullptr,
+                        const char *category = "load")
+        : m_name(name)
+        , m_category(category)
+        , m_timings(timings)
+        , m_start(timings || (category && Tracer::isRecording()) ? Tracer::now() : -1)
+    {
+    }
+    ~TraceScope() { finish(); }
+
+    // Ends the phase before the scope does
+    void finish();
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_name;
+    const char *m_category;
+    PhaseTimings *m_timings;
+    qint64 m_start;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,276 @@
+#include "trigramindex.h"
+#include "symboldemangler.h"
+#include "symboltable.h"
+
+#include <algorithm>
+
+// Buckets per symbol, as a power of two, within these bounds
+static const int MinBucketBits = 12;
+static const int MaxBucketBits = 16;
+
+// A trigram in more than this share of the names is too common to list
+static const int CommonShare = 8;
+
+// A query stops intersecting once this few candidates are left; checking
+// them is cheaper than decoding further lists
+static const qsizetype FewCandidates = 64;
+
+// Names added since the index was built that find() may scan before a
+// continued table is worth indexing again; scanning them stays well below a
+// keystroke's time
+static const int UnindexedNames = 1 << 16;
+
+static char toLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+static char toUpperAscii(char c)
+{
+    return c >= 'a' && c <= 'z' ? char(c - 'a' + 'A') : c;
+}
+
+static QByteArray toLowerAscii(QByteArrayView text)
+{
+    QByteArray lower(text.size(), Qt::Uninitialized);
+    for (qsizetype i = 0; i < text.size(); ++i)
+        lower[i] = toLowerAscii(text.at(i));
+    return lower;
+}
+
+// Whether \a name contains \a lower, which is in lower case
+static bool containsFolded(QByteArrayView name, QByteArrayView lower)
+{
+    if (lower.isEmpty())
+        return true;
+    const char first = lower.front();
+    const char upper = toUpperAscii(first);
+    const char *rest = lower.data() + 1;
+    const qsizetype restSize = lower.size() - 1;
+    const char *last = name.data() + name.size() - lower.size();
+    for (const char *p = name.data(); p <= last; ++p) {
+        if (*p != first && *p != upper)
+            continue;
+        qsizetype i = 0;
+        while (i < restSize && toLowerAscii(p[1 + i]) == rest[i])
+            ++i;
+        if (i == restSize)
+            return true;
+    }
+    return false;
+}
+
+static int varintSize(quint32 value)
+{
+    int size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+static char *writeVarint(char *p, quint32 value)
+{
+    while (value >= 0x80) {
+        *p++ = char(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = char(value);
+    return p;
+}
+
+static const char *readVarint(const char *p, quint32 *value)
+{
+    quint32 result = 0;
+    for (int shift = 0;; shift += 7) {
+        const uchar byte = uchar(*p++);
+        result |= quint32(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            break;
+    }
+    *value = result;
+    return p;
+}
+
+// Calls \a function with the bucket of every trigram of \a name, keeping
+// the last three folded bytes as a rolling key
+template <typename Function>
+static void forEachBucket(QByteArrayView name, int bucketBits, Function function)
+{
+    quint32 key = 0;
+    for (qsizetype i = 0; i < name.size(); ++i) {
+        key = (key << 8 | uchar(toLowerAscii(name.data()[i]))) & 0xffffff;
+        if (i >= 2)
+            function((key * 0x9e3779b1u) >> (32 - bucketBits));
+    }
+}
+
+void TrigramIndex::clear()
+{
+    m_symbolCount = 0;
+    m_bucketBits = 0;
+    m_offsets.clear();
+    m_postings.clear();
+    m_common.clear();
+}
+
+void TrigramIndex::build(const SymbolTable &symbols)
+{
+    buildNames(symbols, symbols.count());
+}
+
+void TrigramIndex::build(const SymbolDemangler &names)
+{
+    buildNames(names, names.symbolCount());
+}
+
+template <typename Names>
+void TrigramIndex::buildNames(const Names &symbols, int count)
+{
+    clear();
+    m_symbolCount = count;
+    m_bucketBits = MinBucketBits;
+    while (m_bucketBits < MaxBucketBits && (1 << m_bucketBits) < m_symbolCount * 2)
+        ++m_bucketBits;
+    const qsizetype bucketCount = qsizetype(1) << m_bucketBits;
+
+    // One entry per bucket, so that a trigram touches one cache line.
+    // previous also drops the repeated trigrams of a name.
+    struct List {
+        int count;
+        quint32 size; // Bytes, then the write position
+        int previous;
+    };
+    QList<List> lists(bucketCount, List{0, 0, -1});
+
+    // First pass: list lengths in symbols and in bytes
+    List *entries = lists.data();
+    for (int symbol = 0; symbol < m_symbolCount; ++symbol) {
+        forEachBucket(symbols.name(symbol), m_bucketBits, [entries, symbol](quint32 bucket) {
+            List &list = entries[bucket];
+            if (list.previous == symbol)
+                return;
+            ++list.count;
+            list.size += varintSize(quint32(symbol - list.previous));
+            list.previous = symbol;
+        });
+    }
+
+    m_common.resize(bucketCount);
+    m_offsets.resize(bucketCount + 1);
+    const int commonCount = qMax(FewCandidates, qsizetype(m_symbolCount / CommonShare));
+    quint32 offset = 0;
+    for (qsizetype b = 0; b < bucketCount; ++b) {
+        List &list = lists[b];
+        m_offsets[b] = offset;
+        if (list.count > commonCount)
+            m_common.setBit(b);
+        else
+            offset += list.size;
+        list.size = m_offsets.at(b);
+        list.previous = -1;
+    }
+    m_offsets[bucketCount] = offset;
+
+    // Second pass: the lists themselves
+    m_postings.resize(offset);
+    char *postings = m_postings.data();
+    for (int symbol = 0; symbol < m_symbolCount; ++symbol) {
+        forEachBucket(symbols.name(symbol), m_bucketBits, [&](quint32 bucket) {
+            List &list = entries[bucket];
+            if (list.previous == symbol || list.count > commonCount)
+                return;
+            list.size = quint32(writeVarint(postings + list.size, quint32(symbol - list.previous)) - postings);
+            list.previous = symbol;
+        });
+    }
+}
+
+bool TrigramIndex::covers(int symbolCount) const
+{
+    return symbolCount - m_symbolCount <= UnindexedNames;
+}
+
+qint64 TrigramIndex::memoryUsage() const
+{
+    return m_postings.capacity() + m_offsets.capacity() * qint64(sizeof(quint32)) + m_common.size() / 8;
+}
+
+QList<int> TrigramIndex::find(const SymbolTable &symbols, QByteArrayView text, qsizetype *candidates) const
+{
+    return findNames(symbols, symbols.count(), text, candidates);
+}
+
+QList<int> TrigramIndex::find(const SymbolDemangler &names, QByteArrayView text, qsizetype *candidates) const
+{
+    return findNames(names, names.symbolCount(), text, candidates);
+}
+
+template <typename Names>
+QList<int> TrigramIndex::findNames(const Names &symbols, int count, QByteArrayView text,
+                                   qsizetype *candidates) const
+{
+    const QByteArray lower = toLowerAscii(text);
+    QList<int> result;
+
+    // The lists to intersect, shortest first
+    QList<quint32> buckets;
+    bool narrowed = false;
+    if (m_bucketBits > 0) {
+        bool missing = false;
+        forEachBucket(lower, m_bucketBits, [&](quint32 b) {
+            if (m_common.testBit(b) || buckets.contains(b))
+                return;
+            missing = missing || m_offsets.at(b) == m_offsets.at(b + 1);
+            buckets.append(b);
+        });
+        if (missing) {
+            narrowed = true; // No indexed name has one of the trigrams
+            buckets.clear();
+        }
+        std::sort(buckets.begin(), buckets.end(), [this](quint32 a, quint32 b) {
+            return m_offsets.at(a + 1) - m_offsets.at(a) < m_offsets.at(b + 1) - m_offsets.at(b);
+        });
+    }
+
+    if (!buckets.isEmpty()) {
+        narrowed = true;
+        const char *p = m_postings.constData() + m_offsets.at(buckets.first());
+        const char *end = m_postings.constData() + m_offsets.at(buckets.first() + 1);
+        for (int symbol = -1; p < end;) {
+            quint32 delta;
+            p = readVarint(p, &delta);
+            symbol += int(delta);
+            result.append(symbol);
+        }
+        for (qsizetype i = 1; i < buckets.size() && result.size() > FewCandidates; ++i) {
+            p = m_postings.constData() + m_offsets.at(buckets.at(i));
+            end = m_postings.constData() + m_offsets.at(buckets.at(i) + 1);
+            qsizetype kept = 0;
+            qsizetype next = 0;
+            for (int symbol = -1; p < end && next < result.size();) {
+                quint32 delta;
+                p = readVarint(p, &delta);
+                symbol += int(delta);
+                while (next < result.size() && result.at(next) < symbol)
+                    ++next;
+                if (next < result.size() && result.at(next) == symbol)
+                    result[kept++] = result.at(next++);
+            }
+            result.resize(kept);
+        }
+    }
+
+    // Without a listed trigram every indexed name is a candidate
+    const int first = narrowed ? m_symbolCount : 0;
+    qsizetype checked = result.size() + count - first;
+    result.removeIf([&](int symbol) { return !containsFolded(symbols.name(symbol), lower); });
+    for (int symbol = first; symbol < count; ++symbol) {
+        if (containsFolded(symbols.name(symbol), lower))
+            result.append(symbol);
+    }
+    if (candidates)
+        *candidates = checked;
+    return result;
+}
@@ -0,0 +1,59 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+class SymbolDemangler;
+class SymbolTable;
+
+// Substring lookup over the names of a SymbolTable, or over the demangled
+// names of a SymbolDemangler, ignoring ASCII case.
+// Every name is split into its trigrams, which are hashed into buckets; a
+// bucket lists the symbols with one of its trigrams in ascending order,
+// delta- and varint-encoded. A query intersects the lists of its own
+// trigrams, shortest first, and only checks the names that remain.
+//
+// Hash collisions, and names with the query's trigrams in other places,
+// only add candidates, which the check removes. Trigrams in a large share
+// of all names hardly narrow anything and are not listed, which keeps
+// repetitive C++ names, where every symbol contains "std" or "::", from
+// inflating the index.
+class TrigramIndex
+{
+public:
+    // Two linear passes over the names. \a names must be done.
+    void build(const SymbolTable &symbols);
+    void build(const SymbolDemangler &names);
+    void clear();
+
+    // Symbols indexed by build(); names added to the table later are
+    // scanned by find()
+    int symbolCount() const { return m_symbolCount; }
+    // Whether the index is worth keeping for a table of \a symbolCount
+    // names that continues the indexed one, rather than rebuilt
+    bool covers(int symbolCount) const;
+    qint64 memoryUsage() const;
+
+    // The symbols of \a symbols whose name contains \a text, in ascending
+    // order. \a candidates, if given, receives how many names were checked.
+    QList<int> find(const SymbolTable &symbols, QByteArrayView text, qsizetype *candidates = nullptr) const;
+    QList<int> find(const SymbolDemangler &names, QByteArrayView text, qsizetype *candidates = nullptr) const;
+
+private:
+    template <typename Names>
+    void buildNames(const Names &names, int count);
+    template <typename Names>
+    QList<int> findNames(const Names &names, int count, QByteArrayView text, qsizetype *candidates) const;
+
+    int m_symbolCount = 0;
+    int m_bucketBits = 0;
+    QList<quint32> m_offsets;
+    QByteArray m_postings;
+    // Buckets left out for being too common
+    QBitArray m_common;
+};
+
+#endif // TRIGRAMINDEX_H